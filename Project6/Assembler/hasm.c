@@ -0,0 +1,3214 @@
+/**
+ * @file hasm.c
+ * @brief Hack assembler library: line scanner, symbol table, field decoders,
+ *        the assembly passes and the output stage. All state lives in the
+ *        context, the tables below are read-only.
+ *
+ * The passes:
+ * 1. **First Pass**: Scans the assembly code to build a symbol table by identifying all label declarations
+ *    and their corresponding memory addresses.
+ * 2. **Second Pass**: Translates the assembly instructions into Hack machine code, using the symbol table
+ *    to resolve symbols and variables.
+ * The single pass folds both into one scan and backpatches forward label
+ * references; the chunked, incremental and streaming passes are variations
+ * that give the same words. The optimizing pass (-O) rewrites the decoded
+ * program before it is written and places the labels again.
+ */
+
+#include <stdarg.h>
+
+#include "hasm_internal.h"
+#include "hasm_tables.h"
+
+/* Macro Definitions */
+#define CHUNK_MIN_LINES  (4096U)    /* Fewest instructions worth a thread of their own */
+#define EMIT_BUFFER_INIT (1024U)    /* Initial words/fixups of the single pass buffer */
+#define SYMBOL_PENDING   (0x80000000U) /* Symbol value is a fixup chain, not an address */
+#define FIXUP_END        (0x7FFFFFFFU) /* Terminates a fixup chain */
+#define CACHE_MAGIC      (0x4354324EU) /* "N2TC" read as a little-endian word */
+#define CACHE_VERSION    (2U)      /* 2: labels and symbols validated, a line version 1 took may be rejected */
+#define ERROR_TEXT_SIZE  (256U)     /* One diagnostic, the line quoted in it is cut to fit */
+
+/* Optimizing pass */
+#define OPT_ROUNDS_MAX   (16U)      /* Each round of rewrites exposes a few more, stop here regardless */
+#define OPT_SCAN_MAX     (64U)      /* Instructions searched for a read of A or D, further on it counts as read */
+#define OPT_THREAD_MAX   (16U)      /* Jumps to jumps followed from one jump */
+#define OPT_UNKNOWN      (0xFFFFFFFFU) /* Value the comp can't work out */
+#define OPT_LABEL_KEY    (0x80000000U) /* Value is the address of the label in the low bits */
+#define OPT_FRESH_FIRST  (0x00010000U) /* Values only known to equal themselves, past the numbers */
+#define OPT_FRESH_LAST   (0x7FFFFFF0U)
+#define OPT_NUMERIC(key) ((key) <= 0xFFFFU)
+#define OPT_IO_FIRST     (0x4000U)  /* SCREEN, then KBD: M from here on is memory-mapped I/O */
+#define OPT_PLAIN_RAM(key) ((key) < OPT_IO_FIRST) /* Known to address RAM, nothing else is numbered */
+
+/* Bits of an encoded instruction */
+#define INS_C_BIT        (0x8000U)
+#define INS_M_BIT        (0x1000U)  /* The "a" bit: the comp reads M instead of A */
+#define INS_COMP_MASK    (0x1FC0U)  /* a and c1..c6 */
+#define INS_ZX_BIT       (0x0800U)  /* c1: the comp ignores D */
+#define INS_ZY_BIT       (0x0200U)  /* c3: the comp ignores A (or M) */
+#define INS_DEST_A       (0x0020U)
+#define INS_DEST_D       (0x0010U)
+#define INS_DEST_M       (0x0008U)
+#define INS_DEST_MASK    (0x0038U)
+#define INS_JUMP_MASK    (0x0007U)
+#define INS_JUMP_ALWAYS  (0x0007U)
+
+/* Variable Definitions */
+/* Single pass: A-instruction waiting for its symbol to be resolved */
+typedef struct
+{
+  uint32_t wordIndex;
+  uint32_t next;
+} Fixup_Entry;
+
+/*
+ * Single pass: encoded words kept in memory until every forward reference
+ * is patched. A pending symbol stores (SYMBOL_PENDING | first fixup) as its
+ * value, and the fixups of that symbol are chained through "next".
+ */
+typedef struct
+{
+  uint16_t *words;
+  uint32_t wordCount;
+  uint32_t wordSize;
+  Fixup_Entry *fixups;
+  uint32_t fixupCount;
+  uint32_t fixupSize;
+
+  /* --stream: words[0] is at address "emitted", words before "written" are out */
+  uint32_t emitted;
+  uint32_t written;
+  uint32_t firstPending;  /* First fixup that may still be unresolved */
+  uint8_t sealed;         /* Past ADDRESS_MAX, unknown symbols are variables */
+} Emit_Buffer;
+
+/*
+ * Incremental mode sidecar: the header, one record per word emitting line
+ * of the last run, then that run's symbol table entries and their names.
+ * Everything is stored in host byte order; another host fails the magic.
+ */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t lineCount;
+  uint32_t symbolCount;
+  uint32_t namesSize;
+  uint32_t reserved;
+} Cache_Header;
+
+typedef struct
+{
+  uint64_t hash;        /* Of the trimmed instruction text */
+  uint32_t symbol;      /* Symbol entry of an @symbol line, SYMBOL_NOT_FOUND otherwise */
+  uint16_t word;
+  uint8_t valid;        /* 0 when the line did not assemble */
+  uint8_t reserved;
+} Cache_Line;
+
+typedef struct
+{
+  Cache_Header header;
+  Cache_Line *lines;
+  Symbol_Table *symbols;
+  uint8_t *names;
+} Line_Cache;
+
+/*
+ * Chunked second pass: one slice of the instruction lines encoded on its own
+ * thread. The context is a shallow copy of the file's context, so only the
+ * instruction fields are private; the symbol table is shared and only read,
+ * as every variable was allocated by the sequential scan beforehand.
+ */
+typedef struct
+{
+  Assembler_Context ctx;
+  const Line_View *lines;
+  uint16_t *words;
+  uint8_t *valid;
+  uint32_t first;
+  uint32_t last;
+} Encode_Chunk;
+
+/* LookUp Table for "Comp" Field */
+const Instruction_Encoding compFieldLT[COMP_FIELD_COUNT] =
+{
+  { "0"   , (0x2AU << COMP_FIELD_SHIFT) }, /* 0101010 */
+  { "1"   , (0x3FU << COMP_FIELD_SHIFT) }, /* 0111111 */
+  { "-1"  , (0x3AU << COMP_FIELD_SHIFT) }, /* 0111010 */
+  { "D"   , (0x0CU << COMP_FIELD_SHIFT) }, /* 0001100 */
+  { "A"   , (0x30U << COMP_FIELD_SHIFT) }, /* 0110000 */
+  { "!D"  , (0x0DU << COMP_FIELD_SHIFT) }, /* 0001101 */
+  { "!A"  , (0x31U << COMP_FIELD_SHIFT) }, /* 0110001 */
+  { "-D"  , (0x0FU << COMP_FIELD_SHIFT) }, /* 0001111 */
+  { "-A"  , (0x33U << COMP_FIELD_SHIFT) }, /* 0110011 */
+  { "D+1" , (0x1FU << COMP_FIELD_SHIFT) }, /* 0011111 */
+  { "A+1" , (0x37U << COMP_FIELD_SHIFT) }, /* 0110111 */
+  { "D-1" , (0x0EU << COMP_FIELD_SHIFT) }, /* 0001110 */
+  { "A-1" , (0x32U << COMP_FIELD_SHIFT) }, /* 0110010 */
+  { "D+A" , (0x02U << COMP_FIELD_SHIFT) }, /* 0000010 */
+  { "D-A" , (0x13U << COMP_FIELD_SHIFT) }, /* 0010011 */
+  { "A-D" , (0x07U << COMP_FIELD_SHIFT) }, /* 0000111 */
+  { "D&A" , (0x00U << COMP_FIELD_SHIFT) }, /* 0000000 */
+  { "D|A" , (0x15U << COMP_FIELD_SHIFT) }, /* 0010101 */
+  { "M"   , (0x70U << COMP_FIELD_SHIFT) }, /* 1110000 */
+  { "!M"  , (0x71U << COMP_FIELD_SHIFT) }, /* 1110001 */
+  { "-M"  , (0x73U << COMP_FIELD_SHIFT) }, /* 1110011 */
+  { "M+1" , (0x77U << COMP_FIELD_SHIFT) }, /* 1110111 */
+  { "M-1" , (0x72U << COMP_FIELD_SHIFT) }, /* 1110010 */
+  { "D+M" , (0x42U << COMP_FIELD_SHIFT) }, /* 1000010 */
+  { "D-M" , (0x53U << COMP_FIELD_SHIFT) }, /* 1010011 */
+  { "M-D" , (0x47U << COMP_FIELD_SHIFT) }, /* 1000111 */
+  { "D&M" , (0x40U << COMP_FIELD_SHIFT) }, /* 1000000 */
+  { "D|M" , (0x55U << COMP_FIELD_SHIFT) }, /* 1010101 */
+};
+
+/* LookUp Table for "Dest" Field */
+const Instruction_Encoding destFieldLT[DEST_FIELD_COUNT] =
+{
+  { "\0"  , (0x0U << DEST_FIELD_SHIFT) }, /* 000 */
+  { "M"   , (0x1U << DEST_FIELD_SHIFT) }, /* 001 */
+  { "D"   , (0x2U << DEST_FIELD_SHIFT) }, /* 010 */
+  { "MD"  , (0x3U << DEST_FIELD_SHIFT) }, /* 011 */
+  { "A"   , (0x4U << DEST_FIELD_SHIFT) }, /* 100 */
+  { "AM"  , (0x5U << DEST_FIELD_SHIFT) }, /* 101 */
+  { "AD"  , (0x6U << DEST_FIELD_SHIFT) }, /* 110 */
+  { "AMD" , (0x7U << DEST_FIELD_SHIFT) }, /* 111 */
+};
+
+/* LookUp Table for "Jump" Field */
+const Instruction_Encoding jumpFieldLT[JUMP_FIELD_COUNT] =
+{
+  { "\0"  , (0x0U << JUMP_FIELD_SHIFT) }, /* 000 */
+  { "JGT" , (0x1U << JUMP_FIELD_SHIFT) }, /* 001 */
+  { "JEQ" , (0x2U << JUMP_FIELD_SHIFT) }, /* 010 */
+  { "JGE" , (0x3U << JUMP_FIELD_SHIFT) }, /* 011 */
+  { "JLT" , (0x4U << JUMP_FIELD_SHIFT) }, /* 100 */
+  { "JNE" , (0x5U << JUMP_FIELD_SHIFT) }, /* 101 */
+  { "JLE" , (0x6U << JUMP_FIELD_SHIFT) }, /* 110 */
+  { "JMP" , (0x7U << JUMP_FIELD_SHIFT) }, /* 111 */
+};
+
+/* Names accepted by --format, indexed by OUTPUT_FORMAT_* */
+const Output_Format_Info outputFormats[OUTPUT_FORMAT_COUNT] =
+{
+  { "hack"   , ".hack" , 0U },
+  { "bin-le" , ".bin"  , 1U },
+  { "bin-be" , ".bin"  , 1U },
+  { "ihex"   , ".hex"  , 0U },
+  { "memb"   , ".memb" , 0U },
+  { "memh"   , ".memh" , 0U },
+};
+
+/* Function Declarations */
+uint8_t *outputReserve(Output_Writer *writer, size_t len);
+void ihexRecord(Output_Writer *writer, uint8_t type, uint32_t address, const uint8_t *data, uint32_t len);
+uint32_t fieldKey(const uint8_t *str, uint32_t len);
+int32_t singlePassLine(Assembler_Context *ctx, Emit_Buffer *emit, const Line_View *line);
+int32_t singlePassVariables(Assembler_Context *ctx, Emit_Buffer *emit);
+void streamFlush(Emit_Buffer *emit, Output_Writer *writer);
+int32_t collectInstructions(Assembler_Context *ctx, const Source_Buffer *src, Line_View **lines, uint32_t **entries, uint32_t *count);
+int32_t cacheLoad(const uint8_t *path, Line_Cache *cache);
+int32_t cacheSave(const uint8_t *path, const Assembler_Context *ctx, const Cache_Line *lines, uint32_t lineCount);
+void cacheFree(Line_Cache *cache);
+uint64_t lineHash(const uint8_t *str, uint32_t len);
+void *encodeChunk(void *arg);
+uint32_t optimizeJump(const Optimize_Ins *ins, uint32_t count, const uint32_t *labels, uint32_t at);
+uint32_t optimizeCodeAddresses(Optimize_Ins *ins, uint32_t count, uint32_t *labels, uint32_t labelCount);
+uint32_t optimizeSkip(const Optimize_Ins *ins, uint32_t count, uint32_t index);
+uint8_t optimizeDead(const Optimize_Ins *ins, uint32_t count, uint32_t from, uint16_t reg);
+uint8_t optimizeBranch(Optimize_Ins *ins, uint32_t count, const uint32_t *labels, uint32_t at);
+uint32_t optimizeAlu(uint16_t word, uint32_t d, uint32_t a);
+void resolveFixups(Assembler_Context *ctx, Emit_Buffer *emit, uint32_t entry, uint32_t value);
+uint32_t searchSymbolEntry(Assembler_Context *ctx, const uint8_t *str, uint32_t len);
+uint32_t symbolEntryFor(Assembler_Context *ctx, const uint8_t *str, uint32_t len);
+uint8_t symbolValid(const uint8_t *str, uint32_t len);
+int32_t labelName(Assembler_Context *ctx, const Line_View *line, uint32_t *len, uint32_t *entry);
+void positionMove(Assembler_Context *ctx, const uint8_t *to);
+uint32_t scanBlock(const uint8_t *ptr, size_t avail, Scan_Masks *masks);
+#if N2T_SCAN_NEON
+uint32_t neonMask(uint8x16_t match);
+#endif
+uint32_t lowestBit(uint32_t bits);
+uint32_t highestBit(uint32_t bits);
+int32_t symbolTableGrow(Assembler_Context *ctx);
+uint32_t symbolHash(const uint8_t *str, uint32_t len);
+uint32_t symbolTableLookup(Assembler_Context *ctx, const uint8_t *str, uint32_t len);
+uint32_t symbolTableInsert(Assembler_Context *ctx, const uint8_t *str, uint32_t len, uint32_t value);
+
+hasm_ctx *hasm_ctx_create(void)
+{
+  hasm_ctx *ctx = calloc(1U, sizeof(*ctx));
+
+  if(ctx == NULL)
+  {
+    return NULL;
+  }
+  varInit(ctx);
+
+  if(symbolTableInit(ctx) != SYSTEM_SUCCESS)
+  {
+    free(ctx);
+    return NULL;
+  }
+
+  return ctx;
+}
+
+/* Only the entries past the predefined ones are unlinked, see symbolTableReset() */
+void hasm_ctx_reset(hasm_ctx *ctx)
+{
+  symbolTableReset(ctx);
+  varInit(ctx);
+  ctx->errors = 0U;
+  ctx->errorLine = 0U;
+  memset(&ctx->position, 0, sizeof(ctx->position));
+}
+
+void hasm_ctx_destroy(hasm_ctx *ctx)
+{
+  if(ctx != NULL)
+  {
+    mapStop(ctx);
+    symbolTableFree(ctx);
+    free(ctx);
+  }
+}
+
+/* Both passes over the caller's buffer, the words go straight into out */
+int32_t hasm_assemble_buffer(hasm_ctx *ctx, const char *src, size_t len, uint16_t *out, size_t *n)
+{
+  Source_Buffer source = { (const uint8_t *)src, len, 0U };
+  Line_View line;
+  size_t pos = 0U;
+  size_t count = 0U;
+
+  if( (ctx == NULL) || (n == NULL) || ((src == NULL) && (len > 0U)) || ((out == NULL) && (*n > 0U)) )
+  {
+    return HASM_FAILURE;
+  }
+
+  hasm_ctx_reset(ctx);
+  positionStart(ctx, NULL, source.data);
+  firstPass(ctx, &source);
+
+  while(sourceNextInstruction(&source, &pos, &line) == SYSTEM_SUCCESS)
+  {
+    if(lineParser(ctx, &line) == SYSTEM_SUCCESS)
+    {
+      if(count < *n)
+      {
+        out[count] = ctx->insFields.word;
+      }
+      count++;
+      if(ctx->map.enabled)
+      {
+        mapRecord(ctx, &line);
+      }
+    }
+    varInit(ctx);
+  }
+
+  len = *n;
+  *n = count;
+
+  if(ctx->errors > 0U)
+  {
+    return HASM_SYNTAX;
+  }
+
+  return (count <= len) ? HASM_SUCCESS : HASM_NO_SPACE;
+}
+
+uint32_t hasm_error_line(const hasm_ctx *ctx)
+{
+  return (ctx != NULL) ? ctx->errorLine : 0U;
+}
+
+/*
+ * Input layer: the whole source is mapped (or, for pipes and stdin, read
+ * once) into a single buffer that both passes scan in place.
+ * A path of "-" reads stdin.
+ */
+int32_t sourceOpen(const uint8_t *path, Source_Buffer *src)
+{
+  int fd = STDIN_FILENO;
+  size_t capacity = 0U;
+  uint8_t *data = NULL;
+
+  memset(src, 0, sizeof(*src));
+
+  if(strcmp(path, "-"))
+  {
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+      return SYSTEM_FAILURE;
+    }
+  }
+
+#if N2T_HAVE_MMAP
+  {
+    struct stat info;
+
+    if( (fstat(fd, &info) == 0) && S_ISREG(info.st_mode) && (info.st_size > 0) )
+    {
+      void *map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if(map != MAP_FAILED)
+      {
+        src->data = map;
+        src->size = (size_t)info.st_size;
+        src->mapped = 1U;
+        if(fd != STDIN_FILENO)
+        {
+          close(fd);
+        }
+        return SYSTEM_SUCCESS;
+      }
+    }
+  }
+#endif
+
+  /* Not mappable: read it once into a growing buffer */
+  for(;;)
+  {
+    ssize_t count = 0;
+
+    if(src->size == capacity)
+    {
+      uint8_t *newData = NULL;
+
+      capacity = (capacity == 0U) ? SOURCE_READ_CHUNK : (capacity * 2U);
+      newData = realloc(data, capacity);
+      if(newData == NULL)
+      {
+        free(data);
+        src->size = 0U;
+        data = NULL;
+        break;
+      }
+      data = newData;
+    }
+
+    /* stdin goes through stdio, which may already hold buffered input */
+    if(fd == STDIN_FILENO)
+    {
+      count = (ssize_t)fread(&data[src->size], 1U, capacity - src->size, stdin);
+    }
+    else
+    {
+      count = read(fd, &data[src->size], capacity - src->size);
+    }
+    if(count <= 0)
+    {
+      break;
+    }
+    src->size += (size_t)count;
+  }
+
+  if(fd != STDIN_FILENO)
+  {
+    close(fd);
+  }
+  src->data = data;
+
+  return (data != NULL) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+}
+
+void sourceClose(Source_Buffer *src)
+{
+#if N2T_HAVE_MMAP
+  if(src->mapped)
+  {
+    munmap((void *)src->data, src->size);
+  }
+  else
+#endif
+  {
+    free((void *)src->data);
+  }
+  memset(src, 0, sizeof(*src));
+}
+
+/* Hands out the next line (without "\n" or "\r\n") starting at *pos */
+int32_t sourceNextLine(const Source_Buffer *src, size_t *pos, Line_View *line)
+{
+  const uint8_t *start = NULL;
+  const uint8_t *newLine = NULL;
+  size_t len = 0U;
+
+  if(*pos >= src->size)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  start = &src->data[*pos];
+  newLine = memchr(start, '\n', src->size - *pos);
+  len = (newLine != NULL) ? (size_t)(newLine - start) : (src->size - *pos);
+  *pos += len + ((newLine != NULL) ? 1U : 0U);
+
+  if( (len > 0U) && (start[len - 1U] == '\r') )
+  {
+    len--;
+  }
+
+  line->ptr = start;
+  line->len = (uint32_t)len;
+  line->equal = line->len;
+  line->semicolon = line->len;
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * Hands out the next line of a program as a trimmed instruction span: white
+ * space around the instruction and any "//" comment are cut, so blank and
+ * comment lines come back empty. The source is classified SCAN_BLOCK bytes
+ * at a time and the span is read off the masks of the block(s) it sits in.
+ */
+int32_t sourceNextInstruction(const Source_Buffer *src, size_t *pos, Line_View *line)
+{
+  size_t offset = *pos;
+  size_t text = SIZE_MAX;     /* First non-space byte */
+  size_t textEnd = 0U;        /* One past the last non-space byte */
+  size_t equal = SIZE_MAX;
+  size_t semicolon = SIZE_MAX;
+  uint8_t comment = 0U;
+
+  if(*pos >= src->size)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  while(offset < src->size)
+  {
+    Scan_Masks masks;
+    uint32_t count = scanBlock(&src->data[offset], src->size - offset, &masks);
+    uint32_t valid = (count == 32U) ? 0xFFFFFFFFU : ((1U << count) - 1U);
+    uint32_t stop = (masks.newLine | masks.comment) & valid;
+    uint32_t before = (stop != 0U) ? ((1U << lowestBit(stop)) - 1U) : valid;
+    uint32_t textBits = ~masks.space & before;
+
+    if(textBits != 0U)
+    {
+      text = (text == SIZE_MAX) ? (offset + lowestBit(textBits)) : text;
+      textEnd = offset + highestBit(textBits) + 1U;
+    }
+    if( (equal == SIZE_MAX) && ((masks.equal & before) != 0U) )
+    {
+      equal = offset + lowestBit(masks.equal & before);
+    }
+    if( (semicolon == SIZE_MAX) && ((masks.semicolon & before) != 0U) )
+    {
+      semicolon = offset + lowestBit(masks.semicolon & before);
+    }
+
+    if(stop != 0U)
+    {
+      comment = (uint8_t)((masks.comment >> lowestBit(stop)) & 1U);
+      offset += lowestBit(stop);
+      break;
+    }
+    offset += count;
+  }
+
+  if(comment)
+  {
+    /* Rest of the line is the comment */
+    const uint8_t *newLine = memchr(&src->data[offset], '\n', src->size - offset);
+
+    *pos = (newLine != NULL) ? ((size_t)(newLine - src->data) + 1U) : src->size;
+  }
+  else
+  {
+    *pos = (offset < src->size) ? (offset + 1U) : src->size;
+  }
+
+  if(text == SIZE_MAX)
+  {
+    line->ptr = &src->data[offset];
+    line->len = 0U;
+  }
+  else
+  {
+    line->ptr = &src->data[text];
+    line->len = (uint32_t)(textEnd - text);
+  }
+  line->equal = (equal != SIZE_MAX) ? (uint32_t)(equal - text) : line->len;
+  line->semicolon = (semicolon != SIZE_MAX) ? (uint32_t)(semicolon - text) : line->len;
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * Classifies the next SCAN_BLOCK bytes (fewer at the end of the source) and
+ * returns how many were classified. avail is the number of readable bytes at
+ * ptr; the vector paths need one byte past the block to spot a "//" that
+ * starts on its last byte, so the final block always takes the scalar loop.
+ */
+uint32_t scanBlock(const uint8_t *ptr, size_t avail, Scan_Masks *masks)
+{
+  uint32_t count = (avail < SCAN_BLOCK) ? (uint32_t)avail : SCAN_BLOCK;
+
+#if N2T_SCAN_AVX2
+  if(avail > SCAN_BLOCK)
+  {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)ptr);
+    __m256i next = _mm256_loadu_si256((const __m256i *)(ptr + 1));
+    __m256i slash = _mm256_set1_epi8('/');
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                    _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')));
+
+    space = _mm256_or_si256(space, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')));
+    masks->newLine = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+    masks->comment = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(bytes, slash),
+                                                                     _mm256_cmpeq_epi8(next, slash)));
+    masks->space = (uint32_t)_mm256_movemask_epi8(space);
+    masks->equal = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('=')));
+    masks->semicolon = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(';')));
+    return count;
+  }
+#elif N2T_SCAN_SSE2
+  if(avail > SCAN_BLOCK)
+  {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i next = _mm_loadu_si128((const __m128i *)(ptr + 1));
+    __m128i slash = _mm_set1_epi8('/');
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                 _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')));
+
+    space = _mm_or_si128(space, _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')));
+    masks->newLine = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+    masks->comment = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bytes, slash),
+                                                               _mm_cmpeq_epi8(next, slash)));
+    masks->space = (uint32_t)_mm_movemask_epi8(space);
+    masks->equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('=')));
+    masks->semicolon = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(';')));
+    return count;
+  }
+#elif N2T_SCAN_NEON
+  if(avail > SCAN_BLOCK)
+  {
+    uint8x16_t bytes = vld1q_u8(ptr);
+    uint8x16_t next = vld1q_u8(ptr + 1);
+    uint8x16_t slash = vdupq_n_u8('/');
+    uint8x16_t space = vorrq_u8(vceqq_u8(bytes, vdupq_n_u8(' ')), vceqq_u8(bytes, vdupq_n_u8('\t')));
+
+    space = vorrq_u8(space, vceqq_u8(bytes, vdupq_n_u8('\r')));
+    masks->newLine = neonMask(vceqq_u8(bytes, vdupq_n_u8('\n')));
+    masks->comment = neonMask(vandq_u8(vceqq_u8(bytes, slash), vceqq_u8(next, slash)));
+    masks->space = neonMask(space);
+    masks->equal = neonMask(vceqq_u8(bytes, vdupq_n_u8('=')));
+    masks->semicolon = neonMask(vceqq_u8(bytes, vdupq_n_u8(';')));
+    return count;
+  }
+#endif
+
+  /* Scalar fallback, also used for the last block of the source */
+  memset(masks, 0, sizeof(*masks));
+  for(uint32_t i = 0U; i < count; i++)
+  {
+    uint32_t bit = 1U << i;
+
+    switch(ptr[i])
+    {
+      case '\n':
+        masks->newLine |= bit;
+        break;
+      case ' ':
+      case '\t':
+      case '\r':
+        masks->space |= bit;
+        break;
+      case '=':
+        masks->equal |= bit;
+        break;
+      case ';':
+        masks->semicolon |= bit;
+        break;
+      case '/':
+        if( ((i + 1U) < avail) && (ptr[i + 1U] == '/') )
+        {
+          masks->comment |= bit;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  return count;
+}
+
+#if N2T_SCAN_NEON
+/* NEON has no movemask: weight each lane by its bit and add up each half */
+uint32_t neonMask(uint8x16_t match)
+{
+  static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+  uint8x16_t bits = vandq_u8(match, vld1q_u8(weights));
+
+  return (uint32_t)vaddv_u8(vget_low_u8(bits)) | ((uint32_t)vaddv_u8(vget_high_u8(bits)) << 8);
+}
+#endif
+
+/* Index of the lowest / highest set bit, bits must not be 0 */
+uint32_t lowestBit(uint32_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return (uint32_t)__builtin_ctz(bits);
+#else
+  uint32_t index = 0U;
+
+  while( !(bits & 1U) )
+  {
+    bits >>= 1;
+    index++;
+  }
+  return index;
+#endif
+}
+
+uint32_t highestBit(uint32_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  return 31U - (uint32_t)__builtin_clz(bits);
+#else
+  uint32_t index = 0U;
+
+  while(bits >>= 1)
+  {
+    index++;
+  }
+  return index;
+#endif
+}
+
+/* First Pass of assembler to resolve labels */
+void  firstPass(Assembler_Context *ctx, const Source_Buffer *src)
+{
+  Line_View line;
+  size_t pos = 0U;
+  uint32_t lineCount = 0;
+
+  while(sourceNextInstruction(src, &pos, &line) == SYSTEM_SUCCESS)
+  {
+    STATS_COUNT(ctx->stats.lines, 1U);
+
+    if(line.len == 0U)
+    {
+      /* Skip the blank or comment line */
+    }
+    else
+    {
+      /* Instruction Line */
+      if(line.ptr[0] == '(' )
+      {
+        /* Labels */
+        uint32_t len = 0U;
+        uint32_t entry = SYMBOL_NOT_FOUND;
+
+        if(labelName(ctx, &line, &len, &entry) != SYSTEM_SUCCESS)
+        {
+          /* Reported */
+        }
+        else if(entry != SYMBOL_NOT_FOUND)
+        {
+          lineError(ctx, &line, "Duplicate Label");
+        }
+        else
+        {
+          symbolTableInsert(ctx, &line.ptr[1], len, lineCount);
+          STATS_COUNT(ctx->stats.labels, 1U);
+        }
+      }
+      else
+      {
+        lineCount++;
+      }
+    }
+  }
+
+  ctx->symbolTableMeta.labelTail = ctx->symbolTableMeta.symbolTableTail;
+}
+
+void secondPass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer)
+{
+  int32_t status = SYSTEM_SUCCESS;
+  Line_View line;
+  size_t pos = 0U;
+
+  while(sourceNextInstruction(src, &pos, &line) == SYSTEM_SUCCESS)
+  {
+    /* Pass the line to the parser */
+    status = lineParser(ctx, &line);
+
+    if(SYSTEM_SUCCESS == status)
+    {
+      /* Valid line and got parsed successfully */
+      /* Write the binary value to file in string format */
+      lineWriter(writer, ctx->insFields.word);
+      if(ctx->map.enabled)
+      {
+        mapRecord(ctx, &line);
+      }
+    }
+    else
+    {
+      /* Skip the line and proceed to next */
+    }
+    /* Reset the variables for next instruction */
+    varInit(ctx);
+  }
+}
+
+/*
+ * Sequential scan ahead of an out of order second pass: collects the lines
+ * that emit a word and allocates every variable in first-use order, exactly
+ * as secondPass() would. entries (optional) gets the symbol table entry of
+ * each symbolic A-instruction, SYMBOL_NOT_FOUND for the other lines.
+ */
+int32_t collectInstructions(Assembler_Context *ctx, const Source_Buffer *src, Line_View **lines, uint32_t **entries, uint32_t *count)
+{
+  uint32_t lineSize = 0U;
+  uint32_t entrySize = 0U;
+  Line_View line;
+  size_t pos = 0U;
+
+  *lines = NULL;
+  *count = 0U;
+  if(entries != NULL)
+  {
+    *entries = NULL;
+  }
+
+  while(sourceNextInstruction(src, &pos, &line) == SYSTEM_SUCCESS)
+  {
+    uint32_t entry = SYMBOL_NOT_FOUND;
+
+    /* Same classification as lineParser(): comments, blanks and labels emit nothing */
+    if( (line.len == 0U) || (line.ptr[0] == '(') )
+    {
+      continue;
+    }
+
+    if( (line.ptr[0] == '@') && (line.len > 1U) && (line.ptr[1] > '9') && symbolValid(&line.ptr[1], line.len - 1U) )
+    {
+      /* Settles the variable's address now */
+      entry = symbolEntryFor(ctx, &line.ptr[1], line.len - 1U);
+    }
+
+    if( (growArray((void **)lines, &lineSize, sizeof(Line_View), *count + 1U) != SYSTEM_SUCCESS) ||
+        ((entries != NULL) && (growArray((void **)entries, &entrySize, sizeof(uint32_t), *count + 1U) != SYSTEM_SUCCESS)) )
+    {
+      fprintf(stderr, "Out of memory\n");
+      free(*lines);
+      *lines = NULL;
+      if(entries != NULL)
+      {
+        free(*entries);
+        *entries = NULL;
+      }
+      return SYSTEM_FAILURE;
+    }
+
+    (*lines)[*count] = line;
+    if(entries != NULL)
+    {
+      (*entries)[*count] = entry;
+    }
+    (*count)++;
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * Second pass split over threads. Only variables depend on the order the
+ * lines are encoded in, so collectInstructions() settles them first. After
+ * that encoding is lookup only and the lines are
+ * encoded in chunks into disjoint parts of one word array, then written in
+ * source order.
+ */
+int32_t chunkedPass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer, uint32_t threads)
+{
+  Line_View *lines = NULL;
+  uint32_t lineCount = 0U;
+  uint16_t *words = NULL;
+  uint8_t *valid = NULL;
+  Encode_Chunk chunks[MAX_WORKERS];
+#if N2T_HAVE_THREADS
+  pthread_t tids[MAX_WORKERS];
+  uint8_t started[MAX_WORKERS];
+#endif
+
+  if(collectInstructions(ctx, src, &lines, NULL, &lineCount) != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  /* Small inputs are not worth the threads */
+  if(threads > ((lineCount / CHUNK_MIN_LINES) + 1U))
+  {
+    threads = (lineCount / CHUNK_MIN_LINES) + 1U;
+  }
+
+  words = malloc(((size_t)lineCount + 1U) * sizeof(uint16_t));
+  valid = malloc((size_t)lineCount + 1U);
+  if( (words == NULL) || (valid == NULL) )
+  {
+    fprintf(stderr, "Out of memory\n");
+    free(lines);
+    free(words);
+    free(valid);
+    return SYSTEM_FAILURE;
+  }
+
+  for(uint32_t t = 0U; t < threads; t++)
+  {
+    chunks[t].ctx = *ctx;
+    chunks[t].ctx.errors = 0U;
+    chunks[t].ctx.errorLine = 0U;
+#if N2T_ENABLE_STATS
+    memset(&chunks[t].ctx.stats, 0, sizeof(chunks[t].ctx.stats));
+#endif
+    chunks[t].lines = lines;
+    chunks[t].words = words;
+    chunks[t].valid = valid;
+    chunks[t].first = (uint32_t)(((uint64_t)t * lineCount) / threads);
+    chunks[t].last = (uint32_t)(((uint64_t)(t + 1U) * lineCount) / threads);
+  }
+
+#if N2T_HAVE_THREADS
+  /* Chunk 0 is encoded on this thread, as is any chunk whose thread failed to start */
+  for(uint32_t t = 1U; t < threads; t++)
+  {
+    started[t] = (pthread_create(&tids[t], NULL, encodeChunk, &chunks[t]) == 0) ? 1U : 0U;
+  }
+  encodeChunk(&chunks[0]);
+  for(uint32_t t = 1U; t < threads; t++)
+  {
+    if(started[t])
+    {
+      pthread_join(tids[t], NULL);
+    }
+    else
+    {
+      encodeChunk(&chunks[t]);
+    }
+  }
+#else
+  for(uint32_t t = 0U; t < threads; t++)
+  {
+    encodeChunk(&chunks[t]);
+  }
+#endif
+
+  for(uint32_t t = 0U; t < threads; t++)
+  {
+    ctx->errors += chunks[t].ctx.errors;
+    if( (chunks[t].ctx.errorLine != 0U) && ((ctx->errorLine == 0U) || (chunks[t].ctx.errorLine < ctx->errorLine)) )
+    {
+      ctx->errorLine = chunks[t].ctx.errorLine;
+    }
+#if N2T_ENABLE_STATS
+    statsMerge(&ctx->stats, &chunks[t].ctx.stats);
+#endif
+  }
+
+  for(uint32_t i = 0U; i < lineCount; i++)
+  {
+    if(valid[i])
+    {
+      lineWriter(writer, words[i]);
+      if(ctx->map.enabled)
+      {
+        mapRecord(ctx, &lines[i]);
+      }
+    }
+  }
+
+  free(lines);
+  free(words);
+  free(valid);
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Encodes lines[first..last) of a chunk; invalid lines are skipped and counted like in secondPass() */
+void *encodeChunk(void *arg)
+{
+  Encode_Chunk *chunk = arg;
+
+  varInit(&chunk->ctx);
+  for(uint32_t i = chunk->first; i < chunk->last; i++)
+  {
+    chunk->valid[i] = (lineParser(&chunk->ctx, &chunk->lines[i]) == SYSTEM_SUCCESS) ? 1U : 0U;
+    chunk->words[i] = chunk->ctx.insFields.word;
+    varInit(&chunk->ctx);
+  }
+
+  return NULL;
+}
+
+/*
+ * Optimizing pass (-O): the program is decoded in full, then rounds of
+ * peephole rewrites run over the words until nothing changes:
+ * - an @X reloading what A already holds, or whose value is overwritten
+ *   before anything reads A or M, is dropped;
+ * - a comp on known constants becomes 0, 1 or -1 (freeing the @X that fed
+ *   it) and a jump on a known value becomes unconditional or goes away;
+ * - an instruction writing only what A, D or M already hold is dropped, the
+ *   values being numbered along each run of instructions between labels
+ *   (M only at a constant address below SCREEN, the rest may be I/O);
+ * - a jump to an unconditional jump goes to its final target, a jump to
+ *   the next instruction is dropped, a conditional jump over an
+ *   unconditional one is turned around and code after an unconditional
+ *   jump that no label leads to is dropped;
+ * - a D=... whose value nothing reads is dropped.
+ * Labels are placed again on the smaller program. Code addresses are
+ * taken to be labels and constants loaded right before a jump (as in the
+ * helper calls of compiled VM code), which become labels of their own; a
+ * constant only jumped to later, through memory, is taken for data.
+ */
+int32_t optimizePass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer)
+{
+  uint32_t labelCount = ctx->symbolTableMeta.labelTail - SYMBOLTABLE_TAIL;
+  Line_View *lines = NULL;
+  uint32_t *entries = NULL;
+  uint32_t lineCount = 0U;
+  uint32_t count = 0U;
+#if N2T_ENABLE_STATS
+  uint32_t decoded = 0U;
+#endif
+  uint32_t allLabels = 0U;
+  uint32_t round = 0U;
+  int32_t status = SYSTEM_SUCCESS;
+  Optimize_Ins *ins = NULL;
+  uint32_t *labels = NULL;
+  uint32_t *map = NULL;
+
+  if(collectInstructions(ctx, src, &lines, &entries, &lineCount) != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  ins = malloc(((size_t)lineCount + 1U) * sizeof(Optimize_Ins));
+  labels = malloc(((size_t)labelCount + lineCount + 1U) * sizeof(uint32_t));
+  map = malloc(((size_t)lineCount + 1U) * sizeof(uint32_t));
+  if( (ins == NULL) || (labels == NULL) || (map == NULL) )
+  {
+    fprintf(stderr, "Out of memory\n");
+    status = SYSTEM_FAILURE;
+  }
+
+  /*
+   * Decode, label references are kept symbolic as labels[entry - SYMBOLTABLE_TAIL];
+   * map takes a line to its instruction
+   */
+  for(uint32_t i = 0U; (status == SYSTEM_SUCCESS) && (i < lineCount); i++)
+  {
+    map[i] = count;
+    if( (entries[i] >= SYMBOLTABLE_TAIL) && (entries[i] < (SYMBOLTABLE_TAIL + labelCount)) )
+    {
+      ins[count].word = 0U;
+      ins[count].label = entries[i] - SYMBOLTABLE_TAIL;
+      ins[count].line = i;
+      count++;
+    }
+    else if(lineParser(ctx, &lines[i]) == SYSTEM_SUCCESS)
+    {
+      ins[count].word = ctx->insFields.word;
+      ins[count].label = SYMBOL_NOT_FOUND;
+      ins[count].line = i;
+      count++;
+    }
+    varInit(ctx);
+  }
+
+  if(status == SYSTEM_SUCCESS)
+  {
+    map[lineCount] = count;
+    for(uint32_t label = 0U; label < labelCount; label++)
+    {
+      uint32_t line = ctx->symbolTable[SYMBOLTABLE_TAIL + label].value;
+
+      labels[label] = map[(line < lineCount) ? line : lineCount];
+    }
+
+#if N2T_ENABLE_STATS
+    decoded = count;
+#endif
+    allLabels = optimizeCodeAddresses(ins, count, labels, labelCount);
+    while( (round < OPT_ROUNDS_MAX) && optimizeRound(ins, &count, labels, allLabels, map) )
+    {
+      round++;
+    }
+#if N2T_ENABLE_STATS
+    STATS_COUNT(ctx->stats.optimized, decoded - count);
+#endif
+
+    if(count > (ADDRESS_MAX + 1U))
+    {
+      fprintf(stderr, "%u instructions don't fit the ROM (max %u)\n", count, ADDRESS_MAX + 1U);
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  if(status == SYSTEM_SUCCESS)
+  {
+    /* The labels take their final addresses, for the words and anything reading the table later */
+    for(uint32_t label = 0U; label < labelCount; label++)
+    {
+      ctx->symbolTable[SYMBOLTABLE_TAIL + label].value = labels[label];
+    }
+
+    for(uint32_t i = 0U; i < count; i++)
+    {
+      uint32_t word = (ins[i].label != SYMBOL_NOT_FOUND) ? labels[ins[i].label] : ins[i].word;
+
+      if( (ins[i].label != SYMBOL_NOT_FOUND) && (word > ADDRESS_MAX) )
+      {
+        /* A label past the last ROM word, rejected like any address lineCommand() rejects */
+        lineError(ctx, &lines[ins[i].line], "Address %u out of range (max %u)", word, ADDRESS_MAX);
+      }
+      else
+      {
+        lineWriter(writer, (uint16_t)word);
+        if(ctx->map.enabled)
+        {
+          mapRecord(ctx, &lines[ins[i].line]);
+        }
+      }
+    }
+  }
+
+  free(lines);
+  free(entries);
+  free(ins);
+  free(labels);
+  free(map);
+
+  return status;
+}
+
+/*
+ * One forward walk over the program numbering the values of A, D and the
+ * M that A addresses: a number, a label's address or a value only known to
+ * be equal to itself (fresh). Where a label some A-instruction loads points
+ * the registers start fresh; nothing else can jump there. The removed instructions are then squeezed out and the labels
+ * follow. Returns non-zero if anything changed.
+ */
+uint32_t optimizeRound(Optimize_Ins *ins, uint32_t *count, uint32_t *labels, uint32_t labelCount, uint32_t *map)
+{
+  uint32_t n = *count;
+  uint32_t changed = 0U;
+  uint32_t fresh = OPT_FRESH_FIRST;
+  uint32_t aKey = fresh++;
+  uint32_t dKey = fresh++;
+  uint32_t mKey = fresh++;
+  uint32_t kept = 0U;
+  uint8_t unreached = 0U;
+
+  for(uint32_t i = 0U; i < n; i++)
+  {
+    ins[i].target = 0U;
+    ins[i].removed = 0U;
+  }
+  if(n > 0U)
+  {
+    /* Entered with whatever a reset left */
+    ins[0].target = 1U;
+  }
+  for(uint32_t i = 0U; i < n; i++)
+  {
+    if( (ins[i].label != SYMBOL_NOT_FOUND) && (labels[ins[i].label] < n) )
+    {
+      ins[labels[ins[i].label]].target = 1U;
+    }
+  }
+
+  for(uint32_t i = 0U; i < n; i++)
+  {
+    uint16_t word = ins[i].word;
+    uint8_t drop = 0U;
+
+    if(ins[i].removed)
+    {
+      continue;
+    }
+
+    if(fresh > OPT_FRESH_LAST)
+    {
+      /* Far apart enough that no value is still held */
+      fresh = OPT_FRESH_FIRST;
+    }
+    if(ins[i].target)
+    {
+      aKey = fresh++;
+      dKey = fresh++;
+      mKey = fresh++;
+      unreached = 0U;
+    }
+
+    if(unreached)
+    {
+      /* After an unconditional jump and no label leads here */
+      drop = 1U;
+    }
+    else if(!(word & INS_C_BIT))
+    {
+      uint32_t key = (ins[i].label != SYMBOL_NOT_FOUND) ? (OPT_LABEL_KEY | ins[i].label) : word;
+      uint32_t next = optimizeSkip(ins, n, i + 1U);
+
+      if( (key == aKey) || optimizeDead(ins, n, next, INS_DEST_A) )
+      {
+        /* Reload of what A holds, or a load nothing reads */
+        drop = 1U;
+      }
+      else if( (ins[i].label != SYMBOL_NOT_FOUND) && optimizeBranch(ins, n, labels, i) )
+      {
+        /* Now loads the label of the jump it went around */
+        key = OPT_LABEL_KEY | ins[i].label;
+        changed = 1U;
+      }
+      else if( (ins[i].label != SYMBOL_NOT_FOUND) && (next < n) && (ins[next].word & INS_C_BIT) && !ins[next].target &&
+               (ins[next].word & INS_JUMP_MASK) && !(ins[next].word & (INS_DEST_A | INS_DEST_M)) && (ins[next].word & INS_ZY_BIT) &&
+               ( ((ins[next].word & INS_JUMP_MASK) == INS_JUMP_ALWAYS) || optimizeDead(ins, n, optimizeSkip(ins, n, next + 1U), INS_DEST_A) ) )
+      {
+        /* Only feeds a jump: straight to where the jumps at its target end up */
+        uint32_t label = optimizeJump(ins, n, labels, i);
+
+        if(label != ins[i].label)
+        {
+          ins[i].label = label;
+          key = OPT_LABEL_KEY | label;
+          changed = 1U;
+        }
+      }
+
+      if(!drop)
+      {
+        aKey = key;
+        mKey = fresh++;
+      }
+    }
+    else
+    {
+      uint16_t dest = word & INS_DEST_MASK;
+      uint16_t jump = word & INS_JUMP_MASK;
+      /* I/O, or an address that may be: every access stays and reads an unknown word */
+      uint8_t ioAccess = ( ((word & INS_M_BIT) || (dest & INS_DEST_M)) && !OPT_PLAIN_RAM(aKey) ) ? 1U : 0U;
+      uint32_t result = OPT_UNKNOWN;
+
+      mKey = ioAccess ? fresh++ : mKey;
+      result = optimizeAlu(word, dKey, (word & INS_M_BIT) ? mKey : aKey);
+      if(result == OPT_UNKNOWN)
+      {
+        result = fresh++;
+      }
+
+      if(OPT_NUMERIC(result) && ((result <= 1U) || (result == 0xFFFFU)) && !ioAccess)
+      {
+        /* 0, 1 or -1 in the comp itself, then A needn't hold anything for it */
+        uint16_t bits = compFieldLT[(result == 0xFFFFU) ? 2U : result].bits;
+
+        word = (uint16_t)((word & ~INS_COMP_MASK) | bits);
+      }
+
+      if( (jump != 0U) && OPT_NUMERIC(result) )
+      {
+        int16_t value = (int16_t)result;
+        uint8_t taken = ( ((jump & 4U) && (value < 0)) || ((jump & 2U) && (value == 0)) || ((jump & 1U) && (value > 0)) ) ? 1U : 0U;
+
+        jump = taken ? INS_JUMP_ALWAYS : 0U;
+        word = (uint16_t)((word & ~INS_JUMP_MASK) | jump);
+      }
+
+      if( (jump != 0U) && (dest == 0U) && !ioAccess && (aKey & OPT_LABEL_KEY) &&
+          (optimizeSkip(ins, n, labels[aKey & ~OPT_LABEL_KEY]) == optimizeSkip(ins, n, i + 1U)) )
+      {
+        /* Jump to the next instruction */
+        drop = 1U;
+      }
+      else if( (jump == 0U) && !ioAccess && (!(dest & INS_DEST_A) || (aKey == result)) &&
+               (!(dest & INS_DEST_D) || (dKey == result)) && (!(dest & INS_DEST_M) || (mKey == result)) )
+      {
+        /* Every register it writes already holds the result, or it writes none */
+        drop = 1U;
+      }
+      else if( (jump == 0U) && (dest == INS_DEST_D) && !ioAccess && optimizeDead(ins, n, optimizeSkip(ins, n, i + 1U), INS_DEST_D) )
+      {
+        /* D is written again before anything reads it */
+        drop = 1U;
+      }
+      else
+      {
+        if(word != ins[i].word)
+        {
+          ins[i].word = word;
+          changed = 1U;
+        }
+
+        /* M is written at the old address; a new address holds an unknown word, as I/O always does */
+        mKey = (dest & INS_DEST_M) ? (ioAccess ? fresh++ : result) : mKey;
+        mKey = ((dest & INS_DEST_A) && (aKey != result)) ? fresh++ : mKey;
+        aKey = (dest & INS_DEST_A) ? result : aKey;
+        dKey = (dest & INS_DEST_D) ? result : dKey;
+        unreached = (jump == INS_JUMP_ALWAYS) ? 1U : 0U;
+      }
+    }
+
+    if(drop)
+    {
+      /* Its labels now point at the next instruction, entered with unknown registers as well */
+      ins[i].removed = 1U;
+      changed = 1U;
+      if(ins[i].target && ((i + 1U) < n))
+      {
+        ins[i + 1U].target = 1U;
+      }
+    }
+  }
+
+  /* Squeeze the removed instructions out, map takes an old index to the new one */
+  for(uint32_t i = 0U; i < n; i++)
+  {
+    map[i] = kept;
+    if(!ins[i].removed)
+    {
+      ins[kept++] = ins[i];
+    }
+  }
+  map[n] = kept;
+  for(uint32_t label = 0U; label < labelCount; label++)
+  {
+    labels[label] = map[(labels[label] < n) ? labels[label] : n];
+  }
+  *count = kept;
+
+  return changed;
+}
+
+/*
+ * Label the jump fed by the A-instruction at "at" ends up at, following
+ * targets that are themselves "@L; 0;JMP". A loop of such jumps (a halt
+ * included) is left alone.
+ */
+uint32_t optimizeJump(const Optimize_Ins *ins, uint32_t count, const uint32_t *labels, uint32_t at)
+{
+  uint32_t label = ins[at].label;
+
+  for(uint32_t hop = 0U; hop < OPT_THREAD_MAX; hop++)
+  {
+    uint32_t target = optimizeSkip(ins, count, labels[label]);
+    uint32_t next = optimizeSkip(ins, count, target + 1U);
+
+    if( (next >= count) || (ins[target].word & INS_C_BIT) || (ins[target].label == SYMBOL_NOT_FOUND) ||
+        ((ins[next].word & (INS_C_BIT | INS_DEST_MASK | INS_JUMP_MASK)) != (INS_C_BIT | INS_JUMP_ALWAYS)) )
+    {
+      return label;
+    }
+    if(ins[target].label == ins[at].label)
+    {
+      return ins[at].label;
+    }
+    label = ins[target].label;
+  }
+
+  return ins[at].label;
+}
+
+/*
+ * "@L1; cond;J..; @L2; 0;JMP; (L1)" at "at" becomes "@L2; cond;Jnot",
+ * provided the jump at L1 leaves A unread. Returns non-zero if it did.
+ */
+uint8_t optimizeBranch(Optimize_Ins *ins, uint32_t count, const uint32_t *labels, uint32_t at)
+{
+  uint32_t branch = optimizeSkip(ins, count, at + 1U);
+  uint32_t load = optimizeSkip(ins, count, branch + 1U);
+  uint32_t jump = optimizeSkip(ins, count, load + 1U);
+  uint32_t after = optimizeSkip(ins, count, jump + 1U);
+
+  if( (jump >= count) || !(ins[branch].word & INS_C_BIT) || (ins[load].word & INS_C_BIT) || (ins[load].label == SYMBOL_NOT_FOUND) ||
+      ins[branch].target || ins[load].target || ins[jump].target ||
+      ((ins[branch].word & INS_DEST_MASK) != 0U) || !(ins[branch].word & INS_ZY_BIT) ||
+      ((ins[branch].word & INS_JUMP_MASK) == 0U) || ((ins[branch].word & INS_JUMP_MASK) == INS_JUMP_ALWAYS) ||
+      ((ins[jump].word & (INS_C_BIT | INS_DEST_MASK | INS_JUMP_MASK)) != (INS_C_BIT | INS_JUMP_ALWAYS)) ||
+      (optimizeSkip(ins, count, labels[ins[at].label]) != after) || !optimizeDead(ins, count, after, INS_DEST_A) )
+  {
+    return 0U;
+  }
+
+  ins[at].label = ins[load].label;
+  ins[branch].word = (uint16_t)(ins[branch].word ^ INS_JUMP_MASK);
+  ins[load].removed = 1U;
+  ins[jump].removed = 1U;
+
+  return 1U;
+}
+
+/*
+ * Turns the constants loaded right before a jump into labels of the
+ * instruction they address, after the labelCount of the table. Returns
+ * the number of labels.
+ */
+uint32_t optimizeCodeAddresses(Optimize_Ins *ins, uint32_t count, uint32_t *labels, uint32_t labelCount)
+{
+  uint32_t load = count;      /* The constant A-instruction A holds the value of */
+
+  for(uint32_t i = 0U; i < count; i++)
+  {
+    if(!(ins[i].word & INS_C_BIT))
+    {
+      load = (ins[i].label == SYMBOL_NOT_FOUND) ? i : count;
+    }
+    else
+    {
+      if( (ins[i].word & INS_JUMP_MASK) && (load < count) )
+      {
+        labels[labelCount] = (ins[load].word < count) ? ins[load].word : count;
+        ins[load].label = labelCount;
+        ins[load].word = 0U;
+        labelCount++;
+        load = count;
+      }
+      if(ins[i].word & INS_DEST_A)
+      {
+        load = count;
+      }
+    }
+  }
+
+  return labelCount;
+}
+
+/* First instruction from index on that is not removed, count at the end */
+uint32_t optimizeSkip(const Optimize_Ins *ins, uint32_t count, uint32_t index)
+{
+  while( (index < count) && ins[index].removed )
+  {
+    index++;
+  }
+  return index;
+}
+
+/*
+ * Non-zero if reg (INS_DEST_A or INS_DEST_D) is overwritten before anything
+ * from "from" on reads it: A as itself, M's address or a jump target, D as
+ * itself. Whatever is at a jump's target may read either.
+ */
+uint8_t optimizeDead(const Optimize_Ins *ins, uint32_t count, uint32_t from, uint16_t reg)
+{
+  uint32_t scanned = 0U;
+
+  for(uint32_t i = optimizeSkip(ins, count, from); (i < count) && (scanned < OPT_SCAN_MAX); i = optimizeSkip(ins, count, i + 1U))
+  {
+    uint16_t word = ins[i].word;
+
+    if(!(word & INS_C_BIT))
+    {
+      if(reg == INS_DEST_A)
+      {
+        return 1U;
+      }
+    }
+    else
+    {
+      uint8_t reads = (reg == INS_DEST_A) ? (!(word & INS_ZY_BIT) || (word & INS_DEST_M)) : !(word & INS_ZX_BIT);
+
+      if(reads || (word & INS_JUMP_MASK))
+      {
+        return 0U;
+      }
+      if(word & reg)
+      {
+        return 1U;
+      }
+    }
+    scanned++;
+  }
+
+  /* The end of the program or too far to tell */
+  return 0U;
+}
+
+/*
+ * Value the comp of a C-instruction gives for the values d and a (a is
+ * M's with the a bit set). A plain copy passes any value through,
+ * arithmetic needs numbers and gives OPT_UNKNOWN otherwise.
+ */
+uint32_t optimizeAlu(uint16_t word, uint32_t d, uint32_t a)
+{
+  uint32_t comp = (word >> COMP_FIELD_SHIFT) & 0x3FU;
+  uint32_t x = 0U;
+  uint32_t y = 0U;
+  uint32_t out = 0U;
+
+  if(comp == 0x30U)
+  {
+    return a;
+  }
+  if(comp == 0x0CU)
+  {
+    return d;
+  }
+  if( (!(comp & 0x20U) && !OPT_NUMERIC(d)) || (!(comp & 0x08U) && !OPT_NUMERIC(a)) )
+  {
+    return OPT_UNKNOWN;
+  }
+
+  /* zx nx zy ny f no */
+  x = (comp & 0x20U) ? 0U : d;
+  x = (comp & 0x10U) ? ~x : x;
+  y = (comp & 0x08U) ? 0U : a;
+  y = (comp & 0x04U) ? ~y : y;
+  out = (comp & 0x02U) ? (x + y) : (x & y);
+  out = (comp & 0x01U) ? ~out : out;
+
+  return out & 0xFFFFU;
+}
+
+/*
+ * Incremental second pass against the sidecar cache of the previous run.
+ * Variables are settled as usual by collectInstructions(), then the common
+ * prefix and suffix of the old and new lines (by content hash) count as
+ * unchanged and their cached words are reused, except for A-instructions
+ * whose symbol has another address now. Only those and the lines in between
+ * are encoded again. Lines that failed are always re-parsed, so their
+ * diagnostics show up on every run.
+ */
+int32_t incrementalPass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer, const uint8_t *cachePath)
+{
+  Line_Cache cache;
+  Line_View *lines = NULL;
+  uint32_t *entries = NULL;
+  Cache_Line *records = NULL;
+  uint8_t *moved = NULL;
+  uint32_t lineCount = 0U;
+  uint32_t prefix = 0U;
+  uint32_t suffix = 0U;
+
+  memset(&cache, 0, sizeof(cache));
+
+  if(collectInstructions(ctx, src, &lines, &entries, &lineCount) != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  records = malloc(((size_t)lineCount + 1U) * sizeof(Cache_Line));
+  if(records == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    free(lines);
+    free(entries);
+    return SYSTEM_FAILURE;
+  }
+
+  for(uint32_t i = 0U; i < lineCount; i++)
+  {
+    records[i].hash = lineHash(lines[i].ptr, lines[i].len);
+    records[i].symbol = entries[i];
+    records[i].reserved = 0U;
+  }
+
+  /* No (usable) cache just means everything is encoded */
+  if(cacheLoad(cachePath, &cache) == SYSTEM_SUCCESS)
+  {
+    moved = malloc((size_t)cache.header.symbolCount + 1U);
+  }
+
+  if(moved != NULL)
+  {
+    /* A symbol moved when it is gone or has another address now */
+    for(uint32_t entry = 0U; entry < cache.header.symbolCount; entry++)
+    {
+      uint32_t now = symbolTableLookup(ctx, &cache.names[cache.symbols[entry].offset], cache.symbols[entry].length);
+
+      moved[entry] = ( (now == SYMBOL_NOT_FOUND) || (ctx->symbolTable[now].value != cache.symbols[entry].value) ) ? 1U : 0U;
+    }
+
+    while( (prefix < lineCount) && (prefix < cache.header.lineCount) &&
+           (records[prefix].hash == cache.lines[prefix].hash) )
+    {
+      prefix++;
+    }
+    while( (suffix < (lineCount - prefix)) && (suffix < (cache.header.lineCount - prefix)) &&
+           (records[lineCount - 1U - suffix].hash == cache.lines[cache.header.lineCount - 1U - suffix].hash) )
+    {
+      suffix++;
+    }
+  }
+
+  for(uint32_t i = 0U; i < lineCount; i++)
+  {
+    const Cache_Line *old = NULL;
+
+    if(i < prefix)
+    {
+      old = &cache.lines[i];
+    }
+    else if(i >= (lineCount - suffix))
+    {
+      old = &cache.lines[cache.header.lineCount - (lineCount - i)];
+    }
+
+    if( (old != NULL) && old->valid && ((old->symbol == SYMBOL_NOT_FOUND) || !moved[old->symbol]) )
+    {
+      records[i].word = old->word;
+      records[i].valid = 1U;
+    }
+    else
+    {
+      records[i].valid = (lineParser(ctx, &lines[i]) == SYSTEM_SUCCESS) ? 1U : 0U;
+      records[i].word = ctx->insFields.word;
+      varInit(ctx);
+    }
+
+    if(records[i].valid)
+    {
+      lineWriter(writer, records[i].word);
+    }
+  }
+
+  if(ctx->errors > 0U)
+  {
+    /* The output is dropped, so there is nothing for the cache to vouch for */
+  }
+  else if(cacheSave(cachePath, ctx, records, lineCount) != SYSTEM_SUCCESS)
+  {
+    /* The output itself is fine, the next run just starts from scratch */
+    fprintf(stderr, "Error writing cache %s\n", cachePath);
+  }
+
+  cacheFree(&cache);
+  free(moved);
+  free(records);
+  free(entries);
+  free(lines);
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Reads and validates a sidecar cache; anything unexpected rejects it whole */
+int32_t cacheLoad(const uint8_t *path, Line_Cache *cache)
+{
+  FILE *file = fopen(path, "rb");
+  int32_t status = SYSTEM_SUCCESS;
+
+  memset(cache, 0, sizeof(*cache));
+
+  if(file == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  if( (fread(&cache->header, sizeof(cache->header), 1U, file) != 1U) ||
+      (cache->header.magic != CACHE_MAGIC) || (cache->header.version != CACHE_VERSION) )
+  {
+    fclose(file);
+    return SYSTEM_FAILURE;
+  }
+
+  cache->lines = malloc(((size_t)cache->header.lineCount + 1U) * sizeof(Cache_Line));
+  cache->symbols = malloc(((size_t)cache->header.symbolCount + 1U) * sizeof(Symbol_Table));
+  cache->names = malloc((size_t)cache->header.namesSize + 1U);
+
+  if( (cache->lines == NULL) || (cache->symbols == NULL) || (cache->names == NULL) ||
+      (fread(cache->lines, sizeof(Cache_Line), cache->header.lineCount, file) != cache->header.lineCount) ||
+      (fread(cache->symbols, sizeof(Symbol_Table), cache->header.symbolCount, file) != cache->header.symbolCount) ||
+      (fread(cache->names, 1U, cache->header.namesSize, file) != cache->header.namesSize) )
+  {
+    status = SYSTEM_FAILURE;
+  }
+
+  for(uint32_t i = 0U; (status == SYSTEM_SUCCESS) && (i < cache->header.lineCount); i++)
+  {
+    if( (cache->lines[i].symbol != SYMBOL_NOT_FOUND) && (cache->lines[i].symbol >= cache->header.symbolCount) )
+    {
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  for(uint32_t i = 0U; (status == SYSTEM_SUCCESS) && (i < cache->header.symbolCount); i++)
+  {
+    if( ((uint64_t)cache->symbols[i].offset + cache->symbols[i].length) > cache->header.namesSize )
+    {
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  fclose(file);
+  if(status != SYSTEM_SUCCESS)
+  {
+    cacheFree(cache);
+  }
+
+  return status;
+}
+
+/* Records of this run plus the final symbol table, for the next one */
+int32_t cacheSave(const uint8_t *path, const Assembler_Context *ctx, const Cache_Line *lines, uint32_t lineCount)
+{
+  FILE *file = fopen(path, "wb");
+  Cache_Header header;
+  int32_t status = SYSTEM_SUCCESS;
+
+  if(file == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  header.magic = CACHE_MAGIC;
+  header.version = CACHE_VERSION;
+  header.lineCount = lineCount;
+  header.symbolCount = ctx->symbolTableMeta.symbolTableTail;
+  header.namesSize = ctx->symbolArena.used;
+  header.reserved = 0U;
+
+  if( (fwrite(&header, sizeof(header), 1U, file) != 1U) ||
+      (fwrite(lines, sizeof(Cache_Line), lineCount, file) != lineCount) ||
+      (fwrite(ctx->symbolTable, sizeof(Symbol_Table), header.symbolCount, file) != header.symbolCount) ||
+      (fwrite(ctx->symbolArena.base, 1U, header.namesSize, file) != header.namesSize) )
+  {
+    status = SYSTEM_FAILURE;
+  }
+
+  if(fclose(file) != 0)
+  {
+    status = SYSTEM_FAILURE;
+  }
+
+  return status;
+}
+
+void cacheFree(Line_Cache *cache)
+{
+  free(cache->lines);
+  free(cache->symbols);
+  free(cache->names);
+  memset(cache, 0, sizeof(*cache));
+}
+
+/* 64-bit FNV-1a, wide enough that equal hashes are taken as equal lines */
+uint64_t lineHash(const uint8_t *str, uint32_t len)
+{
+  uint64_t hash = 0xCBF29CE484222325ULL;
+
+  for(uint32_t i = 0U; i < len; i++)
+  {
+    hash ^= str[i];
+    hash *= 0x100000001B3ULL;
+  }
+
+  return hash;
+}
+
+/*
+ * --map: from here on the words written are recorded with where their
+ * instruction is in src, for mapSave() once the file is assembled
+ */
+void mapStart(Assembler_Context *ctx, const Source_Buffer *src)
+{
+  ctx->map.count = 0U;
+  ctx->map.scanned = src->data;
+  ctx->map.lineStart = src->data;
+  ctx->map.line = 1U;
+  ctx->map.enabled = 1U;
+  ctx->map.failed = 0U;
+}
+
+/* Position of the word just written; the lines come in source order, so the newlines are counted once */
+void mapRecord(Assembler_Context *ctx, const Line_View *line)
+{
+  Map_Recorder *map = &ctx->map;
+  const uint8_t *newLine = NULL;
+
+  while( (map->scanned < line->ptr) &&
+         ((newLine = memchr(map->scanned, '\n', (size_t)(line->ptr - map->scanned))) != NULL) )
+  {
+    map->line++;
+    map->scanned = newLine + 1;
+    map->lineStart = map->scanned;
+  }
+  map->scanned = line->ptr;
+
+  if(growArray((void **)&map->lines, &map->size, sizeof(Map_Line), map->count + 1U) != SYSTEM_SUCCESS)
+  {
+    map->failed = 1U;
+    map->enabled = 0U;
+    return;
+  }
+
+  map->lines[map->count].line = map->line;
+  map->lines[map->count].column = (uint32_t)(line->ptr - map->lineStart) + 1U;
+  map->lines[map->count].length = line->len;
+  map->count++;
+}
+
+/*
+ * Writes what was recorded with the labels and variables of the table:
+ * the binary sidecar described at Map_Header, or with MAP_JSON
+ * {"source":..., "words":N, "labels":{name:address}, "variables":{name:address},
+ *  "instructions":[[line, column, length] per word]}
+ */
+int32_t mapSave(const Assembler_Context *ctx, const uint8_t *path, uint32_t format, const uint8_t *source)
+{
+  FILE *file = NULL;
+  const Map_Recorder *map = &ctx->map;
+  uint32_t labelTail = ctx->symbolTableMeta.labelTail;
+  uint32_t tail = ctx->symbolTableMeta.symbolTableTail;
+  int32_t status = SYSTEM_SUCCESS;
+
+  if(map->failed)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return SYSTEM_FAILURE;
+  }
+
+  file = fopen(path, (format == MAP_JSON) ? "w" : "wb");
+  if(file == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  if(format == MAP_JSON)
+  {
+    fputs("{\"source\":", file);
+    jsonString(file, source, (uint32_t)strlen(source));
+    fprintf(file, ",\"words\":%u,\"labels\":{", map->count);
+    for(uint32_t entry = SYMBOLTABLE_TAIL; entry < tail; entry++)
+    {
+      if(entry == labelTail)
+      {
+        fputs("},\"variables\":{", file);
+      }
+      else if(entry > SYMBOLTABLE_TAIL)
+      {
+        fputc(',', file);
+      }
+      jsonString(file, &ctx->symbolArena.base[ctx->symbolTable[entry].offset], ctx->symbolTable[entry].length);
+      fprintf(file, ":%u", ctx->symbolTable[entry].value);
+    }
+    fputs((labelTail == tail) ? "},\"variables\":{},\"instructions\":[" : "},\"instructions\":[", file);
+    for(uint32_t i = 0U; i < map->count; i++)
+    {
+      fprintf(file, "%s[%u,%u,%u]", (i > 0U) ? "," : "", map->lines[i].line, map->lines[i].column, map->lines[i].length);
+    }
+    fputs("]}\n", file);
+    status = ferror(file) ? SYSTEM_FAILURE : SYSTEM_SUCCESS;
+  }
+  else
+  {
+    Map_Header header;
+
+    header.magic = MAP_MAGIC;
+    header.version = MAP_VERSION;
+    header.words = map->count;
+    header.labelCount = labelTail - SYMBOLTABLE_TAIL;
+    header.variableCount = tail - labelTail;
+    header.namesSize = ctx->symbolArena.used;
+
+    if( (fwrite(&header, sizeof(header), 1U, file) != 1U) ||
+        (fwrite(&ctx->symbolTable[SYMBOLTABLE_TAIL], sizeof(Symbol_Table), tail - SYMBOLTABLE_TAIL, file) != (tail - SYMBOLTABLE_TAIL)) ||
+        (fwrite(map->lines, sizeof(Map_Line), map->count, file) != map->count) ||
+        (fwrite(ctx->symbolArena.base, 1U, header.namesSize, file) != header.namesSize) )
+    {
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  if(fclose(file) != 0)
+  {
+    status = SYSTEM_FAILURE;
+  }
+
+  return status;
+}
+
+void mapStop(Assembler_Context *ctx)
+{
+  free(ctx->map.lines);
+  memset(&ctx->map, 0, sizeof(ctx->map));
+}
+
+/* Binary map of mapSave(), checked like the cache: every name and count has to fit */
+int32_t mapLoad(const uint8_t *path, Source_Map *map)
+{
+  FILE *file = fopen(path, "rb");
+  uint32_t symbols = 0U;
+  int32_t status = SYSTEM_SUCCESS;
+
+  memset(map, 0, sizeof(*map));
+
+  if(file == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  if( (fread(&map->header, sizeof(map->header), 1U, file) != 1U) ||
+      (map->header.magic != MAP_MAGIC) || (map->header.version != MAP_VERSION) ||
+      (map->header.words > (ADDRESS_MAX + 1U)) ||
+      (((uint64_t)map->header.labelCount + map->header.variableCount) > 0xFFFFFFFEU) )
+  {
+    fclose(file);
+    return SYSTEM_FAILURE;
+  }
+
+  symbols = map->header.labelCount + map->header.variableCount;
+  map->symbols = malloc(((size_t)symbols + 1U) * sizeof(Symbol_Table));
+  map->lines = malloc(((size_t)map->header.words + 1U) * sizeof(Map_Line));
+  map->names = malloc((size_t)map->header.namesSize + 1U);
+
+  if( (map->symbols == NULL) || (map->lines == NULL) || (map->names == NULL) ||
+      (fread(map->symbols, sizeof(Symbol_Table), symbols, file) != symbols) ||
+      (fread(map->lines, sizeof(Map_Line), map->header.words, file) != map->header.words) ||
+      (fread(map->names, 1U, map->header.namesSize, file) != map->header.namesSize) )
+  {
+    status = SYSTEM_FAILURE;
+  }
+
+  for(uint32_t i = 0U; (status == SYSTEM_SUCCESS) && (i < symbols); i++)
+  {
+    if( ((uint64_t)map->symbols[i].offset + map->symbols[i].length) > map->header.namesSize )
+    {
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  fclose(file);
+  if(status != SYSTEM_SUCCESS)
+  {
+    mapFree(map);
+  }
+
+  return status;
+}
+
+/* The map of the file just assembled with mapStart(), without the round trip through a file */
+int32_t mapFromContext(const Assembler_Context *ctx, Source_Map *map)
+{
+  uint32_t symbols = ctx->symbolTableMeta.symbolTableTail - SYMBOLTABLE_TAIL;
+
+  memset(map, 0, sizeof(*map));
+  if(ctx->map.failed)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  map->header.magic = MAP_MAGIC;
+  map->header.version = MAP_VERSION;
+  map->header.words = ctx->map.count;
+  map->header.labelCount = ctx->symbolTableMeta.labelTail - SYMBOLTABLE_TAIL;
+  map->header.variableCount = ctx->symbolTableMeta.symbolTableTail - ctx->symbolTableMeta.labelTail;
+  map->header.namesSize = ctx->symbolArena.used;
+  map->symbols = malloc(((size_t)symbols + 1U) * sizeof(Symbol_Table));
+  map->lines = malloc(((size_t)ctx->map.count + 1U) * sizeof(Map_Line));
+  map->names = malloc((size_t)ctx->symbolArena.used + 1U);
+
+  if( (map->symbols == NULL) || (map->lines == NULL) || (map->names == NULL) )
+  {
+    mapFree(map);
+    return SYSTEM_FAILURE;
+  }
+
+  memcpy(map->symbols, &ctx->symbolTable[SYMBOLTABLE_TAIL], (size_t)symbols * sizeof(Symbol_Table));
+  if(ctx->map.count != 0U)
+  {
+    memcpy(map->lines, ctx->map.lines, (size_t)ctx->map.count * sizeof(Map_Line));
+  }
+  memcpy(map->names, ctx->symbolArena.base, ctx->symbolArena.used);
+
+  return SYSTEM_SUCCESS;
+}
+
+void mapFree(Source_Map *map)
+{
+  free(map->symbols);
+  free(map->lines);
+  free(map->names);
+  memset(map, 0, sizeof(*map));
+}
+
+/* str as a quoted JSON string */
+void jsonString(FILE *file, const uint8_t *str, uint32_t len)
+{
+  fputc('"', file);
+  for(uint32_t i = 0U; i < len; i++)
+  {
+    if( (str[i] == '"') || (str[i] == '\\') )
+    {
+      fputc('\\', file);
+      fputc(str[i], file);
+    }
+    else if(str[i] < 0x20U)
+    {
+      fprintf(file, "\\u%04x", str[i]);
+    }
+    else
+    {
+      fputc(str[i], file);
+    }
+  }
+  fputc('"', file);
+}
+
+/*
+ * Single pass assembly: instructions are encoded into the emit buffer as
+ * they are read; symbolic A-instructions that are not yet known get a
+ * fixup that is patched when the (LABEL) shows up. Whatever is still
+ * pending at the end is a variable, allocated in first-use order.
+ */
+int32_t singlePass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer)
+{
+  int32_t status = SYSTEM_SUCCESS;
+  Emit_Buffer emit;
+  Line_View line;
+  size_t pos = 0U;
+
+  memset(&emit, 0, sizeof(emit));
+
+  while( (status == SYSTEM_SUCCESS) && (sourceNextInstruction(src, &pos, &line) == SYSTEM_SUCCESS) )
+  {
+    STATS_COUNT(ctx->stats.lines, 1U);
+    status = singlePassLine(ctx, &emit, &line);
+  }
+
+  if(status == SYSTEM_SUCCESS)
+  {
+    status = singlePassVariables(ctx, &emit);
+  }
+
+  /* After a rejected line the labels differ from the two passes, so nothing is written */
+  if( (status == SYSTEM_SUCCESS) && (ctx->errors == 0U) )
+  {
+    for(uint32_t word = 0U; word < emit.wordCount; word++)
+    {
+      lineWriter(writer, emit.words[word]);
+    }
+  }
+
+  free(emit.words);
+  free(emit.fixups);
+
+  return status;
+}
+
+/* Encodes one trimmed line into the emit buffer, labels resolve their pending fixups */
+int32_t singlePassLine(Assembler_Context *ctx, Emit_Buffer *emit, const Line_View *line)
+{
+  uint32_t address = emit->emitted + emit->wordCount;
+
+  if( (line->len > 0U) && (line->ptr[0] == '(') )
+  {
+    /* Label: resolve any pending forward references */
+    uint32_t len = 0U;
+    uint32_t entry = SYMBOL_NOT_FOUND;
+
+    if(address > ADDRESS_MAX)
+    {
+      lineError(ctx, line, "Address %u out of range (max %u)", address, ADDRESS_MAX);
+      return SYSTEM_FAILURE;
+    }
+
+    if(labelName(ctx, line, &len, &entry) != SYSTEM_SUCCESS)
+    {
+      /* Reported, and skipped like an invalid instruction */
+    }
+    else if(entry == SYMBOL_NOT_FOUND)
+    {
+      symbolTableInsert(ctx, &line->ptr[1], len, address);
+      STATS_COUNT(ctx->stats.labels, 1U);
+    }
+    else if(ctx->symbolTable[entry].value & SYMBOL_PENDING)
+    {
+      resolveFixups(ctx, emit, entry, address);
+      STATS_COUNT(ctx->stats.labels, 1U);
+    }
+    else
+    {
+      lineError(ctx, line, "Duplicate Label");
+    }
+    return SYSTEM_SUCCESS;
+  }
+
+  if( (line->len > 1U) && (line->ptr[0] == '@') && (line->ptr[1] > '9') )
+  {
+    /* Symbolic A-instruction */
+    uint32_t entry = SYMBOL_NOT_FOUND;
+    uint32_t chain = FIXUP_END;
+
+    if(!symbolValid(&line->ptr[1], line->len - 1U))
+    {
+      lineError(ctx, line, "Invalid Symbol");
+      return SYSTEM_SUCCESS;
+    }
+
+    entry = symbolTableLookup(ctx, &line->ptr[1], line->len - 1U);
+    if(entry != SYMBOL_NOT_FOUND)
+    {
+      chain = ctx->symbolTable[entry].value;
+    }
+
+    if( (entry != SYMBOL_NOT_FOUND) && !(chain & SYMBOL_PENDING) )
+    {
+      ctx->insFields.word = (uint16_t)chain;
+    }
+    else if(emit->sealed)
+    {
+      /* No label can follow any more, so it is a new variable (the insert may move the table) */
+      entry = symbolEntryFor(ctx, &line->ptr[1], line->len - 1U);
+      if(entry == SYMBOL_NOT_FOUND)
+      {
+        return SYSTEM_FAILURE;
+      }
+      ctx->insFields.word = (uint16_t)ctx->symbolTable[entry].value;
+    }
+    else
+    {
+      /* Unknown yet: placeholder word plus a fixup */
+      if(growArray((void **)&emit->fixups, &emit->fixupSize, sizeof(Fixup_Entry), emit->fixupCount + 1U) != SYSTEM_SUCCESS)
+      {
+        fprintf(stderr, "Out of memory\n");
+        return SYSTEM_FAILURE;
+      }
+
+      if(entry == SYMBOL_NOT_FOUND)
+      {
+        entry = symbolTableInsert(ctx, &line->ptr[1], line->len - 1U, SYMBOL_PENDING | FIXUP_END);
+        if(entry == SYMBOL_NOT_FOUND)
+        {
+          return SYSTEM_FAILURE;
+        }
+      }
+
+      emit->fixups[emit->fixupCount].wordIndex = emit->wordCount;
+      emit->fixups[emit->fixupCount].next = ctx->symbolTable[entry].value & ~SYMBOL_PENDING;
+      ctx->symbolTable[entry].value = SYMBOL_PENDING | emit->fixupCount;
+      emit->fixupCount++;
+      ctx->insFields.word = 0U;
+    }
+  }
+  else if(lineParser(ctx, line) != SYSTEM_SUCCESS)
+  {
+    /* Comment, blank or invalid line */
+    varInit(ctx);
+    return SYSTEM_SUCCESS;
+  }
+
+  if(growArray((void **)&emit->words, &emit->wordSize, sizeof(emit->words[0]), emit->wordCount + 1U) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return SYSTEM_FAILURE;
+  }
+  emit->words[emit->wordCount] = ctx->insFields.word;
+  emit->wordCount++;
+  varInit(ctx);
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Still pending symbols are variables, table order is first-use order */
+int32_t singlePassVariables(Assembler_Context *ctx, Emit_Buffer *emit)
+{
+  for(uint32_t entry = 0U; entry < ctx->symbolTableMeta.symbolTableTail; entry++)
+  {
+    if(ctx->symbolTable[entry].value & SYMBOL_PENDING)
+    {
+      if(ctx->symbolTableMeta.currMemory > ADDRESS_MAX)
+      {
+        fprintf(stderr, "Address %u out of range (max %u)\n", ctx->symbolTableMeta.currMemory, ADDRESS_MAX);
+        return SYSTEM_FAILURE;
+      }
+      resolveFixups(ctx, emit, entry, ctx->symbolTableMeta.currMemory);
+      ctx->symbolTableMeta.currMemory++;
+      STATS_COUNT(ctx->stats.variables, 1U);
+    }
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * Streaming single pass: the input is read as it arrives and every prefix of
+ * the program that no forward reference holds back is written straight away.
+ * Once the program counter passes ADDRESS_MAX no label can be defined any
+ * more, so the pending symbols are variables from then on; this bounds the
+ * emit buffer to ADDRESS_MAX + 1 words whatever the length of the stream.
+ * Nothing more is written once a line is rejected: what went out before
+ * is what the two passes write too, the rest would have its labels moved.
+ * A path of "-" streams stdin.
+ */
+int32_t streamPass(Assembler_Context *ctx, const uint8_t *inPath, Output_Writer *writer)
+{
+  int32_t status = SYSTEM_SUCCESS;
+  int fd = STDIN_FILENO;
+  Emit_Buffer emit;
+  uint8_t *data = malloc(SOURCE_READ_CHUNK);
+  size_t capacity = SOURCE_READ_CHUNK;
+  size_t used = 0U;
+  uint8_t done = 0U;
+
+  memset(&emit, 0, sizeof(emit));
+
+  if( strcmp(inPath, "-") && ((fd = open(inPath, O_RDONLY)) < 0) )
+  {
+    free(data);
+    return SYSTEM_FAILURE;
+  }
+  status = (data != NULL) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+
+  while( (status == SYSTEM_SUCCESS) && !done )
+  {
+    size_t tail = used;     /* The partial line kept from the last read has no '\n' */
+    size_t end = 0U;
+    ssize_t count = 0;
+
+    if(used == capacity)
+    {
+      /* A line longer than the buffer */
+      uint8_t *newData = realloc(data, capacity * 2U);
+
+      if(newData == NULL)
+      {
+        fprintf(stderr, "Out of memory\n");
+        status = SYSTEM_FAILURE;
+        break;
+      }
+      data = newData;
+      capacity *= 2U;
+    }
+
+    count = read(fd, &data[used], capacity - used);
+    if(count > 0)
+    {
+      used += (size_t)count;
+    }
+    else
+    {
+      done = 1U;
+    }
+
+    /* Only whole lines are scanned, the last one as well at the end */
+    end = done ? used : 0U;
+    for(size_t byte = used; !done && (byte > tail); byte--)
+    {
+      if(data[byte - 1U] == '\n')
+      {
+        end = byte;
+        break;
+      }
+    }
+
+    if(end > 0U)
+    {
+      Source_Buffer view = { data, end, 0U };
+      Line_View line;
+      size_t pos = 0U;
+
+      /* Lines are numbered on from those already moved out of the buffer */
+      ctx->position.start = data;
+      ctx->position.scanned = data;
+      ctx->position.first = ctx->position.line;
+
+      while( (status == SYSTEM_SUCCESS) && (sourceNextInstruction(&view, &pos, &line) == SYSTEM_SUCCESS) )
+      {
+        STATS_COUNT(ctx->stats.lines, 1U);
+        status = singlePassLine(ctx, &emit, &line);
+
+        if( (status == SYSTEM_SUCCESS) && !emit.sealed && ((emit.emitted + emit.wordCount) > ADDRESS_MAX) )
+        {
+          status = singlePassVariables(ctx, &emit);
+          emit.sealed = 1U;
+        }
+      }
+      positionMove(ctx, &data[end]);
+      memmove(data, &data[end], used - end);
+      used -= end;
+    }
+
+    if( (status == SYSTEM_SUCCESS) && !done && (ctx->errors == 0U) )
+    {
+      /* Hand what is final to the next stage before waiting for more input */
+      streamFlush(&emit, writer);
+      status = outputFlush(writer);
+      if(writer->file == stdout)
+      {
+        fflush(stdout);
+      }
+    }
+  }
+
+  if(status == SYSTEM_SUCCESS)
+  {
+    status = singlePassVariables(ctx, &emit);
+  }
+  if( (status == SYSTEM_SUCCESS) && (ctx->errors == 0U) )
+  {
+    streamFlush(&emit, writer);
+  }
+
+  if(fd != STDIN_FILENO)
+  {
+    close(fd);
+  }
+  free(data);
+  free(emit.words);
+  free(emit.fixups);
+
+  return status;
+}
+
+/* Writes the words up to the first unresolved fixup, and empties the buffer once nothing is pending */
+void streamFlush(Emit_Buffer *emit, Output_Writer *writer)
+{
+  uint32_t limit = emit->wordCount;
+
+  while( (emit->firstPending < emit->fixupCount) && (emit->fixups[emit->firstPending].wordIndex == FIXUP_END) )
+  {
+    emit->firstPending++;
+  }
+  if(emit->firstPending < emit->fixupCount)
+  {
+    limit = emit->fixups[emit->firstPending].wordIndex;
+  }
+
+  for(; emit->written < limit; emit->written++)
+  {
+    lineWriter(writer, emit->words[emit->written]);
+  }
+
+  if( (emit->firstPending == emit->fixupCount) && (emit->written == emit->wordCount) )
+  {
+    emit->emitted += emit->wordCount;
+    emit->wordCount = 0U;
+    emit->written = 0U;
+    emit->fixupCount = 0U;
+    emit->firstPending = 0U;
+  }
+}
+
+/* Binds a pending symbol to its value and patches every word waiting on it */
+void resolveFixups(Assembler_Context *ctx, Emit_Buffer *emit, uint32_t entry, uint32_t value)
+{
+  uint32_t fixup = ctx->symbolTable[entry].value & ~SYMBOL_PENDING;
+
+  while(fixup != FIXUP_END)
+  {
+    emit->words[emit->fixups[fixup].wordIndex] = (uint16_t)value;
+    emit->fixups[fixup].wordIndex = FIXUP_END;   /* Resolved, for streamFlush */
+    fixup = emit->fixups[fixup].next;
+  }
+  ctx->symbolTable[entry].value = value;
+}
+
+/* Makes room for at least "need" elements, doubling the array */
+int32_t growArray(void **array, uint32_t *size, size_t elemSize, uint32_t need)
+{
+  uint32_t newSize = (*size == 0U) ? EMIT_BUFFER_INIT : *size;
+  void *newArray = NULL;
+
+  if(need <= *size)
+  {
+    return SYSTEM_SUCCESS;
+  }
+
+  while(newSize < need)
+  {
+    newSize *= 2U;
+  }
+
+  newArray = realloc(*array, newSize * elemSize);
+  if(newArray == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+  *array = newArray;
+  *size = newSize;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Instruction line parser, line is a trimmed span from sourceNextInstruction() */
+int32_t lineParser(Assembler_Context *ctx, const Line_View *line)
+{
+  int32_t status = SYSTEM_SUCCESS;
+  const uint8_t *ptr = line->ptr;
+  const uint8_t *end = line->ptr + line->len;
+  uint32_t len = line->len;
+
+  if(len == 0U)
+  {
+    /* Skip the blank or comment line */
+    status = SYSTEM_FAILURE;
+  }
+  else
+  {
+    /* Parse the fields */
+
+    if(*ptr == '@')
+    {
+      /* A Instruction ( @2 or @sum ) */
+      ptr++;
+
+      /* Check if it is a symbol */
+      if( (ptr < end) && (*ptr > '9') )
+      {
+        /* Symbol - Check the entry in symbol table */
+        if(symbolValid(ptr, (uint32_t)(end - ptr)))
+        {
+          ctx->insFields.address = searchSymbolEntry(ctx, ptr, (uint32_t)(end - ptr));
+        }
+        else
+        {
+          lineError(ctx, line, "Invalid Symbol");
+          status = SYSTEM_FAILURE;
+        }
+      }
+      else
+      {
+        /* Address*/
+        uint32_t address = 0U;
+
+        while( (ptr < end) && (*ptr >= '0') && (*ptr <= '9') )
+        {
+          /* Saturate, anything above ADDRESS_MAX is rejected below */
+          if(address <= ADDRESS_MAX)
+          {
+            address = (address * 10U) + (uint32_t)(*ptr - '0');
+          }
+          ptr++;
+        }
+
+        if( (ptr != end) || (ptr == (line->ptr + 1)) )
+        {
+          lineError(ctx, line, "Invalid Address");
+          status = SYSTEM_FAILURE;
+        }
+        else if(address > ADDRESS_MAX)
+        {
+          lineError(ctx, line, "Address out of range (max %u)", ADDRESS_MAX);
+          status = SYSTEM_FAILURE;
+        }
+        ctx->insFields.address = address;
+      }
+
+      /* Pass the line parsed to lineCommand(ctx) to get bitfields */
+      if(status == SYSTEM_SUCCESS)
+      {
+        status = lineCommand(ctx, line);
+      }
+    }
+    else if(*ptr == '(' )
+    {
+      /* Labels are resolved by the first pass */
+      status = SYSTEM_FAILURE;
+    }
+    else
+    {
+      /* C Instruction: dest=comp;jump, split where the scanner found '=' and ';' */
+      uint32_t compStart = (line->equal < line->semicolon) ? (line->equal + 1U) : 0U;
+      uint32_t destLen = (line->equal < line->semicolon) ? line->equal : 0U;
+      uint32_t compLen = line->semicolon - compStart;
+      uint32_t jumpLen = (line->semicolon < len) ? (len - line->semicolon - 1U) : 0U;
+
+      ctx->insFields.address = ADDRESS_INVALID;
+      ctx->insFields.dest.ptr = ptr;
+      ctx->insFields.dest.len = destLen;
+      ctx->insFields.comp.ptr = &ptr[compStart];
+      ctx->insFields.comp.len = compLen;
+      ctx->insFields.jump.ptr = &ptr[len - jumpLen];
+      ctx->insFields.jump.len = jumpLen;
+
+      /* Pass the line parsed to lineCommand(ctx) to get bitfields */
+      status = lineCommand(ctx, line);
+    }
+  }
+
+  return status;
+}
+
+/* Letters, digits, '_', '.', '$' and ':', not starting with a digit */
+uint8_t symbolValid(const uint8_t *str, uint32_t len)
+{
+  uint8_t valid = ( (len > 0U) && ((str[0] < '0') || (str[0] > '9')) ) ? 1U : 0U;
+
+  for(uint32_t i = 0U; valid && (i < len); i++)
+  {
+    uint8_t c = str[i];
+
+    valid = ( ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) ||
+              (c == '_') || (c == '.') || (c == '$') || (c == ':') ) ? 1U : 0U;
+  }
+
+  return valid;
+}
+
+/*
+ * Name of a "(NAME)" line and its table entry, SYMBOL_NOT_FOUND when it is
+ * new; a malformed label or one naming a predefined symbol is reported
+ */
+int32_t labelName(Assembler_Context *ctx, const Line_View *line, uint32_t *len, uint32_t *entry)
+{
+  *len = (line->len >= 2U) ? (line->len - 2U) : 0U;
+  *entry = SYMBOL_NOT_FOUND;
+
+  if( (line->len < 2U) || (line->ptr[line->len - 1U] != ')') || !symbolValid(&line->ptr[1], *len) )
+  {
+    lineError(ctx, line, "Invalid Label");
+    return SYSTEM_FAILURE;
+  }
+
+  *entry = symbolTableLookup(ctx, &line->ptr[1], *len);
+  if( (*entry != SYMBOL_NOT_FOUND) && (*entry < SYMBOLTABLE_TAIL) )
+  {
+    lineError(ctx, line, "Label redefines a predefined symbol");
+    return SYSTEM_FAILURE;
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Diagnostics from here on name the source (NULL for none) and count the lines of start */
+void positionStart(Assembler_Context *ctx, const uint8_t *name, const uint8_t *start)
+{
+  ctx->position.name = name;
+  ctx->position.start = start;
+  ctx->position.scanned = start;
+  ctx->position.line = 1U;
+  ctx->position.first = 1U;
+}
+
+/* Counts the newlines up to "to", which is past what was scanned */
+void positionMove(Assembler_Context *ctx, const uint8_t *to)
+{
+  Source_Position *at = &ctx->position;
+  const uint8_t *newLine = NULL;
+
+  while( (at->scanned < to) && ((newLine = memchr(at->scanned, '\n', (size_t)(to - at->scanned))) != NULL) )
+  {
+    at->line++;
+    at->scanned = newLine + 1;
+  }
+  at->scanned = to;
+}
+
+/*
+ * Reports a rejected line as "source:line: message: text" in one write and
+ * counts it; the program fails once it is done
+ */
+void lineError(Assembler_Context *ctx, const Line_View *line, const char *format, ...)
+{
+  Source_Position *at = &ctx->position;
+  char text[ERROR_TEXT_SIZE] = { 0 };
+  uint32_t number = 0U;
+  int32_t used = 0;
+  va_list args;
+
+  if( (at->start != NULL) && (line->ptr >= at->start) )
+  {
+    if(line->ptr < at->scanned)
+    {
+      /* Before the last line reported (a later pass), counted again */
+      at->scanned = at->start;
+      at->line = at->first;
+    }
+    positionMove(ctx, line->ptr);
+    number = at->line;
+  }
+
+  ctx->errors++;
+  if( (number != 0U) && ((ctx->errorLine == 0U) || (number < ctx->errorLine)) )
+  {
+    ctx->errorLine = number;
+  }
+
+  if(number != 0U)
+  {
+    used = snprintf(text, sizeof(text), "%s%s%u: ", (at->name != NULL) ? (const char *)at->name : "line ",
+                    (at->name != NULL) ? ":" : "", number);
+  }
+  if( (used >= 0) && ((size_t)used < sizeof(text)) )
+  {
+    va_start(args, format);
+    used += vsnprintf(&text[used], sizeof(text) - (size_t)used, format, args);
+    va_end(args);
+  }
+  if( (used >= 0) && ((size_t)used < sizeof(text)) )
+  {
+    snprintf(&text[used], sizeof(text) - (size_t)used, ": %.*s\n", (int)line->len, line->ptr);
+  }
+  /* A cut line still ends the diagnostic */
+  text[sizeof(text) - 2U] = (text[sizeof(text) - 2U] != '\0') ? '\n' : '\0';
+  text[sizeof(text) - 1U] = '\0';
+
+  fputs(text, stderr);
+}
+
+/* Resolves a symbolic operand, allocating a variable on a miss */
+uint32_t searchSymbolEntry(Assembler_Context *ctx, const uint8_t *line, uint32_t strLen)
+{
+  uint32_t entry = symbolEntryFor(ctx, line, strLen);
+  uint32_t value = 0;
+
+  if(entry != SYMBOL_NOT_FOUND)
+  {
+    value = ctx->symbolTable[entry].value;
+  }
+
+  return value;
+}
+
+/* Table entry of a symbolic operand, a miss allocates the next variable */
+uint32_t symbolEntryFor(Assembler_Context *ctx, const uint8_t *str, uint32_t len)
+{
+  uint32_t entry = symbolTableLookup(ctx, str, len);
+
+  if(entry == SYMBOL_NOT_FOUND)
+  {
+    /* Add the new entry */
+    entry = symbolTableInsert(ctx, str, len, ctx->symbolTableMeta.currMemory);
+    ctx->symbolTableMeta.currMemory++;
+    STATS_COUNT(ctx->stats.variables, 1U);
+  }
+
+  return entry;
+}
+
+/* Allocate the symbol table and index the predefined symbols (R0-R15, SCREEN, KBD, SP ...) */
+int32_t symbolTableInit(Assembler_Context *ctx)
+{
+  ctx->symbolTable = malloc(SYMBOLTABLE_INIT * sizeof(Symbol_Table));
+  ctx->symbolHash = calloc(SYMBOL_HASH_INIT, sizeof(uint32_t));
+  ctx->symbolArena.base = malloc(SYMBOL_ARENA_INIT);
+  ctx->symbolArena.used = sizeof(predefinedNames) - 1U;
+  ctx->symbolArena.size = SYMBOL_ARENA_INIT;
+  ctx->symbolTableMeta.symbolTableTail = SYMBOLTABLE_TAIL;
+  ctx->symbolTableMeta.labelTail = SYMBOLTABLE_TAIL;
+  ctx->symbolTableMeta.symbolTableSize = SYMBOLTABLE_INIT;
+  ctx->symbolTableMeta.hashSize = SYMBOL_HASH_INIT;
+  ctx->symbolTableMeta.currMemory = CURR_MEMORY;
+
+  if( (ctx->symbolTable == NULL) || (ctx->symbolHash == NULL) || (ctx->symbolArena.base == NULL) )
+  {
+    symbolTableFree(ctx);
+    return SYSTEM_FAILURE;
+  }
+
+  /* The predefined symbols come indexed from hasm_tables.h */
+  memcpy(ctx->symbolTable, predefinedEntries, sizeof(predefinedEntries));
+  memcpy(ctx->symbolHash, predefinedHash, sizeof(predefinedHash));
+  memcpy(ctx->symbolArena.base, predefinedNames, sizeof(predefinedNames) - 1U);
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Back to the predefined symbols only, keeping every allocation for the next file */
+void symbolTableReset(Assembler_Context *ctx)
+{
+  uint32_t mask = ctx->symbolTableMeta.hashSize - 1U;
+
+  /*
+   * The predefined entries were indexed first (also after a rehash), so
+   * their probe chains never pass through a later entry's slot and clearing
+   * those slots leaves them reachable.
+   */
+  for(uint32_t entry = SYMBOLTABLE_TAIL; entry < ctx->symbolTableMeta.symbolTableTail; entry++)
+  {
+    uint32_t slot = symbolHash(&ctx->symbolArena.base[ctx->symbolTable[entry].offset],
+                               ctx->symbolTable[entry].length) & mask;
+
+    while(ctx->symbolHash[slot] != (entry + 1U))
+    {
+      slot = (slot + 1U) & mask;
+    }
+    ctx->symbolHash[slot] = 0U;
+  }
+
+  ctx->symbolTableMeta.symbolTableTail = SYMBOLTABLE_TAIL;
+  ctx->symbolTableMeta.labelTail = SYMBOLTABLE_TAIL;
+  ctx->symbolArena.used = ctx->symbolTable[SYMBOLTABLE_TAIL - 1U].offset + ctx->symbolTable[SYMBOLTABLE_TAIL - 1U].length;
+  ctx->symbolTableMeta.currMemory = CURR_MEMORY;
+}
+
+void symbolTableFree(Assembler_Context *ctx)
+{
+  free(ctx->symbolTable);
+  free(ctx->symbolHash);
+  free(ctx->symbolArena.base);
+  ctx->symbolTable = NULL;
+  ctx->symbolHash = NULL;
+  memset(&ctx->symbolArena, 0, sizeof(ctx->symbolArena));
+  ctx->symbolTableMeta.symbolTableTail = 0U;
+  ctx->symbolTableMeta.symbolTableSize = 0U;
+  ctx->symbolTableMeta.hashSize = 0U;
+}
+
+/* Double the entry array and the hash index, then re-index every entry */
+int32_t symbolTableGrow(Assembler_Context *ctx)
+{
+  uint32_t newSize = ctx->symbolTableMeta.symbolTableSize * 2U;
+  uint32_t newHashSize = ctx->symbolTableMeta.hashSize * 2U;
+  uint32_t mask = newHashSize - 1U;
+  uint32_t *newHash = calloc(newHashSize, sizeof(uint32_t));
+  Symbol_Table *newTable = NULL;
+
+  if(newHash == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  newTable = realloc(ctx->symbolTable, newSize * sizeof(Symbol_Table));
+  if(newTable == NULL)
+  {
+    free(newHash);
+    return SYSTEM_FAILURE;
+  }
+  ctx->symbolTable = newTable;
+  ctx->symbolTableMeta.symbolTableSize = newSize;
+
+  for(uint32_t entry = 0U; entry < ctx->symbolTableMeta.symbolTableTail; entry++)
+  {
+    uint32_t slot = symbolHash(&ctx->symbolArena.base[ctx->symbolTable[entry].offset],
+                               ctx->symbolTable[entry].length) & mask;
+
+    while(newHash[slot] != 0U)
+    {
+      slot = (slot + 1U) & mask;
+    }
+    newHash[slot] = entry + 1U;
+  }
+
+  free(ctx->symbolHash);
+  ctx->symbolHash = newHash;
+  ctx->symbolTableMeta.hashSize = newHashSize;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* FNV-1a hash of a symbol */
+uint32_t symbolHash(const uint8_t *str, uint32_t len)
+{
+  uint32_t hash = 2166136261U;
+
+  for(uint32_t i = 0U; i < len; i++)
+  {
+    hash ^= str[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+/* Returns the ctx->symbolTable index of the symbol or SYMBOL_NOT_FOUND */
+uint32_t symbolTableLookup(Assembler_Context *ctx, const uint8_t *str, uint32_t len)
+{
+  uint32_t mask = ctx->symbolTableMeta.hashSize - 1U;
+  uint32_t slot = 0U;
+  uint32_t found = SYMBOL_NOT_FOUND;
+  uint32_t probes = 1U;
+  STATS_TIMER(timer);
+
+  STATS_START(ctx, timer);
+  slot = symbolHash(str, len) & mask;
+
+  while(ctx->symbolHash[slot] != 0U)
+  {
+    const Symbol_Table *entry = &ctx->symbolTable[ctx->symbolHash[slot] - 1U];
+
+    if( (entry->length == len) && !memcmp(str, &ctx->symbolArena.base[entry->offset], len) )
+    {
+      found = ctx->symbolHash[slot] - 1U;
+      break;
+    }
+    slot = (slot + 1U) & mask;
+    probes++;
+  }
+
+  STATS_STOP(ctx, timer, STATS_SYMBOLS);
+  STATS_COUNT(ctx->stats.lookups, 1U);
+  STATS_COUNT(ctx->stats.probes, probes);
+#if N2T_ENABLE_STATS
+  ctx->stats.probeMax = (probes > ctx->stats.probeMax) ? probes : ctx->stats.probeMax;
+#endif
+  (void)probes;
+
+  return found;
+}
+
+/* Interns the symbol, appends it to ctx->symbolTable and indexes it; caller checks for duplicates */
+uint32_t symbolTableInsert(Assembler_Context *ctx, const uint8_t *str, uint32_t len, uint32_t value)
+{
+  uint32_t entry = ctx->symbolTableMeta.symbolTableTail;
+  uint32_t mask = 0U;
+  uint32_t slot = 0U;
+
+  if( (entry >= ctx->symbolTableMeta.symbolTableSize) && (symbolTableGrow(ctx) != SYSTEM_SUCCESS) )
+  {
+    fprintf(stderr, "Symbol table full\n");
+    return SYMBOL_NOT_FOUND;
+  }
+
+  if( (ctx->symbolArena.size - ctx->symbolArena.used) < len )
+  {
+    uint32_t newSize = ctx->symbolArena.size;
+    uint8_t *newBase = NULL;
+
+    while( (newSize - ctx->symbolArena.used) < len )
+    {
+      newSize *= 2U;
+    }
+
+    newBase = realloc(ctx->symbolArena.base, newSize);
+    if(newBase == NULL)
+    {
+      fprintf(stderr, "Symbol table full\n");
+      return SYMBOL_NOT_FOUND;
+    }
+    ctx->symbolArena.base = newBase;
+    ctx->symbolArena.size = newSize;
+  }
+
+  memcpy(&ctx->symbolArena.base[ctx->symbolArena.used], str, len);
+  ctx->symbolTable[entry].offset = ctx->symbolArena.used;
+  ctx->symbolTable[entry].length = len;
+  ctx->symbolTable[entry].value = value;
+  ctx->symbolArena.used += len;
+
+  mask = ctx->symbolTableMeta.hashSize - 1U;
+  slot = symbolHash(str, len) & mask;
+
+  while(ctx->symbolHash[slot] != 0U)
+  {
+    slot = (slot + 1U) & mask;
+  }
+  ctx->symbolHash[slot] = entry + 1U;
+  ctx->symbolTableMeta.symbolTableTail++;
+
+  return entry;
+}
+
+int32_t lineCommand(Assembler_Context *ctx, const Line_View *line)
+{
+  int32_t status = SYSTEM_SUCCESS; 
+
+  ctx->insFields.word = 0U;
+
+  if(ctx->insFields.address != ADDRESS_INVALID)
+  {
+    /* A Instruction: opcode bit is 0, the word is the address itself */
+    if(ctx->insFields.address > ADDRESS_MAX)
+    {
+      lineError(ctx, line, "Address %u out of range (max %u)", ctx->insFields.address, ADDRESS_MAX);
+      status = SYSTEM_FAILURE;
+    }
+    else
+    {
+      ctx->insFields.word = (uint16_t)ctx->insFields.address;
+    }
+  }
+  else 
+  {
+    uint16_t word = C_INST_PREFIX;
+    uint16_t bits = 0U;
+
+    /* C Instruction */
+
+    /* Populate the Compare field (the decoders reject any slice longer than a mnemonic) */
+    status = decodeComp(ctx->insFields.comp.ptr, ctx->insFields.comp.len, &bits);
+    word |= bits;
+
+    if(status == SYSTEM_SUCCESS)
+    {
+      /* Populate the Destination field */
+      status = decodeDest(ctx->insFields.dest.ptr, ctx->insFields.dest.len, &bits);
+      word |= bits;
+
+      if(SYSTEM_SUCCESS == status)
+      {
+        /* Populate the Jump field */
+        status = decodeJump(ctx->insFields.jump.ptr, ctx->insFields.jump.len, &bits);
+        word |= bits;
+
+        if(SYSTEM_SUCCESS == status)
+        {
+          ctx->insFields.word = word;
+        }
+        else
+        {
+          lineError(ctx, line, "Invalid Jump Instruction");
+        }
+      }
+      else
+      {
+        lineError(ctx, line, "Invalid Dest Instruction");
+      }
+    }
+    else
+    {
+      lineError(ctx, line, "Invalid Comp Instruction");
+    }
+  }
+  return status;
+}
+
+/*
+ * Field decoders: the mnemonic sets are fixed, so each one is a single switch
+ * on the packed (length, characters) key instead of a strcmp table scan.
+ * The case values mirror compFieldLT, destFieldLT and jumpFieldLT, which
+ * --self-test checks exhaustively.
+ */
+uint32_t fieldKey(const uint8_t *str, uint32_t len)
+{
+  uint32_t key = FIELD_KEY_NONE;
+
+  switch(len)
+  {
+    case 0U: key = 0U; break;
+    case 1U: key = FIELD_KEY1(str[0]); break;
+    case 2U: key = FIELD_KEY2(str[0], str[1]); break;
+    case 3U: key = FIELD_KEY3(str[0], str[1], str[2]); break;
+    default: break;
+  }
+  return key;
+}
+
+int32_t decodeComp(const uint8_t *str, uint32_t len, uint16_t *bits)
+{
+  uint16_t comp = 0U;
+
+  switch(fieldKey(str, len))
+  {
+    case FIELD_KEY1('0'):           comp = 0x2AU; break;
+    case FIELD_KEY1('1'):           comp = 0x3FU; break;
+    case FIELD_KEY2('-', '1'):      comp = 0x3AU; break;
+    case FIELD_KEY1('D'):           comp = 0x0CU; break;
+    case FIELD_KEY1('A'):           comp = 0x30U; break;
+    case FIELD_KEY2('!', 'D'):      comp = 0x0DU; break;
+    case FIELD_KEY2('!', 'A'):      comp = 0x31U; break;
+    case FIELD_KEY2('-', 'D'):      comp = 0x0FU; break;
+    case FIELD_KEY2('-', 'A'):      comp = 0x33U; break;
+    case FIELD_KEY3('D', '+', '1'): comp = 0x1FU; break;
+    case FIELD_KEY3('A', '+', '1'): comp = 0x37U; break;
+    case FIELD_KEY3('D', '-', '1'): comp = 0x0EU; break;
+    case FIELD_KEY3('A', '-', '1'): comp = 0x32U; break;
+    case FIELD_KEY3('D', '+', 'A'): comp = 0x02U; break;
+    case FIELD_KEY3('D', '-', 'A'): comp = 0x13U; break;
+    case FIELD_KEY3('A', '-', 'D'): comp = 0x07U; break;
+    case FIELD_KEY3('D', '&', 'A'): comp = 0x00U; break;
+    case FIELD_KEY3('D', '|', 'A'): comp = 0x15U; break;
+    case FIELD_KEY1('M'):           comp = 0x70U; break;
+    case FIELD_KEY2('!', 'M'):      comp = 0x71U; break;
+    case FIELD_KEY2('-', 'M'):      comp = 0x73U; break;
+    case FIELD_KEY3('M', '+', '1'): comp = 0x77U; break;
+    case FIELD_KEY3('M', '-', '1'): comp = 0x72U; break;
+    case FIELD_KEY3('D', '+', 'M'): comp = 0x42U; break;
+    case FIELD_KEY3('D', '-', 'M'): comp = 0x53U; break;
+    case FIELD_KEY3('M', '-', 'D'): comp = 0x47U; break;
+    case FIELD_KEY3('D', '&', 'M'): comp = 0x40U; break;
+    case FIELD_KEY3('D', '|', 'M'): comp = 0x55U; break;
+    default:
+      *bits = 0U;
+      return SYSTEM_FAILURE;
+  }
+  *bits = (uint16_t)(comp << COMP_FIELD_SHIFT);
+
+  return SYSTEM_SUCCESS;
+}
+
+int32_t decodeDest(const uint8_t *str, uint32_t len, uint16_t *bits)
+{
+  uint16_t dest = 0U;
+
+  switch(fieldKey(str, len))
+  {
+    case 0U:                        dest = 0x0U; break;
+    case FIELD_KEY1('M'):           dest = 0x1U; break;
+    case FIELD_KEY1('D'):           dest = 0x2U; break;
+    case FIELD_KEY2('M', 'D'):      dest = 0x3U; break;
+    case FIELD_KEY1('A'):           dest = 0x4U; break;
+    case FIELD_KEY2('A', 'M'):      dest = 0x5U; break;
+    case FIELD_KEY2('A', 'D'):      dest = 0x6U; break;
+    case FIELD_KEY3('A', 'M', 'D'): dest = 0x7U; break;
+    default:
+      *bits = 0U;
+      return SYSTEM_FAILURE;
+  }
+  *bits = (uint16_t)(dest << DEST_FIELD_SHIFT);
+
+  return SYSTEM_SUCCESS;
+}
+
+int32_t decodeJump(const uint8_t *str, uint32_t len, uint16_t *bits)
+{
+  uint16_t jump = 0U;
+
+  switch(fieldKey(str, len))
+  {
+    case 0U:                        jump = 0x0U; break;
+    case FIELD_KEY3('J', 'G', 'T'): jump = 0x1U; break;
+    case FIELD_KEY3('J', 'E', 'Q'): jump = 0x2U; break;
+    case FIELD_KEY3('J', 'G', 'E'): jump = 0x3U; break;
+    case FIELD_KEY3('J', 'L', 'T'): jump = 0x4U; break;
+    case FIELD_KEY3('J', 'N', 'E'): jump = 0x5U; break;
+    case FIELD_KEY3('J', 'L', 'E'): jump = 0x6U; break;
+    case FIELD_KEY3('J', 'M', 'P'): jump = 0x7U; break;
+    default:
+      *bits = 0U;
+      return SYSTEM_FAILURE;
+  }
+  *bits = (uint16_t)(jump << JUMP_FIELD_SHIFT);
+
+  return SYSTEM_SUCCESS;
+}
+
+/* CPU time of the calling thread in seconds (of the process where threads can't be told apart) */
+double cpuSeconds(void)
+{
+#if N2T_HAVE_MONOTONIC && defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec now;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (double)now.tv_sec + ((double)now.tv_nsec * 1e-9);
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+#if N2T_ENABLE_STATS
+void statsNow(Stats_Time *now)
+{
+  now->wall = wallSeconds();
+  now->cpu = cpuSeconds();
+}
+
+/* Adds the time since start to total */
+void statsAdd(Stats_Time *total, const Stats_Time *start)
+{
+  Stats_Time now;
+
+  statsNow(&now);
+  total->wall += now.wall - start->wall;
+  total->cpu += now.cpu - start->cpu;
+}
+
+/* Folds the counters of a chunk context into the file's */
+void statsMerge(Assembler_Stats *into, const Assembler_Stats *from)
+{
+  into->lines += from->lines;
+  into->labels += from->labels;
+  into->variables += from->variables;
+  into->lookups += from->lookups;
+  into->probes += from->probes;
+  into->probeMax = (from->probeMax > into->probeMax) ? from->probeMax : into->probeMax;
+  for(uint32_t phase = 0U; phase < STATS_PHASE_COUNT; phase++)
+  {
+    into->time[phase].wall += from->time[phase].wall;
+    into->time[phase].cpu += from->time[phase].cpu;
+  }
+}
+
+#endif
+
+/* Monotonic wall clock in seconds */
+double wallSeconds(void)
+{
+#if N2T_HAVE_MONOTONIC
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + ((double)now.tv_nsec * 1e-9);
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+const uint8_t hexDigits[] = "0123456789ABCDEF";
+
+/* Output stage: the encoded word is only turned into text or bytes here */
+void lineWriter(Output_Writer *writer, uint16_t word)
+{
+  uint8_t *out = NULL;
+
+  STATS_COUNT(writer->aWords, (word >> 15) ^ 1U);
+  STATS_COUNT(writer->cWords, word >> 15);
+
+  switch(writer->format)
+  {
+    case OUTPUT_FORMAT_BIN_LE:
+      out = outputReserve(writer, 2U);
+      out[0] = (uint8_t)(word & 0xFFU);
+      out[1] = (uint8_t)(word >> 8);
+      break;
+
+    case OUTPUT_FORMAT_BIN_BE:
+      out = outputReserve(writer, 2U);
+      out[0] = (uint8_t)(word >> 8);
+      out[1] = (uint8_t)(word & 0xFFU);
+      break;
+
+    case OUTPUT_FORMAT_IHEX:
+      writer->record[writer->recordLen++] = (uint8_t)(word >> 8);
+      writer->record[writer->recordLen++] = (uint8_t)(word & 0xFFU);
+      if(writer->recordLen == IHEX_RECORD_DATA)
+      {
+        ihexRecord(writer, 0x00U, writer->byteAddress, writer->record, writer->recordLen);
+        writer->byteAddress += writer->recordLen;
+        writer->recordLen = 0U;
+      }
+      break;
+
+    case OUTPUT_FORMAT_MEMH:
+      out = outputReserve(writer, 5U);
+      out[0] = hexDigits[(word >> 12) & 0xFU];
+      out[1] = hexDigits[(word >> 8) & 0xFU];
+      out[2] = hexDigits[(word >> 4) & 0xFU];
+      out[3] = hexDigits[word & 0xFU];
+      out[4] = '\n';
+      break;
+
+    case OUTPUT_FORMAT_HACK:
+    case OUTPUT_FORMAT_MEMB:
+    default:
+      /* $readmemb takes the same one-word-per-line bit strings as .hack */
+      out = outputReserve(writer, HACK_LINE_LEN);
+      memcpy(&out[0], byteBits[word >> 8], 8U);
+      memcpy(&out[8], byteBits[word & 0xFFU], 8U);
+      out[BITFIELD_MAX] = '\n';
+      break;
+  }
+}
+
+/* Space for len more bytes in the chunk, flushing it first if needed */
+uint8_t *outputReserve(Output_Writer *writer, size_t len)
+{
+  uint8_t *out = NULL;
+
+  if( (OUTPUT_BUFFER_SIZE - writer->used) < len )
+  {
+    outputFlush(writer);
+  }
+
+  out = &writer->buffer[writer->used];
+  writer->used += len;
+
+  return out;
+}
+
+/* One ":LLAAAATT<data>CC" Intel HEX record */
+void ihexRecord(Output_Writer *writer, uint8_t type, uint32_t address, const uint8_t *data, uint32_t len)
+{
+  uint8_t header[4] = { (uint8_t)len, (uint8_t)(address >> 8), (uint8_t)(address & 0xFFU), type };
+  uint8_t *out = outputReserve(writer, 12U + (2U * len));
+  uint8_t checksum = 0U;
+
+  *out++ = ':';
+  for(uint32_t i = 0U; i < (4U + len); i++)
+  {
+    uint8_t byte = (i < 4U) ? header[i] : data[i - 4U];
+
+    *out++ = hexDigits[byte >> 4];
+    *out++ = hexDigits[byte & 0xFU];
+    checksum += byte;
+  }
+  checksum = (uint8_t)(0x100U - checksum);
+  *out++ = hexDigits[checksum >> 4];
+  *out++ = hexDigits[checksum & 0xFU];
+  *out = '\n';
+}
+
+/* Opens the output ("-" is stdout); stdio buffering is bypassed in favour of writer chunks */
+int32_t outputOpen(const uint8_t *path, uint32_t format, Output_Writer *writer)
+{
+  memset(writer, 0, sizeof(*writer));
+
+  writer->buffer = malloc(OUTPUT_BUFFER_SIZE);
+  writer->file = strcmp(path, "-") ? fopen(path, outputFormats[format].binary ? "wb" : "w") : stdout;
+  writer->status = SYSTEM_SUCCESS;
+  writer->format = format;
+
+  if( (writer->buffer == NULL) || (writer->file == NULL) )
+  {
+    if( (writer->file != NULL) && (writer->file != stdout) )
+    {
+      fclose(writer->file);
+    }
+    free(writer->buffer);
+    memset(writer, 0, sizeof(*writer));
+    return SYSTEM_FAILURE;
+  }
+
+  if(writer->file != stdout)
+  {
+    setvbuf(writer->file, NULL, _IONBF, 0U);
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Writes the formatted chunk out in one call */
+int32_t outputFlush(Output_Writer *writer)
+{
+#if N2T_ENABLE_STATS
+  /* Once per chunk, cheap enough to time unconditionally */
+  Stats_Time start;
+
+  statsNow(&start);
+#endif
+
+  if( (writer->used > 0U) && (fwrite(writer->buffer, 1U, writer->used, writer->file) != writer->used) )
+  {
+    writer->status = SYSTEM_FAILURE;
+  }
+  STATS_COUNT(writer->bytes, writer->used);
+  writer->used = 0U;
+
+#if N2T_ENABLE_STATS
+  statsAdd(&writer->writeTime, &start);
+#endif
+
+  return writer->status;
+}
+
+int32_t outputClose(Output_Writer *writer)
+{
+  int32_t status = SYSTEM_SUCCESS;
+
+  if(writer->format == OUTPUT_FORMAT_IHEX)
+  {
+    /* Last partial data record, then End Of File */
+    if(writer->recordLen > 0U)
+    {
+      ihexRecord(writer, 0x00U, writer->byteAddress, writer->record, writer->recordLen);
+    }
+    ihexRecord(writer, 0x01U, 0U, NULL, 0U);
+  }
+  status = outputFlush(writer);
+
+  if(writer->file == stdout)
+  {
+    fflush(stdout);
+  }
+  else if(fclose(writer->file) != 0)
+  {
+    status = SYSTEM_FAILURE;
+  }
+  free(writer->buffer);
+
+  /* The counters stay readable for --stats */
+  writer->file = NULL;
+  writer->buffer = NULL;
+  writer->used = 0U;
+
+  return status;
+}
+
+/* Empty slices: nothing is copied per line, so there is nothing to clear */
+void varInit(Assembler_Context *ctx)
+{
+  ctx->insFields.dest.len = 0U;
+  ctx->insFields.comp.len = 0U;
+  ctx->insFields.jump.len = 0U;
+  ctx->insFields.address = ADDRESS_INVALID;
+  ctx->insFields.word = 0U;
+}
\ No newline at end of file
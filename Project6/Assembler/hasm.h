@@ -0,0 +1,63 @@
+/**
+ * @file hasm.h
+ * @brief Hack assembler library: assembles a program held in memory into
+ *        16-bit Hack machine words, without touching any file.
+ *
+ * A context owns the symbol table of one program at a time and may be reused
+ * for any number of programs; the predefined symbols (R0-R15, SCREEN, KBD,
+ * SP ...) are indexed once by hasm_ctx_create() and survive every reset.
+ * Contexts are independent, so each thread may assemble with its own.
+ *
+ *   hasm_ctx *ctx = hasm_ctx_create();
+ *   uint16_t rom[32768];
+ *   size_t words = 32768;
+ *
+ *   if(hasm_assemble_buffer(ctx, text, strlen(text), rom, &words) == HASM_SUCCESS) { ... }
+ *   hasm_ctx_destroy(ctx);
+ *
+ * An invalid line fails the program with HASM_SYNTAX; hasm_error_line() gives
+ * its line number and the diagnostics are also printed on stderr, as by the
+ * n2tasm tool.
+ */
+#ifndef HASM_H
+#define HASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HASM_SUCCESS  (1)
+#define HASM_FAILURE  (-1)  /* NULL context or buffers */
+#define HASM_NO_SPACE (-2)  /* The output array is too small, *n is the size needed */
+#define HASM_SYNTAX   (-3)  /* An invalid line, see hasm_error_line() */
+
+typedef struct hasm_ctx hasm_ctx;
+
+/* New context holding the predefined symbols only, NULL if out of memory */
+hasm_ctx *hasm_ctx_create(void);
+
+/* Drops the labels and variables of the last program, the predefined symbols are kept */
+void hasm_ctx_reset(hasm_ctx *ctx);
+
+void hasm_ctx_destroy(hasm_ctx *ctx);
+
+/*
+ * Assembles the len bytes at src into out. *n is the capacity of out in
+ * words on entry and the number of words of the program on return. The
+ * context is reset first, so it need not be reset between programs.
+ * On HASM_SYNTAX the invalid lines were skipped and the words in out are
+ * not a usable program: every label after the first of them is off.
+ */
+int32_t hasm_assemble_buffer(hasm_ctx *ctx, const char *src, size_t len, uint16_t *out, size_t *n);
+
+/* Source line (from 1) of the first invalid line of the last program, 0 if none */
+uint32_t hasm_error_line(const hasm_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HASM_H */
@@ -0,0 +1,136 @@
+/**
+ * @file hasm_gen_tables.c
+ * @brief Build step: prints hasm_tables.h, the constant tables of the
+ *        assembler library, so that nothing is computed when a context is
+ *        created or a file is written.
+ *
+ *   gcc -o hasm_gen_tables hasm_gen_tables.c && ./hasm_gen_tables > hasm_tables.h
+ *
+ * - The predefined symbols as they sit in a fresh context: the interned
+ *   names, the Symbol_Table entries and the open addressing index with
+ *   SYMBOL_HASH_INIT slots. symbolTableInit() copies them as they are.
+ * - The ASCII bits of every byte value for the hack and memb formats.
+ *
+ * The hash must stay the FNV-1a of symbolHash() in hasm.c; --self-test looks
+ * every predefined symbol up through the generated index.
+ */
+
+#include "hasm_internal.h"
+
+/* Predefined Symbols, in the order of their table entries */
+const Predefined_Symbol predefinedList[SYMBOLTABLE_TAIL] =
+{
+  { "R0"      , 0       },
+  { "R1"      , 1       },
+  { "R2"      , 2       },
+  { "R3"      , 3       },
+  { "R4"      , 4       },
+  { "R5"      , 5       },
+  { "R6"      , 6       },
+  { "R7"      , 7       },
+  { "R8"      , 8       },
+  { "R9"      , 9       },
+  { "R10"     , 10      },
+  { "R11"     , 11      },
+  { "R12"     , 12      },
+  { "R13"     , 13      },
+  { "R14"     , 14      },
+  { "R15"     , 15      },
+  { "SCREEN"  , 16384   },
+  { "KBD"     , 24576   },
+  { "SP"      , 0       },
+  { "LCL"     , 1       },
+  { "ARG"     , 2       },
+  { "THIS"    , 3       },
+  { "THAT"    , 4       },
+};
+
+uint32_t genHash(const uint8_t *str, uint32_t len);
+
+int main(void)
+{
+  uint32_t index[SYMBOL_HASH_INIT] = { 0U };
+  uint32_t offset = 0U;
+
+  printf("/* Generated by hasm_gen_tables.c, do not edit */\n"
+         "#ifndef HASM_TABLES_H\n"
+         "#define HASM_TABLES_H\n\n"
+         "#if (SYMBOLTABLE_TAIL != %uU) || (SYMBOL_HASH_INIT != %uU)\n"
+         "#error \"hasm_tables.h is stale, run hasm_gen_tables\"\n"
+         "#endif\n\n",
+         SYMBOLTABLE_TAIL, SYMBOL_HASH_INIT);
+
+  /* Names back to back, as interned by symbolTableInsert() */
+  printf("/* Interned names of the predefined symbols */\n"
+         "const uint8_t predefinedNames[] =\n");
+  for(uint32_t i = 0U; i < SYMBOLTABLE_TAIL; i++)
+  {
+    printf("  \"%s\"%s\n", predefinedList[i].symbol, (i == (SYMBOLTABLE_TAIL - 1U)) ? ";" : "");
+  }
+
+  printf("\n/* Symbol table entries of the predefined symbols */\n"
+         "const Symbol_Table predefinedEntries[SYMBOLTABLE_TAIL] =\n{\n");
+  for(uint32_t i = 0U; i < SYMBOLTABLE_TAIL; i++)
+  {
+    uint32_t len = (uint32_t)strlen(predefinedList[i].symbol);
+    uint32_t slot = genHash(predefinedList[i].symbol, len) & (SYMBOL_HASH_INIT - 1U);
+
+    /* Same linear probing, same insertion order */
+    while(index[slot] != 0U)
+    {
+      slot = (slot + 1U) & (SYMBOL_HASH_INIT - 1U);
+    }
+    index[slot] = i + 1U;
+
+    printf("  { %3u, %u, %5u }, /* %s */\n", offset, len, predefinedList[i].value, predefinedList[i].symbol);
+    offset += len;
+  }
+  printf("};\n\n");
+
+  printf("/* Index over predefinedEntries, (entry + 1) per slot, 0 when empty */\n"
+         "const uint32_t predefinedHash[SYMBOL_HASH_INIT] =\n{\n");
+  for(uint32_t slot = 0U; slot < SYMBOL_HASH_INIT; slot += 16U)
+  {
+    printf(" ");
+    for(uint32_t i = slot; i < (slot + 16U); i++)
+    {
+      printf(" %2u,", index[i]);
+    }
+    printf("\n");
+  }
+  printf("};\n\n");
+
+  printf("/* ASCII bits of every byte value */\n"
+         "const uint8_t byteBits[256][8] =\n{\n");
+  for(uint32_t byte = 0U; byte < 256U; byte += 8U)
+  {
+    printf(" ");
+    for(uint32_t i = byte; i < (byte + 8U); i++)
+    {
+      printf(" \"");
+      for(uint32_t bitPos = 0U; bitPos < 8U; bitPos++)
+      {
+        putchar((int)(((i >> (7U - bitPos)) & 1U) + '0'));
+      }
+      printf("\",");
+    }
+    printf("\n");
+  }
+  printf("};\n\n"
+         "#endif /* HASM_TABLES_H */\n");
+
+  return EXIT_SUCCESS;
+}
+
+/* FNV-1a, as symbolHash() */
+uint32_t genHash(const uint8_t *str, uint32_t len)
+{
+  uint32_t hash = 2166136261U;
+
+  for(uint32_t i = 0U; i < len; i++)
+  {
+    hash ^= str[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
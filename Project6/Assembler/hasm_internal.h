@@ -0,0 +1,443 @@
+/**
+ * @file hasm_internal.h
+ * @brief Internals of the Hack assembler library shared with the n2tasm tool:
+ *        the context layout, the line scanner, the symbol table, the passes
+ *        and the output stage. Programs embedding the assembler only need
+ *        hasm.h.
+ */
+#ifndef HASM_INTERNAL_H
+#define HASM_INTERNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "hasm.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#define N2T_HAVE_MMAP    (1)
+#define N2T_HAVE_THREADS (1)
+#define N2T_HAVE_MONOTONIC (1)
+#define NULL_DEVICE      "/dev/null"
+#else
+#include <io.h>
+#include <fcntl.h>
+#define N2T_HAVE_MMAP    (0)
+#define N2T_HAVE_THREADS (0)
+#define N2T_HAVE_MONOTONIC (0)
+#define NULL_DEVICE      "NUL"
+#define STDIN_FILENO     (0)
+#endif
+
+/* --stats instrumentation, -DN2T_ENABLE_STATS=0 compiles every counter and timer out */
+#ifndef N2T_ENABLE_STATS
+#define N2T_ENABLE_STATS (1)
+#endif
+
+/* Line scanner: widest vector unit available, N2T_SCAN_SCALAR forces the plain loop */
+#if !defined(N2T_SCAN_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#define N2T_SCAN_AVX2    (1)
+#elif !defined(N2T_SCAN_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define N2T_SCAN_SSE2    (1)
+#elif !defined(N2T_SCAN_SCALAR) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define N2T_SCAN_NEON    (1)
+#endif
+#ifndef N2T_SCAN_AVX2
+#define N2T_SCAN_AVX2    (0)
+#endif
+#ifndef N2T_SCAN_SSE2
+#define N2T_SCAN_SSE2    (0)
+#endif
+#ifndef N2T_SCAN_NEON
+#define N2T_SCAN_NEON    (0)
+#endif
+
+/* Macro Definitions */
+#define SYSTEM_SUCCESS   (1U)
+#define SYSTEM_FAILURE   ((int32_t)(-1))
+#define BITFIELD_MAX     (16U)
+#define C_INST_PREFIX    (0xE000U)  /* "111" opcode and padding of a C-instruction */
+#define COMP_FIELD_SHIFT (6U)
+#define DEST_FIELD_SHIFT (3U)
+#define JUMP_FIELD_SHIFT (0U)
+#define COMP_FIELD_COUNT (28U)
+#define DEST_FIELD_COUNT (8U)
+#define JUMP_FIELD_COUNT (8U)
+#define FIELD_KEY_NONE   (0xFFFFFFFFU) /* Mnemonic too long to be valid */
+#define FIELD_KEY1(a)       ( (1U << 24) | ((uint32_t)(a) << 16) )
+#define FIELD_KEY2(a, b)    ( (2U << 24) | ((uint32_t)(a) << 16) | ((uint32_t)(b) << 8) )
+#define FIELD_KEY3(a, b, c) ( (3U << 24) | ((uint32_t)(a) << 16) | ((uint32_t)(b) << 8) | (uint32_t)(c) )
+#define ADDRESS_INVALID  (0xFFFFFFFFU) /* No address field: C-instruction */
+#define ADDRESS_MAX      (32767U)      /* Largest value an A-instruction can load */
+#define CURR_MEMORY      (16U)
+#define SYMBOLTABLE_TAIL (23U)
+#define SYMBOLTABLE_INIT (64U)      /* Initial entries, doubled on demand */
+#define SYMBOL_HASH_INIT (128U)     /* Power of two, kept at least 2x the entries */
+#define SYMBOL_ARENA_INIT (1024U)   /* Initial bytes of interned symbol names */
+#define SYMBOL_NOT_FOUND (0xFFFFFFFFU)
+#define SOURCE_READ_CHUNK (65536U)  /* Initial buffer when the input can't be mapped */
+#define OUTPUT_BUFFER_SIZE (1024U * 1024U) /* Bytes formatted before each write */
+#define HACK_LINE_LEN    (BITFIELD_MAX + 1U) /* 16 ASCII bits and a newline */
+#define IHEX_RECORD_DATA (16U)      /* Data bytes per Intel HEX record */
+#define SCAN_BLOCK       (N2T_SCAN_AVX2 ? 32U : 16U) /* Source bytes classified at once */
+#define CACHE_EXTENSION  ".cache"   /* Appended to the output path */
+#define MAP_EXTENSION    ".map"     /* Appended to the output path, ".map.json" with --map=json */
+#define MAP_JSON_EXTENSION ".map.json"
+#define MAP_MAGIC        (0x4D54324EU) /* "N2TM" read as a little-endian word */
+#define MAP_VERSION      (1U)
+#define MAX_WORKERS      (256U)     /* Upper bound for -j and -t */
+
+/* Output formats, all produced from the same encoded word stream */
+#define OUTPUT_FORMAT_HACK   (0U)  /* 16 ASCII bits per line */
+#define OUTPUT_FORMAT_BIN_LE (1U)  /* Raw 16-bit words, little-endian */
+#define OUTPUT_FORMAT_BIN_BE (2U)  /* Raw 16-bit words, big-endian */
+#define OUTPUT_FORMAT_IHEX   (3U)  /* Intel HEX, byte addressed, high byte of each word first */
+#define OUTPUT_FORMAT_MEMB   (4U)  /* Verilog $readmemb */
+#define OUTPUT_FORMAT_MEMH   (5U)  /* Verilog $readmemh */
+#define OUTPUT_FORMAT_COUNT  (6U)
+
+/* --stats */
+#define STATS_OFF          (0U)
+#define STATS_TEXT         (1U)
+#define STATS_JSON         (2U)
+#define STATS_FIRST_PASS   (0U)
+#define STATS_SECOND_PASS  (1U)  /* The whole pass with --single-pass */
+#define STATS_SYMBOLS      (2U)  /* Symbol table lookups, part of the passes */
+#define STATS_OUTPUT       (3U)  /* Writing the formatted chunks */
+#define STATS_PHASE_COUNT  (4U)
+
+/* --map */
+#define MAP_OFF            (0U)
+#define MAP_BINARY         (1U)
+#define MAP_JSON           (2U)
+
+#if N2T_ENABLE_STATS
+#define STATS_COUNT(counter, n)        ((counter) += (n))
+#define STATS_TIMER(name)              Stats_Time name
+#define STATS_START(ctx, name)         do { if((ctx)->statsMode) { statsNow(&(name)); } } while(0)
+#define STATS_STOP(ctx, name, phase)   do { if((ctx)->statsMode) { statsAdd(&(ctx)->stats.time[phase], &(name)); } } while(0)
+#else
+#define STATS_COUNT(counter, n)        ((void)0)
+#define STATS_TIMER(name)
+#define STATS_START(ctx, name)         ((void)0)
+#define STATS_STOP(ctx, name, phase)   ((void)0)
+#endif
+
+/* Variable Definitions */
+typedef struct
+{
+  uint8_t mnemonic[4];  /* In place rather than a pointer, so the tables need no relocation */
+  uint16_t bits;        /* Field already shifted into its instruction position */
+} Instruction_Encoding;
+
+typedef struct
+{
+  const uint8_t *symbol;
+  uint32_t value;
+} Predefined_Symbol;
+
+/* Symbol names live in gSymbolArena, entries only hold offset/length */
+typedef struct
+{
+  uint32_t offset;
+  uint32_t length;
+  uint32_t value;
+} Symbol_Table;
+
+typedef struct
+{
+  uint8_t *base;
+  uint32_t used;
+  uint32_t size;
+} Symbol_Arena;
+
+typedef struct
+{
+  uint32_t symbolTableTail;
+  uint32_t labelTail;       /* Entries from SYMBOLTABLE_TAIL up to here are the labels of firstPass() */
+  uint32_t symbolTableSize;
+  uint32_t hashSize;
+  uint32_t currMemory;
+} SymbolTableMeta;
+
+/* Wall and CPU seconds, a point in time or an accumulated duration */
+typedef struct
+{
+  double wall;
+  double cpu;
+} Stats_Time;
+
+/* Per file counters and phase times for --stats */
+typedef struct
+{
+  uint64_t lines;
+  uint64_t labels;
+  uint64_t variables;
+  uint64_t lookups;
+  uint64_t probes;      /* Slots visited by all lookups */
+  uint64_t probeMax;
+  uint64_t optimized;   /* Instructions the -O pass removed */
+  Stats_Time time[STATS_PHASE_COUNT];
+} Assembler_Stats;
+
+/* Source file, mapped or read once, shared by both passes */
+typedef struct
+{
+  const uint8_t *data;
+  size_t size;
+  uint8_t mapped;
+} Source_Buffer;
+
+/*
+ * Non-owning view of one source line, line terminator excluded. Lines of a
+ * program are trimmed instruction spans (no white space around, no comment)
+ * and equal/semicolon are the offsets of the first '=' and ';', len if absent.
+ */
+typedef struct
+{
+  const uint8_t *ptr;
+  uint32_t len;
+  uint32_t equal;
+  uint32_t semicolon;
+} Line_View;
+
+/*
+ * One block of source classified in bit masks, bit i for byte i. '(' and
+ * '@' only matter as the first byte of a trimmed span, so they need no mask.
+ */
+typedef struct
+{
+  uint32_t newLine;
+  uint32_t comment;   /* First '/' of a "//" */
+  uint32_t space;     /* ' ', '\t' and '\r' */
+  uint32_t equal;
+  uint32_t semicolon;
+} Scan_Masks;
+
+typedef struct
+{
+  const uint8_t *name;
+  const uint8_t *extension;
+  uint8_t binary;
+} Output_Format_Info;
+
+/* Output stage: words are formatted into one large buffer and written per chunk */
+typedef struct
+{
+  FILE *file;
+  uint8_t *buffer;
+  size_t used;
+  int32_t status;
+  uint32_t format;
+
+  /* Intel HEX record being filled */
+  uint8_t record[IHEX_RECORD_DATA];
+  uint32_t recordLen;
+  uint32_t byteAddress;
+
+#if N2T_ENABLE_STATS
+  /* Words by kind and bytes handed to the file, with the time spent writing */
+  uint64_t aWords;
+  uint64_t cWords;
+  uint64_t bytes;
+  Stats_Time writeTime;
+#endif
+} Output_Writer;
+
+/*
+ * --map sidecar: the header, the label then the variable entries of the
+ * symbol table (offsets into the names), one Map_Line per ROM word, then
+ * the names. Everything is stored in host byte order, like the cache.
+ */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t words;
+  uint32_t labelCount;
+  uint32_t variableCount;
+  uint32_t namesSize;
+} Map_Header;
+
+/* Source of one ROM word: line and column from 1, length of the instruction in bytes */
+typedef struct
+{
+  uint32_t line;
+  uint32_t column;
+  uint32_t length;
+} Map_Line;
+
+/* Positions of the words written so far, recorded by the passes while enabled */
+typedef struct
+{
+  Map_Line *lines;
+  uint32_t count;
+  uint32_t size;
+  const uint8_t *scanned;   /* Newlines before here are counted in line */
+  const uint8_t *lineStart;
+  uint32_t line;
+  uint8_t enabled;
+  uint8_t failed;           /* Out of memory, no map is written */
+} Map_Recorder;
+
+/*
+ * Where the diagnostics point: the newlines before scanned are counted in
+ * line, so the lines of a pass are numbered as it goes. A stream moves its
+ * buffer, first is the line number of start.
+ */
+typedef struct
+{
+  const uint8_t *name;      /* Source printed before the line, NULL for none */
+  const uint8_t *start;     /* NULL when there is no buffer to count lines in */
+  const uint8_t *scanned;
+  uint32_t line;
+  uint32_t first;
+} Source_Position;
+
+/* A map read back by mapLoad(), or copied out of a context by mapFromContext() */
+typedef struct
+{
+  Map_Header header;
+  Symbol_Table *symbols;    /* labelCount labels, then variableCount variables */
+  Map_Line *lines;          /* header.words */
+  uint8_t *names;
+} Source_Map;
+
+/*
+ * Optimizing pass: one decoded instruction. A label reference keeps the
+ * label rather than its address, which is only known once the program is
+ * final.
+ */
+typedef struct
+{
+  uint16_t word;        /* Encoded, 0 for a label reference */
+  uint32_t label;       /* Label an A-instruction loads, SYMBOL_NOT_FOUND otherwise */
+  uint32_t line;        /* Source line it was decoded from, for --map */
+  uint8_t target;       /* A loaded label points here: nothing is known on entry */
+  uint8_t removed;
+} Optimize_Ins;
+
+/* Non-owning (ptr, len) slice of a field inside the source line */
+typedef struct
+{
+  const uint8_t *ptr;
+  uint32_t len;
+} Field_Slice;
+
+/* ISA Fields */
+typedef struct
+{
+  /* For C instruction: slices into the line, validated by the decoders */
+  Field_Slice dest;
+  Field_Slice comp;
+  Field_Slice jump;
+
+  /* For A instruction: resolved address, ADDRESS_INVALID otherwise */
+  uint32_t address;
+
+  /* Encoded instruction */
+  uint16_t word;
+} ISA_Field;
+
+/*
+ * Per-job assembler state, the hasm_ctx of the library interface. Everything
+ * a file's assembly mutates lives here, so independent files can be
+ * assembled concurrently, one context each.
+ */
+struct hasm_ctx
+{
+  /* Fields of the instruction being encoded */
+  ISA_Field insFields;
+
+  /* Symbol Table, grown on demand */
+  Symbol_Table *symbolTable;
+  Symbol_Arena symbolArena;
+
+  /*
+   * Open addressing index over symbolTable (linear probing).
+   * Each slot holds (table index + 1), so a zeroed slot means empty.
+   */
+  uint32_t *symbolHash;
+  SymbolTableMeta symbolTableMeta;
+
+  /* --map, idle unless mapStart() */
+  Map_Recorder map;
+
+  /* Instruction lines rejected so far (lineError()), any one fails the program */
+  uint32_t errors;
+  uint32_t errorLine;    /* Lowest line number among them, 0 for none */
+  Source_Position position;
+
+  /* STATS_OFF unless --stats, so the timers stay idle */
+  uint8_t statsMode;
+#if N2T_ENABLE_STATS
+  Assembler_Stats stats;
+#endif
+};
+
+typedef struct hasm_ctx Assembler_Context;
+
+/* LookUp Tables of the C-instruction fields, the output formats and (hasm_tables.h) the predefined symbols */
+extern const Instruction_Encoding compFieldLT[COMP_FIELD_COUNT];
+extern const Instruction_Encoding destFieldLT[DEST_FIELD_COUNT];
+extern const Instruction_Encoding jumpFieldLT[JUMP_FIELD_COUNT];
+extern const uint8_t predefinedNames[];
+extern const Symbol_Table predefinedEntries[SYMBOLTABLE_TAIL];
+extern const Output_Format_Info outputFormats[OUTPUT_FORMAT_COUNT];
+
+/* Function Declarations */
+int32_t lineParser(Assembler_Context *ctx, const Line_View *line);
+int32_t lineCommand(Assembler_Context *ctx, const Line_View *line);
+void positionStart(Assembler_Context *ctx, const uint8_t *name, const uint8_t *start);
+void lineError(Assembler_Context *ctx, const Line_View *line, const char *format, ...);
+void lineWriter(Output_Writer *writer, uint16_t word);
+int32_t outputOpen(const uint8_t *path, uint32_t format, Output_Writer *writer);
+int32_t outputFlush(Output_Writer *writer);
+int32_t outputClose(Output_Writer *writer);
+int32_t decodeComp(const uint8_t *str, uint32_t len, uint16_t *bits);
+int32_t decodeDest(const uint8_t *str, uint32_t len, uint16_t *bits);
+int32_t decodeJump(const uint8_t *str, uint32_t len, uint16_t *bits);
+double wallSeconds(void);
+double cpuSeconds(void);
+void varInit(Assembler_Context *ctx);
+void  firstPass(Assembler_Context *ctx, const Source_Buffer *src);
+void secondPass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer);
+int32_t optimizePass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer);
+uint32_t optimizeRound(Optimize_Ins *ins, uint32_t *count, uint32_t *labels, uint32_t labelCount, uint32_t *map);
+int32_t singlePass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer);
+int32_t streamPass(Assembler_Context *ctx, const uint8_t *inPath, Output_Writer *writer);
+int32_t chunkedPass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer, uint32_t threads);
+int32_t incrementalPass(Assembler_Context *ctx, const Source_Buffer *src, Output_Writer *writer, const uint8_t *cachePath);
+void mapStart(Assembler_Context *ctx, const Source_Buffer *src);
+void mapRecord(Assembler_Context *ctx, const Line_View *line);
+int32_t mapSave(const Assembler_Context *ctx, const uint8_t *path, uint32_t format, const uint8_t *source);
+void mapStop(Assembler_Context *ctx);
+int32_t mapLoad(const uint8_t *path, Source_Map *map);
+int32_t mapFromContext(const Assembler_Context *ctx, Source_Map *map);
+void mapFree(Source_Map *map);
+void jsonString(FILE *file, const uint8_t *str, uint32_t len);
+int32_t growArray(void **array, uint32_t *size, size_t elemSize, uint32_t need);
+int32_t sourceOpen(const uint8_t *path, Source_Buffer *src);
+void sourceClose(Source_Buffer *src);
+int32_t sourceNextLine(const Source_Buffer *src, size_t *pos, Line_View *line);
+int32_t sourceNextInstruction(const Source_Buffer *src, size_t *pos, Line_View *line);
+int32_t symbolTableInit(Assembler_Context *ctx);
+void symbolTableReset(Assembler_Context *ctx);
+void symbolTableFree(Assembler_Context *ctx);
+#if N2T_ENABLE_STATS
+void statsNow(Stats_Time *now);
+void statsAdd(Stats_Time *total, const Stats_Time *start);
+void statsMerge(Assembler_Stats *into, const Assembler_Stats *from);
+#endif
+
+#endif /* HASM_INTERNAL_H */
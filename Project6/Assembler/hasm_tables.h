@@ -0,0 +1,113 @@
+/* Generated by hasm_gen_tables.c, do not edit */
+#ifndef HASM_TABLES_H
+#define HASM_TABLES_H
+
+#if (SYMBOLTABLE_TAIL != 23U) || (SYMBOL_HASH_INIT != 128U)
+#error "hasm_tables.h is stale, run hasm_gen_tables"
+#endif
+
+/* Interned names of the predefined symbols */
+const uint8_t predefinedNames[] =
+  "R0"
+  "R1"
+  "R2"
+  "R3"
+  "R4"
+  "R5"
+  "R6"
+  "R7"
+  "R8"
+  "R9"
+  "R10"
+  "R11"
+  "R12"
+  "R13"
+  "R14"
+  "R15"
+  "SCREEN"
+  "KBD"
+  "SP"
+  "LCL"
+  "ARG"
+  "THIS"
+  "THAT";
+
+/* Symbol table entries of the predefined symbols */
+const Symbol_Table predefinedEntries[SYMBOLTABLE_TAIL] =
+{
+  {   0, 2,     0 }, /* R0 */
+  {   2, 2,     1 }, /* R1 */
+  {   4, 2,     2 }, /* R2 */
+  {   6, 2,     3 }, /* R3 */
+  {   8, 2,     4 }, /* R4 */
+  {  10, 2,     5 }, /* R5 */
+  {  12, 2,     6 }, /* R6 */
+  {  14, 2,     7 }, /* R7 */
+  {  16, 2,     8 }, /* R8 */
+  {  18, 2,     9 }, /* R9 */
+  {  20, 3,    10 }, /* R10 */
+  {  23, 3,    11 }, /* R11 */
+  {  26, 3,    12 }, /* R12 */
+  {  29, 3,    13 }, /* R13 */
+  {  32, 3,    14 }, /* R14 */
+  {  35, 3,    15 }, /* R15 */
+  {  38, 6, 16384 }, /* SCREEN */
+  {  44, 3, 24576 }, /* KBD */
+  {  47, 2,     0 }, /* SP */
+  {  49, 3,     1 }, /* LCL */
+  {  52, 3,     2 }, /* ARG */
+  {  55, 4,     3 }, /* THIS */
+  {  59, 4,     4 }, /* THAT */
+};
+
+/* Index over predefinedEntries, (entry + 1) per slot, 0 when empty */
+const uint32_t predefinedHash[SYMBOL_HASH_INIT] =
+{
+   6, 22,  0,  0,  0,  3,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0, 17,  0,  5, 18,  0,  0,  0,  0,  0,  0,  0, 20,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0, 11,  0,  0,  0,  0,  7,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0, 12, 21,  0,  0,  0,  2,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 13,  0,  0,  0,  0,  1,
+   0,  0,  0,  0, 10,  0,  0,  0, 15,  0,  0,  0, 23, 14,  0,  0,
+   0,  0,  4,  0,  0,  0, 19,  9,  0,  0,  0, 16,  0,  0,  0,  0,
+};
+
+/* ASCII bits of every byte value */
+const uint8_t byteBits[256][8] =
+{
+  "00000000", "00000001", "00000010", "00000011", "00000100", "00000101", "00000110", "00000111",
+  "00001000", "00001001", "00001010", "00001011", "00001100", "00001101", "00001110", "00001111",
+  "00010000", "00010001", "00010010", "00010011", "00010100", "00010101", "00010110", "00010111",
+  "00011000", "00011001", "00011010", "00011011", "00011100", "00011101", "00011110", "00011111",
+  "00100000", "00100001", "00100010", "00100011", "00100100", "00100101", "00100110", "00100111",
+  "00101000", "00101001", "00101010", "00101011", "00101100", "00101101", "00101110", "00101111",
+  "00110000", "00110001", "00110010", "00110011", "00110100", "00110101", "00110110", "00110111",
+  "00111000", "00111001", "00111010", "00111011", "00111100", "00111101", "00111110", "00111111",
+  "01000000", "01000001", "01000010", "01000011", "01000100", "01000101", "01000110", "01000111",
+  "01001000", "01001001", "01001010", "01001011", "01001100", "01001101", "01001110", "01001111",
+  "01010000", "01010001", "01010010", "01010011", "01010100", "01010101", "01010110", "01010111",
+  "01011000", "01011001", "01011010", "01011011", "01011100", "01011101", "01011110", "01011111",
+  "01100000", "01100001", "01100010", "01100011", "01100100", "01100101", "01100110", "01100111",
+  "01101000", "01101001", "01101010", "01101011", "01101100", "01101101", "01101110", "01101111",
+  "01110000", "01110001", "01110010", "01110011", "01110100", "01110101", "01110110", "01110111",
+  "01111000", "01111001", "01111010", "01111011", "01111100", "01111101", "01111110", "01111111",
+  "10000000", "10000001", "10000010", "10000011", "10000100", "10000101", "10000110", "10000111",
+  "10001000", "10001001", "10001010", "10001011", "10001100", "10001101", "10001110", "10001111",
+  "10010000", "10010001", "10010010", "10010011", "10010100", "10010101", "10010110", "10010111",
+  "10011000", "10011001", "10011010", "10011011", "10011100", "10011101", "10011110", "10011111",
+  "10100000", "10100001", "10100010", "10100011", "10100100", "10100101", "10100110", "10100111",
+  "10101000", "10101001", "10101010", "10101011", "10101100", "10101101", "10101110", "10101111",
+  "10110000", "10110001", "10110010", "10110011", "10110100", "10110101", "10110110", "10110111",
+  "10111000", "10111001", "10111010", "10111011", "10111100", "10111101", "10111110", "10111111",
+  "11000000", "11000001", "11000010", "11000011", "11000100", "11000101", "11000110", "11000111",
+  "11001000", "11001001", "11001010", "11001011", "11001100", "11001101", "11001110", "11001111",
+  "11010000", "11010001", "11010010", "11010011", "11010100", "11010101", "11010110", "11010111",
+  "11011000", "11011001", "11011010", "11011011", "11011100", "11011101", "11011110", "11011111",
+  "11100000", "11100001", "11100010", "11100011", "11100100", "11100101", "11100110", "11100111",
+  "11101000", "11101001", "11101010", "11101011", "11101100", "11101101", "11101110", "11101111",
+  "11110000", "11110001", "11110010", "11110011", "11110100", "11110101", "11110110", "11110111",
+  "11111000", "11111001", "11111010", "11111011", "11111100", "11111101", "11111110", "11111111",
+};
+
+#endif /* HASM_TABLES_H */
@@ -0,0 +1,1843 @@
+/**
+ * @file hdl.c
+ * @brief HDL netlist library: parser, flattener, levelizer and the
+ *        bit-sliced evaluator and C writer of the netlist.
+ *
+ * A chip is read once per context from Chip.hdl and checked on its own:
+ * every part pin exists, widths agree, internal pins are driven by some
+ * part, OUT pins are only driven and IN pins only read. Building then:
+ * - flattens the top chip into a graph of Nand, DFF, constant and wire
+ *   nodes, each part instance getting fresh nodes for its pin bits;
+ * - reduces the graph from the OUT pins and the DFF inputs: wires
+ *   disappear, constants fold, double negations cancel and equal Nands
+ *   are shared, so only the gates some output depends on remain;
+ * - orders the gates by level (longest path from a top or clocked pin),
+ *   which every gate of a level only reads from lower levels.
+ * A loop that does not pass through a DFF cannot settle and is an error.
+ *
+ * Memories stay arrays through all of it: their out bits are values read
+ * at one level past their address bits, their in and load are sampled on
+ * the tick like the data inputs of DFFs.
+ */
+
+#include <stdarg.h>
+
+#include "hdl_internal.h"
+
+/* Macro Definitions */
+#define HDL_SHARE_INIT   (1024U)    /* Power of two, kept at least 2x the Nand values */
+
+/* Variable Definitions */
+const Hdl_Memory_Def hdlMemoryDefs[HDL_MEMORY_DEFS] =
+{
+  { "RAM8",     3U,  1U, 0U },
+  { "RAM64",    6U,  1U, 0U },
+  { "RAM512",   9U,  1U, 0U },
+  { "RAM4K",    12U, 1U, 0U },
+  { "RAM16K",   14U, 1U, 0U },
+  { "Screen",   13U, 1U, 1U },
+  { "Keyboard", 0U,  0U, 1U },
+  { "ROM32K",   15U, 0U, 1U },
+};
+
+hdl_ctx *hdl_create(void)
+{
+  return calloc(1U, sizeof(hdl_ctx));
+}
+
+void hdl_destroy(hdl_ctx *ctx)
+{
+  if(ctx == NULL)
+  {
+    return;
+  }
+
+  hdlNetlistFree(ctx);
+  for(uint32_t i = 0U; i < ctx->chipCount; i++)
+  {
+    free(ctx->chips[i].pins);
+    free(ctx->chips[i].internals);
+    free(ctx->chips[i].parts);
+    free(ctx->chips[i].conns);
+  }
+  for(uint32_t i = 0U; i < ctx->pathCount; i++)
+  {
+    free(ctx->paths[i]);
+  }
+  free(ctx->chips);
+  free(ctx->paths);
+  free(ctx);
+}
+
+int32_t hdl_add_path(hdl_ctx *ctx, const char *dir)
+{
+  size_t len = strlen(dir);
+
+  if( (len + HDL_NAME_MAX + 6U >= HDL_PATH_MAX) ||
+      (growArray((void **)&ctx->paths, &ctx->pathSize, sizeof(uint8_t *), ctx->pathCount + 1U) != SYSTEM_SUCCESS) ||
+      ((ctx->paths[ctx->pathCount] = malloc(len + 1U)) == NULL) )
+  {
+    return HDL_FAILURE;
+  }
+  memcpy(ctx->paths[ctx->pathCount++], dir, len + 1U);
+
+  return HDL_SUCCESS;
+}
+
+void hdl_set_structural(hdl_ctx *ctx, int32_t structural)
+{
+  ctx->structural = (structural != 0);
+}
+
+int32_t hdl_build(hdl_ctx *ctx, const char *path)
+{
+  uint8_t name[HDL_NAME_MAX];
+  const uint8_t *base = (const uint8_t *)strrchr(path, '/');
+  size_t len = strlen(path);
+  uint32_t *pinNodes = NULL;
+  uint32_t *memo = NULL;
+  uint32_t *outputValues = NULL;
+  uint32_t *dffValues = NULL;
+  uint32_t dffCount = 0U;
+  uint32_t dffSize = 0U;
+  uint32_t inputBits = 0U;
+  int32_t status = SYSTEM_SUCCESS;
+  const Hdl_Chip *top = NULL;
+
+  hdlNetlistFree(ctx);
+  base = (base != NULL) ? (base + 1) : (const uint8_t *)path;
+
+  /* The directory of Chip.hdl is searched first */
+  if( (len > 4U) && !strcmp(&path[len - 4U], ".hdl") )
+  {
+    uint8_t dir[HDL_PATH_MAX];
+    size_t dirLen = (size_t)(base - (const uint8_t *)path);
+
+    len = strlen(base) - 4U;
+    if( (len >= HDL_NAME_MAX) || (dirLen >= HDL_PATH_MAX) )
+    {
+      return HDL_FAILURE;
+    }
+    if(dirLen == 0U)
+    {
+      strcpy(dir, ".");
+    }
+    else
+    {
+      memcpy(dir, path, dirLen - 1U);
+      dir[dirLen - 1U] = '\0';
+    }
+    if( (ctx->pathCount == 0U) || strcmp(ctx->paths[0], dir) )
+    {
+      uint8_t *last = NULL;
+
+      if(hdl_add_path(ctx, dir) != HDL_SUCCESS)
+      {
+        return HDL_FAILURE;
+      }
+      /* Moved to the front */
+      last = ctx->paths[ctx->pathCount - 1U];
+      memmove(&ctx->paths[1], &ctx->paths[0], (ctx->pathCount - 1U) * sizeof(uint8_t *));
+      ctx->paths[0] = last;
+    }
+  }
+  else
+  {
+    len = strlen(base);
+    if(len >= HDL_NAME_MAX)
+    {
+      return HDL_FAILURE;
+    }
+  }
+  memcpy(name, base, len);
+  name[len] = '\0';
+
+  if(hdlChipFind(ctx, name, &ctx->top) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "No %s.hdl could be built\n", name);
+    return HDL_FAILURE;
+  }
+  top = &ctx->chips[ctx->top];
+
+  /* Nodes 0 and 1 are the constants, then the pin bits of the top chip */
+  ctx->nodeCount = 0U;
+  ctx->memoryCount = 0U;
+  hdlNodeAdd(ctx, HDL_NODE_CONST, 0U, 0U);
+  hdlNodeAdd(ctx, HDL_NODE_CONST, 0U, 0U);
+  pinNodes = malloc((top->pinBits + 1U) * sizeof(uint32_t));
+  if(pinNodes == NULL)
+  {
+    return HDL_FAILURE;
+  }
+  for(uint32_t i = 0U; i < top->inputs + top->outputs; i++)
+  {
+    for(uint32_t bit = 0U; bit < top->pins[i].width; bit++)
+    {
+      pinNodes[top->pins[i].first + bit] = (i < top->inputs) ? hdlNodeAdd(ctx, HDL_NODE_INPUT, inputBits++, 0U) :
+                                           hdlNodeAdd(ctx, HDL_NODE_UNDRIVEN, 0U, 0U);
+    }
+  }
+  status = hdlFlatten(ctx, ctx->top, pinNodes);
+  for(uint32_t i = 0U; i < top->pinBits; i++)
+  {
+    status = (pinNodes[i] != HDL_NONE) ? status : SYSTEM_FAILURE;
+  }
+
+  /* Values 0 and 1 are the constants, 2.. the IN bits */
+  memo = malloc(((size_t)ctx->nodeCount + 1U) * sizeof(uint32_t));
+  outputValues = malloc(((size_t)top->pinBits + 1U) * sizeof(uint32_t));
+  if( (status != SYSTEM_SUCCESS) || (memo == NULL) || (outputValues == NULL) )
+  {
+    status = SYSTEM_FAILURE;
+  }
+  else
+  {
+    memset(memo, 0xFF, (size_t)ctx->nodeCount * sizeof(uint32_t));
+    ctx->valueCount = 0U;
+    hdlValueAdd(ctx, HDL_NODE_CONST, 0U, 0U, 0U);
+    hdlValueAdd(ctx, HDL_NODE_CONST, 0U, 0U, 0U);
+    memo[HDL_FALSE] = HDL_FALSE;
+    memo[HDL_TRUE] = HDL_TRUE;
+    for(uint32_t bit = 0U; bit < top->pinBits; bit++)
+    {
+      if(ctx->nodes[pinNodes[bit]].kind == HDL_NODE_INPUT)
+      {
+        memo[pinNodes[bit]] = hdlValueAdd(ctx, HDL_NODE_INPUT, ctx->nodes[pinNodes[bit]].a, 0U, 0U);
+      }
+    }
+  }
+
+  for(uint32_t bit = inputBits; (status == SYSTEM_SUCCESS) && (bit < top->pinBits); bit++)
+  {
+    status = hdlReduce(ctx, pinNodes[bit], memo, &outputValues[bit - inputBits]);
+  }
+
+  /* Memories are seen through hdl_memory_get() as much as the OUT pins: everything they take is kept */
+  for(uint32_t m = 0U; (status == SYSTEM_SUCCESS) && (m < ctx->memoryCount); m++)
+  {
+    Hdl_Memory *memory = &ctx->memories[m];
+
+    status = hdlMemoryReduce(ctx, m, memo);
+    for(uint32_t bit = 0U; (status == SYSTEM_SUCCESS) && (bit < HDL_WORD_BITS); bit++)
+    {
+      status = hdlReduce(ctx, memory->in[bit], memo, &memory->in[bit]);
+    }
+    status = (status == SYSTEM_SUCCESS) ? hdlReduce(ctx, memory->load, memo, &memory->load) : status;
+  }
+
+  /* The inputs of DFFs reached so far, which may reach further DFFs */
+  for(uint32_t v = 0U; (status == SYSTEM_SUCCESS) && (v < ctx->valueCount); v++)
+  {
+    if(ctx->values[v].kind == HDL_NODE_DFF)
+    {
+      uint32_t input = HDL_NONE;
+
+      status = hdlReduce(ctx, ctx->values[v].a, memo, &input);
+      ctx->values[v].a = input;
+      if( (status == SYSTEM_SUCCESS) &&
+          ((status = growArray((void **)&dffValues, &dffSize, sizeof(uint32_t), dffCount + 1U)) == SYSTEM_SUCCESS) )
+      {
+        dffValues[dffCount++] = v;
+      }
+    }
+  }
+
+  if(status == SYSTEM_SUCCESS)
+  {
+    status = hdlLevelize(ctx, outputValues, dffCount, dffValues);
+  }
+
+  free(pinNodes);
+  free(memo);
+  free(outputValues);
+  free(dffValues);
+  free(ctx->nodes);
+  free(ctx->values);
+  free(ctx->share);
+  ctx->nodes = NULL;
+  ctx->values = NULL;
+  ctx->share = NULL;
+  ctx->nodeSize = 0U;
+  ctx->valueSize = 0U;
+  ctx->shareSize = 0U;
+
+  if(status != SYSTEM_SUCCESS)
+  {
+    hdlNetlistFree(ctx);
+    return HDL_FAILURE;
+  }
+  ctx->built = 1U;
+
+  return HDL_SUCCESS;
+}
+
+void hdl_get_stats(const hdl_ctx *ctx, hdl_stats *stats)
+{
+  *stats = ctx->stats;
+}
+
+uint32_t hdl_pin_count(const hdl_ctx *ctx)
+{
+  return ctx->pinCount;
+}
+
+int32_t hdl_pin_get(const hdl_ctx *ctx, uint32_t index, hdl_pin *pin)
+{
+  if(index >= ctx->pinCount)
+  {
+    return HDL_FAILURE;
+  }
+  *pin = ctx->pins[index];
+
+  return HDL_SUCCESS;
+}
+
+int32_t hdl_pin_find(const hdl_ctx *ctx, const char *name, hdl_pin *pin)
+{
+  for(uint32_t i = 0U; i < ctx->pinCount; i++)
+  {
+    if(!strcmp(ctx->pins[i].name, name))
+    {
+      *pin = ctx->pins[i];
+      return HDL_SUCCESS;
+    }
+  }
+
+  return HDL_FAILURE;
+}
+
+uint32_t hdl_memory_count(const hdl_ctx *ctx)
+{
+  return ctx->memoryCount;
+}
+
+int32_t hdl_memory_get(const hdl_ctx *ctx, uint32_t index, hdl_memory *memory)
+{
+  if(index >= ctx->memoryCount)
+  {
+    return HDL_FAILURE;
+  }
+  memory->chip = hdlMemoryDefs[ctx->memories[index].def].name;
+  memory->words = ctx->memories[index].words;
+  memory->offset = ctx->memories[index].base;
+
+  return HDL_SUCCESS;
+}
+
+void hdl_reset(const hdl_ctx *ctx, uint64_t *signals)
+{
+  memset(signals, 0, (size_t)ctx->stats.signals * sizeof(uint64_t));
+  signals[HDL_TRUE] = ~(uint64_t)0U;
+}
+
+void hdl_eval(const hdl_ctx *ctx, uint64_t *signals)
+{
+  const Hdl_Gate *gate = ctx->gates;
+  const Hdl_Gate *end = gate + ctx->stats.gates;
+  uint64_t *out = &signals[ctx->outputBase];
+
+  if(ctx->memoryCount == 0U)
+  {
+    for( ; gate < end; gate++)
+    {
+      signals[gate->out] = ~(signals[gate->a] & signals[gate->b]);
+    }
+  }
+  else
+  {
+    /* Level by level, the reads of a level before its gates */
+    const Hdl_Memory *memory = ctx->memories;
+    const Hdl_Memory *last = memory + ctx->memoryCount;
+
+    for(uint32_t level = 0U; level < ctx->stats.levels; level++)
+    {
+      for( ; (memory < last) && (memory->level == (level + 1U)); memory++)
+      {
+        hdlMemoryRead(memory, signals);
+      }
+      for(end = &ctx->gates[ctx->levelStart[level + 1U]]; gate < end; gate++)
+      {
+        signals[gate->out] = ~(signals[gate->a] & signals[gate->b]);
+      }
+    }
+  }
+  for(uint32_t i = 0U; i < ctx->stats.outputs; i++)
+  {
+    out[i] = signals[ctx->copies[i]];
+  }
+}
+
+void hdl_tick(const hdl_ctx *ctx, uint64_t *signals)
+{
+  uint64_t *next = &signals[ctx->nextBase];
+
+  /* All inputs are sampled before any state changes */
+  for(uint32_t i = 0U; i < ctx->stats.dffs; i++)
+  {
+    next[i] = signals[ctx->dffInputs[i]];
+  }
+  for(uint32_t i = 0U; i < ctx->memoryCount; i++)
+  {
+    hdlMemoryWrite(&ctx->memories[i], signals);
+  }
+  memcpy(&signals[ctx->dffBase], next, (size_t)ctx->stats.dffs * sizeof(uint64_t));
+}
+
+int32_t hdl_emit_c(const hdl_ctx *ctx, const char *path, const char *prefix)
+{
+  FILE *file = NULL;
+  uint8_t upper[HDL_NAME_MAX];
+  size_t len = strlen(prefix);
+  int32_t status = SYSTEM_SUCCESS;
+
+  if( !ctx->built || (len >= HDL_NAME_MAX) || ((file = fopen(path, "w")) == NULL) )
+  {
+    return HDL_FAILURE;
+  }
+  for(size_t i = 0U; i <= len; i++)
+  {
+    upper[i] = (uint8_t)(((prefix[i] >= 'a') && (prefix[i] <= 'z')) ? (prefix[i] - 'a' + 'A') : prefix[i]);
+  }
+
+  fprintf(file, "/*\n * %s.hdl as a levelized Nand netlist: %u IN bits, %u OUT bits, %u DFFs,\n"
+                " * %u memories, %u gates in %u levels. Bit-sliced: each uint64_t signal\n"
+                " * carries 64 independent test vectors, bit j for vector j. Written by n2thdl.\n */\n\n"
+                "#include <stdint.h>\n#include <string.h>\n\n",
+          ctx->chips[ctx->top].name, ctx->stats.inputs, ctx->stats.outputs, ctx->stats.dffs,
+          ctx->stats.memories, ctx->stats.gates, ctx->stats.levels);
+  fprintf(file, "#define %s_SIGNALS (%uU)\n", upper, ctx->stats.signals);
+  for(uint32_t i = 0U; i < ctx->pinCount; i++)
+  {
+    uint8_t pin[HDL_NAME_MAX];
+
+    for(size_t c = 0U; c < HDL_NAME_MAX; c++)
+    {
+      const char ch = ctx->pins[i].name[c];
+
+      pin[c] = (uint8_t)(((ch >= 'a') && (ch <= 'z')) ? (ch - 'a' + 'A') : ch);
+      if(ch == '\0')
+      {
+        break;
+      }
+    }
+    fprintf(file, "#define %s_%s (%uU) /* %s %s[%u], bit 0 first */\n", upper, pin, ctx->pins[i].offset,
+            ctx->pins[i].output ? "OUT" : "IN", ctx->pins[i].name, ctx->pins[i].width);
+  }
+
+  for(uint32_t m = 0U; m < ctx->memoryCount; m++)
+  {
+    fprintf(file, "#define %s_MEMORY%u (%uU) /* %s, %u uint16_t words per vector, vector j's at j * %u */\n", upper, m,
+            ctx->memories[m].base, hdlMemoryDefs[ctx->memories[m].def].name, ctx->memories[m].words, ctx->memories[m].words);
+  }
+
+  fprintf(file, "\n/* Power on */\nvoid %s_reset(uint64_t *s)\n{\n  memset(s, 0, %s_SIGNALS * sizeof(uint64_t));\n"
+                "  s[1] = ~(uint64_t)0U;\n}\n\n", prefix, upper);
+  if(ctx->memoryCount != 0U)
+  {
+    /* The same as hdlMemoryRead() and hdlMemoryWrite() */
+    fprintf(file, "/* out of a memory for all 64 vectors */\n"
+                  "void %s_read(uint64_t *s, const uint32_t *address, uint32_t bits, uint32_t out, uint32_t base, uint32_t words)\n"
+                  "{\n  const uint16_t *m = (const uint16_t *)&s[base];\n  uint32_t a[64] = { 0 };\n  uint64_t o[16] = { 0 };\n\n"
+                  "  for(uint32_t bit = 0U; bit < bits; bit++)\n  {\n    for(uint32_t j = 0U; j < 64U; j++)\n    {\n"
+                  "      a[j] |= (uint32_t)((s[address[bit]] >> j) & 1U) << bit;\n    }\n  }\n"
+                  "  for(uint32_t j = 0U; j < 64U; j++)\n  {\n    uint32_t w = m[(j * words) + a[j]];\n\n"
+                  "    for(uint32_t bit = 0U; bit < 16U; bit++)\n    {\n      o[bit] |= (uint64_t)((w >> bit) & 1U) << j;\n    }\n  }\n"
+                  "  memcpy(&s[out], o, sizeof(o));\n}\n\n"
+                  "/* in at address, for the vectors with load set */\n"
+                  "void %s_write(uint64_t *s, const uint32_t *address, uint32_t bits, const uint32_t *in, uint32_t load, uint32_t base, uint32_t words)\n"
+                  "{\n  uint16_t *m = (uint16_t *)&s[base];\n\n"
+                  "  for(uint32_t j = 0U; j < 64U; j++)\n  {\n    uint32_t a = 0U;\n    uint32_t w = 0U;\n\n"
+                  "    if(!((s[load] >> j) & 1U))\n    {\n      continue;\n    }\n"
+                  "    for(uint32_t bit = 0U; bit < bits; bit++)\n    {\n      a |= (uint32_t)((s[address[bit]] >> j) & 1U) << bit;\n    }\n"
+                  "    for(uint32_t bit = 0U; bit < 16U; bit++)\n    {\n      w |= (uint32_t)((s[in[bit]] >> j) & 1U) << bit;\n    }\n"
+                  "    m[(j * words) + a] = (uint16_t)w;\n  }\n}\n\n", prefix, prefix);
+  }
+  fprintf(file, "/* Settles the gates for the IN pins and the DFF states */\nvoid %s_eval(uint64_t *s)\n{\n", prefix);
+  for(uint32_t level = 0U, m = 0U; level < ctx->stats.levels; level++)
+  {
+    fprintf(file, "  /* Level %u */\n", level + 1U);
+    for( ; (m < ctx->memoryCount) && (ctx->memories[m].level == (level + 1U)); m++)
+    {
+      fprintf(file, "  %s_read(s, (const uint32_t[]){ ", prefix);
+      hdlSlotsWrite(file, ctx->memories[m].address, ctx->memories[m].addressBits);
+      fprintf(file, " }, %uU, %uU, %uU, %uU);\n", ctx->memories[m].addressBits, ctx->memories[m].out,
+              ctx->memories[m].base, ctx->memories[m].words);
+    }
+    for(uint32_t g = ctx->levelStart[level]; g < ctx->levelStart[level + 1U]; g++)
+    {
+      fprintf(file, "  s[%u] = ~(s[%u] & s[%u]);\n", ctx->gates[g].out, ctx->gates[g].a, ctx->gates[g].b);
+    }
+  }
+  fprintf(file, "  /* OUT pins */\n");
+  for(uint32_t i = 0U; i < ctx->stats.outputs; i++)
+  {
+    fprintf(file, "  s[%u] = s[%u];\n", ctx->outputBase + i, ctx->copies[i]);
+  }
+
+  fprintf(file, "}\n\n/* Clock edge, %s_eval() again for the outputs */\nvoid %s_tick(uint64_t *s)\n{\n", prefix, prefix);
+  for(uint32_t i = 0U; i < ctx->stats.dffs; i++)
+  {
+    fprintf(file, "  s[%u] = s[%u];\n", ctx->nextBase + i, ctx->dffInputs[i]);
+  }
+  for(uint32_t m = 0U; m < ctx->memoryCount; m++)
+  {
+    fprintf(file, "  %s_write(s, (const uint32_t[]){ ", prefix);
+    hdlSlotsWrite(file, ctx->memories[m].address, ctx->memories[m].addressBits);
+    fprintf(file, " }, %uU,\n            (const uint32_t[]){ ", ctx->memories[m].addressBits);
+    hdlSlotsWrite(file, ctx->memories[m].in, HDL_WORD_BITS);
+    fprintf(file, " }, %uU, %uU, %uU);\n", ctx->memories[m].load, ctx->memories[m].base, ctx->memories[m].words);
+  }
+  if(ctx->stats.dffs != 0U)
+  {
+    fprintf(file, "  memcpy(&s[%u], &s[%u], %uU * sizeof(uint64_t));\n", ctx->dffBase, ctx->nextBase, ctx->stats.dffs);
+  }
+  else if(ctx->memoryCount == 0U)
+  {
+    fprintf(file, "  (void)s;\n");
+  }
+  fprintf(file, "}\n");
+
+  status = ferror(file) ? SYSTEM_FAILURE : SYSTEM_SUCCESS;
+  status = (fclose(file) == 0) ? status : SYSTEM_FAILURE;
+
+  return (status == SYSTEM_SUCCESS) ? HDL_SUCCESS : HDL_FAILURE;
+}
+
+/* slots as "a, b, c", 0 for none (an address of a one-word memory) */
+void hdlSlotsWrite(FILE *file, const uint32_t *slots, uint32_t count)
+{
+  fprintf(file, "%uU", (count != 0U) ? slots[0] : 0U);
+  for(uint32_t i = 1U; i < count; i++)
+  {
+    fprintf(file, ", %uU", slots[i]);
+  }
+}
+
+/* Chip by name: already read, a primitive, or Name.hdl on the search path */
+int32_t hdlChipFind(hdl_ctx *ctx, const uint8_t *name, uint32_t *index)
+{
+  static const Hdl_Pin_Def nandPins[3] = { { "a", 1U, 0U }, { "b", 1U, 1U }, { "out", 1U, 2U } };
+  static const Hdl_Pin_Def dffPins[2] = { { "in", 1U, 0U }, { "out", 1U, 1U } };
+  uint8_t path[HDL_PATH_MAX];
+
+  /* The CPU's A and D registers are built-in Registers */
+  if( !strcmp(name, "ARegister") || !strcmp(name, "DRegister") )
+  {
+    name = (const uint8_t *)"Register";
+  }
+
+  for(uint32_t i = 0U; i < ctx->chipCount; i++)
+  {
+    if(!strcmp(ctx->chips[i].name, name))
+    {
+      *index = i;
+      return SYSTEM_SUCCESS;
+    }
+  }
+
+  if( !strcmp(name, "Nand") || !strcmp(name, "DFF") )
+  {
+    uint32_t nand = !strcmp(name, "Nand");
+    Hdl_Chip *chip = NULL;
+
+    if(growArray((void **)&ctx->chips, &ctx->chipSize, sizeof(Hdl_Chip), ctx->chipCount + 1U) != SYSTEM_SUCCESS)
+    {
+      return SYSTEM_FAILURE;
+    }
+    chip = &ctx->chips[ctx->chipCount];
+    memset(chip, 0, sizeof(*chip));
+    strcpy(chip->name, name);
+    strcpy(chip->path, "(built-in)");
+    chip->kind = nand ? HDL_CHIP_NAND : HDL_CHIP_DFF;
+    chip->inputs = nand ? 2U : 1U;
+    chip->outputs = 1U;
+    chip->pinBits = chip->inputs + 1U;
+    chip->pins = malloc(sizeof(nandPins));
+    if(chip->pins == NULL)
+    {
+      return SYSTEM_FAILURE;
+    }
+    memcpy(chip->pins, nand ? nandPins : dffPins, nand ? sizeof(nandPins) : sizeof(dffPins));
+    chip->memory = HDL_NONE;
+    *index = ctx->chipCount++;
+    return SYSTEM_SUCCESS;
+  }
+
+  for(uint32_t m = 0U; m < HDL_MEMORY_DEFS; m++)
+  {
+    const Hdl_Memory_Def *def = &hdlMemoryDefs[m];
+    const char *names[4];
+    uint32_t widths[4];
+    uint32_t count = 0U;
+    Hdl_Chip *chip = NULL;
+
+    if( !def->builtIn || strcmp(name, def->name) )
+    {
+      continue;
+    }
+    if(growArray((void **)&ctx->chips, &ctx->chipSize, sizeof(Hdl_Chip), ctx->chipCount + 1U) != SYSTEM_SUCCESS)
+    {
+      return SYSTEM_FAILURE;
+    }
+    chip = &ctx->chips[ctx->chipCount];
+    memset(chip, 0, sizeof(*chip));
+    strcpy(chip->name, name);
+    strcpy(chip->path, "(built-in)");
+    chip->kind = HDL_CHIP_MEMORY;
+    chip->memory = m;
+
+    /* in[16], load and address[n] as far as it has them, then out[16] */
+    if(def->writable)
+    {
+      names[count] = "in";
+      widths[count++] = HDL_WORD_BITS;
+      names[count] = "load";
+      widths[count++] = 1U;
+    }
+    if(def->addressBits != 0U)
+    {
+      names[count] = "address";
+      widths[count++] = def->addressBits;
+    }
+    names[count] = "out";
+    widths[count++] = HDL_WORD_BITS;
+    chip->pins = malloc(count * sizeof(Hdl_Pin_Def));
+    if(chip->pins == NULL)
+    {
+      return SYSTEM_FAILURE;
+    }
+    for(uint32_t i = 0U; i < count; i++)
+    {
+      strcpy(chip->pins[i].name, names[i]);
+      chip->pins[i].width = widths[i];
+      chip->pins[i].first = chip->pinBits;
+      chip->pinBits += widths[i];
+    }
+    chip->inputs = count - 1U;
+    chip->outputs = 1U;
+    *index = ctx->chipCount++;
+    return SYSTEM_SUCCESS;
+  }
+
+  for(uint32_t i = 0U; i < ctx->pathCount; i++)
+  {
+    FILE *file = NULL;
+
+    snprintf(path, sizeof(path), "%s/%s.hdl", ctx->paths[i], name);
+    if((file = fopen(path, "rb")) != NULL)
+    {
+      fclose(file);
+      return hdlChipLoad(ctx, name, path, index);
+    }
+  }
+
+  return SYSTEM_FAILURE;
+}
+
+/* Reads, parses and checks one chip; its parts are loaded on the way */
+int32_t hdlChipLoad(hdl_ctx *ctx, const uint8_t *name, const uint8_t *path, uint32_t *index)
+{
+  uint8_t *text = NULL;
+  size_t len = 0U;
+  int32_t status = SYSTEM_SUCCESS;
+  uint32_t chip = ctx->chipCount;
+
+  if(hdlFileRead(path, &text, &len) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Couldn't read %s\n", path);
+    return SYSTEM_FAILURE;
+  }
+  if(growArray((void **)&ctx->chips, &ctx->chipSize, sizeof(Hdl_Chip), ctx->chipCount + 1U) != SYSTEM_SUCCESS)
+  {
+    free(text);
+    return SYSTEM_FAILURE;
+  }
+  memset(&ctx->chips[chip], 0, sizeof(Hdl_Chip));
+  strcpy(ctx->chips[chip].path, path);
+  ctx->chips[chip].kind = HDL_CHIP_PARSED;
+  ctx->chips[chip].memory = HDL_NONE;
+  ctx->chipCount++;
+
+  status = hdlChipParse(ctx, chip, text, len);
+  free(text);
+  if( (status == SYSTEM_SUCCESS) && strcmp(ctx->chips[chip].name, name) )
+  {
+    hdlError(path, 1U, "declares CHIP %s, expected %s", ctx->chips[chip].name, name);
+    status = SYSTEM_FAILURE;
+  }
+  if(status == SYSTEM_SUCCESS)
+  {
+    status = hdlChipCheck(ctx, chip);
+    ctx->chips[chip].memory = hdlMemoryMatch(&ctx->chips[chip]);
+  }
+
+  if(status != SYSTEM_SUCCESS)
+  {
+    /* Keeps the name out of the lookups, the arrays are freed with the context */
+    ctx->chips[chip].name[0] = '\0';
+    return SYSTEM_FAILURE;
+  }
+  *index = chip;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* CHIP Name { IN pins; OUT pins; PARTS: parts } */
+int32_t hdlChipParse(hdl_ctx *ctx, uint32_t index, const uint8_t *text, size_t len)
+{
+  Hdl_Chip *chip = &ctx->chips[index];
+  Hdl_Lexer lex;
+
+  lex.pos = text;
+  lex.end = text + len;
+  lex.path = chip->path;
+  lex.line = 1U;
+  hdlNext(&lex);
+
+  if(!hdlKeyword(&lex, "CHIP") || (lex.kind != HDL_TOKEN_NAME))
+  {
+    hdlError(lex.path, lex.line, "expected CHIP Name");
+    return SYSTEM_FAILURE;
+  }
+  strcpy(chip->name, lex.text);
+  hdlNext(&lex);
+  if(hdlExpect(&lex, '{') != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  /* IN and OUT before PARTS */
+  while(1)
+  {
+    if(hdlKeyword(&lex, "IN"))
+    {
+      if(chip->outputs != 0U)
+      {
+        hdlError(lex.path, lex.line, "IN pins after OUT");
+        return SYSTEM_FAILURE;
+      }
+      if(hdlPinsParse(&lex, chip, &chip->inputs) != SYSTEM_SUCCESS)
+      {
+        return SYSTEM_FAILURE;
+      }
+    }
+    else if(hdlKeyword(&lex, "OUT"))
+    {
+      if(hdlPinsParse(&lex, chip, &chip->outputs) != SYSTEM_SUCCESS)
+      {
+        return SYSTEM_FAILURE;
+      }
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if(hdlKeyword(&lex, "BUILTIN"))
+  {
+    hdlError(lex.path, lex.line, "built-in chip %s has no gates to flatten", chip->name);
+    return SYSTEM_FAILURE;
+  }
+  if( !hdlKeyword(&lex, "PARTS") || (hdlExpect(&lex, ':') != SYSTEM_SUCCESS) )
+  {
+    hdlError(lex.path, lex.line, "expected PARTS:");
+    return SYSTEM_FAILURE;
+  }
+  while( (lex.kind == HDL_TOKEN_NAME) )
+  {
+    if(hdlPartParse(&lex, chip) != SYSTEM_SUCCESS)
+    {
+      return SYSTEM_FAILURE;
+    }
+  }
+
+  return hdlExpect(&lex, '}');
+}
+
+/* name or name[width], comma separated up to ';', appended to the pins and counted in *count */
+int32_t hdlPinsParse(Hdl_Lexer *lex, Hdl_Chip *chip, uint32_t *count)
+{
+  do
+  {
+    Hdl_Pin_Def pin;
+
+    if(lex->kind != HDL_TOKEN_NAME)
+    {
+      hdlError(lex->path, lex->line, "expected a pin name");
+      return SYSTEM_FAILURE;
+    }
+    strcpy(pin.name, lex->text);
+    pin.width = 1U;
+    pin.first = chip->pinBits;
+    hdlNext(lex);
+    if(hdlAccept(lex, '['))
+    {
+      if( (lex->kind != HDL_TOKEN_NUMBER) || (lex->number == 0U) || (lex->number > HDL_PART_BITS) )
+      {
+        hdlError(lex->path, lex->line, "expected the width of %s", pin.name);
+        return SYSTEM_FAILURE;
+      }
+      pin.width = lex->number;
+      hdlNext(lex);
+      if(hdlExpect(lex, ']') != SYSTEM_SUCCESS)
+      {
+        return SYSTEM_FAILURE;
+      }
+    }
+
+    if(growArray((void **)&chip->pins, &chip->pinSize, sizeof(Hdl_Pin_Def), chip->inputs + chip->outputs + 1U) != SYSTEM_SUCCESS)
+    {
+      return SYSTEM_FAILURE;
+    }
+    chip->pins[chip->inputs + chip->outputs] = pin;
+    (*count)++;
+    chip->pinBits += pin.width;
+  } while(hdlAccept(lex, ','));
+
+  return hdlExpect(lex, ';');
+}
+
+/* Part(pin=signal, ...); */
+int32_t hdlPartParse(Hdl_Lexer *lex, Hdl_Chip *chip)
+{
+  Hdl_Part part;
+
+  strcpy(part.name, lex->text);
+  part.chip = HDL_NONE;
+  part.firstConn = chip->connCount;
+  part.connCount = 0U;
+  part.line = lex->line;
+  hdlNext(lex);
+  if(hdlExpect(lex, '(') != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  do
+  {
+    Hdl_Conn conn;
+
+    memset(&conn, 0, sizeof(conn));
+    conn.line = lex->line;
+    if( (hdlRefParse(lex, &conn.pin) != SYSTEM_SUCCESS) || (hdlExpect(lex, '=') != SYSTEM_SUCCESS) ||
+        (hdlRefParse(lex, &conn.signal) != SYSTEM_SUCCESS) )
+    {
+      return SYSTEM_FAILURE;
+    }
+    if(growArray((void **)&chip->conns, &chip->connSize, sizeof(Hdl_Conn), chip->connCount + 1U) != SYSTEM_SUCCESS)
+    {
+      return SYSTEM_FAILURE;
+    }
+    chip->conns[chip->connCount++] = conn;
+    part.connCount++;
+  } while(hdlAccept(lex, ','));
+
+  if( (hdlExpect(lex, ')') != SYSTEM_SUCCESS) || (hdlExpect(lex, ';') != SYSTEM_SUCCESS) ||
+      (growArray((void **)&chip->parts, &chip->partSize, sizeof(Hdl_Part), chip->partCount + 1U) != SYSTEM_SUCCESS) )
+  {
+    return SYSTEM_FAILURE;
+  }
+  chip->parts[chip->partCount++] = part;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* name, name[i] or name[lo..hi] */
+int32_t hdlRefParse(Hdl_Lexer *lex, Hdl_Ref *ref)
+{
+  if(lex->kind != HDL_TOKEN_NAME)
+  {
+    hdlError(lex->path, lex->line, "expected a pin name");
+    return SYSTEM_FAILURE;
+  }
+  strcpy(ref->name, lex->text);
+  ref->ranged = 0U;
+  hdlNext(lex);
+
+  if(hdlAccept(lex, '['))
+  {
+    if(lex->kind != HDL_TOKEN_NUMBER)
+    {
+      hdlError(lex->path, lex->line, "expected a bit of %s", ref->name);
+      return SYSTEM_FAILURE;
+    }
+    ref->ranged = 1U;
+    ref->lo = lex->number;
+    ref->hi = lex->number;
+    hdlNext(lex);
+    if(lex->kind == HDL_TOKEN_RANGE)
+    {
+      hdlNext(lex);
+      if( (lex->kind != HDL_TOKEN_NUMBER) || (lex->number < ref->lo) )
+      {
+        hdlError(lex->path, lex->line, "expected the last bit of %s", ref->name);
+        return SYSTEM_FAILURE;
+      }
+      ref->hi = lex->number;
+      hdlNext(lex);
+    }
+    return hdlExpect(lex, ']');
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Next token, past blanks and comments */
+void hdlNext(Hdl_Lexer *lex)
+{
+  while(lex->pos < lex->end)
+  {
+    if(*lex->pos == '\n')
+    {
+      lex->line++;
+      lex->pos++;
+    }
+    else if( (*lex->pos == ' ') || (*lex->pos == '\t') || (*lex->pos == '\r') )
+    {
+      lex->pos++;
+    }
+    else if( (*lex->pos == '/') && ((lex->pos + 1) < lex->end) && (lex->pos[1] == '/') )
+    {
+      while( (lex->pos < lex->end) && (*lex->pos != '\n') )
+      {
+        lex->pos++;
+      }
+    }
+    else if( (*lex->pos == '/') && ((lex->pos + 1) < lex->end) && (lex->pos[1] == '*') )
+    {
+      for(lex->pos += 2; (lex->pos < lex->end) && !((*lex->pos == '*') && ((lex->pos + 1) < lex->end) && (lex->pos[1] == '/')); lex->pos++)
+      {
+        lex->line += (*lex->pos == '\n') ? 1U : 0U;
+      }
+      lex->pos = (lex->pos < lex->end) ? (lex->pos + 2) : lex->end;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  if(lex->pos >= lex->end)
+  {
+    lex->kind = HDL_TOKEN_END;
+  }
+  else if( ((*lex->pos | 0x20) >= 'a') && ((*lex->pos | 0x20) <= 'z') )
+  {
+    uint32_t len = 0U;
+
+    while( (lex->pos < lex->end) && ((((*lex->pos | 0x20) >= 'a') && ((*lex->pos | 0x20) <= 'z')) ||
+           ((*lex->pos >= '0') && (*lex->pos <= '9')) || (*lex->pos == '_')) )
+    {
+      if(len == (HDL_NAME_MAX - 1U))
+      {
+        hdlError(lex->path, lex->line, "name longer than %u characters", HDL_NAME_MAX - 1U);
+        lex->kind = HDL_TOKEN_ERROR;
+        return;
+      }
+      lex->text[len++] = *lex->pos++;
+    }
+    lex->text[len] = '\0';
+    lex->kind = HDL_TOKEN_NAME;
+  }
+  else if( (*lex->pos >= '0') && (*lex->pos <= '9') )
+  {
+    lex->number = 0U;
+    while( (lex->pos < lex->end) && (*lex->pos >= '0') && (*lex->pos <= '9') && (lex->number < 100000U) )
+    {
+      lex->number = (lex->number * 10U) + (uint32_t)(*lex->pos++ - '0');
+    }
+    lex->kind = HDL_TOKEN_NUMBER;
+  }
+  else if( (*lex->pos == '.') && ((lex->pos + 1) < lex->end) && (lex->pos[1] == '.') )
+  {
+    lex->pos += 2;
+    lex->kind = HDL_TOKEN_RANGE;
+  }
+  else
+  {
+    lex->text[0] = *lex->pos++;
+    lex->text[1] = '\0';
+    lex->kind = HDL_TOKEN_SYMBOL;
+  }
+}
+
+/* Consumes the symbol if it is next */
+int32_t hdlAccept(Hdl_Lexer *lex, uint8_t symbol)
+{
+  if( (lex->kind == HDL_TOKEN_SYMBOL) && (lex->text[0] == symbol) )
+  {
+    hdlNext(lex);
+    return 1;
+  }
+
+  return 0;
+}
+
+int32_t hdlExpect(Hdl_Lexer *lex, uint8_t symbol)
+{
+  if(!hdlAccept(lex, symbol))
+  {
+    hdlError(lex->path, lex->line, "expected '%c'", symbol);
+    return SYSTEM_FAILURE;
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Consumes the keyword if it is next */
+int32_t hdlKeyword(Hdl_Lexer *lex, const char *word)
+{
+  if( (lex->kind == HDL_TOKEN_NAME) && !strcmp(lex->text, word) )
+  {
+    hdlNext(lex);
+    return 1;
+  }
+
+  return 0;
+}
+
+void hdlError(const uint8_t *path, uint32_t line, const char *format, ...)
+{
+  va_list args;
+
+  fprintf(stderr, "%s:%u: ", path, line);
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fprintf(stderr, "\n");
+}
+
+int32_t hdlFileRead(const uint8_t *path, uint8_t **text, size_t *len)
+{
+  FILE *file = fopen(path, "rb");
+  long size = 0;
+
+  *text = NULL;
+  if(file == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  if( (fseek(file, 0, SEEK_END) == 0) && ((size = ftell(file)) >= 0) && (fseek(file, 0, SEEK_SET) == 0) )
+  {
+    *text = malloc((size_t)size + 1U);
+  }
+
+  if( (*text == NULL) || (fread(*text, 1U, (size_t)size, file) != (size_t)size) )
+  {
+    free(*text);
+    *text = NULL;
+    fclose(file);
+    return SYSTEM_FAILURE;
+  }
+  *len = (size_t)size;
+  fclose(file);
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * Loads the parts and resolves every connection: OUT pins of parts define
+ * the internal pins and their widths, IN pins of parts may then read any
+ * IN pin of the chip, an internal pin or true/false.
+ */
+int32_t hdlChipCheck(hdl_ctx *ctx, uint32_t index)
+{
+  Hdl_Chip *chip = &ctx->chips[index];
+
+  chip->loading = 1U;
+  for(uint32_t p = 0U; p < chip->partCount; p++)
+  {
+    uint8_t name[HDL_NAME_MAX];
+    uint32_t part = HDL_NONE;
+    uint32_t line = chip->parts[p].line;
+
+    strcpy(name, chip->parts[p].name);
+    if(hdlChipFind(ctx, name, &part) != SYSTEM_SUCCESS)
+    {
+      chip = &ctx->chips[index];
+      hdlError(chip->path, line, "no %s.hdl on the search path", name);
+      return SYSTEM_FAILURE;
+    }
+    chip = &ctx->chips[index];
+    if(ctx->chips[part].loading)
+    {
+      hdlError(chip->path, line, "%s contains itself", name);
+      return SYSTEM_FAILURE;
+    }
+    if(ctx->chips[part].pinBits > HDL_PART_BITS)
+    {
+      hdlError(chip->path, line, "%s has more than %u pin bits", name, HDL_PART_BITS);
+      return SYSTEM_FAILURE;
+    }
+    chip->parts[p].chip = part;
+  }
+  chip->loading = 0U;
+
+  /* OUT pins of the parts first, they define the internal pins */
+  for(uint32_t pass = 0U; pass < 2U; pass++)
+  {
+    for(uint32_t p = 0U; p < chip->partCount; p++)
+    {
+      const Hdl_Chip *part = &ctx->chips[chip->parts[p].chip];
+
+      for(uint32_t c = chip->parts[p].firstConn; c < chip->parts[p].firstConn + chip->parts[p].connCount; c++)
+      {
+        Hdl_Conn *conn = &chip->conns[c];
+        uint32_t width = 0U;
+        uint32_t pinIndex = HDL_NONE;
+        uint32_t signal = HDL_NONE;
+        uint8_t driving = 0U;
+
+        if(hdlPinFindDef(part, conn->pin.name, &pinIndex) != SYSTEM_SUCCESS)
+        {
+          hdlError(chip->path, conn->line, "%s has no pin %s", part->name, conn->pin.name);
+          return SYSTEM_FAILURE;
+        }
+        driving = (pinIndex >= part->inputs);
+        if(driving != (pass == 0U))
+        {
+          continue;
+        }
+        width = part->pins[pinIndex].width;
+        if( conn->pin.ranged && (conn->pin.hi >= width) )
+        {
+          hdlError(chip->path, conn->line, "%s[%u] is past the last bit of %s", conn->pin.name, conn->pin.hi, part->name);
+          return SYSTEM_FAILURE;
+        }
+        width = conn->pin.ranged ? (conn->pin.hi - conn->pin.lo + 1U) : width;
+        conn->pinIndex = pinIndex;
+
+        if( !strcmp(conn->signal.name, "true") || !strcmp(conn->signal.name, "false") )
+        {
+          if(driving || conn->signal.ranged)
+          {
+            hdlError(chip->path, conn->line, "%s can only feed an IN pin", conn->signal.name);
+            return SYSTEM_FAILURE;
+          }
+          conn->signalKind = HDL_SIGNAL_CONST;
+          conn->signalIndex = !strcmp(conn->signal.name, "true") ? HDL_TRUE : HDL_FALSE;
+        }
+        else if(hdlPinFindDef(chip, conn->signal.name, &signal) == SYSTEM_SUCCESS)
+        {
+          const Hdl_Pin_Def *pin = &chip->pins[signal];
+
+          if(driving != (signal >= chip->inputs))
+          {
+            hdlError(chip->path, conn->line, driving ? "IN pin %s can't be driven" : "OUT pin %s can't be read",
+                     conn->signal.name);
+            return SYSTEM_FAILURE;
+          }
+          if( (conn->signal.ranged && (conn->signal.hi >= pin->width)) ||
+              ((conn->signal.ranged ? (conn->signal.hi - conn->signal.lo + 1U) : pin->width) != width) )
+          {
+            hdlError(chip->path, conn->line, "width of %s doesn't match %s.%s", conn->signal.name, part->name, conn->pin.name);
+            return SYSTEM_FAILURE;
+          }
+          conn->signalKind = HDL_SIGNAL_PIN;
+          conn->signalIndex = signal;
+        }
+        else
+        {
+          uint32_t i = 0U;
+
+          for( ; (i < chip->internalCount) && strcmp(chip->internals[i].name, conn->signal.name); i++)
+          {
+          }
+          if(conn->signal.ranged)
+          {
+            hdlError(chip->path, conn->line, "internal pin %s can't have a sub-bus", conn->signal.name);
+            return SYSTEM_FAILURE;
+          }
+          if( !driving && (i == chip->internalCount) )
+          {
+            hdlError(chip->path, conn->line, "internal pin %s is not driven by any part", conn->signal.name);
+            return SYSTEM_FAILURE;
+          }
+          if(i == chip->internalCount)
+          {
+            if(growArray((void **)&chip->internals, &chip->internalSize, sizeof(Hdl_Pin_Def), i + 1U) != SYSTEM_SUCCESS)
+            {
+              return SYSTEM_FAILURE;
+            }
+            strcpy(chip->internals[i].name, conn->signal.name);
+            chip->internals[i].width = width;
+            chip->internals[i].first = chip->internalBits;
+            chip->internalBits += width;
+            chip->internalCount++;
+          }
+          if(chip->internals[i].width != width)
+          {
+            hdlError(chip->path, conn->line, "width of %s doesn't match %s.%s", conn->signal.name, part->name, conn->pin.name);
+            return SYSTEM_FAILURE;
+          }
+          conn->signalKind = HDL_SIGNAL_INTERNAL;
+          conn->signalIndex = i;
+        }
+      }
+    }
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * Wires one instance of the chip to the nodes of its pin bits: a Nand or
+ * DFF becomes that node, a memory an array, a parsed chip gets nodes for
+ * its internal pins and recurses into each part with fresh nodes for the
+ * part's pins.
+ */
+int32_t hdlFlatten(hdl_ctx *ctx, uint32_t index, const uint32_t *pinNodes)
+{
+  const Hdl_Chip *chip = &ctx->chips[index];
+  uint32_t internalBase = ctx->nodeCount;
+
+  if( (chip->kind == HDL_CHIP_MEMORY) || ((chip->memory != HDL_NONE) && (index != ctx->top) && !ctx->structural) )
+  {
+    return hdlMemoryFlatten(ctx, index, pinNodes);
+  }
+  if(chip->kind == HDL_CHIP_NAND)
+  {
+    ctx->nodes[pinNodes[2]].kind = HDL_NODE_NAND;
+    ctx->nodes[pinNodes[2]].a = pinNodes[0];
+    ctx->nodes[pinNodes[2]].b = pinNodes[1];
+    return SYSTEM_SUCCESS;
+  }
+  if(chip->kind == HDL_CHIP_DFF)
+  {
+    ctx->nodes[pinNodes[1]].kind = HDL_NODE_DFF;
+    ctx->nodes[pinNodes[1]].a = pinNodes[0];
+    return SYSTEM_SUCCESS;
+  }
+
+  for(uint32_t bit = 0U; bit < chip->internalBits; bit++)
+  {
+    if(hdlNodeAdd(ctx, HDL_NODE_UNDRIVEN, 0U, 0U) == HDL_NONE)
+    {
+      return SYSTEM_FAILURE;
+    }
+  }
+
+  for(uint32_t p = 0U; p < chip->partCount; p++)
+  {
+    const Hdl_Part *part = &chip->parts[p];
+    const Hdl_Chip *partChip = &ctx->chips[part->chip];
+    uint32_t partNodes[HDL_PART_BITS];
+
+    /* Unconnected IN bits are false */
+    for(uint32_t i = 0U; i < partChip->inputs + partChip->outputs; i++)
+    {
+      for(uint32_t bit = 0U; bit < partChip->pins[i].width; bit++)
+      {
+        partNodes[partChip->pins[i].first + bit] = (i < partChip->inputs) ? hdlNodeAdd(ctx, HDL_NODE_BUF, HDL_FALSE, 0U) :
+                                                   hdlNodeAdd(ctx, HDL_NODE_UNDRIVEN, 0U, 0U);
+        if(partNodes[partChip->pins[i].first + bit] == HDL_NONE)
+        {
+          return SYSTEM_FAILURE;
+        }
+      }
+    }
+
+    for(uint32_t c = part->firstConn; c < part->firstConn + part->connCount; c++)
+    {
+      const Hdl_Conn *conn = &chip->conns[c];
+      const Hdl_Pin_Def *pin = &partChip->pins[conn->pinIndex];
+      uint32_t lo = conn->pin.ranged ? conn->pin.lo : 0U;
+      uint32_t width = conn->pin.ranged ? (conn->pin.hi - conn->pin.lo + 1U) : pin->width;
+      uint32_t signalLo = conn->signal.ranged ? conn->signal.lo : 0U;
+
+      for(uint32_t bit = 0U; bit < width; bit++)
+      {
+        uint32_t partNode = partNodes[pin->first + lo + bit];
+        uint32_t signal = conn->signalIndex;
+
+        if(conn->signalKind == HDL_SIGNAL_PIN)
+        {
+          signal = pinNodes[chip->pins[conn->signalIndex].first + signalLo + bit];
+        }
+        else if(conn->signalKind == HDL_SIGNAL_INTERNAL)
+        {
+          signal = internalBase + chip->internals[conn->signalIndex].first + bit;
+        }
+
+        if(conn->pinIndex < partChip->inputs)
+        {
+          ctx->nodes[partNode].a = signal;
+        }
+        else if(ctx->nodes[signal].kind != HDL_NODE_UNDRIVEN)
+        {
+          hdlError(chip->path, conn->line, "%s is driven by more than one part", conn->signal.name);
+          return SYSTEM_FAILURE;
+        }
+        else
+        {
+          ctx->nodes[signal].kind = HDL_NODE_BUF;
+          ctx->nodes[signal].a = partNode;
+        }
+      }
+    }
+
+    if(hdlFlatten(ctx, part->chip, partNodes) != SYSTEM_SUCCESS)
+    {
+      return SYSTEM_FAILURE;
+    }
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/* HDL_NONE when out of memory */
+uint32_t hdlNodeAdd(hdl_ctx *ctx, uint32_t kind, uint32_t a, uint32_t b)
+{
+  if( (ctx->nodeCount == HDL_VISITING) ||
+      (growArray((void **)&ctx->nodes, &ctx->nodeSize, sizeof(Hdl_Node), ctx->nodeCount + 1U) != SYSTEM_SUCCESS) )
+  {
+    return HDL_NONE;
+  }
+  ctx->nodes[ctx->nodeCount].kind = kind;
+  ctx->nodes[ctx->nodeCount].a = a;
+  ctx->nodes[ctx->nodeCount].b = b;
+
+  return ctx->nodeCount++;
+}
+
+/* A new memory instance, its out bits reading it; the nodes of in, load and address are kept for the reduction */
+int32_t hdlMemoryFlatten(hdl_ctx *ctx, uint32_t index, const uint32_t *pinNodes)
+{
+  const Hdl_Chip *chip = &ctx->chips[index];
+  const Hdl_Memory_Def *def = &hdlMemoryDefs[chip->memory];
+  Hdl_Memory *memory = NULL;
+  uint32_t pin = HDL_NONE;
+
+  if(growArray((void **)&ctx->memories, &ctx->memorySize, sizeof(Hdl_Memory), ctx->memoryCount + 1U) != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+  memory = &ctx->memories[ctx->memoryCount];
+  memset(memory, 0, sizeof(*memory));
+  memory->def = chip->memory;
+  memory->addressBits = def->addressBits;
+  memory->words = 1U << def->addressBits;
+  memory->level = HDL_NONE;
+  memory->load = HDL_FALSE;
+  if(def->writable)
+  {
+    hdlPinFindDef(chip, (const uint8_t *)"in", &pin);
+    for(uint32_t bit = 0U; bit < HDL_WORD_BITS; bit++)
+    {
+      memory->in[bit] = pinNodes[chip->pins[pin].first + bit];
+    }
+    hdlPinFindDef(chip, (const uint8_t *)"load", &pin);
+    memory->load = pinNodes[chip->pins[pin].first];
+  }
+  if(def->addressBits != 0U)
+  {
+    hdlPinFindDef(chip, (const uint8_t *)"address", &pin);
+    for(uint32_t bit = 0U; bit < def->addressBits; bit++)
+    {
+      memory->address[bit] = pinNodes[chip->pins[pin].first + bit];
+    }
+  }
+  hdlPinFindDef(chip, (const uint8_t *)"out", &pin);
+  for(uint32_t bit = 0U; bit < HDL_WORD_BITS; bit++)
+  {
+    Hdl_Node *node = &ctx->nodes[pinNodes[chip->pins[pin].first + bit]];
+
+    node->kind = HDL_NODE_MEMORY;
+    node->a = ctx->memoryCount;
+    node->b = bit;
+  }
+  ctx->memoryCount++;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Entry of hdlMemoryDefs a parsed chip can be replaced by: the name and in[16], load, address[n], out[16] */
+uint32_t hdlMemoryMatch(const Hdl_Chip *chip)
+{
+  for(uint32_t m = 0U; m < HDL_MEMORY_DEFS; m++)
+  {
+    const Hdl_Memory_Def *def = &hdlMemoryDefs[m];
+    uint32_t in = HDL_NONE;
+    uint32_t load = HDL_NONE;
+    uint32_t address = HDL_NONE;
+    uint32_t out = HDL_NONE;
+
+    if( !def->builtIn && !strcmp(chip->name, def->name) && (chip->inputs == 3U) && (chip->outputs == 1U) &&
+        (hdlPinFindDef(chip, (const uint8_t *)"in", &in) == SYSTEM_SUCCESS) &&
+        (hdlPinFindDef(chip, (const uint8_t *)"load", &load) == SYSTEM_SUCCESS) &&
+        (hdlPinFindDef(chip, (const uint8_t *)"address", &address) == SYSTEM_SUCCESS) &&
+        (hdlPinFindDef(chip, (const uint8_t *)"out", &out) == SYSTEM_SUCCESS) &&
+        (chip->pins[in].width == HDL_WORD_BITS) && (chip->pins[load].width == 1U) &&
+        (chip->pins[address].width == def->addressBits) && (chip->pins[out].width == HDL_WORD_BITS) )
+    {
+      return m;
+    }
+  }
+
+  return HDL_NONE;
+}
+
+/* out of all 64 vectors: their addresses gathered from the lanes, the words scattered back */
+void hdlMemoryRead(const Hdl_Memory *memory, uint64_t *signals)
+{
+  const uint16_t *words = (const uint16_t *)&signals[memory->base];
+  uint32_t address[HDL_LANES];
+  uint64_t out[HDL_WORD_BITS];
+
+  memset(address, 0, sizeof(address));
+  memset(out, 0, sizeof(out));
+  for(uint32_t bit = 0U; bit < memory->addressBits; bit++)
+  {
+    uint64_t lanes = signals[memory->address[bit]];
+
+    for(uint32_t lane = 0U; lane < HDL_LANES; lane++)
+    {
+      address[lane] |= (uint32_t)((lanes >> lane) & 1U) << bit;
+    }
+  }
+  for(uint32_t lane = 0U; lane < HDL_LANES; lane++)
+  {
+    uint32_t word = words[(lane * memory->words) + address[lane]];
+
+    for(uint32_t bit = 0U; bit < HDL_WORD_BITS; bit++)
+    {
+      out[bit] |= (uint64_t)((word >> bit) & 1U) << lane;
+    }
+  }
+  memcpy(&signals[memory->out], out, sizeof(out));
+}
+
+/* in at address, for the vectors with load set */
+void hdlMemoryWrite(const Hdl_Memory *memory, uint64_t *signals)
+{
+  uint16_t *words = (uint16_t *)&signals[memory->base];
+  uint64_t load = signals[memory->load];
+
+  for(uint32_t lane = 0U; load != 0U; lane++, load >>= 1)
+  {
+    uint32_t address = 0U;
+    uint32_t word = 0U;
+
+    if(!(load & 1U))
+    {
+      continue;
+    }
+    for(uint32_t bit = 0U; bit < memory->addressBits; bit++)
+    {
+      address |= (uint32_t)((signals[memory->address[bit]] >> lane) & 1U) << bit;
+    }
+    for(uint32_t bit = 0U; bit < HDL_WORD_BITS; bit++)
+    {
+      word |= (uint32_t)((signals[memory->in[bit]] >> lane) & 1U) << bit;
+    }
+    words[(lane * memory->words) + address] = (uint16_t)word;
+  }
+}
+
+/*
+ * Value of a node, through its wires. DFFs become values at once with the
+ * node of their data input in a, hdl_build() reduces those afterwards, and
+ * so do the in and load of memories, whose reads wait for the address.
+ */
+int32_t hdlReduce(hdl_ctx *ctx, uint32_t node, uint32_t *memo, uint32_t *value)
+{
+  uint32_t head = node;
+  uint32_t a = HDL_NONE;
+  uint32_t b = HDL_NONE;
+
+  while(ctx->nodes[node].kind == HDL_NODE_BUF)
+  {
+    node = ctx->nodes[node].a;
+  }
+
+  if(memo[node] == HDL_VISITING)
+  {
+    fprintf(stderr, "%s: a loop of gates without a DFF, the outputs never settle\n", ctx->chips[ctx->top].path);
+    return SYSTEM_FAILURE;
+  }
+  if(memo[node] != HDL_NONE)
+  {
+    *value = memo[node];
+    memo[head] = *value;
+    return SYSTEM_SUCCESS;
+  }
+
+  switch(ctx->nodes[node].kind)
+  {
+    case HDL_NODE_DFF:
+      *value = hdlValueAdd(ctx, HDL_NODE_DFF, ctx->nodes[node].a, 0U, 0U);
+      break;
+    case HDL_NODE_MEMORY:
+      a = ctx->nodes[node].a;
+      if(hdlMemoryReduce(ctx, a, memo) != SYSTEM_SUCCESS)
+      {
+        return SYSTEM_FAILURE;
+      }
+      *value = hdlValueAdd(ctx, HDL_NODE_MEMORY, a, ctx->nodes[node].b, ctx->memories[a].level);
+      break;
+    case HDL_NODE_NAND:
+      memo[node] = HDL_VISITING;
+      if( (hdlReduce(ctx, ctx->nodes[node].a, memo, &a) != SYSTEM_SUCCESS) ||
+          (hdlReduce(ctx, ctx->nodes[node].b, memo, &b) != SYSTEM_SUCCESS) )
+      {
+        return SYSTEM_FAILURE;
+      }
+      *value = hdlNand(ctx, a, b);
+      break;
+    default:
+      /* Undriven */
+      *value = HDL_FALSE;
+      break;
+  }
+
+  if(*value == HDL_NONE)
+  {
+    return SYSTEM_FAILURE;
+  }
+  memo[node] = *value;
+  memo[head] = *value;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* The address bits of a memory, its reads come one level after the last of them */
+int32_t hdlMemoryReduce(hdl_ctx *ctx, uint32_t memory, uint32_t *memo)
+{
+  uint32_t level = 0U;
+
+  if(ctx->memories[memory].level == HDL_VISITING)
+  {
+    fprintf(stderr, "%s: a loop of gates without a DFF, the outputs never settle\n", ctx->chips[ctx->top].path);
+    return SYSTEM_FAILURE;
+  }
+  if(ctx->memories[memory].level != HDL_NONE)
+  {
+    return SYSTEM_SUCCESS;
+  }
+
+  ctx->memories[memory].level = HDL_VISITING;
+  for(uint32_t bit = 0U; bit < ctx->memories[memory].addressBits; bit++)
+  {
+    uint32_t value = HDL_NONE;
+
+    if(hdlReduce(ctx, ctx->memories[memory].address[bit], memo, &value) != SYSTEM_SUCCESS)
+    {
+      return SYSTEM_FAILURE;
+    }
+    ctx->memories[memory].address[bit] = value;
+    level = (ctx->values[value].level > level) ? ctx->values[value].level : level;
+  }
+  ctx->memories[memory].level = level + 1U;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Nand of two values, folded and shared; HDL_NONE when out of memory */
+uint32_t hdlNand(hdl_ctx *ctx, uint32_t a, uint32_t b)
+{
+  uint32_t mask = ctx->shareSize - 1U;
+  uint32_t slot = 0U;
+
+  if(a > b)
+  {
+    uint32_t swap = a;
+
+    a = b;
+    b = swap;
+  }
+
+  if(a == HDL_FALSE)
+  {
+    return HDL_TRUE;
+  }
+  if( (a == HDL_TRUE) && (b == HDL_TRUE) )
+  {
+    return HDL_FALSE;
+  }
+  if(a == HDL_TRUE)
+  {
+    a = b;
+  }
+  /* !!x is x, x & !x is false */
+  if( (a == b) && (ctx->values[a].kind == HDL_NODE_NAND) && (ctx->values[a].a == ctx->values[a].b) )
+  {
+    return ctx->values[a].a;
+  }
+  if( ((ctx->values[a].kind == HDL_NODE_NAND) && (ctx->values[a].a == b) && (ctx->values[a].b == b)) ||
+      ((ctx->values[b].kind == HDL_NODE_NAND) && (ctx->values[b].a == a) && (ctx->values[b].b == a)) )
+  {
+    return HDL_TRUE;
+  }
+
+  /* Kept under half full */
+  if((ctx->valueCount * 2U) >= ctx->shareSize)
+  {
+    uint32_t size = (ctx->shareSize == 0U) ? HDL_SHARE_INIT : (ctx->shareSize * 2U);
+    uint32_t *share = malloc((size_t)size * sizeof(uint32_t));
+
+    if(share == NULL)
+    {
+      return HDL_NONE;
+    }
+    memset(share, 0xFF, (size_t)size * sizeof(uint32_t));
+    free(ctx->share);
+    ctx->share = share;
+    ctx->shareSize = size;
+    mask = size - 1U;
+    for(uint32_t v = 0U; v < ctx->valueCount; v++)
+    {
+      if(ctx->values[v].kind == HDL_NODE_NAND)
+      {
+        for(slot = ((ctx->values[v].a * 0x9E3779B1U) ^ (ctx->values[v].b * 0x85EBCA77U)) & mask; share[slot] != HDL_NONE; slot = (slot + 1U) & mask)
+        {
+        }
+        share[slot] = v;
+      }
+    }
+  }
+
+  for(slot = ((a * 0x9E3779B1U) ^ (b * 0x85EBCA77U)) & mask; ctx->share[slot] != HDL_NONE; slot = (slot + 1U) & mask)
+  {
+    const Hdl_Value *value = &ctx->values[ctx->share[slot]];
+
+    if( (value->a == a) && (value->b == b) )
+    {
+      return ctx->share[slot];
+    }
+  }
+  ctx->share[slot] = hdlValueAdd(ctx, HDL_NODE_NAND, a, b,
+                                 1U + ((ctx->values[a].level > ctx->values[b].level) ? ctx->values[a].level : ctx->values[b].level));
+
+  return ctx->share[slot];
+}
+
+/* HDL_NONE when out of memory */
+uint32_t hdlValueAdd(hdl_ctx *ctx, uint32_t kind, uint32_t a, uint32_t b, uint32_t level)
+{
+  if(growArray((void **)&ctx->values, &ctx->valueSize, sizeof(Hdl_Value), ctx->valueCount + 1U) != SYSTEM_SUCCESS)
+  {
+    return HDL_NONE;
+  }
+  ctx->values[ctx->valueCount].kind = kind;
+  ctx->values[ctx->valueCount].a = a;
+  ctx->values[ctx->valueCount].b = b;
+  ctx->values[ctx->valueCount].level = level;
+
+  return ctx->valueCount++;
+}
+
+/*
+ * Signal slots: false, true, the IN bits, the OUT bits, the DFF states,
+ * the out bits of the memories, the gates level by level, the scratch of
+ * the tick and the arrays of the memories. A counting sort on the levels
+ * orders the gates, the memories are ordered by level too.
+ */
+int32_t hdlLevelize(hdl_ctx *ctx, const uint32_t *outputValues, uint32_t dffCount, const uint32_t *dffValues)
+{
+  const Hdl_Chip *top = &ctx->chips[ctx->top];
+  hdl_stats *stats = &ctx->stats;
+  uint32_t *slots = malloc(((size_t)ctx->valueCount + 1U) * sizeof(uint32_t));
+  uint32_t *remap = malloc(((size_t)ctx->memoryCount + 1U) * sizeof(uint32_t));
+  uint32_t memoryBase = 0U;
+  uint32_t gateBase = 0U;
+  uint32_t offset = 2U;
+  uint32_t nameBytes = 0U;
+  char *names = NULL;
+
+  memset(stats, 0, sizeof(*stats));
+  for(uint32_t i = 0U; i < top->inputs + top->outputs; i++)
+  {
+    *((i < top->inputs) ? &stats->inputs : &stats->outputs) += top->pins[i].width;
+    nameBytes += (uint32_t)strlen(top->pins[i].name) + 1U;
+  }
+  stats->dffs = dffCount;
+  for(uint32_t v = 0U; v < ctx->valueCount; v++)
+  {
+    if(ctx->values[v].kind == HDL_NODE_NAND)
+    {
+      stats->gates++;
+      stats->levels = (ctx->values[v].level > stats->levels) ? ctx->values[v].level : stats->levels;
+    }
+  }
+  if(remap == NULL)
+  {
+    free(slots);
+    return SYSTEM_FAILURE;
+  }
+
+  /* Memories by level, an insertion sort as there are only a few */
+  for(uint32_t m = 0U; m < ctx->memoryCount; m++)
+  {
+    Hdl_Memory memory = ctx->memories[m];
+    uint32_t i = stats->memories++;
+
+    memory.out = m;
+    for( ; (i > 0U) && (ctx->memories[i - 1U].level > memory.level); i--)
+    {
+      ctx->memories[i] = ctx->memories[i - 1U];
+    }
+    ctx->memories[i] = memory;
+    stats->levels = (memory.level > stats->levels) ? memory.level : stats->levels;
+  }
+  for(uint32_t m = 0U; m < ctx->memoryCount; m++)
+  {
+    remap[ctx->memories[m].out] = m;
+  }
+
+  ctx->outputBase = 2U + stats->inputs;
+  ctx->dffBase = ctx->outputBase + stats->outputs;
+  memoryBase = ctx->dffBase + dffCount;
+  gateBase = memoryBase + (stats->memories * HDL_WORD_BITS);
+  ctx->nextBase = gateBase + stats->gates;
+  stats->signals = ctx->nextBase + dffCount;
+  for(uint32_t m = 0U; m < ctx->memoryCount; m++)
+  {
+    /* 64 uint16_t words per address */
+    ctx->memories[m].out = memoryBase + (m * HDL_WORD_BITS);
+    ctx->memories[m].base = stats->signals;
+    stats->signals += ctx->memories[m].words * (HDL_LANES / 4U);
+  }
+
+  ctx->gates = malloc(((size_t)stats->gates + 1U) * sizeof(Hdl_Gate));
+  ctx->levelStart = calloc((size_t)stats->levels + 2U, sizeof(uint32_t));
+  ctx->copies = malloc(((size_t)stats->outputs + 1U) * sizeof(uint32_t));
+  ctx->dffInputs = malloc(((size_t)dffCount + 1U) * sizeof(uint32_t));
+  ctx->pins = malloc(((size_t)top->inputs + top->outputs) * sizeof(hdl_pin) + nameBytes);
+  if( (slots == NULL) || (ctx->gates == NULL) || (ctx->levelStart == NULL) || (ctx->copies == NULL) ||
+      (ctx->dffInputs == NULL) || (ctx->pins == NULL) )
+  {
+    free(slots);
+    free(remap);
+    return SYSTEM_FAILURE;
+  }
+
+  /* Pins, their names after the array */
+  names = (char *)&ctx->pins[top->inputs + top->outputs];
+  ctx->pinCount = top->inputs + top->outputs;
+  for(uint32_t i = 0U; i < ctx->pinCount; i++)
+  {
+    strcpy(names, top->pins[i].name);
+    ctx->pins[i].name = names;
+    ctx->pins[i].width = top->pins[i].width;
+    ctx->pins[i].offset = offset;
+    ctx->pins[i].output = (i >= top->inputs);
+    names += strlen(names) + 1U;
+    offset += top->pins[i].width;
+  }
+
+  /* levelStart[l] counts the gates of level l, then becomes the first of them */
+  for(uint32_t v = 0U; v < ctx->valueCount; v++)
+  {
+    if(ctx->values[v].kind == HDL_NODE_NAND)
+    {
+      ctx->levelStart[ctx->values[v].level]++;
+    }
+  }
+  for(uint32_t level = 0U, first = 0U; level <= stats->levels; level++)
+  {
+    uint32_t count = ctx->levelStart[level + 1U];
+
+    ctx->levelStart[level + 1U] = first;
+    first += count;
+  }
+  for(uint32_t i = 0U, dff = 0U; i < ctx->valueCount; i++)
+  {
+    const Hdl_Value *value = &ctx->values[i];
+
+    if(value->kind == HDL_NODE_CONST)
+    {
+      slots[i] = i;
+    }
+    else if(value->kind == HDL_NODE_INPUT)
+    {
+      slots[i] = 2U + value->a;
+    }
+    else if(value->kind == HDL_NODE_DFF)
+    {
+      slots[i] = ctx->dffBase + dff++;
+    }
+    else if(value->kind == HDL_NODE_MEMORY)
+    {
+      slots[i] = memoryBase + (remap[value->a] * HDL_WORD_BITS) + value->b;
+    }
+    else
+    {
+      slots[i] = gateBase + ctx->levelStart[value->level]++;
+    }
+  }
+  /* levelStart[l] is now the first gate of level l + 1, levelStart[0] stays 0 */
+  for(uint32_t i = 0U; i < ctx->valueCount; i++)
+  {
+    if(ctx->values[i].kind == HDL_NODE_NAND)
+    {
+      Hdl_Gate *gate = &ctx->gates[slots[i] - gateBase];
+
+      gate->out = slots[i];
+      gate->a = slots[ctx->values[i].a];
+      gate->b = slots[ctx->values[i].b];
+    }
+  }
+  for(uint32_t i = 0U; i < stats->outputs; i++)
+  {
+    ctx->copies[i] = slots[outputValues[i]];
+  }
+  for(uint32_t i = 0U; i < dffCount; i++)
+  {
+    ctx->dffInputs[i] = slots[ctx->values[dffValues[i]].a];
+  }
+  for(uint32_t m = 0U; m < ctx->memoryCount; m++)
+  {
+    Hdl_Memory *memory = &ctx->memories[m];
+
+    for(uint32_t bit = 0U; bit < HDL_WORD_BITS; bit++)
+    {
+      memory->in[bit] = slots[memory->in[bit]];
+    }
+    memory->load = slots[memory->load];
+    for(uint32_t bit = 0U; bit < memory->addressBits; bit++)
+    {
+      memory->address[bit] = slots[memory->address[bit]];
+    }
+  }
+  free(slots);
+  free(remap);
+
+  return SYSTEM_SUCCESS;
+}
+
+void hdlNetlistFree(hdl_ctx *ctx)
+{
+  free(ctx->pins);
+  free(ctx->gates);
+  free(ctx->levelStart);
+  free(ctx->copies);
+  free(ctx->dffInputs);
+  free(ctx->memories);
+  ctx->pins = NULL;
+  ctx->gates = NULL;
+  ctx->levelStart = NULL;
+  ctx->copies = NULL;
+  ctx->dffInputs = NULL;
+  ctx->memories = NULL;
+  ctx->memoryCount = 0U;
+  ctx->memorySize = 0U;
+  ctx->pinCount = 0U;
+  ctx->built = 0U;
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+}
+
+int32_t hdlPinFindDef(const Hdl_Chip *chip, const uint8_t *name, uint32_t *index)
+{
+  for(uint32_t i = 0U; i < chip->inputs + chip->outputs; i++)
+  {
+    if(!strcmp(chip->pins[i].name, name))
+    {
+      *index = i;
+      return SYSTEM_SUCCESS;
+    }
+  }
+
+  return SYSTEM_FAILURE;
+}
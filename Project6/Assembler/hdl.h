@@ -0,0 +1,133 @@
+/**
+ * @file hdl.h
+ * @brief HDL netlist library: parses the chips of Project1-Project5 in the
+ *        course HDL, flattens the part hierarchy down to Nand gates and DFFs
+ *        and evaluates the levelized netlist bit-sliced, 64 test vectors per
+ *        uint64_t, or writes it out as C doing the same.
+ *
+ * A netlist is a flat array of signals: s[0] is false, s[1] is true, then
+ * every bit of the IN pins, the OUT pins, the DFF states and the gates,
+ * each in their own slot; bit j of every slot belongs to vector j. The
+ * caller owns the array, so any number of threads may evaluate one netlist.
+ *
+ *   hdl_ctx *ctx = hdl_create();
+ *   hdl_stats stats;
+ *   hdl_pin out;
+ *
+ *   hdl_add_path(ctx, "../../Project1");
+ *   if(hdl_build(ctx, "../../Project2/Add16.hdl") == HDL_SUCCESS)
+ *   {
+ *     hdl_get_stats(ctx, &stats);
+ *     s = calloc(stats.signals, sizeof(uint64_t));
+ *     hdl_reset(ctx, s);
+ *     ... set the lanes of the IN pins, hdl_eval(ctx, s) ...
+ *     hdl_pin_find(ctx, "out", &out);  ... s[out.offset + bit] ...
+ *   }
+ *   hdl_destroy(ctx);
+ *
+ * Parse and connection errors are reported on stderr as file:line.
+ */
+#ifndef HDL_H
+#define HDL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HDL_SUCCESS   (1)
+#define HDL_FAILURE   (-1)  /* Unreadable chip, bad HDL, or no netlist built */
+
+#define HDL_LANES     (64U) /* Test vectors per signal word */
+
+typedef struct hdl_ctx hdl_ctx;
+
+/* One IN or OUT pin of the top chip */
+typedef struct
+{
+  const char *name;
+  uint32_t width;
+  uint32_t offset;      /* Signal slot of bit 0, bit i follows at offset + i */
+  int32_t output;
+} hdl_pin;
+
+typedef struct
+{
+  uint32_t inputs;      /* IN bits */
+  uint32_t outputs;     /* OUT bits */
+  uint32_t dffs;
+  uint32_t gates;       /* Nand gates left after constant folding and sharing */
+  uint32_t levels;      /* Gates on the longest path between two clocked or top pins */
+  uint32_t memories;
+  uint32_t signals;     /* uint64_t words of a signal array, the memories included */
+} hdl_stats;
+
+/* One memory of the netlist, in the order of its reads */
+typedef struct
+{
+  const char *chip;     /* RAM16K, Screen, Keyboard, ROM32K ... */
+  uint32_t words;
+  uint32_t offset;      /* Signal slot of its array */
+} hdl_memory;
+
+/* Word address of vector lane of the memory, e.g. a ROM32K to load or a Keyboard to press */
+#define HDL_MEMORY_WORD(signals, memory, lane, address) \
+  (((uint16_t *)&(signals)[(memory)->offset])[((size_t)(lane) * (memory)->words) + (address)])
+
+/* New context searching no directory yet, NULL if out of memory */
+hdl_ctx *hdl_create(void);
+
+void hdl_destroy(hdl_ctx *ctx);
+
+/* Directory searched for Part.hdl, after the directory of the chip being built */
+int32_t hdl_add_path(hdl_ctx *ctx, const char *dir);
+
+/* Non-zero flattens RAM8 ... RAM16K parts to gates like any other chip, for the next builds */
+void hdl_set_structural(hdl_ctx *ctx, int32_t structural);
+
+/*
+ * Builds the netlist of the chip in the file at path (or Chip.hdl on the
+ * search path when path has no ".hdl"). Nand and DFF are the primitives,
+ * ARegister and DRegister are Register.
+ */
+int32_t hdl_build(hdl_ctx *ctx, const char *path);
+
+void hdl_get_stats(const hdl_ctx *ctx, hdl_stats *stats);
+
+/* IN pins first, then OUT pins, in declaration order */
+uint32_t hdl_pin_count(const hdl_ctx *ctx);
+
+int32_t hdl_pin_get(const hdl_ctx *ctx, uint32_t index, hdl_pin *pin);
+
+int32_t hdl_pin_find(const hdl_ctx *ctx, const char *name, hdl_pin *pin);
+
+uint32_t hdl_memory_count(const hdl_ctx *ctx);
+
+int32_t hdl_memory_get(const hdl_ctx *ctx, uint32_t index, hdl_memory *memory);
+
+/* Power on: every signal, DFF and memory word of all 64 vectors false */
+void hdl_reset(const hdl_ctx *ctx, uint64_t *signals);
+
+/* Settles the gates for the IN bits and DFF states in signals */
+void hdl_eval(const hdl_ctx *ctx, uint64_t *signals);
+
+/*
+ * Clock edge: every DFF takes the value at its input and every memory with
+ * load set stores in, hdl_eval() again to see the outputs
+ */
+void hdl_tick(const hdl_ctx *ctx, uint64_t *signals);
+
+/*
+ * Writes the netlist as a C file with <prefix>_reset(), <prefix>_eval() and
+ * <prefix>_tick() over the same signal layout, and a <PREFIX>_<PIN> offset
+ * macro per pin.
+ */
+int32_t hdl_emit_c(const hdl_ctx *ctx, const char *path, const char *prefix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HDL_H */
@@ -0,0 +1,248 @@
+/**
+ * @file hdl_internal.h
+ * @brief Internals of the HDL netlist library (hdl.c): the parsed chips, the
+ *        flattened node graph, the levelized netlist and its memories.
+ *        Programs using the library only need hdl.h.
+ */
+#ifndef HDL_INTERNAL_H
+#define HDL_INTERNAL_H
+
+#include "hasm_internal.h"
+#include "hdl.h"
+
+/* Macro Definitions */
+#define HDL_NAME_MAX     (64U)      /* Longest chip or pin name, with the terminator */
+#define HDL_PATH_MAX     (4096U)
+#define HDL_PART_BITS    (1024U)    /* Pin bits of one part, the flattener keeps them on its stack */
+#define HDL_NONE         (0xFFFFFFFFU)
+#define HDL_VISITING     (0xFFFFFFFEU) /* Reduction of a node in progress: meeting it again is a loop */
+#define HDL_WORD_BITS    (16U)      /* in and out of a memory */
+#define HDL_ADDRESS_MAX  (15U)      /* address bits of the largest memory, ROM32K */
+#define HDL_MEMORY_DEFS  (8U)
+
+/* Node (and reduced value) ids of the constants */
+#define HDL_FALSE        (0U)
+#define HDL_TRUE         (1U)
+
+/* Kinds of chips */
+#define HDL_CHIP_NAND    (0U)
+#define HDL_CHIP_DFF     (1U)
+#define HDL_CHIP_PARSED  (2U)
+#define HDL_CHIP_MEMORY  (3U)       /* Screen, Keyboard, ROM32K: built-in, only ever an array */
+
+/* Kinds of nodes of the flattened graph */
+#define HDL_NODE_UNDRIVEN (0U)      /* An OUT or internal pin bit no part drives: false */
+#define HDL_NODE_CONST   (1U)
+#define HDL_NODE_INPUT   (2U)       /* a: the IN bit of the top chip */
+#define HDL_NODE_BUF     (3U)       /* a: the node it is wired to */
+#define HDL_NODE_NAND    (4U)
+#define HDL_NODE_DFF     (5U)       /* a: the data input, the node is the state */
+#define HDL_NODE_MEMORY  (6U)       /* a: the memory, b: the bit of its out */
+
+/* What the signal side of a connection is */
+#define HDL_SIGNAL_CONST    (0U)    /* signalIndex is HDL_FALSE or HDL_TRUE */
+#define HDL_SIGNAL_PIN      (1U)
+#define HDL_SIGNAL_INTERNAL (2U)
+
+/* Tokens of the HDL */
+#define HDL_TOKEN_END    (0U)
+#define HDL_TOKEN_NAME   (1U)
+#define HDL_TOKEN_NUMBER (2U)
+#define HDL_TOKEN_SYMBOL (3U)       /* text[0] is the character */
+#define HDL_TOKEN_RANGE  (4U)       /* .. */
+#define HDL_TOKEN_ERROR  (5U)
+
+/* Variable Definitions */
+/* A chip evaluated as an array of words behind its in, load, address and out pins */
+typedef struct
+{
+  const char *name;
+  uint32_t addressBits;
+  uint8_t writable;     /* Has in and load */
+  uint8_t builtIn;      /* No HDL: always an array, otherwise only as a part and with the models on */
+} Hdl_Memory_Def;
+
+typedef struct
+{
+  const uint8_t *pos;
+  const uint8_t *end;
+  const uint8_t *path;
+  uint32_t line;
+  uint32_t kind;
+  uint32_t number;
+  uint8_t text[HDL_NAME_MAX];
+} Hdl_Lexer;
+
+typedef struct
+{
+  uint8_t name[HDL_NAME_MAX];
+  uint32_t width;
+  uint32_t first;       /* Bit of the pin in the node list of an instance */
+} Hdl_Pin_Def;
+
+/* pin, pin[i] or pin[lo..hi] on either side of a connection */
+typedef struct
+{
+  uint8_t name[HDL_NAME_MAX];
+  uint32_t lo;
+  uint32_t hi;
+  uint8_t ranged;
+} Hdl_Ref;
+
+/* One part-pin = signal, resolved by hdlChipCheck() */
+typedef struct
+{
+  Hdl_Ref pin;
+  Hdl_Ref signal;
+  uint32_t line;
+  uint32_t pinIndex;    /* In the pins of the part */
+  uint32_t signalKind;  /* HDL_SIGNAL_* */
+  uint32_t signalIndex; /* Pin or internal of the chip */
+} Hdl_Conn;
+
+typedef struct
+{
+  uint8_t name[HDL_NAME_MAX];
+  uint32_t chip;
+  uint32_t firstConn;
+  uint32_t connCount;
+  uint32_t line;
+} Hdl_Part;
+
+typedef struct
+{
+  uint8_t name[HDL_NAME_MAX];
+  uint8_t path[HDL_PATH_MAX];
+  uint32_t kind;
+  uint32_t memory;      /* Its entry of hdlMemoryDefs when the pins match, HDL_NONE otherwise */
+  uint8_t loading;      /* Set while its parts are being loaded, catches a chip containing itself */
+  Hdl_Pin_Def *pins;    /* inputs, then outputs */
+  uint32_t inputs;
+  uint32_t outputs;
+  uint32_t pinBits;     /* All pin bits, the node list of one instance */
+  uint32_t pinSize;
+  Hdl_Pin_Def *internals;
+  uint32_t internalCount;
+  uint32_t internalBits;
+  uint32_t internalSize;
+  Hdl_Part *parts;
+  uint32_t partCount;
+  uint32_t partSize;
+  Hdl_Conn *conns;
+  uint32_t connCount;
+  uint32_t connSize;
+} Hdl_Chip;
+
+typedef struct
+{
+  uint32_t a;
+  uint32_t b;
+  uint32_t kind;
+} Hdl_Node;
+
+/* A value of the reduced, shared netlist; gates are NAND values */
+typedef struct
+{
+  uint32_t kind;        /* HDL_NODE_CONST, _INPUT, _DFF or _NAND */
+  uint32_t a;
+  uint32_t b;
+  uint32_t level;
+} Hdl_Value;
+
+/*
+ * One memory instance. in, load and address hold nodes once flattened,
+ * values once reduced and signal slots in the netlist, where its read
+ * happens at level (after the address bits settle) and its write on the
+ * tick. The words of vector j are ((uint16_t *)&s[base])[j * words ...].
+ */
+typedef struct
+{
+  uint32_t def;
+  uint32_t in[HDL_WORD_BITS];
+  uint32_t load;
+  uint32_t address[HDL_ADDRESS_MAX];
+  uint32_t addressBits;
+  uint32_t words;
+  uint32_t level;       /* HDL_NONE until its address is reduced */
+  uint32_t out;         /* Slot of out[0], the others follow */
+  uint32_t base;
+} Hdl_Memory;
+
+/* One Nand of the levelized netlist: s[out] = ~(s[a] & s[b]) */
+typedef struct
+{
+  uint32_t out;
+  uint32_t a;
+  uint32_t b;
+} Hdl_Gate;
+
+struct hdl_ctx
+{
+  uint8_t **paths;
+  uint32_t pathCount;
+  uint32_t pathSize;
+  Hdl_Chip *chips;
+  uint32_t chipCount;
+  uint32_t chipSize;
+  uint32_t top;
+
+  /* Flattening, freed once the netlist is built */
+  Hdl_Node *nodes;
+  uint32_t nodeCount;
+  uint32_t nodeSize;
+  Hdl_Value *values;
+  uint32_t valueCount;
+  uint32_t valueSize;
+  uint32_t *share;      /* Open addressing of the NAND values by their inputs */
+  uint32_t shareSize;
+  uint8_t structural;   /* RAM8..RAM16K parts flattened to gates too */
+
+  /* The netlist */
+  uint8_t built;
+  hdl_pin *pins;
+  uint32_t pinCount;
+  hdl_stats stats;
+  Hdl_Gate *gates;
+  uint32_t *levelStart; /* First gate of each level, levels + 1 entries */
+  uint32_t *copies;     /* OUT slot i takes copies[i] after the gates */
+  uint32_t *dffInputs;  /* DFF i takes dffInputs[i] on a tick */
+  Hdl_Memory *memories; /* By instance while flattening, by read level in the netlist */
+  uint32_t memoryCount;
+  uint32_t memorySize;
+  uint32_t outputBase;
+  uint32_t dffBase;
+  uint32_t nextBase;    /* Scratch of the tick, after the gates */
+};
+
+extern const Hdl_Memory_Def hdlMemoryDefs[HDL_MEMORY_DEFS];
+
+/* Function Declarations */
+int32_t hdlChipFind(hdl_ctx *ctx, const uint8_t *name, uint32_t *index);
+int32_t hdlChipLoad(hdl_ctx *ctx, const uint8_t *name, const uint8_t *path, uint32_t *index);
+int32_t hdlChipParse(hdl_ctx *ctx, uint32_t index, const uint8_t *text, size_t len);
+int32_t hdlPinsParse(Hdl_Lexer *lex, Hdl_Chip *chip, uint32_t *count);
+int32_t hdlPartParse(Hdl_Lexer *lex, Hdl_Chip *chip);
+int32_t hdlRefParse(Hdl_Lexer *lex, Hdl_Ref *ref);
+void hdlNext(Hdl_Lexer *lex);
+int32_t hdlAccept(Hdl_Lexer *lex, uint8_t symbol);
+int32_t hdlExpect(Hdl_Lexer *lex, uint8_t symbol);
+int32_t hdlKeyword(Hdl_Lexer *lex, const char *word);
+void hdlError(const uint8_t *path, uint32_t line, const char *format, ...);
+int32_t hdlFileRead(const uint8_t *path, uint8_t **text, size_t *len);
+int32_t hdlChipCheck(hdl_ctx *ctx, uint32_t index);
+int32_t hdlFlatten(hdl_ctx *ctx, uint32_t index, const uint32_t *pinNodes);
+int32_t hdlMemoryFlatten(hdl_ctx *ctx, uint32_t index, const uint32_t *pinNodes);
+uint32_t hdlMemoryMatch(const Hdl_Chip *chip);
+int32_t hdlMemoryReduce(hdl_ctx *ctx, uint32_t memory, uint32_t *memo);
+void hdlMemoryRead(const Hdl_Memory *memory, uint64_t *signals);
+void hdlMemoryWrite(const Hdl_Memory *memory, uint64_t *signals);
+uint32_t hdlNodeAdd(hdl_ctx *ctx, uint32_t kind, uint32_t a, uint32_t b);
+int32_t hdlReduce(hdl_ctx *ctx, uint32_t node, uint32_t *memo, uint32_t *value);
+uint32_t hdlNand(hdl_ctx *ctx, uint32_t a, uint32_t b);
+uint32_t hdlValueAdd(hdl_ctx *ctx, uint32_t kind, uint32_t a, uint32_t b, uint32_t level);
+int32_t hdlLevelize(hdl_ctx *ctx, const uint32_t *outputValues, uint32_t dffCount, const uint32_t *dffValues);
+void hdlNetlistFree(hdl_ctx *ctx);
+void hdlSlotsWrite(FILE *file, const uint32_t *slots, uint32_t count);
+int32_t hdlPinFindDef(const Hdl_Chip *chip, const uint8_t *name, uint32_t *index);
+
+#endif /* HDL_INTERNAL_H */
@@ -0,0 +1,540 @@
+/**
+ * @file hemu.c
+ * @brief Hack computer emulator library: the CPU of Project5/CPU.hdl and the
+ *        memory map of Memory.hdl, one instruction per clock.
+ *
+ * Per C-instruction (111a cccc ccdd djjj):
+ * - the ALU takes x = D and y = instruction[12] ? M : A, where M is the word
+ *   at A, and applies zx/nx/zy/ny/f/no = instruction[11..6];
+ * - the output is written to M (d3, through the old A), then loaded into A
+ *   (d1) and D (d2) at the clock edge;
+ * - the jump mux picks JGT/JEQ/JGE/JLT/JNE/JLE/JMP from instruction[2..0]
+ *   against the zr/ng flags of that output and loads the PC with the old A.
+ * An A-instruction loads itself into A. Only C-instructions jump: the mux
+ * legs of CPU.hdl for JGT, JEQ, JGE, JLT and JLE are not gated by
+ * instruction[15] there, the Hack specification the programs are written
+ * against gates all of them.
+ *
+ * Data memory is RAM16K (0-16383), SCREEN (16384-24575) and KBD (24576);
+ * writes to KBD and above are dropped and reads above KBD give 0.
+ * Every write to SCREEN also sets the bit of its row (32 words) in
+ * screenDirty, so a frontend converts only the rows that changed.
+ *
+ * The ROM is decoded once, by hemu_load(), into one Hemu_Op per word: the
+ * A-instructions keep their value, every C-instruction with one of the 28
+ * comp encodings of compFieldLT becomes an op that computes just that
+ * function and either stores to a fixed dest or tests a fixed jump
+ * condition. The run loop then dispatches on the op alone (computed goto
+ * with GCC/Clang, a switch elsewhere). C-instructions with both dest and
+ * jump, or a comp outside the table, keep the bit level decode (GENERIC).
+ */
+
+#include "hemu_internal.h"
+
+/* Macro Definitions */
+#define HEMU_STEP_CYCLES (64U)      /* Runs this short never start the JIT */
+
+/* Function Declarations */
+void hemuDecode(hemu_ctx *emu, const uint16_t *rom, size_t words);
+void hemuScreenRow(const uint16_t *words, uint8_t *pixels, int32_t format);
+
+hemu_ctx *hemu_create(void)
+{
+  hemu_ctx *emu = malloc(sizeof(hemu_ctx));
+
+  if(emu != NULL)
+  {
+    emu->jit = NULL;
+    emu->profile = NULL;
+    hemuDecode(emu, NULL, 0U);
+    hemuInterpret(emu, 0U);
+  }
+
+  return emu;
+}
+
+void hemu_destroy(hemu_ctx *emu)
+{
+  if(emu != NULL)
+  {
+    hemuJitDestroy(emu->jit);
+    hemuProfileDestroy(emu->profile);
+  }
+  free(emu);
+}
+
+int32_t hemu_load(hemu_ctx *emu, const uint16_t *rom, size_t words)
+{
+  if( (emu == NULL) || ((rom == NULL) && (words != 0U)) || (words > HEMU_ROM_SIZE) )
+  {
+    return HEMU_FAILURE;
+  }
+  hemuDecode(emu, rom, words);
+  memset(emu->screenDirty, 0xFF, sizeof(emu->screenDirty));
+
+  /* A run of no cycles binds the ops to their code */
+  hemuInterpret(emu, 0U);
+  if(emu->jit != NULL)
+  {
+    hemuJitFlush(emu->jit);
+  }
+
+  return HEMU_SUCCESS;
+}
+
+void hemu_reset(hemu_ctx *emu)
+{
+  emu->pc = 0U;
+  emu->cycles = 0U;
+}
+
+int32_t hemu_set_jit(hemu_ctx *emu, int32_t enable)
+{
+  if(emu == NULL)
+  {
+    return HEMU_FAILURE;
+  }
+
+  if(!enable)
+  {
+    hemuJitDestroy(emu->jit);
+    emu->jit = NULL;
+  }
+  else if(emu->jit == NULL)
+  {
+    emu->jit = hemuJitCreate();
+  }
+
+  return (!enable || (emu->jit != NULL)) ? HEMU_SUCCESS : HEMU_FAILURE;
+}
+
+int32_t hemu_jit_active(const hemu_ctx *emu)
+{
+  return ( (emu != NULL) && (emu->jit != NULL) ) ? 1 : 0;
+}
+
+/*
+ * Budgets of a few cycles are single steps, the interpreter serves them
+ * without compiling anything. A profiled computer always runs the counting
+ * interpreter of hemu_prof.c.
+ */
+int32_t hemu_run(hemu_ctx *emu, uint64_t cycles)
+{
+  if(emu->profile != NULL)
+  {
+    return hemuProfileRun(emu, cycles);
+  }
+
+  if( (emu->jit != NULL) && (cycles > HEMU_STEP_CYCLES) )
+  {
+    return hemuJitRun(emu, cycles);
+  }
+
+  return hemuInterpret(emu, cycles);
+}
+
+/*
+ * The registers live in locals and the PC is a pointer into the ops for
+ * the length of the run. Every op ends in HEMU_NEXT (fall through to the
+ * following word) or HEMU_GOTO (a taken jump), both of which count the
+ * cycle and dispatch on the next op's kind.
+ *
+ * A taken unconditional jump that writes nothing and lands on itself, or
+ * on an A-instruction loading its own address right before it, can never
+ * change the state again: that is the halt of every course program.
+ */
+int32_t hemuInterpret(hemu_ctx *emu, uint64_t cycles)
+{
+  const Hemu_Op *ops = emu->ops;
+  const Hemu_Op *op = &ops[emu->pc];
+  uint16_t *ram = emu->ram;
+  uint64_t *dirty = emu->screenDirty;
+  uint16_t a = emu->a;
+  uint16_t d = emu->d;
+  uint64_t remaining = cycles;
+  int32_t status = HEMU_LIMIT;
+
+#define HEMU_STORE_M(out) \
+  do \
+  { \
+    uint16_t address_ = (uint16_t)(a & HEMU_ADDR_MASK); \
+    if(address_ < HEMU_KBD) \
+    { \
+      ram[address_] = (out); \
+      if(address_ >= HEMU_SCREEN) { HEMU_MARK_ROW(dirty, address_); } \
+    } \
+  } while(0)
+
+#if HEMU_THREADED
+#define HEMU_DISPATCH  do { if(remaining == 0U) { goto stop; } remaining--; goto *op->handler; } while(0)
+#define HEMU_OP_LABEL(name) hemu_##name:
+#define HEMU_LABEL_ADDR(name) &&hemu_##name,
+#define HEMU_COMP_LABELS(name, expr) \
+  HEMU_LABEL_ADDR(name##_M) HEMU_LABEL_ADDR(name##_D) HEMU_LABEL_ADDR(name##_MD) HEMU_LABEL_ADDR(name##_A) \
+  HEMU_LABEL_ADDR(name##_AM) HEMU_LABEL_ADDR(name##_AD) HEMU_LABEL_ADDR(name##_AMD) \
+  HEMU_LABEL_ADDR(name##_JGT) HEMU_LABEL_ADDR(name##_JEQ) HEMU_LABEL_ADDR(name##_JGE) \
+  HEMU_LABEL_ADDR(name##_JLT) HEMU_LABEL_ADDR(name##_JNE) HEMU_LABEL_ADDR(name##_JLE)
+
+  static const void *const labels[HEMU_OP_COUNT] =
+  {
+    HEMU_LABEL_ADDR(LOAD_A) HEMU_LABEL_ADDR(NOP) HEMU_LABEL_ADDR(JMP) HEMU_LABEL_ADDR(GENERIC) HEMU_LABEL_ADDR(WRAP)
+    HEMU_COMP_LIST(HEMU_COMP_LABELS)
+  };
+
+  if(!emu->bound)
+  {
+    /* Direct threading: every op carries the address of its code */
+    for(uint32_t i = 0U; i <= HEMU_ROM_SIZE; i++)
+    {
+      emu->ops[i].handler = labels[emu->ops[i].kind];
+    }
+    emu->bound = 1U;
+  }
+#else
+#define HEMU_DISPATCH  do { if(remaining == 0U) { goto stop; } remaining--; goto dispatch; } while(0)
+#define HEMU_OP_LABEL(name) case HEMU_OP_##name:
+#endif
+#define HEMU_NEXT      do { op++; HEMU_DISPATCH; } while(0)
+#define HEMU_GOTO      do { op = &ops[a & HEMU_ADDR_MASK]; HEMU_DISPATCH; } while(0)
+#define HEMU_BRANCH(out, cond) \
+  do { int16_t out_ = (int16_t)(uint16_t)(out); if(out_ cond 0) { HEMU_GOTO; } HEMU_NEXT; } while(0)
+
+/* The 13 ops of one comp; the comp is evaluated before A or D change and M is stored through the old A */
+#define HEMU_COMP_CODE(name, expr) \
+  HEMU_OP_LABEL(name##_M)   { HEMU_STORE_M((uint16_t)(expr)); HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_D)   { d = (uint16_t)(expr); HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_MD)  { uint16_t out = (uint16_t)(expr); HEMU_STORE_M(out); d = out; HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_A)   { a = (uint16_t)(expr); HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_AM)  { uint16_t out = (uint16_t)(expr); HEMU_STORE_M(out); a = out; HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_AD)  { uint16_t out = (uint16_t)(expr); a = out; d = out; HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_AMD) { uint16_t out = (uint16_t)(expr); HEMU_STORE_M(out); a = out; d = out; HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_JGT) { HEMU_BRANCH(expr, >); } \
+  HEMU_OP_LABEL(name##_JEQ) { HEMU_BRANCH(expr, ==); } \
+  HEMU_OP_LABEL(name##_JGE) { HEMU_BRANCH(expr, >=); } \
+  HEMU_OP_LABEL(name##_JLT) { HEMU_BRANCH(expr, <); } \
+  HEMU_OP_LABEL(name##_JNE) { HEMU_BRANCH(expr, !=); } \
+  HEMU_OP_LABEL(name##_JLE) { HEMU_BRANCH(expr, <=); }
+
+  HEMU_DISPATCH;
+
+#if !HEMU_THREADED
+dispatch:
+  switch(op->kind)
+  {
+#endif
+  HEMU_OP_LABEL(LOAD_A)
+  {
+    a = op->value;
+    HEMU_NEXT;
+  }
+  HEMU_OP_LABEL(NOP)
+  {
+    HEMU_NEXT;
+  }
+  HEMU_OP_LABEL(JMP)
+  {
+    uint16_t target = (uint16_t)(a & HEMU_ADDR_MASK);
+    uint16_t pc = (uint16_t)(op - ops);
+
+    if( (target == pc) || ((target == (uint16_t)(pc - 1U)) && (ops[target].kind == HEMU_OP_LOAD_A) && (ops[target].value == target)) )
+    {
+      op = &ops[target];
+      status = HEMU_HALTED;
+      goto stop;
+    }
+    HEMU_GOTO;
+  }
+  HEMU_OP_LABEL(GENERIC)
+  {
+    uint16_t instruction = op->value;
+    uint16_t address = (uint16_t)(a & HEMU_ADDR_MASK);
+    uint16_t out = hemuAlu(instruction, d, (instruction & HEMU_A_SELECT) ? ram[address] : a);
+
+    op = ((instruction & hemuJumpFlag(out)) != 0U) ? &ops[address] : (op + 1);
+    if( (instruction & HEMU_DEST_M) && (address < HEMU_KBD) )
+    {
+      ram[address] = out;
+      if(address >= HEMU_SCREEN)
+      {
+        HEMU_MARK_ROW(dirty, address);
+      }
+    }
+    if(instruction & HEMU_DEST_A)
+    {
+      a = out;
+    }
+    if(instruction & HEMU_DEST_D)
+    {
+      d = out;
+    }
+    HEMU_DISPATCH;
+  }
+  HEMU_OP_LABEL(WRAP)
+  {
+    /* Not an instruction: give the cycle back */
+    remaining++;
+    op = ops;
+    HEMU_DISPATCH;
+  }
+  HEMU_COMP_LIST(HEMU_COMP_CODE)
+#if !HEMU_THREADED
+  default:
+    break;
+  }
+#endif
+
+stop:
+  emu->a = a;
+  emu->d = d;
+  emu->pc = (uint16_t)((op - ops) & HEMU_ADDR_MASK);
+  emu->cycles += cycles - remaining;
+
+  return status;
+
+#undef HEMU_STORE_M
+#undef HEMU_DISPATCH
+#undef HEMU_OP_LABEL
+#undef HEMU_NEXT
+#undef HEMU_GOTO
+#undef HEMU_BRANCH
+#undef HEMU_COMP_CODE
+}
+
+uint64_t hemu_cycles(const hemu_ctx *emu)
+{
+  return emu->cycles;
+}
+
+uint16_t *hemu_ram(hemu_ctx *emu)
+{
+  return emu->ram;
+}
+
+void hemu_registers(const hemu_ctx *emu, uint16_t *a, uint16_t *d, uint16_t *pc)
+{
+  *a = emu->a;
+  *d = emu->d;
+  *pc = emu->pc;
+}
+
+void hemu_set_key(hemu_ctx *emu, uint16_t key)
+{
+  emu->ram[HEMU_KBD] = key;
+}
+
+void hemu_screen_dirty(hemu_ctx *emu, uint64_t dirty[HEMU_SCREEN_DIRTY])
+{
+  memcpy(dirty, emu->screenDirty, sizeof(emu->screenDirty));
+  memset(emu->screenDirty, 0, sizeof(emu->screenDirty));
+}
+
+uint32_t hemu_screen_render(const hemu_ctx *emu, const uint64_t *dirty, uint8_t *pixels, size_t stride, int32_t format)
+{
+  uint32_t rows = 0U;
+
+  for(uint32_t row = 0U; row < HEMU_SCREEN_HEIGHT; row++)
+  {
+    if( (dirty == NULL) || ((dirty[row >> 6] >> (row & 63U)) & 1U) )
+    {
+      hemuScreenRow(&emu->ram[HEMU_SCREEN + (row * HEMU_SCREEN_WORDS)], pixels + (row * stride), format);
+      rows++;
+    }
+  }
+
+  return rows;
+}
+
+/*
+ * One row of 32 words to 512 pixels, 16 per word from bit 0: every pixel
+ * bit is spread to a whole byte by a compare against its mask, 0 (white)
+ * where the bit is clear. For RGB24 the 48 bytes of a word are three
+ * vectors of the word's low byte, low then high byte, and high byte.
+ */
+void hemuScreenRow(const uint16_t *words, uint8_t *pixels, int32_t format)
+{
+#if N2T_SCAN_AVX2 || N2T_SCAN_SSE2
+  const __m128i zero = _mm_setzero_si128();
+
+  if(format == HEMU_PIXELS_RGB24)
+  {
+    const __m128i mask0 = _mm_setr_epi8(1, 1, 1, 2, 2, 2, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32);
+    const __m128i mask1 = _mm_setr_epi8(32, 32, 64, 64, 64, -128, -128, -128, 1, 1, 1, 2, 2, 2, 4, 4);
+    const __m128i mask2 = _mm_setr_epi8(4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64, -128, -128, -128);
+
+    for(uint32_t i = 0U; i < HEMU_SCREEN_WORDS; i++, pixels += 48)
+    {
+      __m128i lo = _mm_set1_epi8((char)(words[i] & 0xFFU));
+      __m128i hi = _mm_set1_epi8((char)(words[i] >> 8));
+
+      _mm_storeu_si128((__m128i *)pixels, _mm_cmpeq_epi8(_mm_and_si128(lo, mask0), zero));
+      _mm_storeu_si128((__m128i *)(pixels + 16), _mm_cmpeq_epi8(_mm_and_si128(_mm_unpacklo_epi64(lo, hi), mask1), zero));
+      _mm_storeu_si128((__m128i *)(pixels + 32), _mm_cmpeq_epi8(_mm_and_si128(hi, mask2), zero));
+    }
+    return;
+  }
+#if N2T_SCAN_AVX2
+  {
+    const __m256i white = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i mask0 = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i mask1 = _mm256_slli_epi32(mask0, 8);
+
+    for(uint32_t i = 0U; i < HEMU_SCREEN_WORDS; i++, pixels += 64)
+    {
+      __m256i word = _mm256_set1_epi32(words[i]);
+
+      _mm256_storeu_si256((__m256i *)pixels, _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(word, mask0), mask0), white));
+      _mm256_storeu_si256((__m256i *)(pixels + 32), _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(word, mask1), mask1), white));
+    }
+  }
+#else
+  {
+    const __m128i white = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i mask = _mm_setr_epi32(1, 2, 4, 8);
+
+    (void)zero;
+    for(uint32_t i = 0U; i < HEMU_SCREEN_WORDS; i++)
+    {
+      __m128i word = _mm_set1_epi32(words[i]);
+
+      for(uint32_t j = 0U; j < 4U; j++, pixels += 16)
+      {
+        __m128i bits = _mm_slli_epi32(mask, (int)(4U * j));
+
+        _mm_storeu_si128((__m128i *)pixels, _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(word, bits), bits), white));
+      }
+    }
+  }
+#endif
+#elif N2T_SCAN_NEON
+  static const uint8_t bitMasks[16] = { 1U, 2U, 4U, 8U, 16U, 32U, 64U, 128U, 1U, 2U, 4U, 8U, 16U, 32U, 64U, 128U };
+  const uint8x16_t mask = vld1q_u8(bitMasks);
+
+  for(uint32_t i = 0U; i < HEMU_SCREEN_WORDS; i++)
+  {
+    uint8x16_t bytes = vcombine_u8(vdup_n_u8((uint8_t)(words[i] & 0xFFU)), vdup_n_u8((uint8_t)(words[i] >> 8)));
+    uint8x16_t paper = vmvnq_u8(vtstq_u8(bytes, mask));
+
+    if(format == HEMU_PIXELS_RGB24)
+    {
+      uint8x16x3_t rgb = { { paper, paper, paper } };
+
+      vst3q_u8(pixels, rgb);
+      pixels += 48;
+    }
+    else
+    {
+      uint8x16x4_t xrgb = { { paper, paper, paper, vdupq_n_u8(0U) } };
+
+      vst4q_u8(pixels, xrgb);
+      pixels += 64;
+    }
+  }
+#else
+  for(uint32_t i = 0U; i < HEMU_SCREEN_WORDS; i++)
+  {
+    for(uint32_t bit = 0U; bit < 16U; bit++)
+    {
+      uint8_t paper = ((words[i] >> bit) & 1U) ? 0x00U : 0xFFU;
+
+      if(format == HEMU_PIXELS_RGB24)
+      {
+        pixels[0] = paper;
+        pixels[1] = paper;
+        pixels[2] = paper;
+        pixels += 3;
+      }
+      else
+      {
+        /* 0x00RRGGBB in host order */
+        uint32_t xrgb = paper ? 0x00FFFFFFU : 0U;
+
+        memcpy(pixels, &xrgb, sizeof(xrgb));
+        pixels += 4;
+      }
+    }
+  }
+#endif
+}
+
+/*
+ * Power on with the program in ROM. The ops of one comp are HEMU_COMP_OPS
+ * apart in the kind enum, so a word decodes to
+ * first + comp * HEMU_COMP_OPS + (dest - 1), or + 7 + (jump - 1).
+ */
+void hemuDecode(hemu_ctx *emu, const uint16_t *rom, size_t words)
+{
+  uint8_t compIndex[HEMU_COMP_MASK + 1U];
+
+  hemuCompIndex(compIndex);
+  memset(emu, 0, offsetof(hemu_ctx, ops));
+  for(uint32_t i = 0U; i < HEMU_ROM_SIZE; i++)
+  {
+    uint16_t word = (i < words) ? rom[i] : 0U;
+    uint32_t comp = compIndex[(word >> COMP_FIELD_SHIFT) & HEMU_COMP_MASK];
+    uint32_t dest = (word & HEMU_DEST_MASK) >> DEST_FIELD_SHIFT;
+    uint32_t jump = word & HEMU_JUMP_MASK;
+    uint32_t kind = HEMU_OP_GENERIC;
+
+    if((word & HEMU_C_INST) == 0U)
+    {
+      kind = HEMU_OP_LOAD_A;
+    }
+    else if( (dest == 0U) && (jump == 0U) )
+    {
+      kind = HEMU_OP_NOP;
+    }
+    else if( (dest == 0U) && (jump == HEMU_JUMP_MASK) )
+    {
+      kind = HEMU_OP_JMP;
+    }
+    else if( (comp != HEMU_COMP_NONE) && (jump == 0U) )
+    {
+      kind = HEMU_OP_ZERO_M + (comp * HEMU_COMP_OPS) + (dest - 1U);
+    }
+    else if( (comp != HEMU_COMP_NONE) && (dest == 0U) )
+    {
+      kind = HEMU_OP_ZERO_JGT + (comp * HEMU_COMP_OPS) + (jump - 1U);
+    }
+
+    emu->ops[i].kind = (uint16_t)kind;
+    emu->ops[i].value = word;
+  }
+  emu->ops[HEMU_ROM_SIZE].kind = HEMU_OP_WRAP;
+  emu->ops[HEMU_ROM_SIZE].value = 0U;
+}
+
+/* compFieldLT entry of every a/c1..c6 pattern, HEMU_COMP_NONE for the undocumented ones */
+void hemuCompIndex(uint8_t compIndex[HEMU_COMP_MASK + 1U])
+{
+  memset(compIndex, HEMU_COMP_NONE, HEMU_COMP_MASK + 1U);
+  for(uint32_t i = 0U; i < COMP_FIELD_COUNT; i++)
+  {
+    compIndex[(compFieldLT[i].bits >> COMP_FIELD_SHIFT) & HEMU_COMP_MASK] = (uint8_t)i;
+  }
+}
+
+/*
+ * ALU.hdl without branches: zx/zy clear through an AND mask, nx/ny/no
+ * invert through an XOR mask, f selects x + y over x & y.
+ */
+uint16_t hemuAlu(uint16_t instruction, uint16_t x, uint16_t y)
+{
+  uint16_t out = 0U;
+
+  x = (uint16_t)((x & (((instruction >> 11) & 1U) - 1U)) ^ (0U - ((instruction >> 10) & 1U)));
+  y = (uint16_t)((y & (((instruction >> 9) & 1U) - 1U)) ^ (0U - ((instruction >> 8) & 1U)));
+  out = (instruction & 0x0080U) ? (uint16_t)(x + y) : (uint16_t)(x & y);
+
+  return (uint16_t)(out ^ (0U - ((instruction >> 6) & 1U)));
+}
+
+/* The jump bit that the zr/ng flags of out select */
+uint16_t hemuJumpFlag(uint16_t out)
+{
+  if(out == 0U)
+  {
+    return HEMU_JUMP_EQ;
+  }
+
+  return (out & 0x8000U) ? HEMU_JUMP_LT : HEMU_JUMP_GT;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file hemu.h
+ * @brief Hack computer emulator library: runs the 16-bit words produced by
+ *        the assembler natively, with the semantics of Project5/CPU.hdl and
+ *        Memory.hdl, at native speed instead of gate level.
+ *
+ * A context is one Hack computer: the 32K word ROM, the A, D and PC
+ * registers and the data memory (RAM16K at 0, SCREEN at 16384, KBD at
+ * 24576). Contexts are independent, so each thread may run its own.
+ * The decoder takes the comp encodings from compFieldLT, so link hasm.c too,
+ * and hemu_jit.c for the JIT.
+ *
+ *   hemu_ctx *emu = hemu_create();
+ *
+ *   hemu_load(emu, rom, words);
+ *   hemu_ram(emu)[0] = 6;
+ *   if(hemu_run(emu, 1000000) == HEMU_HALTED) { ... hemu_ram(emu)[2] ... }
+ *   hemu_destroy(emu);
+ */
+#ifndef HEMU_H
+#define HEMU_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HEMU_SUCCESS  (1)
+#define HEMU_FAILURE  (-1)  /* NULL context or a program over 32K words */
+#define HEMU_HALTED   (2)   /* Reached a jump to itself with nothing left to change */
+#define HEMU_LIMIT    (3)   /* The cycle budget ran out first */
+
+#define HEMU_ROM_SIZE   (32768U)
+#define HEMU_RAM_SIZE   (32768U)    /* The whole 15-bit data address space */
+#define HEMU_SCREEN     (16384U)
+#define HEMU_KBD        (24576U)
+
+#define HEMU_SCREEN_WIDTH  (512U)
+#define HEMU_SCREEN_HEIGHT (256U)
+#define HEMU_SCREEN_WORDS  (32U)    /* Words per row, bit 0 is the leftmost pixel */
+#define HEMU_SCREEN_DIRTY  (HEMU_SCREEN_HEIGHT / 64U) /* Words of a row bitmap */
+
+/* Pixel formats of hemu_screen_render(), white paper and black ink */
+#define HEMU_PIXELS_RGB24  (0)      /* 3 bytes per pixel, the body of a binary PPM */
+#define HEMU_PIXELS_XRGB32 (1)      /* 0x00RRGGBB per pixel, as SDL ARGB8888 or a 32 bpp framebuffer */
+
+typedef struct hemu_ctx hemu_ctx;
+
+/* New computer with an empty (all zero) ROM, NULL if out of memory */
+hemu_ctx *hemu_create(void);
+
+void hemu_destroy(hemu_ctx *emu);
+
+/* Powers on with the words of a program in ROM: registers and memory cleared */
+int32_t hemu_load(hemu_ctx *emu, const uint16_t *rom, size_t words);
+
+/* The reset input of the CPU: PC back to 0, A, D and memory are kept */
+void hemu_reset(hemu_ctx *emu);
+
+/*
+ * Executes at most cycles instructions (one per clock, as the CPU) and
+ * returns HEMU_HALTED once the program sits in an `@X / 0;JMP` style loop
+ * on itself, HEMU_LIMIT otherwise.
+ */
+int32_t hemu_run(hemu_ctx *emu, uint64_t cycles);
+
+/*
+ * Compiles the basic blocks the program runs into native code from then
+ * on (x86-64 only, HEMU_FAILURE elsewhere). Short runs, such as single
+ * steps of 1 cycle, still go through the interpreter; both give the same
+ * state and cycle counts.
+ */
+int32_t hemu_set_jit(hemu_ctx *emu, int32_t enable);
+
+/*
+ * 1 while the JIT is on. The host may refuse executable memory, then
+ * hemu_set_jit() fails, or refuse it later, then the JIT is dropped and
+ * the runs go on in the interpreter.
+ */
+int32_t hemu_jit_active(const hemu_ctx *emu);
+
+/* Instructions executed since the last load or reset */
+uint64_t hemu_cycles(const hemu_ctx *emu);
+
+/* The HEMU_RAM_SIZE words of data memory, to set inputs and read results */
+uint16_t *hemu_ram(hemu_ctx *emu);
+
+void hemu_registers(const hemu_ctx *emu, uint16_t *a, uint16_t *d, uint16_t *pc);
+
+/*
+ * Rows of the screen the program wrote since the last call, bit r of
+ * dirty[r / 64] for row r; the set is cleared. hemu_load() marks every
+ * row, writes made through hemu_ram() are not tracked.
+ */
+void hemu_screen_dirty(hemu_ctx *emu, uint64_t dirty[HEMU_SCREEN_DIRTY]);
+
+/*
+ * Converts the rows set in dirty, or all rows if dirty is NULL, into the
+ * pixels of a 512x256 image whose rows are stride bytes apart. Returns the
+ * number of rows converted.
+ */
+uint32_t hemu_screen_render(const hemu_ctx *emu, const uint64_t *dirty, uint8_t *pixels, size_t stride, int32_t format);
+
+/* Scan code of the key held down, 0 for none, as read at KBD */
+void hemu_set_key(hemu_ctx *emu, uint16_t key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEMU_H */
@@ -0,0 +1,203 @@
+/**
+ * @file hemu_internal.h
+ * @brief Internals of the Hack emulator library shared by the interpreter
+ *        (hemu.c) and the JIT (hemu_jit.c): the context layout and the
+ *        pre-decoded ops. Programs embedding the emulator only need hemu.h.
+ */
+#ifndef HEMU_INTERNAL_H
+#define HEMU_INTERNAL_H
+
+#include "hasm_internal.h"
+#include "hemu.h"
+
+/* Direct-threaded dispatch through label addresses, -DHEMU_THREADED=0 selects the switch */
+#ifndef HEMU_THREADED
+#if defined(__GNUC__)
+#define HEMU_THREADED    (1)
+#else
+#define HEMU_THREADED    (0)
+#endif
+#endif
+
+/* Basic block JIT for x86-64 hosts that can map executable memory, -DHEMU_JIT=0 compiles it out */
+#ifndef HEMU_JIT
+#if N2T_HAVE_MMAP && (defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__)
+#define HEMU_JIT         (1)
+#else
+#define HEMU_JIT         (0)
+#endif
+#endif
+
+/* Macro Definitions */
+#define HEMU_C_INST      (0x8000U)  /* instruction[15] */
+#define HEMU_A_SELECT    (0x1000U)  /* instruction[12]: y is M instead of A */
+#define HEMU_COMP_MASK   (0x7FU)    /* a and c1..c6 after COMP_FIELD_SHIFT */
+#define HEMU_DEST_A      (0x0020U)
+#define HEMU_DEST_D      (0x0010U)
+#define HEMU_DEST_M      (0x0008U)
+#define HEMU_DEST_MASK   (0x0038U)
+#define HEMU_JUMP_MASK   (0x0007U)
+#define HEMU_JUMP_GT     (0x0001U)
+#define HEMU_JUMP_EQ     (0x0002U)
+#define HEMU_JUMP_LT     (0x0004U)
+#define HEMU_ADDR_MASK   (0x7FFFU)  /* addressM and pc are 15 bits */
+#define HEMU_COMP_NONE   (0xFFU)    /* Not one of the comp encodings */
+#define HEMU_COMP_OPS    (13U)      /* Ops per comp: 7 dest, then the 6 conditional jumps */
+
+/* Profiling (hemu_prof.c) */
+#define HEMU_PROFILE_DEPTH   (1024U)  /* Calls tracked, deeper ones count in their caller */
+#define HEMU_PROFILE_FOLD    (0xFFFFFFFFU)  /* Most cycles between folds of the 32-bit RAM counters */
+#define HEMU_PROFILE_REACH   (64U)    /* Most words from the @ of a return label to the label, a VM call takes ~50 */
+#define HEMU_PROFILE_NONE    (0xFFFFFFFFU)
+#define HEMU_PROFILE_ADDRESS (0x80000000U) /* Node symbol: a ROM address, no label covers it */
+#define HEMU_PROFILE_LABEL   (0x01U)  /* flags[]: some label's address */
+#define HEMU_PROFILE_RETURN  (0x02U)  /* flags[]: a label also loaded as data, where calls return */
+#define HEMU_PROFILE_CALL    (0x04U)  /* flags[]: an unconditional jump right before a return label */
+
+/* Marks the row of a screen write, HEMU_SCREEN <= address < HEMU_KBD */
+#define HEMU_MARK_ROW(dirty, address) \
+  ((dirty)[((address) - HEMU_SCREEN) >> 11] |= (uint64_t)1U << ((((address) - HEMU_SCREEN) >> 5) & 63U))
+
+/*
+ * The comp functions, in the order of compFieldLT: entry i of the table
+ * is decoded to the ops of entry i here. HEMU_M reads the word at A.
+ */
+#define HEMU_M           (ram[a & HEMU_ADDR_MASK])
+#define HEMU_COMP_LIST(X) \
+  X(ZERO,  0U)        X(ONE,   1U)        X(NEG1,  0xFFFFU)   X(D,     d)         \
+  X(A,     a)         X(NOTD,  ~d)        X(NOTA,  ~a)        X(NEGD,  0U - d)    \
+  X(NEGA,  0U - a)    X(DINC,  d + 1U)    X(AINC,  a + 1U)    X(DDEC,  d - 1U)    \
+  X(ADEC,  a - 1U)    X(DPA,   d + a)     X(DMA,   d - a)     X(AMD,   a - d)     \
+  X(DANDA, d & a)     X(DORA,  d | a)     X(M,     HEMU_M)    X(NOTM,  ~HEMU_M)   \
+  X(NEGM,  0U - HEMU_M) X(MINC, HEMU_M + 1U) X(MDEC, HEMU_M - 1U) X(DPM, d + HEMU_M) \
+  X(DMM,   d - HEMU_M) X(MMD,  HEMU_M - d) X(DANDM, d & HEMU_M) X(DORM, d | HEMU_M)
+
+/* The 13 ops of one comp, dest order AMD = 001..111, then JGT..JLE */
+#define HEMU_COMP_KINDS(name, expr) \
+  HEMU_OP_##name##_M, HEMU_OP_##name##_D, HEMU_OP_##name##_MD, HEMU_OP_##name##_A, \
+  HEMU_OP_##name##_AM, HEMU_OP_##name##_AD, HEMU_OP_##name##_AMD, \
+  HEMU_OP_##name##_JGT, HEMU_OP_##name##_JEQ, HEMU_OP_##name##_JGE, \
+  HEMU_OP_##name##_JLT, HEMU_OP_##name##_JNE, HEMU_OP_##name##_JLE,
+
+/* Variable Definitions */
+enum
+{
+  HEMU_OP_LOAD_A,   /* A-instruction */
+  HEMU_OP_NOP,      /* C-instruction without dest or jump */
+  HEMU_OP_JMP,      /* Unconditional jump without dest, the comp cannot matter */
+  HEMU_OP_GENERIC,  /* Dest and jump, or a comp outside compFieldLT */
+  HEMU_OP_WRAP,     /* Past the last ROM word: the PC wraps to 0 */
+  HEMU_COMP_LIST(HEMU_COMP_KINDS)
+  HEMU_OP_COUNT
+};
+
+/* One pre-decoded ROM word */
+typedef struct
+{
+#if HEMU_THREADED
+  const void *handler;  /* Label of the kind, bound by the first run */
+#endif
+  uint16_t kind;
+  uint16_t value;       /* The word itself: A's value, or GENERIC's instruction */
+} Hemu_Op;
+
+typedef struct Hemu_Jit Hemu_Jit;
+
+/* Call tree of the profile: a function frame (label entered by a call) or, as a leaf, a label of its code */
+typedef struct
+{
+  uint32_t parent;
+  uint32_t symbol;      /* Label index in the map, or HEMU_PROFILE_ADDRESS | address */
+  uint64_t cycles;      /* Spent in this frame, not in its children */
+} Hemu_Profile_Node;
+
+typedef struct
+{
+  uint32_t ret;         /* Address the call returns to */
+  uint32_t frame;       /* Node of the caller */
+} Hemu_Profile_Call;
+
+/* Last leaf a jump to an address found, valid while the frame is the same */
+typedef struct
+{
+  uint32_t frame;
+  uint32_t leaf;
+} Hemu_Profile_Memo;
+
+/*
+ * Counters of a profiled run. Executions are only counted where straight
+ * runs of code start and end (taken jumps, wraps, the ends of runs), as
+ * +1 at the first word and -1 past the last; the prefix sums of starts[]
+ * give the count of every word. RAM accesses are counted as they happen,
+ * in 32-bit counters folded into 64-bit totals.
+ */
+typedef struct
+{
+  int64_t starts[HEMU_ROM_SIZE + 1U];
+  uint64_t taken[HEMU_ROM_SIZE];
+  uint32_t reads[HEMU_RAM_SIZE];        /* Since the last fold, half the cache lines of 64 bits */
+  uint32_t writes[HEMU_RAM_SIZE];
+  uint64_t readTotals[HEMU_RAM_SIZE];   /* Up to the last fold, see hemuProfileFold() */
+  uint64_t writeTotals[HEMU_RAM_SIZE];
+  uint64_t unfolded;                    /* Cycles run since the last fold */
+
+  /* Labels of the program, from its map */
+  const Source_Map *map;
+  uint8_t flags[HEMU_ROM_SIZE + 1U];
+  uint32_t symbolAt[HEMU_ROM_SIZE + 1U];  /* Last label at or before the address */
+
+  /* Call tree, node 0 is the root */
+  Hemu_Profile_Node *nodes;
+  uint32_t nodeCount;
+  uint32_t nodeSize;
+  uint32_t *hash;       /* Open addressing of the nodes by (parent, symbol), node + 1 per slot */
+  uint32_t hashSize;
+  Hemu_Profile_Memo memo[HEMU_ROM_SIZE + 1U];
+  Hemu_Profile_Call calls[HEMU_PROFILE_DEPTH];
+  uint32_t depth;
+  uint32_t frame;
+  uint32_t leaf;        /* Node the current straight run is counted in */
+  uint8_t entering;     /* Called, the frame starts at the next label jumped to */
+  uint8_t failed;       /* Out of memory growing the tree, later cycles stay in the frame */
+} Hemu_Profile;
+
+/*
+ * Everything up to ops is cleared on every load; the JIT and its code
+ * buffer outlive programs and are only flushed.
+ */
+struct hemu_ctx
+{
+  uint16_t a;
+  uint16_t d;
+  uint16_t pc;
+  uint8_t bound;
+  uint64_t cycles;
+  uint16_t ram[HEMU_RAM_SIZE];
+  uint64_t screenDirty[HEMU_SCREEN_DIRTY];  /* Right after ram: the JIT reaches both from one base */
+  Hemu_Op ops[HEMU_ROM_SIZE + 1U];  /* The extra op is HEMU_OP_WRAP */
+  Hemu_Jit *jit;
+  Hemu_Profile *profile;            /* NULL unless hemuProfileStart() */
+};
+
+/* The JIT addresses screenDirty as ram + 2 * HEMU_RAM_SIZE */
+typedef char Hemu_Dirty_Offset[(offsetof(hemu_ctx, screenDirty) == offsetof(hemu_ctx, ram) + 2U * HEMU_RAM_SIZE) ? 1 : -1];
+
+/* Function Declarations */
+int32_t hemuInterpret(hemu_ctx *emu, uint64_t cycles);
+void hemuCompIndex(uint8_t compIndex[HEMU_COMP_MASK + 1U]);
+uint16_t hemuAlu(uint16_t instruction, uint16_t x, uint16_t y);
+uint16_t hemuJumpFlag(uint16_t out);
+Hemu_Jit *hemuJitCreate(void);
+void hemuJitDestroy(Hemu_Jit *jit);
+void hemuJitFlush(Hemu_Jit *jit);
+int32_t hemuJitRun(hemu_ctx *emu, uint64_t cycles);
+int32_t hemuProfileStart(hemu_ctx *emu, const Source_Map *map);
+void hemuProfileDestroy(Hemu_Profile *prof);
+int32_t hemuProfileRun(hemu_ctx *emu, uint64_t cycles);
+int32_t hemuProfileSlice(hemu_ctx *emu, uint64_t cycles);
+void hemuProfileFold(Hemu_Profile *prof);
+void hemuProfileEnter(Hemu_Profile *prof, uint32_t from, uint32_t to);
+uint32_t hemuProfileNode(Hemu_Profile *prof, uint32_t parent, uint32_t symbol);
+void hemuProfileCounts(const Hemu_Profile *prof, uint64_t *counts);
+
+#endif /* HEMU_INTERNAL_H */
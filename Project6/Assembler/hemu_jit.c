@@ -0,0 +1,644 @@
+/**
+ * @file hemu_jit.c
+ * @brief Basic block JIT of the Hack emulator library for x86-64 hosts.
+ *
+ * A block starts wherever control arrives: address 0, the target of a
+ * jump (for a program from the assembler, the label addresses firstPass()
+ * gave out) or the word after a conditional jump. It runs up to the next
+ * jump, at most JIT_BLOCK_MAX words, and is compiled the first time it is
+ * entered. In the code:
+ * - A lives in r12d, D in r13d, the RAM base in r14 and the cycle budget
+ *   in r15; rbx points to the Jit_State and rbp to the entry table;
+ * - each block takes its length off the budget up front and bails out to
+ *   the interpreter when the budget is shorter than the block;
+ * - the ALU is one or two host instructions per comp of compFieldLT, and
+ *   an A known from an earlier @X of the block turns M into a fixed
+ *   address and the jump into a fixed target;
+ * - a store to the screen sets the bit of its row in screenDirty, which
+ *   follows the RAM so r14 reaches it too;
+ * - an exit to a fixed target first returns to hemuJitRun(), which
+ *   compiles the target and patches the jump to enter it directly (block
+ *   chaining); an exit through a computed A looks the target up in the
+ *   entry table.
+ * Whatever the code cannot express falls back to one interpreted step:
+ * the halting `@X / 0;JMP` loop, undocumented comps, short budgets. The
+ * state and cycle count after any run are those of hemuInterpret().
+ * The buffer is never writable and executable at once: it is mapped RW,
+ * turned RX before entering the code and back to RW to compile or patch.
+ * A host refusing the change fails hemuJitCreate(); a change failing later
+ * drops the JIT and the rest of the run is interpreted.
+ */
+
+#include "hemu_internal.h"
+
+#if HEMU_JIT
+
+/* Macro Definitions */
+#define JIT_CODE_SIZE    (16U * 1024U * 1024U) /* Flushed as a whole when full */
+#define JIT_BLOCK_MAX    (64U)      /* Words per block, fits the imm8 budget check */
+#define JIT_BLOCK_BYTES  ((JIT_BLOCK_MAX * 96U) + 512U) /* Bound on the code of one block */
+#define JIT_LINK_NONE    (0U)       /* Exit through the entry table */
+#define JIT_LINK_STEP    (1U)       /* Exit for one interpreted instruction */
+#define JIT_INTERPRET    (1U)       /* flags[]: the word cannot start a block */
+#define JIT_COMP_M       (18U)      /* First comp of compFieldLT that reads M */
+#define JIT_DIRTY        (2U * HEMU_RAM_SIZE) /* screenDirty off the RAM base */
+
+#define JIT_BYTES(jit, ...) \
+  jitEmit((jit), (const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+/* Variable Definitions */
+/* Registers across the calls into the code, offsets are fixed in the enter/exit routines */
+typedef struct
+{
+  uint32_t a;           /* +0 */
+  uint32_t d;           /* +4 */
+  uint64_t remaining;   /* +8 */
+  uint32_t pc;          /* +16 */
+  uint32_t pad;
+  uintptr_t link;       /* +24: rel32 of the fixed exit taken, or JIT_LINK_* */
+} Jit_State;
+
+typedef void (*Jit_Enter)(Jit_State *state, const void *entry, void *const *entries, uint16_t *ram);
+
+struct Hemu_Jit
+{
+  uint8_t *code;
+  size_t used;
+  size_t base;          /* End of the enter/exit routines */
+  uint8_t *exit;        /* Stores the state and returns: eax = pc, rdx = link */
+  uint8_t *exitNoLink;  /* The same with rdx = JIT_LINK_NONE */
+  uint32_t generation;  /* Bumped by every flush */
+  uint8_t writable;     /* The buffer is RW, otherwise RX */
+  uint8_t failed;       /* An mprotect() failed, hemuJitRun() drops the JIT */
+  void *entries[HEMU_ROM_SIZE];
+  uint8_t flags[HEMU_ROM_SIZE];
+  uint8_t compIndex[HEMU_COMP_MASK + 1U];
+};
+
+/* Function Declarations */
+void *jitEntry(Hemu_Jit *jit, const Hemu_Op *ops, uint32_t pc);
+void *jitCompile(Hemu_Jit *jit, const Hemu_Op *ops, uint32_t pc);
+void jitComp(Hemu_Jit *jit, uint32_t comp);
+void jitExitFixed(Hemu_Jit *jit, uint32_t target);
+void jitExitComputed(Hemu_Jit *jit, uint8_t fromEdx, const Hemu_Op *ops, uint32_t haltPc);
+void jitExitStep(Hemu_Jit *jit, uint32_t pc);
+void jitJump(Hemu_Jit *jit, const uint8_t *target);
+void jitPatch(uint8_t *rel32, const uint8_t *target);
+void jitEmit(Hemu_Jit *jit, const uint8_t *bytes, uint32_t len);
+void jitEmit32(Hemu_Jit *jit, uint32_t value);
+int32_t jitProtect(Hemu_Jit *jit, uint8_t writable);
+
+Hemu_Jit *hemuJitCreate(void)
+{
+  Hemu_Jit *jit = calloc(1U, sizeof(*jit));
+  void *code = MAP_FAILED;
+
+  if(jit != NULL)
+  {
+    code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  }
+
+  if(code == MAP_FAILED)
+  {
+    free(jit);
+    return NULL;
+  }
+  jit->code = code;
+  jit->writable = 1U;
+  hemuCompIndex(jit->compIndex);
+
+  /* enter(state, entry, entries, ram): callee-saved registers, then the Hack registers */
+  JIT_BYTES(jit, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);  /* push rbx, rbp, r12-r15 */
+  JIT_BYTES(jit, 0x48, 0x89, 0xFB);             /* mov rbx, rdi */
+  JIT_BYTES(jit, 0x48, 0x89, 0xD5);             /* mov rbp, rdx */
+  JIT_BYTES(jit, 0x49, 0x89, 0xCE);             /* mov r14, rcx */
+  JIT_BYTES(jit, 0x44, 0x8B, 0x23);             /* mov r12d, [rbx] */
+  JIT_BYTES(jit, 0x44, 0x8B, 0x6B, 0x04);       /* mov r13d, [rbx + 4] */
+  JIT_BYTES(jit, 0x4C, 0x8B, 0x7B, 0x08);       /* mov r15, [rbx + 8] */
+  JIT_BYTES(jit, 0xFF, 0xE6);                   /* jmp rsi */
+
+  jit->exitNoLink = &jit->code[jit->used];
+  JIT_BYTES(jit, 0x31, 0xD2);                   /* xor edx, edx */
+  jit->exit = &jit->code[jit->used];
+  JIT_BYTES(jit, 0x44, 0x89, 0x23);             /* mov [rbx], r12d */
+  JIT_BYTES(jit, 0x44, 0x89, 0x6B, 0x04);       /* mov [rbx + 4], r13d */
+  JIT_BYTES(jit, 0x4C, 0x89, 0x7B, 0x08);       /* mov [rbx + 8], r15 */
+  JIT_BYTES(jit, 0x89, 0x43, 0x10);             /* mov [rbx + 16], eax */
+  JIT_BYTES(jit, 0x48, 0x89, 0x53, 0x18);       /* mov [rbx + 24], rdx */
+  JIT_BYTES(jit, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);  /* pop ..., ret */
+  jit->base = jit->used;
+
+  if(jitProtect(jit, 0U) != HEMU_SUCCESS)
+  {
+    /* No executable memory for us (e.g. an SELinux or PaX policy) */
+    hemuJitDestroy(jit);
+    return NULL;
+  }
+
+  return jit;
+}
+
+void hemuJitDestroy(Hemu_Jit *jit)
+{
+  if(jit != NULL)
+  {
+    munmap(jit->code, JIT_CODE_SIZE);
+    free(jit);
+  }
+}
+
+/* Drops every block, for a new program or a full code buffer */
+void hemuJitFlush(Hemu_Jit *jit)
+{
+  memset(jit->entries, 0, sizeof(jit->entries));
+  memset(jit->flags, 0, sizeof(jit->flags));
+  jit->used = jit->base;
+  jit->generation++;
+}
+
+/*
+ * Runs blocks until the budget is spent. An exit with a link is the first
+ * pass through a fixed exit: the target is compiled and the exit patched
+ * to enter it, unless compiling it flushed the buffer the exit was in.
+ */
+int32_t hemuJitRun(hemu_ctx *emu, uint64_t cycles)
+{
+  Hemu_Jit *jit = emu->jit;
+  Jit_Enter enter = (Jit_Enter)(void *)jit->code;
+  Jit_State state;
+  uint64_t start = emu->cycles;
+  uint32_t pc = emu->pc;
+  int32_t status = HEMU_LIMIT;
+
+  memset(&state, 0, sizeof(state));
+  state.a = emu->a;
+  state.d = emu->d;
+  state.remaining = cycles;
+
+  while(state.remaining != 0U)
+  {
+    void *entry = jitEntry(jit, emu->ops, pc);
+
+    state.link = JIT_LINK_STEP;
+    if( jit->failed || ((entry != NULL) && (jitProtect(jit, 0U) != HEMU_SUCCESS)) )
+    {
+      break;
+    }
+    else if(entry != NULL)
+    {
+      enter(&state, entry, jit->entries, emu->ram);
+      pc = state.pc;
+    }
+
+    if( (state.link == JIT_LINK_STEP) && (state.remaining == 0U) )
+    {
+      /* A chained block ran out of budget at its entry */
+      break;
+    }
+    else if(state.link == JIT_LINK_STEP)
+    {
+      uint64_t before = emu->cycles;
+
+      emu->a = (uint16_t)state.a;
+      emu->d = (uint16_t)state.d;
+      emu->pc = (uint16_t)pc;
+      status = hemuInterpret(emu, 1U);
+      state.remaining -= emu->cycles - before;
+      state.a = emu->a;
+      state.d = emu->d;
+      pc = emu->pc;
+
+      if(status == HEMU_HALTED)
+      {
+        break;
+      }
+    }
+    else if(state.link != JIT_LINK_NONE)
+    {
+      uint32_t generation = jit->generation;
+
+      entry = jitEntry(jit, emu->ops, pc);
+      if( (entry != NULL) && (generation == jit->generation) && (jitProtect(jit, 1U) == HEMU_SUCCESS) )
+      {
+        jitPatch((uint8_t *)state.link, entry);
+      }
+    }
+  }
+
+  emu->a = (uint16_t)state.a;
+  emu->d = (uint16_t)state.d;
+  emu->pc = (uint16_t)pc;
+  emu->cycles = start + (cycles - state.remaining);
+
+  if(jit->failed)
+  {
+    /* The same state, the interpreter takes the rest of the budget and every run after it */
+    hemuJitDestroy(jit);
+    emu->jit = NULL;
+    status = (state.remaining != 0U) ? hemuInterpret(emu, state.remaining) : status;
+  }
+
+  return status;
+}
+
+/* Code of the block at pc, compiled on first use; NULL when the word needs the interpreter */
+void *jitEntry(Hemu_Jit *jit, const Hemu_Op *ops, uint32_t pc)
+{
+  if( (jit->entries[pc] == NULL) && (jit->flags[pc] != JIT_INTERPRET) && (jitProtect(jit, 1U) == HEMU_SUCCESS) )
+  {
+    if((jit->used + JIT_BLOCK_BYTES) > JIT_CODE_SIZE)
+    {
+      hemuJitFlush(jit);
+    }
+    jit->entries[pc] = jitCompile(jit, ops, pc);
+    jit->flags[pc] = (jit->entries[pc] == NULL) ? JIT_INTERPRET : 0U;
+  }
+
+  return jit->entries[pc];
+}
+
+void *jitCompile(Hemu_Jit *jit, const Hemu_Op *ops, uint32_t pc)
+{
+  uint8_t *entry = &jit->code[jit->used];
+  uint8_t *lenCheck = NULL;
+  uint8_t *lenSub = NULL;
+  uint8_t *bail = NULL;
+  uint32_t len = 0U;
+  uint32_t addr = pc;
+  uint8_t known = 0U;     /* A holds ca, from an @X earlier in the block */
+  uint32_t ca = 0U;
+  uint8_t open = 1U;
+
+  JIT_BYTES(jit, 0x49, 0x83, 0xFF, 0x00);             /* cmp r15, len */
+  lenCheck = &jit->code[jit->used - 1U];
+  JIT_BYTES(jit, 0x0F, 0x82);                         /* jb bail */
+  bail = &jit->code[jit->used];
+  jitEmit32(jit, 0U);
+  JIT_BYTES(jit, 0x49, 0x83, 0xEF, 0x00);             /* sub r15, len */
+  lenSub = &jit->code[jit->used - 1U];
+
+  while(open)
+  {
+    uint16_t word = ops[addr].value;
+    uint32_t comp = jit->compIndex[(word >> COMP_FIELD_SHIFT) & HEMU_COMP_MASK];
+    uint32_t dest = word & HEMU_DEST_MASK;
+    uint32_t jump = word & HEMU_JUMP_MASK;
+    uint32_t target = ca & HEMU_ADDR_MASK;
+    uint8_t targetKnown = known;
+    uint32_t next = (addr + 1U) & HEMU_ADDR_MASK;
+
+    if(len == JIT_BLOCK_MAX)
+    {
+      jitExitFixed(jit, addr);
+      break;
+    }
+
+    if((word & HEMU_C_INST) == 0U)
+    {
+      JIT_BYTES(jit, 0x41, 0xBC);                     /* mov r12d, imm32 */
+      jitEmit32(jit, word);
+      known = 1U;
+      ca = word;
+      len++;
+      addr = next;
+      continue;
+    }
+
+    if( (dest == 0U) && (jump == 0U) )
+    {
+      /* Nothing is written, reading M has no effect */
+      len++;
+      addr = next;
+      continue;
+    }
+
+    if( ((comp == HEMU_COMP_NONE) && !((dest == 0U) && (jump == HEMU_JUMP_MASK))) ||
+        ((dest == 0U) && (jump == HEMU_JUMP_MASK) && targetKnown &&
+         ((target == addr) || ((target == ((addr - 1U) & HEMU_ADDR_MASK)) && (ops[target].value == target)))) )
+    {
+      /* Undocumented comp, or the halting loop: the interpreter takes this word */
+      if(len == 0U)
+      {
+        jit->used = (size_t)(entry - jit->code);
+        return NULL;
+      }
+      jitExitStep(jit, addr);
+      break;
+    }
+    len++;
+
+    if( (dest != 0U) || (jump != HEMU_JUMP_MASK) )
+    {
+      if(word & HEMU_A_SELECT)
+      {
+        if(known)
+        {
+          JIT_BYTES(jit, 0x41, 0x0F, 0xB7, 0x8E);     /* movzx ecx, word [r14 + 2 * ca] */
+          jitEmit32(jit, (ca & HEMU_ADDR_MASK) * 2U);
+        }
+        else
+        {
+          JIT_BYTES(jit, 0x44, 0x89, 0xE1);           /* mov ecx, r12d */
+          JIT_BYTES(jit, 0x81, 0xE1, 0xFF, 0x7F, 0x00, 0x00);  /* and ecx, 0x7FFF */
+          JIT_BYTES(jit, 0x41, 0x0F, 0xB7, 0x0C, 0x4E);        /* movzx ecx, word [r14 + 2 * rcx] */
+        }
+      }
+      jitComp(jit, comp);
+    }
+
+    if( (jump != 0U) && !targetKnown && (dest & HEMU_DEST_A) )
+    {
+      JIT_BYTES(jit, 0x44, 0x89, 0xE2);               /* mov edx, r12d: the jump goes to the old A */
+    }
+
+    if(dest & HEMU_DEST_M)
+    {
+      if(known)
+      {
+        uint32_t address = ca & HEMU_ADDR_MASK;
+
+        if(address < HEMU_KBD)
+        {
+          JIT_BYTES(jit, 0x66, 0x41, 0x89, 0x86);     /* mov [r14 + 2 * ca], ax */
+          jitEmit32(jit, address * 2U);
+        }
+        if( (address >= HEMU_SCREEN) && (address < HEMU_KBD) )
+        {
+          uint32_t row = (address - HEMU_SCREEN) / HEMU_SCREEN_WORDS;
+
+          JIT_BYTES(jit, 0x41, 0x0F, 0xBA, 0xAE);     /* bts dword [r14 + JIT_DIRTY + row / 8], row % 32 */
+          jitEmit32(jit, JIT_DIRTY + ((row >> 5) * 4U));
+          JIT_BYTES(jit, (uint8_t)(row & 31U));
+        }
+      }
+      else
+      {
+        JIT_BYTES(jit, 0x44, 0x89, 0xE1);             /* mov ecx, r12d */
+        JIT_BYTES(jit, 0x81, 0xE1, 0xFF, 0x7F, 0x00, 0x00);    /* and ecx, 0x7FFF */
+        JIT_BYTES(jit, 0x81, 0xF9, 0x00, 0x60, 0x00, 0x00);    /* cmp ecx, HEMU_KBD */
+        JIT_BYTES(jit, 0x73, 0x18);                   /* jae past the store */
+        JIT_BYTES(jit, 0x66, 0x41, 0x89, 0x04, 0x4E); /* mov [r14 + 2 * rcx], ax */
+        JIT_BYTES(jit, 0x81, 0xF9, 0x00, 0x40, 0x00, 0x00);    /* cmp ecx, HEMU_SCREEN */
+        JIT_BYTES(jit, 0x72, 0x0B);                   /* jb past the row mark */
+        JIT_BYTES(jit, 0xC1, 0xE9, 0x05);             /* shr ecx, 5: the row, 512 above the first */
+        JIT_BYTES(jit, 0x41, 0x0F, 0xAB, 0x8E);       /* bts [r14 + JIT_DIRTY - 64], ecx */
+        jitEmit32(jit, JIT_DIRTY - ((HEMU_SCREEN / HEMU_SCREEN_WORDS) / 8U));
+      }
+    }
+    if(dest & HEMU_DEST_A)
+    {
+      JIT_BYTES(jit, 0x41, 0x89, 0xC4);               /* mov r12d, eax */
+      known = 0U;
+    }
+    if(dest & HEMU_DEST_D)
+    {
+      JIT_BYTES(jit, 0x41, 0x89, 0xC5);               /* mov r13d, eax */
+    }
+
+    if(jump != 0U)
+    {
+      static const uint8_t jccOpcode[HEMU_JUMP_MASK] = { 0x8F, 0x84, 0x8D, 0x8C, 0x85, 0x8E, 0x00 };
+      uint8_t *taken = NULL;
+
+      if(jump != HEMU_JUMP_MASK)
+      {
+        JIT_BYTES(jit, 0x66, 0x85, 0xC0);             /* test ax, ax */
+        JIT_BYTES(jit, 0x0F, jccOpcode[jump - 1U]);   /* jcc taken */
+        taken = &jit->code[jit->used];
+        jitEmit32(jit, 0U);
+        jitExitFixed(jit, next);
+        jitPatch(taken, &jit->code[jit->used]);
+      }
+
+      if(targetKnown)
+      {
+        jitExitFixed(jit, target);
+      }
+      else
+      {
+        jitExitComputed(jit, (dest & HEMU_DEST_A) ? 1U : 0U, ops,
+                        ((dest == 0U) && (jump == HEMU_JUMP_MASK)) ? addr : HEMU_ROM_SIZE);
+      }
+      open = 0U;
+    }
+    addr = next;
+  }
+
+  /* Not enough budget for the whole block: one interpreted step at a time */
+  jitPatch(bail, &jit->code[jit->used]);
+  jitExitStep(jit, pc);
+
+  *lenCheck = (uint8_t)len;
+  *lenSub = (uint8_t)len;
+
+  return entry;
+}
+
+/* eax = comp of D (r13d), A (r12d) and M (ecx), zero extended from 16 bits */
+void jitComp(Hemu_Jit *jit, uint32_t comp)
+{
+  switch(comp)
+  {
+    case 0U:  JIT_BYTES(jit, 0x31, 0xC0); break;                                /* 0 */
+    case 1U:  JIT_BYTES(jit, 0xB8, 0x01, 0x00, 0x00, 0x00); break;              /* 1 */
+    case 2U:  JIT_BYTES(jit, 0xB8, 0xFF, 0xFF, 0x00, 0x00); break;              /* -1 */
+    case 3U:  JIT_BYTES(jit, 0x44, 0x89, 0xE8); break;                          /* D */
+    case 4U:  JIT_BYTES(jit, 0x44, 0x89, 0xE0); break;                          /* A */
+    case 5U:  JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0xF7, 0xD0); break;              /* !D */
+    case 6U:  JIT_BYTES(jit, 0x44, 0x89, 0xE0, 0xF7, 0xD0); break;              /* !A */
+    case 7U:  JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0xF7, 0xD8); break;              /* -D */
+    case 8U:  JIT_BYTES(jit, 0x44, 0x89, 0xE0, 0xF7, 0xD8); break;              /* -A */
+    case 9U:  JIT_BYTES(jit, 0x41, 0x8D, 0x45, 0x01); break;                    /* D+1 */
+    case 10U: JIT_BYTES(jit, 0x41, 0x8D, 0x44, 0x24, 0x01); break;              /* A+1 */
+    case 11U: JIT_BYTES(jit, 0x41, 0x8D, 0x45, 0xFF); break;                    /* D-1 */
+    case 12U: JIT_BYTES(jit, 0x41, 0x8D, 0x44, 0x24, 0xFF); break;              /* A-1 */
+    case 13U: JIT_BYTES(jit, 0x43, 0x8D, 0x04, 0x2C); break;                    /* D+A */
+    case 14U: JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0x44, 0x29, 0xE0); break;        /* D-A */
+    case 15U: JIT_BYTES(jit, 0x44, 0x89, 0xE0, 0x44, 0x29, 0xE8); break;        /* A-D */
+    case 16U: JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0x44, 0x21, 0xE0); break;        /* D&A */
+    case 17U: JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0x44, 0x09, 0xE0); break;        /* D|A */
+    case 18U: JIT_BYTES(jit, 0x89, 0xC8); break;                                /* M */
+    case 19U: JIT_BYTES(jit, 0x89, 0xC8, 0xF7, 0xD0); break;                    /* !M */
+    case 20U: JIT_BYTES(jit, 0x89, 0xC8, 0xF7, 0xD8); break;                    /* -M */
+    case 21U: JIT_BYTES(jit, 0x8D, 0x41, 0x01); break;                          /* M+1 */
+    case 22U: JIT_BYTES(jit, 0x8D, 0x41, 0xFF); break;                          /* M-1 */
+    case 23U: JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0x01, 0xC8); break;              /* D+M */
+    case 24U: JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0x29, 0xC8); break;              /* D-M */
+    case 25U: JIT_BYTES(jit, 0x89, 0xC8, 0x44, 0x29, 0xE8); break;              /* M-D */
+    case 26U: JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0x21, 0xC8); break;              /* D&M */
+    case 27U: JIT_BYTES(jit, 0x44, 0x89, 0xE8, 0x09, 0xC8); break;              /* D|M */
+    default: break;
+  }
+
+  if( (comp > 4U) && (comp != JIT_COMP_M) )
+  {
+    JIT_BYTES(jit, 0x0F, 0xB7, 0xC0);                 /* movzx eax, ax */
+  }
+}
+
+/* jmp to a fixed address: the block if compiled, else a stub that asks for the link */
+void jitExitFixed(Hemu_Jit *jit, uint32_t target)
+{
+  uint8_t *site = NULL;
+
+  if(jit->entries[target] != NULL)
+  {
+    JIT_BYTES(jit, 0xE9);
+    jitJump(jit, jit->entries[target]);
+    return;
+  }
+
+  JIT_BYTES(jit, 0xE9, 0x00, 0x00, 0x00, 0x00);       /* jmp to the stub right after */
+  site = &jit->code[jit->used - 4U];
+  JIT_BYTES(jit, 0xB8);                               /* mov eax, target */
+  jitEmit32(jit, target);
+  JIT_BYTES(jit, 0x48, 0xBA);                         /* mov rdx, site */
+  jitEmit32(jit, (uint32_t)(uintptr_t)site);
+  jitEmit32(jit, (uint32_t)((uint64_t)(uintptr_t)site >> 32));
+  JIT_BYTES(jit, 0xE9);
+  jitJump(jit, jit->exit);
+}
+
+/*
+ * jmp to the old A (r12d, or edx when the instruction loaded A) through
+ * the entry table. haltPc < HEMU_ROM_SIZE is a dest-less unconditional
+ * jump: landing on itself, or on the @X loading its own address, halts,
+ * which the interpreter reports, so that cycle is given back to it.
+ */
+void jitExitComputed(Hemu_Jit *jit, uint8_t fromEdx, const Hemu_Op *ops, uint32_t haltPc)
+{
+  uint8_t *halt[2] = { NULL, NULL };
+  uint8_t *miss = NULL;
+
+  if(fromEdx)
+  {
+    JIT_BYTES(jit, 0x89, 0xD0);                       /* mov eax, edx */
+  }
+  else
+  {
+    JIT_BYTES(jit, 0x44, 0x89, 0xE0);                 /* mov eax, r12d */
+  }
+  JIT_BYTES(jit, 0x25, 0xFF, 0x7F, 0x00, 0x00);       /* and eax, 0x7FFF */
+
+  if(haltPc < HEMU_ROM_SIZE)
+  {
+    uint32_t before = (haltPc - 1U) & HEMU_ADDR_MASK;
+
+    JIT_BYTES(jit, 0x3D);                             /* cmp eax, haltPc */
+    jitEmit32(jit, haltPc);
+    JIT_BYTES(jit, 0x0F, 0x84);                       /* je halt */
+    halt[0] = &jit->code[jit->used];
+    jitEmit32(jit, 0U);
+
+    if(ops[before].value == before)
+    {
+      JIT_BYTES(jit, 0x3D);                           /* cmp eax, haltPc - 1 */
+      jitEmit32(jit, before);
+      JIT_BYTES(jit, 0x0F, 0x84);                     /* je halt */
+      halt[1] = &jit->code[jit->used];
+      jitEmit32(jit, 0U);
+    }
+  }
+
+  JIT_BYTES(jit, 0x48, 0x8B, 0x4C, 0xC5, 0x00);       /* mov rcx, [rbp + 8 * rax] */
+  JIT_BYTES(jit, 0x48, 0x85, 0xC9);                   /* test rcx, rcx */
+  JIT_BYTES(jit, 0x0F, 0x84);                         /* jz exitNoLink */
+  miss = &jit->code[jit->used];
+  jitEmit32(jit, 0U);
+  jitPatch(miss, jit->exitNoLink);
+  JIT_BYTES(jit, 0xFF, 0xE1);                         /* jmp rcx */
+
+  if(halt[0] != NULL)
+  {
+    jitPatch(halt[0], &jit->code[jit->used]);
+    if(halt[1] != NULL)
+    {
+      jitPatch(halt[1], &jit->code[jit->used]);
+    }
+    JIT_BYTES(jit, 0x49, 0x83, 0xC7, 0x01);           /* add r15, 1 */
+    jitExitStep(jit, haltPc);
+  }
+}
+
+/* Leaves with the interpreter to execute the word at pc */
+void jitExitStep(Hemu_Jit *jit, uint32_t pc)
+{
+  JIT_BYTES(jit, 0xB8);                               /* mov eax, pc */
+  jitEmit32(jit, pc);
+  JIT_BYTES(jit, 0xBA);                               /* mov edx, JIT_LINK_STEP */
+  jitEmit32(jit, JIT_LINK_STEP);
+  JIT_BYTES(jit, 0xE9);
+  jitJump(jit, jit->exit);
+}
+
+/* rel32 of a jmp/jcc whose opcode was just emitted */
+void jitJump(Hemu_Jit *jit, const uint8_t *target)
+{
+  uint8_t *rel32 = &jit->code[jit->used];
+
+  jitEmit32(jit, 0U);
+  jitPatch(rel32, target);
+}
+
+void jitPatch(uint8_t *rel32, const uint8_t *target)
+{
+  int32_t rel = (int32_t)(target - (rel32 + 4));
+
+  memcpy(rel32, &rel, sizeof(rel));
+}
+
+void jitEmit(Hemu_Jit *jit, const uint8_t *bytes, uint32_t len)
+{
+  memcpy(&jit->code[jit->used], bytes, len);
+  jit->used += len;
+}
+
+void jitEmit32(Hemu_Jit *jit, uint32_t value)
+{
+  uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+
+  jitEmit(jit, bytes, 4U);
+}
+
+/* RW to write code, RX to run it; only a change of state costs a system call */
+int32_t jitProtect(Hemu_Jit *jit, uint8_t writable)
+{
+  if( !jit->failed && (jit->writable != writable) )
+  {
+    if(mprotect(jit->code, JIT_CODE_SIZE, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC)) == 0)
+    {
+      jit->writable = writable;
+    }
+    else
+    {
+      jit->failed = 1U;
+    }
+  }
+
+  return jit->failed ? HEMU_FAILURE : HEMU_SUCCESS;
+}
+
+#else
+
+/* No JIT on this host: hemu_set_jit() reports HEMU_FAILURE and every run is interpreted */
+Hemu_Jit *hemuJitCreate(void)
+{
+  return NULL;
+}
+
+void hemuJitDestroy(Hemu_Jit *jit)
+{
+  (void)jit;
+}
+
+void hemuJitFlush(Hemu_Jit *jit)
+{
+  (void)jit;
+}
+
+int32_t hemuJitRun(hemu_ctx *emu, uint64_t cycles)
+{
+  return hemuInterpret(emu, cycles);
+}
+
+#endif /* HEMU_JIT */
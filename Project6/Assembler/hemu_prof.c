@@ -0,0 +1,535 @@
+/**
+ * @file hemu_prof.c
+ * @brief Profiling interpreter of the Hack emulator library: the ops of
+ *        hemu.c with counters, for the hot spot reports and flame graphs
+ *        of n2temu.
+ *
+ * Counted over every profiled run:
+ * - the executions of every ROM word and the taken jumps of every jump
+ *   word, the not taken ones and the totals of the 7 conditions follow;
+ * - the reads and writes of every RAM word through M;
+ * - the cycles of a call tree built from the label map. A call is the
+ *   first jump after a label is loaded as data, unconditional and right
+ *   before that label (`@RET / D=A ... 0;JMP / (RET)`, the return address
+ *   convention of compiled VM code). Its frame is named by the first label
+ *   jumped to after it and ends with a jump to its return label, which
+ *   also drops any frame above that never returned. Within a frame the
+ *   cycles go to the label each straight run of code starts in.
+ * A straight run adds its words as a +1/-1 pair at its ends (see
+ * Hemu_Profile), so only taken jumps and RAM accesses touch counters.
+ * The RAM counters are the cost: Pong runs 9-22% slower than under
+ * hemuInterpret(), 2-9% with them taken out.
+ * The state and cycle count after a run are those of hemuInterpret().
+ */
+
+#include "hemu_internal.h"
+
+/* Macro Definitions */
+#define PROFILE_NODES_INIT (256U)   /* Call tree nodes, doubled on demand */
+#define PROFILE_HASH_INIT  (512U)   /* Power of two, kept at least 2x the nodes */
+
+/* Every M the comps read is counted, see HEMU_COMP_LIST */
+#undef HEMU_M
+#define HEMU_M           (reads[a & HEMU_ADDR_MASK]++, ram[a & HEMU_ADDR_MASK])
+
+/* Function Declarations */
+int32_t profileHashGrow(Hemu_Profile *prof);
+
+/*
+ * Profiles the program loaded from here on; map (kept, not copied) names
+ * the frames, without one every straight run is known by its address.
+ * Start it after hemu_load(), the calls are found in the ROM.
+ */
+int32_t hemuProfileStart(hemu_ctx *emu, const Source_Map *map)
+{
+  Hemu_Profile *prof = calloc(1U, sizeof(*prof));
+  uint32_t labels = (map != NULL) ? map->header.labelCount : 0U;
+  uint32_t last = HEMU_PROFILE_NONE;
+
+  if(prof == NULL)
+  {
+    return HEMU_FAILURE;
+  }
+
+  prof->map = map;
+  prof->nodes = malloc(PROFILE_NODES_INIT * sizeof(Hemu_Profile_Node));
+  prof->nodeSize = PROFILE_NODES_INIT;
+  prof->hash = calloc(PROFILE_HASH_INIT, sizeof(uint32_t));
+  prof->hashSize = PROFILE_HASH_INIT;
+  if( (prof->nodes == NULL) || (prof->hash == NULL) )
+  {
+    hemuProfileDestroy(prof);
+    return HEMU_FAILURE;
+  }
+  prof->nodes[0].parent = HEMU_PROFILE_NONE;
+  prof->nodes[0].symbol = HEMU_PROFILE_NONE;
+  prof->nodes[0].cycles = 0U;
+  prof->nodeCount = 1U;
+
+  /* Of labels at the same address the last one defined names it, the one closest to the code */
+  for(uint32_t i = 0U; i <= HEMU_ROM_SIZE; i++)
+  {
+    prof->symbolAt[i] = HEMU_PROFILE_NONE;
+    prof->memo[i].frame = HEMU_PROFILE_NONE;
+  }
+  for(uint32_t label = 0U; label < labels; label++)
+  {
+    if(map->symbols[label].value < HEMU_ROM_SIZE)
+    {
+      prof->symbolAt[map->symbols[label].value] = label;
+      prof->flags[map->symbols[label].value] |= HEMU_PROFILE_LABEL;
+    }
+  }
+  for(uint32_t i = 0U; i <= HEMU_ROM_SIZE; i++)
+  {
+    last = (prof->flags[i] & HEMU_PROFILE_LABEL) ? prof->symbolAt[i] : last;
+    prof->symbolAt[i] = (last != HEMU_PROFILE_NONE) ? last : (HEMU_PROFILE_ADDRESS | i);
+  }
+
+  /*
+   * Return labels: loaded by an @ whose value the next instruction uses as
+   * data, with no jump after it but the unconditional one, the call, right
+   * before the label. Function addresses are loaded as data too, never in
+   * the straight code leading into the function.
+   */
+  for(uint32_t i = 0U; (i + 1U) < HEMU_ROM_SIZE; i++)
+  {
+    uint16_t word = emu->ops[i].value;
+    uint16_t next = emu->ops[i + 1U].value;
+    uint32_t j = i + 1U;
+
+    if( ((word & HEMU_C_INST) == 0U) && (prof->flags[word] & HEMU_PROFILE_LABEL) &&
+        (word > i) && ((word - i) <= HEMU_PROFILE_REACH) &&
+        (next & HEMU_C_INST) && ((next & HEMU_JUMP_MASK) == 0U) )
+    {
+      while( ((j + 1U) < word) && (((emu->ops[j].value & HEMU_C_INST) == 0U) || ((emu->ops[j].value & HEMU_JUMP_MASK) == 0U)) )
+      {
+        j++;
+      }
+      if( ((j + 1U) == word) && (emu->ops[j].value & HEMU_C_INST) && ((emu->ops[j].value & HEMU_JUMP_MASK) == HEMU_JUMP_MASK) )
+      {
+        prof->flags[word] |= HEMU_PROFILE_RETURN;
+        prof->flags[j] |= HEMU_PROFILE_CALL;
+      }
+    }
+  }
+
+  hemuProfileDestroy(emu->profile);
+  emu->profile = prof;
+
+  /* The first straight run starts at the PC, as if jumped to from nowhere */
+  hemuProfileEnter(prof, HEMU_ROM_SIZE, emu->pc);
+
+  return HEMU_SUCCESS;
+}
+
+void hemuProfileDestroy(Hemu_Profile *prof)
+{
+  if(prof != NULL)
+  {
+    free(prof->nodes);
+    free(prof->hash);
+    free(prof);
+  }
+}
+
+/*
+ * Runs in slices the 32-bit RAM counters can take: a slice adds at most
+ * its cycles to any of them, so they are folded into the totals before
+ * the cycles since the last fold could wrap one.
+ */
+int32_t hemuProfileRun(hemu_ctx *emu, uint64_t cycles)
+{
+  Hemu_Profile *prof = emu->profile;
+  int32_t status = HEMU_LIMIT;
+
+  do
+  {
+    uint64_t slice = cycles;
+
+    if(prof->unfolded == HEMU_PROFILE_FOLD)
+    {
+      hemuProfileFold(prof);
+    }
+    if(slice > (HEMU_PROFILE_FOLD - prof->unfolded))
+    {
+      slice = HEMU_PROFILE_FOLD - prof->unfolded;
+    }
+    status = hemuProfileSlice(emu, slice);
+    prof->unfolded += slice;
+    cycles -= slice;
+  } while( (status == HEMU_LIMIT) && (cycles > 0U) );
+
+  return status;
+}
+
+/*
+ * hemuInterpret() with the counters. The handlers bound in the ops are
+ * hemuInterpret()'s labels, so here the kind picks the label from a table
+ * of this function's own. entry is the first word of the straight run in
+ * progress; the tree state the fast path of HEMU_RUN_END() reads is kept
+ * in locals, the RAM counters could alias it, and reloaded after a
+ * hemuProfileEnter().
+ */
+int32_t hemuProfileSlice(hemu_ctx *emu, uint64_t cycles)
+{
+  Hemu_Profile *prof = emu->profile;
+  const Hemu_Op *ops = emu->ops;
+  const Hemu_Op *op = &ops[emu->pc];
+  uint16_t *ram = emu->ram;
+  uint64_t *dirty = emu->screenDirty;
+  uint32_t *reads = prof->reads;
+  uint32_t *writes = prof->writes;
+  Hemu_Profile_Node *nodes = prof->nodes;
+  uint32_t leaf = prof->leaf;
+  uint32_t frame = prof->frame;
+  uint8_t entering = prof->entering;
+  uint16_t a = emu->a;
+  uint16_t d = emu->d;
+  uint32_t entry = emu->pc;
+  uint64_t remaining = cycles;
+  int32_t status = HEMU_LIMIT;
+
+#define HEMU_STORE_M(out) \
+  do \
+  { \
+    uint16_t address_ = (uint16_t)(a & HEMU_ADDR_MASK); \
+    writes[address_]++; \
+    if(address_ < HEMU_KBD) \
+    { \
+      ram[address_] = (out); \
+      if(address_ >= HEMU_SCREEN) { HEMU_MARK_ROW(dirty, address_); } \
+    } \
+  } while(0)
+
+/* The straight run ends at from, the next starts at to */
+#define HEMU_RUN_END(from, to) \
+  do \
+  { \
+    uint32_t from_ = (from); \
+    uint32_t to_ = (to); \
+    prof->starts[entry]++; \
+    prof->starts[from_ + 1U]--; \
+    nodes[leaf].cycles += from_ + 1U - entry; \
+    entry = to_; \
+    if( ((prof->flags[from_] & HEMU_PROFILE_CALL) | (prof->flags[to_] & HEMU_PROFILE_RETURN) | entering) || \
+        (prof->memo[to_].frame != frame) ) \
+    { \
+      hemuProfileEnter(prof, from_, to_); \
+      nodes = prof->nodes; \
+      leaf = prof->leaf; \
+      frame = prof->frame; \
+      entering = prof->entering; \
+    } \
+    else \
+    { \
+      leaf = prof->memo[to_].leaf; \
+    } \
+  } while(0)
+
+#if HEMU_THREADED
+#define HEMU_DISPATCH  do { if(remaining == 0U) { goto stop; } remaining--; goto *labels[op->kind]; } while(0)
+#define HEMU_OP_LABEL(name) hemu_##name:
+#define HEMU_LABEL_ADDR(name) &&hemu_##name,
+#define HEMU_COMP_LABELS(name, expr) \
+  HEMU_LABEL_ADDR(name##_M) HEMU_LABEL_ADDR(name##_D) HEMU_LABEL_ADDR(name##_MD) HEMU_LABEL_ADDR(name##_A) \
+  HEMU_LABEL_ADDR(name##_AM) HEMU_LABEL_ADDR(name##_AD) HEMU_LABEL_ADDR(name##_AMD) \
+  HEMU_LABEL_ADDR(name##_JGT) HEMU_LABEL_ADDR(name##_JEQ) HEMU_LABEL_ADDR(name##_JGE) \
+  HEMU_LABEL_ADDR(name##_JLT) HEMU_LABEL_ADDR(name##_JNE) HEMU_LABEL_ADDR(name##_JLE)
+
+  static const void *const labels[HEMU_OP_COUNT] =
+  {
+    HEMU_LABEL_ADDR(LOAD_A) HEMU_LABEL_ADDR(NOP) HEMU_LABEL_ADDR(JMP) HEMU_LABEL_ADDR(GENERIC) HEMU_LABEL_ADDR(WRAP)
+    HEMU_COMP_LIST(HEMU_COMP_LABELS)
+  };
+#else
+#define HEMU_DISPATCH  do { if(remaining == 0U) { goto stop; } remaining--; goto dispatch; } while(0)
+#define HEMU_OP_LABEL(name) case HEMU_OP_##name:
+#endif
+#define HEMU_NEXT      do { op++; HEMU_DISPATCH; } while(0)
+#define HEMU_GOTO \
+  do \
+  { \
+    uint32_t pc_ = (uint32_t)(op - ops); \
+    prof->taken[pc_]++; \
+    op = &ops[a & HEMU_ADDR_MASK]; \
+    HEMU_RUN_END(pc_, (uint32_t)(op - ops)); \
+    HEMU_DISPATCH; \
+  } while(0)
+#define HEMU_BRANCH(out, cond) \
+  do { int16_t out_ = (int16_t)(uint16_t)(out); if(out_ cond 0) { HEMU_GOTO; } HEMU_NEXT; } while(0)
+
+#define HEMU_COMP_CODE(name, expr) \
+  HEMU_OP_LABEL(name##_M)   { HEMU_STORE_M((uint16_t)(expr)); HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_D)   { d = (uint16_t)(expr); HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_MD)  { uint16_t out = (uint16_t)(expr); HEMU_STORE_M(out); d = out; HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_A)   { a = (uint16_t)(expr); HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_AM)  { uint16_t out = (uint16_t)(expr); HEMU_STORE_M(out); a = out; HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_AD)  { uint16_t out = (uint16_t)(expr); a = out; d = out; HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_AMD) { uint16_t out = (uint16_t)(expr); HEMU_STORE_M(out); a = out; d = out; HEMU_NEXT; } \
+  HEMU_OP_LABEL(name##_JGT) { HEMU_BRANCH(expr, >); } \
+  HEMU_OP_LABEL(name##_JEQ) { HEMU_BRANCH(expr, ==); } \
+  HEMU_OP_LABEL(name##_JGE) { HEMU_BRANCH(expr, >=); } \
+  HEMU_OP_LABEL(name##_JLT) { HEMU_BRANCH(expr, <); } \
+  HEMU_OP_LABEL(name##_JNE) { HEMU_BRANCH(expr, !=); } \
+  HEMU_OP_LABEL(name##_JLE) { HEMU_BRANCH(expr, <=); }
+
+  HEMU_DISPATCH;
+
+#if !HEMU_THREADED
+dispatch:
+  switch(op->kind)
+  {
+#endif
+  HEMU_OP_LABEL(LOAD_A)
+  {
+    a = op->value;
+    HEMU_NEXT;
+  }
+  HEMU_OP_LABEL(NOP)
+  {
+    HEMU_NEXT;
+  }
+  HEMU_OP_LABEL(JMP)
+  {
+    uint16_t target = (uint16_t)(a & HEMU_ADDR_MASK);
+    uint16_t pc = (uint16_t)(op - ops);
+
+    if( (target == pc) || ((target == (uint16_t)(pc - 1U)) && (ops[target].kind == HEMU_OP_LOAD_A) && (ops[target].value == target)) )
+    {
+      prof->taken[pc]++;
+      op = &ops[target];
+      HEMU_RUN_END(pc, target);
+      status = HEMU_HALTED;
+      goto stop;
+    }
+    HEMU_GOTO;
+  }
+  HEMU_OP_LABEL(GENERIC)
+  {
+    uint16_t instruction = op->value;
+    uint16_t address = (uint16_t)(a & HEMU_ADDR_MASK);
+    uint16_t out = 0U;
+
+    if(instruction & HEMU_A_SELECT)
+    {
+      reads[address]++;
+    }
+    out = hemuAlu(instruction, d, (instruction & HEMU_A_SELECT) ? ram[address] : a);
+    if(instruction & HEMU_DEST_M)
+    {
+      writes[address]++;
+      if(address < HEMU_KBD)
+      {
+        ram[address] = out;
+        if(address >= HEMU_SCREEN)
+        {
+          HEMU_MARK_ROW(dirty, address);
+        }
+      }
+    }
+    if(instruction & HEMU_DEST_A)
+    {
+      a = out;
+    }
+    if(instruction & HEMU_DEST_D)
+    {
+      d = out;
+    }
+    if((instruction & hemuJumpFlag(out)) != 0U)
+    {
+      uint32_t pc = (uint32_t)(op - ops);
+
+      prof->taken[pc]++;
+      op = &ops[address];
+      HEMU_RUN_END(pc, address);
+      HEMU_DISPATCH;
+    }
+    HEMU_NEXT;
+  }
+  HEMU_OP_LABEL(WRAP)
+  {
+    /* Not an instruction: give the cycle back, the run ends at the last word */
+    remaining++;
+    op = ops;
+    HEMU_RUN_END(HEMU_ROM_SIZE - 1U, 0U);
+    HEMU_DISPATCH;
+  }
+  HEMU_COMP_LIST(HEMU_COMP_CODE)
+#if !HEMU_THREADED
+  default:
+    break;
+  }
+#endif
+
+stop:
+  /* The words up to op ran; the run goes on from there next time */
+  if((uint32_t)(op - ops) > entry)
+  {
+    prof->starts[entry]++;
+    prof->starts[op - ops]--;
+    nodes[leaf].cycles += (uint32_t)(op - ops) - entry;
+  }
+  prof->leaf = leaf;
+  emu->a = a;
+  emu->d = d;
+  emu->pc = (uint16_t)((op - ops) & HEMU_ADDR_MASK);
+  emu->cycles += cycles - remaining;
+
+  return status;
+
+#undef HEMU_STORE_M
+#undef HEMU_RUN_END
+#undef HEMU_DISPATCH
+#undef HEMU_OP_LABEL
+#undef HEMU_NEXT
+#undef HEMU_GOTO
+#undef HEMU_BRANCH
+#undef HEMU_COMP_CODE
+}
+
+/*
+ * Slow path of a jump from "from" to "to": returns, calls, the frame's
+ * name once entered, and the leaf of a target the memo can't vouch for.
+ * A from of HEMU_ROM_SIZE is no jump at all.
+ */
+void hemuProfileEnter(Hemu_Profile *prof, uint32_t from, uint32_t to)
+{
+  uint32_t symbol = prof->symbolAt[to];
+
+  if( (prof->flags[to] & HEMU_PROFILE_RETURN) && (prof->depth > 0U) )
+  {
+    /*
+     * Back in the caller, whichever frames above it never returned. On the
+     * way into a call, a function sharing its address with an older return
+     * label is no return: only the call just made can come back then.
+     */
+    uint32_t bottom = (prof->entering || (prof->flags[from] & HEMU_PROFILE_CALL)) ? (prof->depth - 1U) : 0U;
+
+    for(uint32_t k = prof->depth; k > bottom; k--)
+    {
+      if(prof->calls[k - 1U].ret == to)
+      {
+        prof->frame = prof->calls[k - 1U].frame;
+        prof->depth = k - 1U;
+        prof->entering = 0U;
+        break;
+      }
+    }
+  }
+
+  if( (prof->flags[from] & HEMU_PROFILE_CALL) && (prof->depth < HEMU_PROFILE_DEPTH) )
+  {
+    prof->calls[prof->depth].ret = from + 1U;
+    prof->calls[prof->depth].frame = prof->frame;
+    prof->depth++;
+    prof->entering = 1U;
+  }
+
+  if(prof->entering && (prof->flags[to] & HEMU_PROFILE_LABEL))
+  {
+    prof->frame = hemuProfileNode(prof, prof->frame, symbol);
+    prof->entering = 0U;
+  }
+
+  if(prof->memo[to].frame != prof->frame)
+  {
+    prof->memo[to].frame = prof->frame;
+    prof->memo[to].leaf = (symbol == prof->nodes[prof->frame].symbol) ? prof->frame :
+                          hemuProfileNode(prof, prof->frame, symbol);
+  }
+  prof->leaf = prof->memo[to].leaf;
+}
+
+/* Child of parent for symbol, added on first use; parent itself when out of memory */
+uint32_t hemuProfileNode(Hemu_Profile *prof, uint32_t parent, uint32_t symbol)
+{
+  uint32_t mask = prof->hashSize - 1U;
+  uint32_t slot = ((parent * 0x9E3779B1U) ^ (symbol * 0x85EBCA6BU)) & mask;
+
+  while(prof->hash[slot] != 0U)
+  {
+    const Hemu_Profile_Node *node = &prof->nodes[prof->hash[slot] - 1U];
+
+    if( (node->parent == parent) && (node->symbol == symbol) )
+    {
+      return prof->hash[slot] - 1U;
+    }
+    slot = (slot + 1U) & mask;
+  }
+
+  if( (growArray((void **)&prof->nodes, &prof->nodeSize, sizeof(Hemu_Profile_Node), prof->nodeCount + 1U) != SYSTEM_SUCCESS) ||
+      (((prof->nodeCount + 1U) * 2U > prof->hashSize) && (profileHashGrow(prof) != SYSTEM_SUCCESS)) )
+  {
+    prof->failed = 1U;
+    return parent;
+  }
+
+  prof->nodes[prof->nodeCount].parent = parent;
+  prof->nodes[prof->nodeCount].symbol = symbol;
+  prof->nodes[prof->nodeCount].cycles = 0U;
+  prof->nodeCount++;
+
+  /* The table may have grown: index the node from scratch */
+  mask = prof->hashSize - 1U;
+  slot = ((parent * 0x9E3779B1U) ^ (symbol * 0x85EBCA6BU)) & mask;
+  while(prof->hash[slot] != 0U)
+  {
+    slot = (slot + 1U) & mask;
+  }
+  prof->hash[slot] = prof->nodeCount;
+
+  return prof->nodeCount - 1U;
+}
+
+int32_t profileHashGrow(Hemu_Profile *prof)
+{
+  uint32_t size = prof->hashSize * 2U;
+  uint32_t *hash = calloc(size, sizeof(uint32_t));
+
+  if(hash == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  for(uint32_t i = 0U; i < prof->nodeCount; i++)
+  {
+    uint32_t slot = ((prof->nodes[i].parent * 0x9E3779B1U) ^ (prof->nodes[i].symbol * 0x85EBCA6BU)) & (size - 1U);
+
+    while(hash[slot] != 0U)
+    {
+      slot = (slot + 1U) & (size - 1U);
+    }
+    hash[slot] = i + 1U;
+  }
+  free(prof->hash);
+  prof->hash = hash;
+  prof->hashSize = size;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Adds the RAM counters since the last fold to readTotals[] and writeTotals[] */
+void hemuProfileFold(Hemu_Profile *prof)
+{
+  for(uint32_t address = 0U; address < HEMU_RAM_SIZE; address++)
+  {
+    prof->readTotals[address] += prof->reads[address];
+    prof->writeTotals[address] += prof->writes[address];
+  }
+  memset(prof->reads, 0, sizeof(prof->reads));
+  memset(prof->writes, 0, sizeof(prof->writes));
+  prof->unfolded = 0U;
+}
+
+/* Executions of every ROM word so far, HEMU_ROM_SIZE of them */
+void hemuProfileCounts(const Hemu_Profile *prof, uint64_t *counts)
+{
+  int64_t sum = 0;
+
+  for(uint32_t i = 0U; i < HEMU_ROM_SIZE; i++)
+  {
+    sum += prof->starts[i];
+    counts[i] = (uint64_t)sum;
+  }
+}
@@ -1,647 +1,1520 @@
-/*
-Assembler for Hack Computer
 /**
  * @file n2tAssembler.c
- * @brief This assembler converts assembly language code into machine code for the Hack computer.
+ * @brief Command line front end of the Hack assembler.
  *
- * The assembler operates using a two-pass approach:
- * 1. **First Pass**: Scans the assembly code to build a symbol table by identifying all label declarations 
- *    and their corresponding memory addresses.
- * 2. **Second Pass**: Translates the assembly instructions into Hack machine code, using the symbol table 
- *    to resolve symbols and variables.
- * 
- * This program is an assembler for the Nand2Tetris Hack computer. It processes
- * assembly language files (.asm) and converts them into binary machine code (.hack).
- * 
- * Functionality:
- * - Opens and processes each line of the input assembly file (e.g., Add.asm).
- * - Reads each line into a temporary buffer and passes it to the "Parser" module.
- * - The "Parser" module splits the instructions into corresponding fields:
- *   - Opcode
- *   - Destination
- *   - Compare
- *   - Jump
- *   - Address field
- *   - For A-instructions: Only Opcode and Address field are valid.
- *   - For C-instructions: Address field is invalid.
- * - The parsed fields are passed to the "Command" module, which populates the
- *   corresponding bit positions based on the fields.
- * 
- * Symbol Table:
- * - Manages variables and labels used in the assembly code.
- * 
- * Handles:
- * - White spaces and comments in the input file.
- * 
- * Modules:
- * - Parser: Responsible for parsing assembly instructions into fields.
- * - Command: Converts parsed fields into binary machine code.
- * - Symbol table management: Manages symbols (variables and labels).
- * - Main function: Coordinates the overall flow of the assembler.
+ * The assembler itself is the hasm library (hasm.c): scanning, the symbol
+ * table, the passes (two-pass, --single-pass, --threads, --incremental,
+ * --stream, --optimize) and the output formats. This file only handles
+ * the options and the input list (arguments, --manifest, --glob or the
+ * interactive prompt), assembles each file on a context of its own, on
+ * --jobs threads when asked, and reports the failed files. --self-test and
+ * --bench also live here.
  */
 
-#include <stdio.h>
-#include <string.h>
-#include <stdint.h>
-#include <math.h>
+#include "hasm_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <glob.h>
+#define N2T_HAVE_GLOB    (1)
+#else
+#define N2T_HAVE_GLOB    (0)
+#endif
 
 /* Macro Definitions */
-#define SYSTEM_SUCCESS   (1U)
-#define SYSTEM_FAILURE   ((int32_t)(-1))
 #define LINEBUFFER_SIZE  (100U)
-#define BITFIELD_MAX     (16U)
-#define COMP_FIELD_LEN   (7U)
-#define DEST_FIELD_LEN   (3U)
-#define JUMP_FIELD_LEN   (3U)
-#define C_INST_PAD_LEN   (3U)
-#define INVALID_VALUE    (0xFFU)
-#define CURR_MEMORY      (16U)
-#define SYMBOLTABLE_TAIL (23U)
+#define JOB_LIST_INIT    (16U)      /* Initial entries of the input file list */
+#define STATS_REPORT_SIZE  (2048U)
+
+/* --bench defaults */
+#define BENCH_DEFAULT_SIZE   (1000000U)
+#define BENCH_DEFAULT_LABELS (5U)     /* Labels per 100 instructions of the first 32K */
+#define BENCH_DEFAULT_VARS   (1000U)
+#define BENCH_DEFAULT_A      (40U)    /* Percent of A-instructions */
+#define BENCH_MAX_LINE       (32U)    /* Longest generated line, newline included */
+#define BENCH_MAX_VARS       (ADDRESS_MAX + 1U - CURR_MEMORY)
 
 /* Variable Definitions */
+/* Options shared by every file of an invocation */
+typedef struct
+{
+  uint8_t onePass;
+  uint32_t format;
+  uint32_t workers;
+  uint32_t encodeThreads;
+  uint8_t incremental;
+  uint8_t stats;
+  uint8_t stream;
+  uint8_t optimize;
+  uint8_t map;
+} Assembler_Options;
+
+/* Synthetic program for --bench */
+typedef struct
+{
+  uint32_t instructions;
+  uint32_t labelPercent;
+  uint32_t variables;
+  uint32_t aPercent;
+  const uint8_t *goldenDir;
+} Bench_Options;
+
+/* One input file and the output it is assembled to */
+typedef struct
+{
+  uint8_t *inPath;
+  uint8_t *outPath;
+} Assembler_Job;
+
 typedef struct
 {
-  uint8_t *mnemonic;
-  uint8_t *binary;
-} Instruction_Encoding;
+  Assembler_Job *jobs;
+  uint32_t count;
+  uint32_t size;
+} Job_List;
 
+#if N2T_HAVE_THREADS
+/*
+ * Work-stealing pool for batch mode: every worker owns a deque of job
+ * indices, pops from its tail and, once empty, steals from another
+ * worker's head. Jobs never create jobs, so all deques empty means done.
+ */
 typedef struct
 {
-  uint8_t symbol[LINEBUFFER_SIZE];
-  uint32_t value;
-} Symbol_Table;
+  pthread_mutex_t lock;
+  uint32_t *jobs;
+  uint32_t head;
+  uint32_t tail;
+} Work_Queue;
 
 typedef struct
 {
-  uint32_t symbolTableTail;
-  uint32_t currMemory;
-} SymbolTableMeta;
+  const Job_List *list;
+  const Assembler_Options *options;
+  Work_Queue *queues;
+  uint32_t workerCount;
+  pthread_mutex_t failedLock;
+  uint32_t failed;
+} Job_Pool;
 
-/* ISA Fields */
 typedef struct
 {
-  /* For C instruction */
-  uint8_t destFldString[5];
-  uint8_t jmpFldString[5];
-  uint8_t cmpFldString[5];
-
-  /* For A instruction */
-  uint8_t addFldString[10];
-
-  /* Bit Fields */
-  uint8_t bitFields[17];
-} ISA_Field;
-
-/* LookUp Table for "Comp" Field */
-Instruction_Encoding compFieldLT[] = 
-{
-  { "0"   , "0101010" },
-  { "1"   , "0111111" },
-  { "-1"  , "0111010" },
-  { "D"   , "0001100" },
-  { "A"   , "0110000" } ,
-  { "!D"  , "0001101" },
-  { "!A"  , "0110001" },
-  { "-D"  , "0001111" },
-  { "-A"  , "0110011" },
-  { "D+1" , "0011111" },
-  { "A+1" , "0110111" },
-  { "D-1" , "0001110" },
-  { "A-1" , "0110010" },
-  { "D+A" , "0000010" },
-  { "D-A" , "0010011" },
-  { "A-D" , "0000111" },
-  { "D&A" , "0000000" },
-  { "D|A" , "0010101" },
-  { "M"   , "1110000" } ,
-  { "!M"  , "1110001" },
-  { "-M"  , "1110011" },
-  { "M+1" , "1110111" },
-  { "M-1" , "1110010" },
-  { "D+M" , "1000010" },
-  { "D-M" , "1010011" },
-  { "M-D" , "1000111" },
-  { "D&M" , "1000000" },
-  { "D|M" , "1010101" },
-};
-
-/* LookUp Table for "Dest" Field */
-Instruction_Encoding destFieldLT[] = 
-{
-  { "\0"  , "000" },
-  { "M"   , "001" },
-  { "D"   , "010" },
-  { "MD"  , "011" },
-  { "A"   , "100" },
-  { "AM"  , "101" },
-  { "AD"  , "110" },
-  { "AMD" , "111" },
-};
-
-/* LookUp Table for "Jump" Field */
-Instruction_Encoding jumpFieldLT[] = 
-{
-  { "\0"  , "000" },
-  { "JGT" , "001" },
-  { "JEQ" , "010" },
-  { "JGE" , "011" },
-  { "JLT" , "100" },
-  { "JNE" , "101" },
-  { "JLE" , "110" },
-  { "JMP" , "111" },
-};
-
-/* Symbol Table */
-Symbol_Table gSymbolTable[65535] = 
-{
-  { "R0"      , 0       },
-  { "R1"      , 1       },
-  { "R2"      , 2       },
-  { "R3"      , 3       },
-  { "R4"      , 4       },
-  { "R5"      , 5       },
-  { "R6"      , 6       },
-  { "R7"      , 7       },
-  { "R8"      , 8       },
-  { "R9"      , 9       },
-  { "R10"     , 10      },
-  { "R11"     , 11      },
-  { "R12"     , 12      },
-  { "R13"     , 13      },
-  { "R14"     , 14      },
-  { "R15"     , 15      },
-  { "SCREEN"  , 16384   },
-  { "KBD"     , 24576   },
-  { "SP"      , 0       },
-  { "LCL"     , 1       },
-  { "ARG"     , 2       },
-  { "THIS"    , 3       },
-  { "THAT"    , 4       },
-};
-
-ISA_Field gInsFields;
-SymbolTableMeta gSymbolTableMeta =
-{
-  .symbolTableTail = 23,
-  .currMemory = CURR_MEMORY,
-};
-uint8_t inputFile[LINEBUFFER_SIZE];
-uint8_t outputFile[LINEBUFFER_SIZE];
+  Job_Pool *pool;
+  uint32_t id;
+} Worker_Arg;
+#endif
 
 /* Function Declarations */
-int32_t lineParser(uint8_t *line);
-int32_t lineCommand(void);
-void lineWriter(FILE *filePtr);
-void varInit(void *arg);
-void  firstPass(FILE *filePtr);
-void secondPass(FILE *ipFilePtr, FILE *opFilePtr);
-void  searchSymbolEntry(uint8_t *str);
-
-int main()
+int32_t selfTest(void);
+int32_t benchRun(const Bench_Options *bench, const Assembler_Options *options);
+int32_t benchGenerate(const Bench_Options *bench, Source_Buffer *src);
+int32_t benchEncode(Assembler_Context *ctx, const Source_Buffer *src, uint16_t **words, uint32_t *wordCount);
+uint32_t benchGolden(Assembler_Context *ctx, const uint8_t *dir);
+void benchReport(const uint8_t *phase, double seconds, uint64_t lines, uint64_t bytes);
+uint32_t benchRandom(uint32_t *state);
+uint8_t *putDecimal(uint8_t *out, uint32_t value);
+int32_t parseNumber(const uint8_t *str, uint32_t *value);
+int32_t assembleFile(Assembler_Context *ctx, const uint8_t *inPath, const uint8_t *outPath, const Assembler_Options *options);
+int32_t jobListAdd(Job_List *list, const uint8_t *inPath, uint32_t inLen, const uint8_t *outPath, uint32_t outLen);
+int32_t jobListManifest(Job_List *list, const uint8_t *path);
+int32_t jobListGlob(Job_List *list, const uint8_t *pattern);
+void jobListFree(Job_List *list);
+uint8_t *outputPathFor(const uint8_t *inPath, uint32_t inLen, uint32_t format);
+uint8_t *copyString(const uint8_t *str, uint32_t len);
+void usage(const uint8_t *program);
+uint32_t assembleSerial(const Job_List *list, const Assembler_Options *options);
+uint32_t assembleParallel(const Job_List *list, const Assembler_Options *options);
+#if N2T_HAVE_THREADS
+uint32_t workerNextJob(Job_Pool *pool, uint32_t id, uint32_t *job);
+void *workerMain(void *arg);
+#endif
+int32_t threadCount(const uint8_t *str, uint32_t *count);
+int32_t mapWrite(Assembler_Context *ctx, const uint8_t *inPath, const uint8_t *outPath, uint32_t format);
+#if N2T_ENABLE_STATS
+void statsReport(const Assembler_Context *ctx, const Output_Writer *writer, const uint8_t *inPath, uint8_t mode);
+#endif
+
+int main(int argc, char **argv)
 {
   int32_t status = SYSTEM_SUCCESS;
-  
-  /* Init the variables */
-  varInit(NULL);
+  Assembler_Options options = { .onePass = 0U, .format = OUTPUT_FORMAT_HACK, .workers = 1U, .encodeThreads = 1U, .incremental = 0U, .stats = STATS_OFF, .stream = 0U, .optimize = 0U, .map = MAP_OFF };
+  Job_List list = { NULL, 0U, 0U };
+  const uint8_t *outPath = NULL;
+  uint8_t runSelfTest = 0U;
+  uint8_t runBench = 0U;
+  Bench_Options bench = { BENCH_DEFAULT_SIZE, BENCH_DEFAULT_LABELS, BENCH_DEFAULT_VARS, BENCH_DEFAULT_A, "src" };
+  uint32_t failed = 0U;
+
+  /* Options */
+  for(int32_t arg = 1; (arg < argc) && (status == SYSTEM_SUCCESS); arg++)
+  {
+    if( !strcmp(argv[arg], "-s") || !strcmp(argv[arg], "--single-pass") )
+    {
+      /* Resolve forward label references by backpatching */
+      options.onePass = 1U;
+    }
+    else if(!strncmp(argv[arg], "--format=", 9U))
+    {
+      /* Output format */
+      for(options.format = 0U; options.format < OUTPUT_FORMAT_COUNT; options.format++)
+      {
+        if(!strcmp(&argv[arg][9], outputFormats[options.format].name))
+        {
+          break;
+        }
+      }
 
-  printf("Enter the input file name\n");
-  scanf("%s", inputFile);
+      if(options.format == OUTPUT_FORMAT_COUNT)
+      {
+        fprintf(stderr, "Unknown format %s\n", &argv[arg][9]);
+        status = SYSTEM_FAILURE;
+      }
+    }
+    else if( (!strcmp(argv[arg], "-j") && ((arg + 1) < argc)) || !strncmp(argv[arg], "--jobs=", 7U) )
+    {
+      /* Worker threads for batch mode */
+      status = threadCount((argv[arg][1] == 'j') ? argv[++arg] : &argv[arg][7], &options.workers);
+    }
+    else if( (!strcmp(argv[arg], "-t") && ((arg + 1) < argc)) || !strncmp(argv[arg], "--threads=", 10U) )
+    {
+      /* Threads encoding the instructions of each file */
+      status = threadCount((argv[arg][1] == 't') ? argv[++arg] : &argv[arg][10], &options.encodeThreads);
+    }
+    else if( !strcmp(argv[arg], "-o") && ((arg + 1) < argc) )
+    {
+      /* Output file of a single input */
+      outPath = argv[++arg];
+    }
+    else if( !strcmp(argv[arg], "--manifest") && ((arg + 1) < argc) )
+    {
+      /* File listing the inputs, one per line */
+      status = jobListManifest(&list, argv[++arg]);
+    }
+    else if( !strcmp(argv[arg], "--glob") && ((arg + 1) < argc) )
+    {
+      /* Every file matching a pattern */
+      status = jobListGlob(&list, argv[++arg]);
+    }
+    else if( !strcmp(argv[arg], "-i") || !strcmp(argv[arg], "--incremental") )
+    {
+      /* Reuse the previous run's words through the sidecar cache */
+      options.incremental = 1U;
+    }
+    else if( !strcmp(argv[arg], "--stats") || !strcmp(argv[arg], "--stats=text") || !strcmp(argv[arg], "--stats=json") )
+    {
+      /* Per file counters and phase times on stderr */
+      options.stats = (argv[arg][7] == '=' && argv[arg][8] == 'j') ? STATS_JSON : STATS_TEXT;
+#if !N2T_ENABLE_STATS
+      fprintf(stderr, "Built without N2T_ENABLE_STATS, --stats is ignored\n");
+      options.stats = STATS_OFF;
+#endif
+    }
+    else if(!strcmp(argv[arg], "--stream"))
+    {
+      /* Read the input as it arrives and write what is final right away */
+      options.stream = 1U;
+    }
+    else if( !strcmp(argv[arg], "-O") || !strcmp(argv[arg], "--optimize") )
+    {
+      /* Peephole rewrites of the decoded program, the labels placed again */
+      options.optimize = 1U;
+    }
+    else if( !strcmp(argv[arg], "--map") || !strcmp(argv[arg], "--map=json") )
+    {
+      /* Labels, variables and the source position of every word, for profilers */
+      options.map = (argv[arg][5] == '=') ? MAP_JSON : MAP_BINARY;
+    }
+    else if(!strcmp(argv[arg], "--self-test"))
+    {
+      /* Check the field decoders against the lookup tables */
+      runSelfTest = 1U;
+    }
+    else if( !strcmp(argv[arg], "--bench") || !strncmp(argv[arg], "--bench=", 8U) )
+    {
+      /* Throughput of a synthetic program, then the golden files */
+      runBench = 1U;
+      if(argv[arg][7] == '=')
+      {
+        status = parseNumber(&argv[arg][8], &bench.instructions);
+      }
+    }
+    else if(!strncmp(argv[arg], "--bench-labels=", 15U))
+    {
+      status = parseNumber(&argv[arg][15], &bench.labelPercent);
+      status = (bench.labelPercent <= 100U) ? status : SYSTEM_FAILURE;
+    }
+    else if(!strncmp(argv[arg], "--bench-vars=", 13U))
+    {
+      status = parseNumber(&argv[arg][13], &bench.variables);
+      bench.variables = (bench.variables > BENCH_MAX_VARS) ? BENCH_MAX_VARS : bench.variables;
+    }
+    else if(!strncmp(argv[arg], "--bench-a=", 10U))
+    {
+      status = parseNumber(&argv[arg][10], &bench.aPercent);
+      status = (bench.aPercent <= 100U) ? status : SYSTEM_FAILURE;
+    }
+    else if( !strcmp(argv[arg], "--golden") && ((arg + 1) < argc) )
+    {
+      /* Directory of the X.asm / X.hack pairs checked by --bench */
+      bench.goldenDir = argv[++arg];
+    }
+    else if( !strcmp(argv[arg], "-h") || !strcmp(argv[arg], "--help") )
+    {
+      usage(argv[0]);
+      jobListFree(&list);
+      return EXIT_SUCCESS;
+    }
+    else if( (argv[arg][0] != '-') || !strcmp(argv[arg], "-") )
+    {
+      /* Input file */
+      status = jobListAdd(&list, argv[arg], strlen(argv[arg]), NULL, 0U);
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[arg]);
+      status = SYSTEM_FAILURE;
+    }
 
-  printf("Enter the output file name\n");
-  scanf("%s", outputFile);
+    if( (status != SYSTEM_SUCCESS) && !strncmp(argv[arg], "--bench", 7U) )
+    {
+      fprintf(stderr, "Invalid value in %s\n", argv[arg]);
+    }
+  }
 
-  /*Open the file*/
-  FILE *ipFilePtr = fopen(inputFile,"r");
-  FILE *opFilePtr = fopen(outputFile,"w");
+  if( (status == SYSTEM_SUCCESS) && options.stream && options.optimize )
+  {
+    fprintf(stderr, "-O needs the whole program, it can't be combined with --stream\n");
+    status = SYSTEM_FAILURE;
+  }
 
-  if(ipFilePtr == NULL || opFilePtr == NULL)
+  if( (status == SYSTEM_SUCCESS) && options.stream && (options.map != MAP_OFF) )
   {
+    fprintf(stderr, "--map can't be combined with --stream\n");
     status = SYSTEM_FAILURE;
   }
 
-  if(status == SYSTEM_SUCCESS)
+  if( (status == SYSTEM_SUCCESS) && (options.onePass || options.incremental) && (options.map != MAP_OFF) )
   {
-    /* First Pass to find lablels */
-    firstPass(ipFilePtr);
+    /* The map is recorded by the two passes (or -t, -O), the others write words it can't place */
+    fprintf(stderr, "--map can't be combined with %s\n", options.onePass ? "-s" : "-i");
+    status = SYSTEM_FAILURE;
+  }
 
-    /* Second Pass to find resolve variables & instructions */
-    secondPass(ipFilePtr, opFilePtr);
+  if(status != SYSTEM_SUCCESS)
+  {
+    usage(argv[0]);
+    jobListFree(&list);
+    return EXIT_FAILURE;
+  }
+
+  if(runSelfTest)
+  {
+    jobListFree(&list);
+    return (selfTest() == SYSTEM_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if(runBench)
+  {
+    jobListFree(&list);
+    return (benchRun(&bench, &options) == SYSTEM_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if( (list.count == 0U) && options.stream )
+  {
+    /* Pipeline stage: stdin to stdout (or -o) */
+    status = jobListAdd(&list, "-", 1U, NULL, 0U);
+  }
+
+  if(list.count == 0U)
+  {
+    /* No inputs on the command line: ask for them */
+    uint8_t inputFile[LINEBUFFER_SIZE];
+    uint8_t outputFile[LINEBUFFER_SIZE];
+
+    printf("Enter the input file name\n");
+    if(scanf("%99s", inputFile) != 1)
+    {
+      return EXIT_FAILURE;
+    }
+
+    printf("Enter the output file name\n");
+    if(scanf("%99s", outputFile) != 1)
+    {
+      return EXIT_FAILURE;
+    }
+
+    status = jobListAdd(&list, inputFile, strlen(inputFile), outputFile, strlen(outputFile));
+  }
+  else if(outPath != NULL)
+  {
+    if(list.count > 1U)
+    {
+      fprintf(stderr, "-o needs a single input file\n");
+      jobListFree(&list);
+      return EXIT_FAILURE;
+    }
+
+    free(list.jobs[0].outPath);
+    list.jobs[0].outPath = copyString(outPath, strlen(outPath));
+    status = (list.jobs[0].outPath != NULL) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+  }
+
+  for(uint32_t job = 0U; (job < list.count) && (status == SYSTEM_SUCCESS); job++)
+  {
+    if(list.jobs[job].outPath == NULL)
+    {
+      list.jobs[job].outPath = outputPathFor(list.jobs[job].inPath, strlen(list.jobs[job].inPath), options.format);
+      status = (list.jobs[job].outPath != NULL) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    }
+  }
+
+  if(status != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Out of memory\n");
+    jobListFree(&list);
+    return EXIT_FAILURE;
+  }
+
+  /* Assemble every file in this process */
+  if( (options.workers > 1U) && (list.count > 1U) )
+  {
+    failed = assembleParallel(&list, &options);
   }
   else
   {
-    printf("Error handling files \n");
+    failed = assembleSerial(&list, &options);
+  }
+
+  if( (failed > 0U) && (list.count > 1U) )
+  {
+    /* One line to grep for in a CI log of many files */
+    fprintf(stderr, "%u of %u files failed\n", failed, list.count);
+  }
+
+  jobListFree(&list);
+
+  return (failed == 0U) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Parses a -j/-t thread count, 0 is one per online CPU */
+int32_t threadCount(const uint8_t *str, uint32_t *count)
+{
+  if(parseNumber(str, count) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Invalid thread count %s\n", str);
+    return SYSTEM_FAILURE;
+  }
+#if N2T_HAVE_THREADS
+  if(*count == 0U)
+  {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    *count = (online > 0) ? (uint32_t)online : 1U;
+  }
+#else
+  *count = 1U;
+#endif
+  *count = (*count > MAX_WORKERS) ? MAX_WORKERS : *count;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Whole string as an unsigned decimal */
+int32_t parseNumber(const uint8_t *str, uint32_t *value)
+{
+  uint8_t *end = NULL;
+  unsigned long number = strtoul(str, (char **)&end, 10);
+
+  if( (end == str) || (*end != '\0') || (str[0] == '-') || (number > 0xFFFFFFFFUL) )
+  {
+    return SYSTEM_FAILURE;
   }
+  *value = (uint32_t)number;
+
+  return SYSTEM_SUCCESS;
 }
 
-/* First Pass of assembler to resolve labels */
-void  firstPass(FILE *ipFilePtr)
+void usage(const uint8_t *program)
 {
-  uint8_t lineBuff[LINEBUFFER_SIZE] = {0};
-  uint32_t lineCount = 0;
-  uint32_t charCount = 1;
+  fprintf(stderr,
+          "Usage: %s [options] [file.asm ...]\n"
+          "  -o FILE            output file (single input; default: input with the format's extension)\n"
+          "  -s, --single-pass  backpatch forward label references instead of a second pass\n"
+          "  --format=FMT       hack, bin-le, bin-be, ihex, memb or memh\n"
+          "  --manifest FILE    assemble the inputs listed in FILE (\"in.asm [out]\" per line)\n"
+          "  --glob PATTERN     assemble every file matching PATTERN\n"
+          "  -j N, --jobs=N     assemble files on N threads (0: one per CPU)\n"
+          "  -t N, --threads=N  encode the instructions of each file on N threads\n"
+          "  -i, --incremental  re-encode only what changed since the last run (OUT" CACHE_EXTENSION " sidecar)\n"
+          "  --stream           assemble a pipe (stdin without inputs) in one bounded pass as it arrives\n"
+          "  -O, --optimize     drop redundant loads and jumps, fold constants and place the labels again\n"
+          "                     (instead of -s, -t and -i; not with --stream)\n"
+          "  --map[=json]       write labels, variables and the source line of every word to OUT" MAP_EXTENSION "\n"
+          "                     (OUT" MAP_JSON_EXTENSION " for json; not with -s, -i or --stream)\n"
+          "  --stats[=json]     per file counters and phase times on stderr (text or JSON)\n"
+          "  --self-test        check the field decoders and the rejection of malformed lines\n"
+          "  --bench[=N]        time a synthetic N instruction program (default %u), then check the golden files\n"
+          "  --bench-labels=P   labels per 100 instructions (default %u)\n"
+          "  --bench-vars=N     distinct variables (default %u)\n"
+          "  --bench-a=P        percent of A-instructions (default %u)\n"
+          "  --golden DIR       X.asm / X.hack pairs for --bench (default src)\n"
+          "Without input files the names are asked for interactively.\n",
+          program, BENCH_DEFAULT_SIZE, BENCH_DEFAULT_LABELS, BENCH_DEFAULT_VARS, BENCH_DEFAULT_A);
+}
 
-  memset(lineBuff, 0, sizeof(lineBuff));
-  static uint8_t count = 0;
+/* One context for every file, reset to the predefined symbols in between */
+uint32_t assembleSerial(const Job_List *list, const Assembler_Options *options)
+{
+  hasm_ctx *ctx = hasm_ctx_create();
+  uint32_t failed = 0U;
 
-  while(fgets(lineBuff, LINEBUFFER_SIZE, ipFilePtr))
+  if(ctx == NULL)
   {
-    count++;
+    fprintf(stderr, "Error allocating symbol table \n");
+    return list->count;
+  }
 
-    /*Check if it is a comment */
-    if( (lineBuff[0] == '/') && (lineBuff[1] == '/') )
+  for(uint32_t job = 0U; job < list->count; job++)
+  {
+    if(assembleFile(ctx, list->jobs[job].inPath, list->jobs[job].outPath, options) != SYSTEM_SUCCESS)
     {
-      /* Skip the comment */
+      failed++;
     }
-    else if(lineBuff[0] == '\r')
+    hasm_ctx_reset(ctx);
+  }
+
+  hasm_ctx_destroy(ctx);
+
+  return failed;
+}
+
+#if N2T_HAVE_THREADS
+/* Next job for a worker: its own tail first, then the head of any other queue */
+uint32_t workerNextJob(Job_Pool *pool, uint32_t id, uint32_t *job)
+{
+  for(uint32_t i = 0U; i < pool->workerCount; i++)
+  {
+    Work_Queue *queue = &pool->queues[(id + i) % pool->workerCount];
+    uint32_t found = 0U;
+
+    pthread_mutex_lock(&queue->lock);
+    if(queue->head != queue->tail)
     {
-      /* Skip the space */
+      *job = (i == 0U) ? queue->jobs[--queue->tail] : queue->jobs[queue->head++];
+      found = 1U;
     }
-    else
+    pthread_mutex_unlock(&queue->lock);
+
+    if(found)
     {
-      /* Instruction Line */
-      if(lineBuff[0] == '(' )
-      {
-        /* Labels */
-        while(lineBuff[charCount] != ')' )
-        {
-          gSymbolTable[gSymbolTableMeta.symbolTableTail].symbol[charCount-1] = lineBuff[charCount];
-          charCount++;
-        }
-        gSymbolTable[gSymbolTableMeta.symbolTableTail].symbol[charCount] = '\0';
-        gSymbolTable[gSymbolTableMeta.symbolTableTail].value = lineCount;
+      return SYSTEM_SUCCESS;
+    }
+  }
+  return SYSTEM_FAILURE;
+}
 
-        charCount = 1U;
-        gSymbolTableMeta.symbolTableTail++;
-      }
-      else
-      {
-        lineCount++;
-      }
+void *workerMain(void *arg)
+{
+  Worker_Arg *worker = arg;
+  Job_Pool *pool = worker->pool;
+  hasm_ctx *ctx = hasm_ctx_create();
+  uint32_t failed = 0U;
+  uint32_t job = 0U;
+
+  if(ctx == NULL)
+  {
+    /* Leave this worker's jobs to the others */
+    fprintf(stderr, "Error allocating symbol table \n");
+    return NULL;
+  }
+
+  while(workerNextJob(pool, worker->id, &job) == SYSTEM_SUCCESS)
+  {
+    if(assembleFile(ctx, pool->list->jobs[job].inPath, pool->list->jobs[job].outPath, pool->options) != SYSTEM_SUCCESS)
+    {
+      failed++;
     }
-    memset(lineBuff, 0, sizeof(lineBuff));
+    hasm_ctx_reset(ctx);
   }
+
+  hasm_ctx_destroy(ctx);
+
+  pthread_mutex_lock(&pool->failedLock);
+  pool->failed += failed;
+  pthread_mutex_unlock(&pool->failedLock);
+
+  return NULL;
 }
+#endif
 
-void secondPass(FILE *ipFilePtr, FILE *opFilePtr)
+/* Files are split into one contiguous block per worker deque, idle workers steal */
+uint32_t assembleParallel(const Job_List *list, const Assembler_Options *options)
 {
-  int32_t status = SYSTEM_SUCCESS;
-  uint8_t lineBuffer[LINEBUFFER_SIZE]={0};
-  memset(lineBuffer, 0, sizeof(lineBuffer));
-  rewind(ipFilePtr);
+#if N2T_HAVE_THREADS
+  uint32_t workers = (options->workers < list->count) ? options->workers : list->count;
+  Work_Queue queues[MAX_WORKERS];
+  Worker_Arg args[MAX_WORKERS];
+  pthread_t threads[MAX_WORKERS];
+  uint32_t *jobs = malloc(list->count * sizeof(uint32_t));
+  uint32_t started = 0U;
+  Job_Pool pool;
+
+  if(jobs == NULL)
+  {
+    return assembleSerial(list, options);
+  }
+
+  pool.list = list;
+  pool.options = options;
+  pool.queues = queues;
+  pool.workerCount = workers;
+  pool.failed = 0U;
+  pthread_mutex_init(&pool.failedLock, NULL);
 
-  while(fgets(lineBuffer, LINEBUFFER_SIZE, ipFilePtr))
+  /* Queue w owns jobs[w * count / workers .. (w + 1) * count / workers) */
+  for(uint32_t w = 0U; w < workers; w++)
   {
-    /* Pass the line to the parser */
-    status = lineParser(&lineBuffer[0]);
+    uint32_t first = (uint32_t)(((uint64_t)w * list->count) / workers);
+    uint32_t last = (uint32_t)(((uint64_t)(w + 1U) * list->count) / workers);
 
-    if(SYSTEM_SUCCESS == status)
+    pthread_mutex_init(&queues[w].lock, NULL);
+    queues[w].jobs = &jobs[first];
+    queues[w].head = 0U;
+    queues[w].tail = 0U;
+
+    for(uint32_t job = first; job < last; job++)
     {
-      /* Valid line and got parsed successfully */
-      /* Write the binary value to file in string format */
-      lineWriter(opFilePtr);
+      jobs[queues[w].tail + first] = job;
+      queues[w].tail++;
     }
-    else
+  }
+
+  for(uint32_t w = 0U; w < workers; w++)
+  {
+    args[w].pool = &pool;
+    args[w].id = w;
+    if(pthread_create(&threads[w], NULL, workerMain, &args[w]) != 0)
     {
-      /* Skip the line and proceed to next */
+      break;
     }
-    /* Reset the variables for next instruction */
-    memset(lineBuffer, 0, sizeof(lineBuffer));
-    varInit(NULL);
+    started++;
+  }
+
+  if(started == 0U)
+  {
+    /* No threads at all: drain the queues here */
+    Worker_Arg self = { &pool, 0U };
+    workerMain(&self);
+  }
+
+  for(uint32_t w = 0U; w < started; w++)
+  {
+    pthread_join(threads[w], NULL);
+  }
+
+  for(uint32_t w = 0U; w < workers; w++)
+  {
+    /* Jobs no worker could take (allocation failures) count as failed */
+    pool.failed += queues[w].tail - queues[w].head;
+    pthread_mutex_destroy(&queues[w].lock);
   }
+  pthread_mutex_destroy(&pool.failedLock);
+  free(jobs);
+
+  return pool.failed;
+#else
+  return assembleSerial(list, options);
+#endif
 }
 
-/* Instruction line parser */
-int32_t lineParser(uint8_t *line)
+/* Assembles one file with the current (predefined only) symbol table */
+int32_t assembleFile(Assembler_Context *ctx, const uint8_t *inPath, const uint8_t *outPath, const Assembler_Options *options)
 {
   int32_t status = SYSTEM_SUCCESS;
-  uint8_t *ptr = line;
-  uint8_t str[LINEBUFFER_SIZE] = {0};
-  uint8_t index = 0U;
-
-  /*Check if it is a comment */
-  if( (*ptr == '/') && (*(ptr+1) == '/') )
+  Source_Buffer source;
+  Output_Writer writer;
+  STATS_TIMER(timer);
+
+#if N2T_ENABLE_STATS
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+#endif
+  ctx->statsMode = options->stats;
+  ctx->errors = 0U;
+  ctx->errorLine = 0U;
+
+  /*Open the file, a stream is read as it goes*/
+  memset(&source, 0, sizeof(source));
+  status = options->stream ? SYSTEM_SUCCESS : sourceOpen(inPath, &source);
+  positionStart(ctx, inPath, source.data);
+
+  if(status == SYSTEM_SUCCESS && outputOpen(outPath, options->format, &writer) != SYSTEM_SUCCESS)
   {
-    /* Skip the comment */
+    sourceClose(&source);
     status = SYSTEM_FAILURE;
   }
-  else if(*ptr == '\r')
+
+  if( (status == SYSTEM_SUCCESS) && (options->map != MAP_OFF) && !options->stream )
   {
-    /* Skip the space */
-    status = SYSTEM_FAILURE;
+    mapStart(ctx, &source);
+  }
+
+  if( (status == SYSTEM_SUCCESS) && options->stream )
+  {
+    /* Bounded single pass over a pipe */
+    STATS_START(ctx, timer);
+    status = streamPass(ctx, inPath, &writer);
+    STATS_STOP(ctx, timer, STATS_SECOND_PASS);
+  }
+  else if( (status == SYSTEM_SUCCESS) && options->optimize )
+  {
+    /* Labels first, then the whole program is decoded, rewritten and written */
+    STATS_START(ctx, timer);
+    firstPass(ctx, &source);
+    STATS_STOP(ctx, timer, STATS_FIRST_PASS);
+    STATS_START(ctx, timer);
+    status = optimizePass(ctx, &source, &writer);
+    STATS_STOP(ctx, timer, STATS_SECOND_PASS);
+  }
+  else if( (status == SYSTEM_SUCCESS) && options->incremental && strcmp(outPath, "-") )
+  {
+    /* Labels first, then only the lines the cache can't vouch for are encoded */
+    uint8_t *cachePath = malloc(strlen(outPath) + sizeof(CACHE_EXTENSION));
+
+    STATS_START(ctx, timer);
+    firstPass(ctx, &source);
+    STATS_STOP(ctx, timer, STATS_FIRST_PASS);
+    if(cachePath != NULL)
+    {
+      sprintf(cachePath, "%s%s", outPath, CACHE_EXTENSION);
+      STATS_START(ctx, timer);
+      status = incrementalPass(ctx, &source, &writer, cachePath);
+      STATS_STOP(ctx, timer, STATS_SECOND_PASS);
+      free(cachePath);
+    }
+    else
+    {
+      fprintf(stderr, "Out of memory\n");
+      status = SYSTEM_FAILURE;
+    }
+  }
+  else if( (status == SYSTEM_SUCCESS) && options->onePass )
+  {
+    /* Single pass with backpatching of forward references */
+    STATS_START(ctx, timer);
+    status = singlePass(ctx, &source, &writer);
+    STATS_STOP(ctx, timer, STATS_SECOND_PASS);
+  }
+  else if( (status == SYSTEM_SUCCESS) && (options->encodeThreads > 1U) )
+  {
+    /* Labels first, then the second pass split in chunks over threads */
+    STATS_START(ctx, timer);
+    firstPass(ctx, &source);
+    STATS_STOP(ctx, timer, STATS_FIRST_PASS);
+    STATS_START(ctx, timer);
+    status = chunkedPass(ctx, &source, &writer, options->encodeThreads);
+    STATS_STOP(ctx, timer, STATS_SECOND_PASS);
+  }
+  else if(status == SYSTEM_SUCCESS)
+  {
+    /* First Pass to find lablels */
+    STATS_START(ctx, timer);
+    firstPass(ctx, &source);
+    STATS_STOP(ctx, timer, STATS_FIRST_PASS);
+
+    /* Second Pass to find resolve variables & instructions */
+    STATS_START(ctx, timer);
+    secondPass(ctx, &source, &writer);
+    STATS_STOP(ctx, timer, STATS_SECOND_PASS);
   }
   else
   {
-    uint8_t count = 0U;
+    fprintf(stderr, "Error handling files %s, %s\n", inPath, outPath);
+    return status;
+  }
 
-    /* Parse the fields */
+  sourceClose(&source);
+  if(outputClose(&writer) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Error writing %s\n", outPath);
+    status = SYSTEM_FAILURE;
+  }
 
-    if(*ptr == '@')
+  if(ctx->errors > 0U)
+  {
+    /* The words after a rejected line would sit at the wrong addresses, so none are kept */
+    if(strcmp(outPath, "-"))
     {
-      /* A Instruction */
-      uint8_t index = 0U;
-      /* A Instruction ( @2 or @sum ) */
-      ptr++;
+      fprintf(stderr, "%s: %u lines rejected, no output written\n", inPath, ctx->errors);
+      remove(outPath);
+    }
+    else
+    {
+      /* A stream may have written the words before the first one */
+      fprintf(stderr, "%s: %u lines rejected, the output is incomplete\n", inPath, ctx->errors);
+    }
+    status = SYSTEM_FAILURE;
+  }
 
-      /* Check if it is a symbol */
-      if(*ptr > '9' )
-      {
-        /* Symbol - Check the entry in symbol table */
-        uint8_t str[LINEBUFFER_SIZE];
-        strcpy(str, ptr);
-        searchSymbolEntry(str);
-      }
-      else
-      {
-        /* Address*/
-        while(*ptr != '\r')
-        {
-          gInsFields.addFldString[index++] = *(ptr);
-          ptr++;
-        }
-        gInsFields.addFldString[index]='\0';
-      }
-      index = 0U;
+  if(ctx->map.enabled || ctx->map.failed)
+  {
+    status = (status == SYSTEM_SUCCESS) ? mapWrite(ctx, inPath, outPath, options->map) : status;
+    mapStop(ctx);
+  }
+
+#if N2T_ENABLE_STATS
+  if(ctx->statsMode != STATS_OFF)
+  {
+    statsReport(ctx, &writer, inPath, ctx->statsMode);
+  }
+#endif
 
-      /* Pass the line parsed to lineCommand() to get bitfields */
-      status = lineCommand();
+  return status;
+}
+
+/* --map sidecar next to the output, which stdout has none of */
+int32_t mapWrite(Assembler_Context *ctx, const uint8_t *inPath, const uint8_t *outPath, uint32_t format)
+{
+  const uint8_t *extension = (format == MAP_JSON) ? MAP_JSON_EXTENSION : MAP_EXTENSION;
+  uint8_t *mapPath = NULL;
+  int32_t status = SYSTEM_SUCCESS;
+
+  if(!strcmp(outPath, "-"))
+  {
+    fprintf(stderr, "No map for %s, the output goes to stdout\n", inPath);
+    return SYSTEM_SUCCESS;
+  }
+
+  mapPath = malloc(strlen(outPath) + strlen(extension) + 1U);
+  if(mapPath == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return SYSTEM_FAILURE;
+  }
+
+  sprintf(mapPath, "%s%s", outPath, extension);
+  status = mapSave(ctx, mapPath, format, inPath);
+  if(status != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Error writing %s\n", mapPath);
+  }
+  free(mapPath);
+
+  return status;
+}
+
+/* Adds an input; a NULL output path is derived from the input name once the format is known */
+int32_t jobListAdd(Job_List *list, const uint8_t *inPath, uint32_t inLen, const uint8_t *outPath, uint32_t outLen)
+{
+  Assembler_Job *job = NULL;
+
+  if(list->count == list->size)
+  {
+    uint32_t newSize = (list->size == 0U) ? JOB_LIST_INIT : (list->size * 2U);
+    Assembler_Job *newJobs = realloc(list->jobs, newSize * sizeof(Assembler_Job));
+
+    if(newJobs == NULL)
+    {
+      return SYSTEM_FAILURE;
     }
-    else if(*ptr == '(' )
+    list->jobs = newJobs;
+    list->size = newSize;
+  }
+
+  job = &list->jobs[list->count];
+  job->inPath = copyString(inPath, inLen);
+  job->outPath = (outPath != NULL) ? copyString(outPath, outLen) : NULL;
+
+  if( (job->inPath == NULL) || ((outPath != NULL) && (job->outPath == NULL)) )
+  {
+    free(job->inPath);
+    free(job->outPath);
+    return SYSTEM_FAILURE;
+  }
+  list->count++;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Manifest: one "input [output]" per line, blank lines and '#' comments ignored */
+int32_t jobListManifest(Job_List *list, const uint8_t *path)
+{
+  int32_t status = SYSTEM_SUCCESS;
+  Source_Buffer manifest;
+  Line_View line;
+  size_t pos = 0U;
+
+  if(sourceOpen(path, &manifest) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Error reading manifest %s\n", path);
+    return SYSTEM_FAILURE;
+  }
+
+  while( (status == SYSTEM_SUCCESS) && (sourceNextLine(&manifest, &pos, &line) == SYSTEM_SUCCESS) )
+  {
+    const uint8_t *ptr = line.ptr;
+    const uint8_t *end = line.ptr + line.len;
+    const uint8_t *inPath = NULL;
+    const uint8_t *outPath = NULL;
+    uint32_t inLen = 0U;
+    uint32_t outLen = 0U;
+
+    while( (ptr < end) && ((*ptr == ' ') || (*ptr == '\t')) )
     {
-      /* Labels */
       ptr++;
-      while(*ptr != ')' )
-      {
-        str[index] = *ptr;
-        index++;
-        ptr++;
-      }
-      str[index++] = '\r';
-      str[index++] = '\n';
-      str[index++] = '\0';
-      searchSymbolEntry(str);
-
-      status = SYSTEM_FAILURE;
     }
-    else
+    if( (ptr == end) || (*ptr == '#') )
     {
-      /* C Instruction */
-      gInsFields.addFldString[0] = INVALID_VALUE;
-      uint8_t index = 0U;
+      continue;
+    }
 
-      while(*ptr != '=')
-      {
-        /* Destination Field */
-        if(*ptr == ';')
-        {
-          status = SYSTEM_FAILURE;
-          break;
-        }
-        else
-        {
-          gInsFields.destFldString[index++] = *ptr;
-          ptr++;
-        }
-      }
+    inPath = ptr;
+    while( (ptr < end) && (*ptr != ' ') && (*ptr != '\t') )
+    {
+      ptr++;
+    }
+    inLen = (uint32_t)(ptr - inPath);
 
-      if(status == SYSTEM_SUCCESS)
+    while( (ptr < end) && ((*ptr == ' ') || (*ptr == '\t')) )
+    {
+      ptr++;
+    }
+    if(ptr < end)
+    {
+      outPath = ptr;
+      while( (ptr < end) && (*ptr != ' ') && (*ptr != '\t') )
       {
-        /* Destination field is present and valid */
-        gInsFields.destFldString[index]='\0';
         ptr++;
-        index = 0U;
-      }
-      else
-      {
-        /* Destination field is not present and valid */
-        ptr = line;
-        index = 0U;
-        memset(gInsFields.destFldString,  0, sizeof(gInsFields.destFldString) );
-        gInsFields.destFldString[0] = '\0';
-        status = SYSTEM_SUCCESS;
       }
+      outLen = (uint32_t)(ptr - outPath);
+    }
 
-      while( (*ptr != ';') && (*ptr != '\r') )
-      {
-        /* Compare Field */
-        gInsFields.cmpFldString[index++] = *ptr;
-        ptr++;
-      }
-      gInsFields.cmpFldString[index]='\0';
-      index = 0U;
+    status = jobListAdd(list, inPath, inLen, outPath, outLen);
+  }
 
-      if(*ptr == ';')
-      {
-        ptr++;
-        /* Jump Field */
-        while( (*ptr != '\r') && (*ptr != ' ') )
-        {
-          /* Jump Field */
-          gInsFields.jmpFldString[index] = *ptr;
-          index++;
-          ptr++;
-        }
-        gInsFields.jmpFldString[index] = '\0';
-      }
-      else
-      {
-        /* No Jump Field */
-        gInsFields.jmpFldString[index++] = '\0';
-      }
-      index = 0U;
+  sourceClose(&manifest);
 
-      while(gInsFields.jmpFldString[index] != '\0')
-      {
-        index++;
-      }
-      /* Pass the line parsed to lineCommand() to get bitfields */
-      status = lineCommand();
-    }
+  return status;
+}
+
+int32_t jobListGlob(Job_List *list, const uint8_t *pattern)
+{
+  int32_t status = SYSTEM_SUCCESS;
+#if N2T_HAVE_GLOB
+  glob_t matches;
+
+  if(glob(pattern, 0, NULL, &matches) != 0)
+  {
+    fprintf(stderr, "No files match %s\n", pattern);
+    return SYSTEM_FAILURE;
+  }
+
+  for(size_t i = 0U; (i < matches.gl_pathc) && (status == SYSTEM_SUCCESS); i++)
+  {
+    status = jobListAdd(list, matches.gl_pathv[i], strlen(matches.gl_pathv[i]), NULL, 0U);
   }
+  globfree(&matches);
+#else
+  fprintf(stderr, "--glob is not supported on this platform\n");
+  status = SYSTEM_FAILURE;
+#endif
 
   return status;
 }
 
-void  searchSymbolEntry(uint8_t *line)
+void jobListFree(Job_List *list)
+{
+  for(uint32_t job = 0U; job < list->count; job++)
+  {
+    free(list->jobs[job].inPath);
+    free(list->jobs[job].outPath);
+  }
+  free(list->jobs);
+  memset(list, 0, sizeof(*list));
+}
+
+/* "dir/prog.asm" -> "dir/prog<format extension>"; stdin goes to stdout */
+uint8_t *outputPathFor(const uint8_t *inPath, uint32_t inLen, uint32_t format)
+{
+  const uint8_t *extension = outputFormats[format].extension;
+  uint32_t stemLen = inLen;
+  uint32_t extLen = strlen(extension);
+  uint8_t *path = NULL;
+
+  if( (inLen == 1U) && (inPath[0] == '-') )
+  {
+    return copyString("-", 1U);
+  }
+
+  if( (inLen >= 4U) && !memcmp(&inPath[inLen - 4U], ".asm", 4U) )
+  {
+    stemLen = inLen - 4U;
+  }
+
+  path = malloc(stemLen + extLen + 1U);
+  if(path != NULL)
+  {
+    memcpy(path, inPath, stemLen);
+    memcpy(&path[stemLen], extension, extLen + 1U);
+  }
+  return path;
+}
+
+uint8_t *copyString(const uint8_t *str, uint32_t len)
 {
-  uint8_t foundEntry = 0U;
-  uint32_t symbolTableTail = gSymbolTableMeta.symbolTableTail;
-  uint32_t currMemory = gSymbolTableMeta.currMemory;
-  uint32_t value = 0;
-  uint8_t str[LINEBUFFER_SIZE];
-  uint8_t strLen = 0U;
-  uint8_t index = 0U;
-  uint8_t tempIndex = 0U;
+  uint8_t *copy = malloc(len + 1U);
 
-  memset(str, 0, sizeof(str));
-  strcpy(str, line);
-  strLen = strlen(line);
+  if(copy != NULL)
+  {
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
 
-  str[strLen - 2] = '\0';
+/*
+ * Exhaustive check of the decoders: every dest=comp;jump combination
+ * (28 x 8 x 8) is scanned and assembled through lineParser(), both bare
+ * and indented with a trailing comment, and compared with the word built
+ * from the lookup tables. The indent varies so that the instructions
+ * straddle scanner block boundaries. Then a few near-miss mnemonics must
+ * be rejected, every predefined symbol must resolve through the generated
+ * hash index and each malformed label or symbol must fail at its line.
+ */
+int32_t selfTest(void)
+{
+  static const uint8_t *invalidFields[] = { "D+", "A+D", "M+D", "1+D", "DM", "MA", "JJJ", "jmp", "D|AM" };
+  /* The first is valid; the duplicate (6) is rejected on line 4, the rest on line 3 */
+  static const uint8_t *malformedLines[] = { "(L)\n@L", "()", "(L", "(L)x", "(12)", "(R0)", "(L)\n(L)", "@a b" };
+  uint32_t compCount = sizeof(compFieldLT)/sizeof(Instruction_Encoding);
+  uint32_t destCount = sizeof(destFieldLT)/sizeof(Instruction_Encoding);
+  uint32_t jumpCount = sizeof(jumpFieldLT)/sizeof(Instruction_Encoding);
+  uint32_t checked = 0U;
+  uint32_t failed = 0U;
+  hasm_ctx *ctx = hasm_ctx_create();
+
+  if(ctx == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return SYSTEM_FAILURE;
+  }
 
-  for(uint32_t i = 0;  i< symbolTableTail; i++)
+  for(uint32_t comp = 0U; comp < compCount; comp++)
   {
-    if(!strcmp(str, gSymbolTable[i].symbol))
+    for(uint32_t dest = 0U; dest < destCount; dest++)
     {
-      foundEntry = 1;
-      value =  gSymbolTable[i].value;
-      break;
+      for(uint32_t jump = 0U; jump < jumpCount; jump++)
+      {
+        uint16_t expected = C_INST_PREFIX | compFieldLT[comp].bits |
+                            destFieldLT[dest].bits | jumpFieldLT[jump].bits;
+
+        for(uint32_t variant = 0U; variant < 2U; variant++)
+        {
+          uint8_t text[LINEBUFFER_SIZE];
+          uint32_t indent = (variant != 0U) ? ((comp + dest + jump) % (2U * SCAN_BLOCK)) : 0U;
+          int32_t len = snprintf(text, sizeof(text), "%*s%s%s%s%s%s%s",
+                                 (int)indent, "",
+                                 destFieldLT[dest].mnemonic, (dest != 0U) ? "=" : "",
+                                 compFieldLT[comp].mnemonic,
+                                 (jump != 0U) ? ";" : "", jumpFieldLT[jump].mnemonic,
+                                 (variant != 0U) ? " \t// comment\r\n" : "");
+          Source_Buffer src = { text, (size_t)len, 0U };
+          Line_View line;
+          size_t pos = 0U;
+
+          varInit(ctx);
+          if( (sourceNextInstruction(&src, &pos, &line) != SYSTEM_SUCCESS) ||
+              (lineParser(ctx, &line) != SYSTEM_SUCCESS) || (ctx->insFields.word != expected) )
+          {
+            fprintf(stderr, "Mismatch for %s\n", text);
+            failed++;
+          }
+          checked++;
+        }
+      }
     }
   }
 
-  if(!foundEntry)
+  for(uint32_t i = 0U; i < (sizeof(invalidFields)/sizeof(invalidFields[0])); i++)
   {
-    /* Add the new entry */
-    strcpy(gSymbolTable[symbolTableTail].symbol, str);
-    gSymbolTable[symbolTableTail].value = currMemory;
-    gSymbolTableMeta.symbolTableTail++;
-    gSymbolTableMeta.currMemory++;
-    value = gSymbolTable[symbolTableTail].value;
+    uint16_t bits = 0U;
+    uint32_t len = strlen(invalidFields[i]);
+
+    if( (decodeComp(invalidFields[i], len, &bits) == SYSTEM_SUCCESS) ||
+        (decodeDest(invalidFields[i], len, &bits) == SYSTEM_SUCCESS) ||
+        (decodeJump(invalidFields[i], len, &bits) == SYSTEM_SUCCESS) )
+    {
+      fprintf(stderr, "Accepted invalid field %s\n", invalidFields[i]);
+      failed++;
+    }
+    checked++;
   }
-  else
+  varInit(ctx);
+
+  /* -O numbers RAM only: a store to KBD is ignored by the hardware, so the read after it must stay */
+  for(uint32_t io = 0U; io < 2U; io++)
   {
-  }
+    static const uint16_t program[] = { 0x0064U, 0xEA88U, 0xFC10U, 0x0000U, 0xE308U };  /* @100 M=0 D=M @R0 M=D */
+    Optimize_Ins ins[sizeof(program)/sizeof(program[0])];
+    uint32_t map[(sizeof(program)/sizeof(program[0])) + 1U];
+    uint32_t label = 0U;
+    uint32_t count = sizeof(program)/sizeof(program[0]);
+    uint8_t read = 0U;
+
+    for(uint32_t i = 0U; i < count; i++)
+    {
+      ins[i].word = program[i];
+      ins[i].label = SYMBOL_NOT_FOUND;
+      ins[i].line = i;
+    }
+    ins[0].word = io ? 0x6000U : program[0];   /* @KBD */
 
-  /* Copy the value to address field string */
-  memset(str, 0, sizeof(str));
+    for(uint32_t round = 0U; (round < LINEBUFFER_SIZE) && optimizeRound(ins, &count, &label, 0U, map); round++)
+    {
+    }
+    for(uint32_t i = 0U; i < count; i++)
+    {
+      read = (ins[i].word == program[2]) ? 1U : read;
+    }
 
-  while(value != 0)
+    if(read != io)
+    {
+      fprintf(stderr, "-O %s D=M after M=0 at %s\n", io ? "dropped" : "kept", io ? "KBD" : "RAM[100]");
+      failed++;
+    }
+    checked++;
+  }
+
+  /* The generated index must find every predefined symbol, a miss would make it a variable */
+  for(uint32_t i = 0U; i < SYMBOLTABLE_TAIL; i++)
   {
-    str[index] = (value % 10) + '0';
-    value = value/10;
-    index++;
+    uint8_t text[LINEBUFFER_SIZE];
+    int32_t len = snprintf(text, sizeof(text), "@%.*s\n", (int)predefinedEntries[i].length,
+                           &predefinedNames[predefinedEntries[i].offset]);
+    uint16_t word = 0U;
+    size_t count = 1U;
+
+    if( (hasm_assemble_buffer(ctx, text, (size_t)len, &word, &count) != HASM_SUCCESS) ||
+        (count != 1U) || (word != predefinedEntries[i].value) )
+    {
+      fprintf(stderr, "Predefined symbol mismatch for %s", text);
+      failed++;
+    }
+    checked++;
   }
 
-  while(index)
+  /* Each malformed line fails the program at its own line (the diagnostics are expected) */
+  for(uint32_t i = 0U; i < (sizeof(malformedLines)/sizeof(malformedLines[0])); i++)
   {
-    gInsFields.addFldString[tempIndex] = str[index-1];
-    index--;
-    tempIndex++;
+    uint8_t text[LINEBUFFER_SIZE];
+    int32_t len = snprintf(text, sizeof(text), "@1\nD=A\n%s\n@2\n", malformedLines[i]);
+    uint32_t line = (i == 0U) ? 0U : ((i == 6U) ? 4U : 3U);
+    uint16_t words[4];
+    size_t count = 4U;
+    int32_t status = hasm_assemble_buffer(ctx, text, (size_t)len, words, &count);
+
+    if( (line == 0U) ? (status != HASM_SUCCESS) :
+        ((status != HASM_SYNTAX) || (hasm_error_line(ctx) != line)) )
+    {
+      fprintf(stderr, "Malformed line %s %s at line %u\n", malformedLines[i],
+              (status == HASM_SUCCESS) ? "accepted" : "rejected", hasm_error_line(ctx));
+      failed++;
+    }
+    checked++;
   }
-  gInsFields.addFldString[tempIndex] = '\0';
+  hasm_ctx_destroy(ctx);
+
+  printf("Self test: %u checks, %u failed\n", checked, failed);
+
+  return (failed == 0U) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
 }
 
-int32_t lineCommand(void)
+/*
+ * Benchmark: a synthetic program is generated in memory and assembled with
+ * each phase timed on its own. tokenize is the line scanner alone, pass 1
+ * is firstPass(), pass 2 encodes every line into memory (scanning again)
+ * and output formats the words to the null device. Hack ROM holds 32K
+ * words, so labels are only defined in the first 32K instructions and
+ * larger programs measure throughput rather than addressing.
+ */
+int32_t benchRun(const Bench_Options *bench, const Assembler_Options *options)
 {
-  uint8_t strlength = 0;
-  memset(gInsFields.bitFields, 0, sizeof(gInsFields.bitFields) );
-  int32_t status = SYSTEM_SUCCESS; 
+  Assembler_Context context;
+  Source_Buffer src;
+  Output_Writer writer;
+  Line_View line;
+  uint16_t *words = NULL;
+  uint32_t wordCount = 0U;
+  uint64_t lines = 0U;
+  size_t pos = 0U;
+  double start = 0.0;
+  double tokenize = 0.0;
+  double pass1 = 0.0;
+  double pass2 = 0.0;
+  double output = 0.0;
+  int32_t status = SYSTEM_SUCCESS;
 
-  if(gInsFields.addFldString[0] != INVALID_VALUE)
+  memset(&context, 0, sizeof(context));
+  varInit(&context);
+
+  if( (symbolTableInit(&context) != SYSTEM_SUCCESS) || (benchGenerate(bench, &src) != SYSTEM_SUCCESS) )
   {
-    /* A Instruction */
-    uint16_t addr = 0U;
-    uint8_t i = 0U;
-    uint8_t powTen = 0;
-    strlength = strlen(&gInsFields.addFldString[0]);
-    powTen = strlength - 1;
+    fprintf(stderr, "Out of memory\n");
+    symbolTableFree(&context);
+    return SYSTEM_FAILURE;
+  }
 
-    while(i < strlength)
-    {
-      addr += ( gInsFields.addFldString[i] - '0' ) * pow(10, powTen);
-      i++;
-      powTen--;
-    }
+  printf("Bench: %u instructions, %u%% A, %u labels per 100, %u variables, %.1f MB of source\n",
+         bench->instructions, bench->aPercent, bench->labelPercent, bench->variables,
+         (double)src.size / 1e6);
 
-    /* Get the binary value to file in string format */
+  start = wallSeconds();
+  while(sourceNextInstruction(&src, &pos, &line) == SYSTEM_SUCCESS)
+  {
+    lines++;
+  }
+  tokenize = wallSeconds();
 
-    for(int8_t bitPos = BITFIELD_MAX - 1; bitPos >= 0; bitPos--)
+  firstPass(&context, &src);
+  pass1 = wallSeconds();
+
+  status = benchEncode(&context, &src, &words, &wordCount);
+  pass2 = wallSeconds();
+
+  if( (status == SYSTEM_SUCCESS) && (outputOpen(NULL_DEVICE, options->format, &writer) == SYSTEM_SUCCESS) )
+  {
+    for(uint32_t i = 0U; i < wordCount; i++)
     {
-      gInsFields.bitFields[BITFIELD_MAX - bitPos - 1] = (( (addr & (1 << bitPos) ) ) >> bitPos) + '0';
-      uint8_t value = ( (addr & (1 << bitPos) ) ) >> bitPos ;
+      lineWriter(&writer, words[i]);
     }
-    gInsFields.bitFields[BITFIELD_MAX] = '\0';
+    status = outputClose(&writer);
   }
-  else 
+  output = wallSeconds();
+
+  benchReport("tokenize", tokenize - start, lines, src.size);
+  benchReport("pass 1", pass1 - tokenize, lines, src.size);
+  benchReport("pass 2", pass2 - pass1, lines, src.size);
+  benchReport("output", output - pass2, wordCount, (uint64_t)wordCount * HACK_LINE_LEN);
+  benchReport("total", output - start, lines, src.size);
+
+  free(words);
+  sourceClose(&src);
+  symbolTableReset(&context);
+
+  if( (status != SYSTEM_SUCCESS) || (benchGolden(&context, bench->goldenDir) != 0U) )
   {
-    uint8_t bitPos = 0U;
-    uint8_t fldValid = 0U;
     status = SYSTEM_FAILURE;
+  }
+  symbolTableFree(&context);
+
+  return status;
+}
+
+/* Deterministic program of bench->instructions lines, plus the labels */
+int32_t benchGenerate(const Bench_Options *bench, Source_Buffer *src)
+{
+  uint32_t window = (bench->instructions <= ADDRESS_MAX) ? bench->instructions : (ADDRESS_MAX + 1U);
+  uint32_t labels = (uint32_t)(((uint64_t)window * bench->labelPercent) / 100U);
+  uint32_t compCount = sizeof(compFieldLT)/sizeof(Instruction_Encoding);
+  uint32_t destCount = sizeof(destFieldLT)/sizeof(Instruction_Encoding);
+  uint32_t jumpCount = sizeof(jumpFieldLT)/sizeof(Instruction_Encoding);
+  uint8_t *data = malloc(((size_t)bench->instructions + labels + 1U) * BENCH_MAX_LINE);
+  uint8_t *out = data;
+  uint32_t state = 0x2545F491U;
+  uint32_t nextLabel = 0U;
+
+  memset(src, 0, sizeof(*src));
+  if(data == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  for(uint32_t i = 0U; i < bench->instructions; i++)
+  {
+    uint32_t kind = benchRandom(&state) % 100U;
+    uint32_t pick = benchRandom(&state);
 
-    /* C Instruction */
-    for(bitPos = 0U; bitPos < C_INST_PAD_LEN; bitPos++)
+    /* Labels at evenly spread addresses */
+    while( (nextLabel < labels) && (i == (uint32_t)(((uint64_t)nextLabel * window) / labels)) )
     {
-      gInsFields.bitFields[bitPos] = '1';
+      *out++ = '(';
+      *out++ = 'L';
+      out = putDecimal(out, nextLabel++);
+      *out++ = ')';
+      *out++ = '\n';
     }
 
-    /* Populate the Compare field */
-
-    for(uint8_t tableIdx = 0U; tableIdx < (sizeof(compFieldLT)/sizeof(Instruction_Encoding)); tableIdx++)
+    if(kind < bench->aPercent)
     {
-      if(!strcmp(compFieldLT[tableIdx].mnemonic, gInsFields.cmpFldString))
+      /* Literal, variable, label or predefined operand */
+      *out++ = '@';
+      if( ((pick & 3U) == 1U) && (bench->variables > 0U) )
       {
-        strcpy(&gInsFields.bitFields[bitPos], compFieldLT[tableIdx].binary);
-        status = SYSTEM_SUCCESS;
-        bitPos = bitPos + COMP_FIELD_LEN;
-        break;
+        *out++ = 'v';
+        out = putDecimal(out, (pick >> 2) % bench->variables);
       }
-    }
+      else if( ((pick & 3U) == 2U) && (labels > 0U) )
+      {
+        *out++ = 'L';
+        out = putDecimal(out, (pick >> 2) % labels);
+      }
+      else if((pick & 3U) == 3U)
+      {
+        const Symbol_Table *symbol = &predefinedEntries[(pick >> 2) % SYMBOLTABLE_TAIL];
 
-    if(status == SYSTEM_SUCCESS)
+        memcpy(out, &predefinedNames[symbol->offset], symbol->length);
+        out += symbol->length;
+      }
+      else
+      {
+        out = putDecimal(out, (pick >> 2) % (ADDRESS_MAX + 1U));
+      }
+    }
+    else
     {
-      /* Populate the Destination field */
-      status = SYSTEM_FAILURE;
+      uint32_t dest = pick % destCount;
+      uint32_t jump = (pick >> 8) % jumpCount;
+      const uint8_t *comp = compFieldLT[(pick >> 16) % compCount].mnemonic;
+      size_t len = strlen(comp);
 
-      for(uint8_t tableIdx = 0U; tableIdx < (sizeof(destFieldLT)/sizeof(Instruction_Encoding)); tableIdx++)
+      if(dest != 0U)
       {
-        if(!strcmp(destFieldLT[tableIdx].mnemonic, gInsFields.destFldString))
-        {
-          strcpy(&gInsFields.bitFields[bitPos], destFieldLT[tableIdx].binary);
-          fldValid = 1U;
-          status = SYSTEM_SUCCESS;
-          break;
-        }
+        len = strlen(destFieldLT[dest].mnemonic);
+        memcpy(out, destFieldLT[dest].mnemonic, len);
+        out += len;
+        *out++ = '=';
+        len = strlen(comp);
       }
-
-      if(SYSTEM_SUCCESS == status)
+      memcpy(out, comp, len);
+      out += len;
+      if(jump != 0U)
       {
-        status = SYSTEM_FAILURE;
-        bitPos = bitPos + DEST_FIELD_LEN;
-  
-        /* Populate the Jump field */
-        for(uint8_t tableIdx = 0U; tableIdx < (sizeof(jumpFieldLT)/sizeof(Instruction_Encoding)); tableIdx++)
-        {
-          if(!strcmp(jumpFieldLT[tableIdx].mnemonic, gInsFields.jmpFldString))
-          {
-            strcpy(&gInsFields.bitFields[bitPos], jumpFieldLT[tableIdx].binary);
-            status = SYSTEM_SUCCESS;
-            break;
-          }
-        }
+        *out++ = ';';
+        memcpy(out, jumpFieldLT[jump].mnemonic, 3U);
+        out += 3U;
       }
-      else
+    }
+
+    /* Some indented lines and trailing comments for the scanner */
+    if((pick >> 28) == 0U)
+    {
+      memcpy(out, "  // c", 6U);
+      out += 6U;
+    }
+    *out++ = '\n';
+  }
+
+  src->data = data;
+  src->size = (size_t)(out - data);
+  src->mapped = 0U;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* secondPass() into memory instead of an output file */
+int32_t benchEncode(Assembler_Context *ctx, const Source_Buffer *src, uint16_t **words, uint32_t *wordCount)
+{
+  uint32_t wordSize = 0U;
+  Line_View line;
+  size_t pos = 0U;
+
+  *words = NULL;
+  *wordCount = 0U;
+
+  while(sourceNextInstruction(src, &pos, &line) == SYSTEM_SUCCESS)
+  {
+    if(lineParser(ctx, &line) == SYSTEM_SUCCESS)
+    {
+      if(growArray((void **)words, &wordSize, sizeof(uint16_t), *wordCount + 1U) != SYSTEM_SUCCESS)
       {
-        printf("Invalid Dest Instruction\n");
+        fprintf(stderr, "Out of memory\n");
+        return SYSTEM_FAILURE;
       }
+      (*words)[(*wordCount)++] = ctx->insFields.word;
+    }
+    varInit(ctx);
+  }
 
-      if(SYSTEM_SUCCESS == status)
+  return SYSTEM_SUCCESS;
+}
+
+/* Assembles dir/X.asm for the course programs and compares with dir/X.hack */
+uint32_t benchGolden(Assembler_Context *ctx, const uint8_t *dir)
+{
+  static const uint8_t *programs[] = { "Add", "Max", "Rect", "Pong" };
+  uint32_t failed = 0U;
+
+  for(uint32_t i = 0U; i < (sizeof(programs)/sizeof(programs[0])); i++)
+  {
+    uint8_t path[LINEBUFFER_SIZE * 4U];
+    Source_Buffer source;
+    Source_Buffer golden;
+    Line_View line;
+    uint16_t *words = NULL;
+    uint32_t wordCount = 0U;
+    uint32_t index = 0U;
+    uint32_t mismatch = 0U;
+    size_t pos = 0U;
+
+    snprintf(path, sizeof(path), "%s/%s.asm", dir, programs[i]);
+    if(sourceOpen(path, &source) != SYSTEM_SUCCESS)
+    {
+      printf("  %-8s skipped (no %s)\n", programs[i], path);
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s.hack", dir, programs[i]);
+    if(sourceOpen(path, &golden) != SYSTEM_SUCCESS)
+    {
+      printf("  %-8s skipped (no %s)\n", programs[i], path);
+      sourceClose(&source);
+      continue;
+    }
+
+    firstPass(ctx, &source);
+    if(benchEncode(ctx, &source, &words, &wordCount) != SYSTEM_SUCCESS)
+    {
+      mismatch = 1U;
+    }
+
+    while( !mismatch && (sourceNextInstruction(&golden, &pos, &line) == SYSTEM_SUCCESS) )
+    {
+      uint16_t expected = 0U;
+
+      if(line.len == 0U)
       {
-        bitPos = bitPos + JUMP_FIELD_LEN;
-        gInsFields.bitFields[bitPos] = '\0';
+        continue;
       }
-      else
+      for(uint32_t bit = 0U; bit < line.len; bit++)
       {
-        printf("Invalid Jump Instruction\n");
+        expected = (uint16_t)((expected << 1) | (line.ptr[bit] == '1'));
       }
+      mismatch = ( (line.len != BITFIELD_MAX) || (index >= wordCount) || (words[index] != expected) ) ? 1U : 0U;
+      index += mismatch ? 0U : 1U;
+    }
+    mismatch = ( mismatch || (index != wordCount) ) ? 1U : 0U;
+
+    if(mismatch)
+    {
+      printf("  %-8s MISMATCH at word %u\n", programs[i], index);
+      failed++;
     }
     else
     {
-      printf("Invalid Comp Instruction\n");
+      printf("  %-8s ok (%u words)\n", programs[i], wordCount);
     }
+
+    free(words);
+    sourceClose(&golden);
+    sourceClose(&source);
+    symbolTableReset(ctx);
   }
-  return status;
+
+  return failed;
+}
+
+void benchReport(const uint8_t *phase, double seconds, uint64_t lines, uint64_t bytes)
+{
+  double rate = (seconds > 0.0) ? seconds : 1e-9;
+
+  printf("  %-8s %9.3f ms %10.2f M lines/s %9.1f MB/s\n",
+         phase, seconds * 1e3, ((double)lines / rate) / 1e6, ((double)bytes / rate) / 1e6);
+}
+
+/* xorshift32, the same program on every run and host */
+uint32_t benchRandom(uint32_t *state)
+{
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+
+  return x;
 }
 
-void lineWriter(FILE *filePtr)
+uint8_t *putDecimal(uint8_t *out, uint32_t value)
 {
-  fputs(&gInsFields.bitFields[0], filePtr);
-  fputs("\n", filePtr);
+  uint8_t digits[10];
+  uint32_t count = 0U;
+
+  do
+  {
+    digits[count++] = (uint8_t)('0' + (value % 10U));
+    value /= 10U;
+  } while(value != 0U);
+
+  while(count > 0U)
+  {
+    *out++ = digits[--count];
+  }
+  return out;
 }
 
-void varInit(void *arg)
+#if N2T_ENABLE_STATS
+/* One report per file, built first and written at once so -j reports don't interleave */
+void statsReport(const Assembler_Context *ctx, const Output_Writer *writer, const uint8_t *inPath, uint8_t mode)
 {
-  memset(gInsFields.destFldString,  0, sizeof(gInsFields.destFldString) );
-  memset(gInsFields.jmpFldString,   0, sizeof(gInsFields.jmpFldString) );
-  memset(gInsFields.cmpFldString,   0, sizeof(gInsFields.cmpFldString) );
-  memset(gInsFields.addFldString,   INVALID_VALUE, sizeof(gInsFields.addFldString) );
-  memset(gInsFields.bitFields,      0, sizeof(gInsFields.bitFields) );
-}
\ No newline at end of file
+  static const uint8_t *phaseNames[STATS_PHASE_COUNT] = { "first_pass", "second_pass", "symbols", "output" };
+  const Assembler_Stats *stats = &ctx->stats;
+  Stats_Time time[STATS_PHASE_COUNT];
+  uint8_t report[STATS_REPORT_SIZE];
+  double probeAverage = (stats->lookups != 0U) ? ((double)stats->probes / (double)stats->lookups) : 0.0;
+  int32_t used = 0;
+
+  memcpy(time, stats->time, sizeof(time));
+  time[STATS_OUTPUT] = writer->writeTime;
+
+  if(mode == STATS_JSON)
+  {
+    /* The path is escaped by jsonString() ahead of the rest */
+    used = snprintf(report, sizeof(report),
+                    ",\"lines\":%llu,\"a_instructions\":%llu,\"c_instructions\":%llu,"
+                    "\"labels\":%llu,\"variables\":%llu,\"lookups\":%llu,\"probe_avg\":%.3f,"
+                    "\"probe_max\":%llu,\"optimized\":%llu,\"bytes_written\":%llu",
+                    (unsigned long long)stats->lines, (unsigned long long)writer->aWords,
+                    (unsigned long long)writer->cWords, (unsigned long long)stats->labels,
+                    (unsigned long long)stats->variables, (unsigned long long)stats->lookups, probeAverage,
+                    (unsigned long long)stats->probeMax, (unsigned long long)stats->optimized,
+                    (unsigned long long)writer->bytes);
+    for(uint32_t phase = 0U; (phase < STATS_PHASE_COUNT) && (used > 0) && ((size_t)used < sizeof(report)); phase++)
+    {
+      used += snprintf(&report[used], sizeof(report) - (size_t)used, ",\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}",
+                       phaseNames[phase], time[phase].wall * 1e3, time[phase].cpu * 1e3);
+    }
+    if( (used > 0) && ((size_t)used < sizeof(report)) )
+    {
+      snprintf(&report[used], sizeof(report) - (size_t)used, "}\n");
+    }
+  }
+  else
+  {
+    used = snprintf(report, sizeof(report),
+                    "%s: %llu lines, %llu A + %llu C instructions, %llu labels, %llu variables, %llu bytes written\n"
+                    "  %llu symbol lookups, %.2f probes on average, %llu at most, %llu instructions optimized away\n",
+                    inPath, (unsigned long long)stats->lines, (unsigned long long)writer->aWords,
+                    (unsigned long long)writer->cWords, (unsigned long long)stats->labels,
+                    (unsigned long long)stats->variables, (unsigned long long)writer->bytes,
+                    (unsigned long long)stats->lookups, probeAverage, (unsigned long long)stats->probeMax,
+                    (unsigned long long)stats->optimized);
+    for(uint32_t phase = 0U; (phase < STATS_PHASE_COUNT) && (used > 0) && ((size_t)used < sizeof(report)); phase++)
+    {
+      used += snprintf(&report[used], sizeof(report) - (size_t)used, "  %-12s %10.3f ms wall %10.3f ms cpu\n",
+                       phaseNames[phase], time[phase].wall * 1e3, time[phase].cpu * 1e3);
+    }
+  }
+
+#if N2T_HAVE_THREADS
+  /* One object per line whatever the other -j workers print */
+  flockfile(stderr);
+#endif
+  if(mode == STATS_JSON)
+  {
+    fputs("{\"file\":", stderr);
+    jsonString(stderr, inPath, (uint32_t)strlen(inPath));
+  }
+  fputs(report, stderr);
+#if N2T_HAVE_THREADS
+  funlockfile(stderr);
+#endif
+}
+#endif
+
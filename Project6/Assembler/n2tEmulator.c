@@ -0,0 +1,1616 @@
+/**
+ * @file n2tEmulator.c
+ * @brief Command line front end of the Hack emulator library (hemu.c): runs a
+ *        .hack file, or a .asm file assembled in-process through hasm.h, for a
+ *        number of cycles and reports or checks the memory afterwards.
+ *
+ *   ./n2temu --set 0=6 --set 1=7 --expect 2=42 Mult.asm
+ *   ./n2temu --jit --cycles 1000000000 src/Pong.hack
+ *   ./n2temu --jit --frames pong --screen last.ppm src/Pong.hack
+ *   ./n2temu --profile --folded pong.folded src/Pong.hack
+ *   ./n2temu -j 0 --manifest suite.txt
+ *
+ * Frames are binary PPM images of the screen, written for every slice of
+ * --frame-cycles in which the program drew something; only the rows it
+ * wrote are converted again.
+ *
+ * --profile runs the counting interpreter of hemu_prof.c and reports the
+ * hottest labels and words, the jumps taken and not taken per condition
+ * and the RAM accesses per region of the memory map. The labels and source
+ * lines come from the map n2tasm --map wrote next to a .hack file, or from
+ * the in-process assembly of a .asm file.
+ *
+ * Several programs, or a --manifest of them, run as a batch: each worker
+ * thread keeps one emulator, whose RAM every program it takes runs in,
+ * and only the mismatches with the --expect words and the RAM and screen
+ * snapshots are reported, followed by the total throughput.
+ *
+ * The exit status is failure when a file cannot be loaded or an --expect
+ * does not hold, so the tool can drive regression tests of programs.
+ */
+
+#include <stdarg.h>
+
+#include "hemu_internal.h"
+
+/* Macro Definitions */
+#define EMU_DEFAULT_CYCLES (100000000ULL)
+#define EMU_MAX_PROBES     (64U)      /* --set, --expect and --dump of one run */
+#define EMU_FRAME_CYCLES   (200000ULL) /* Somewhat over a 60 Hz frame of the Pong demo's drawing */
+#define EMU_FRAME_BYTES    (HEMU_SCREEN_WIDTH * HEMU_SCREEN_HEIGHT * 3U)
+#define EMU_MAX_PATH       (4096U)
+#define EMU_PROFILE_TOP    (20U)      /* Labels and words listed by --profile */
+#define EMU_REGION_COUNT   (7U)
+#define EMU_DIFF_LINES     (16U)      /* Words listed per RAM snapshot mismatch, the others counted */
+#define EMU_LINE_TOKENS    (256U)     /* Program and options of one manifest line */
+#define EMU_SNAPSHOT_WORDS (HEMU_KBD) /* RAM snapshots end before the keyboard, an input */
+
+/* Variable Definitions */
+/* One --set ADDR=VALUE, --expect ADDR=VALUE or --dump FROM-TO */
+typedef struct
+{
+  uint32_t address;
+  uint32_t value;
+} Emulator_Probe;
+
+typedef struct
+{
+  Emulator_Probe probes[EMU_MAX_PROBES];
+  uint32_t count;
+} Probe_List;
+
+typedef struct
+{
+  uint64_t cycles;
+  uint16_t key;
+  uint64_t frameCycles;
+  uint8_t jit;
+  const uint8_t *framePrefix;    /* --frames, NULL for none */
+  const uint8_t *screenPath;     /* --screen, NULL for none */
+  Probe_List sets;
+  Probe_List expects;
+  Probe_List dumps;
+  uint8_t profile;
+  const uint8_t *profilePath;    /* --profile=FILE, NULL for stderr */
+  const uint8_t *foldedPath;     /* --folded, NULL for none */
+  const uint8_t *heatmapPath;    /* --heatmap, NULL for none */
+  const uint8_t *mapPath;        /* --map, NULL for FILE.hack.map when there is one */
+  const uint8_t *expectRamPath;  /* --expect-ram, NULL for none */
+  const uint8_t *expectScreenPath; /* --expect-screen, NULL for none */
+  const uint8_t *saveRamPath;    /* --save-ram, NULL for none */
+} Emulator_Options;
+
+/* Mismatches of a run, printed once it is done */
+typedef struct
+{
+  uint8_t *text;
+  uint32_t length;
+  uint32_t size;
+} Report_Text;
+
+/* One program of a batch and what came of it */
+typedef struct
+{
+  const uint8_t *path;
+  Emulator_Options options;
+  uint8_t ran;
+  int32_t status;
+  uint64_t cycles;
+  double seconds;                /* The emulation alone */
+  Report_Text report;
+} Batch_Job;
+
+typedef struct
+{
+  Batch_Job *jobs;
+  uint32_t count;
+  uint32_t size;
+  uint8_t *manifest;             /* Text of --manifest, the paths of its jobs point into it */
+} Batch_List;
+
+/*
+ * Programs of a batch are taken in order from one shared index: each runs
+ * for millions of cycles, so workers hardly ever meet at the lock.
+ */
+typedef struct
+{
+  Batch_List *list;
+  uint8_t jit;
+#if N2T_HAVE_THREADS
+  pthread_mutex_t lock;
+#endif
+  uint32_t next;
+} Batch_Pool;
+
+/* Part of the memory map --profile reports the accesses of */
+typedef struct
+{
+  const char *name;
+  uint32_t first;
+  uint32_t last;
+} Memory_Region;
+
+/* Regions of the memory map in the course's conventions, first to last */
+const Memory_Region memoryRegions[EMU_REGION_COUNT] =
+{
+  { "R0-R15" , 0U                , 15U               },
+  { "static" , 16U               , 255U              },
+  { "stack"  , 256U              , 2047U             },
+  { "heap"   , 2048U             , HEMU_SCREEN - 1U  },
+  { "SCREEN" , HEMU_SCREEN       , HEMU_KBD - 1U     },
+  { "KBD"    , HEMU_KBD          , HEMU_KBD          },
+  { "unused" , HEMU_KBD + 1U     , HEMU_RAM_SIZE - 1U },
+};
+
+/* Function Declarations */
+int32_t emulatorRun(const uint8_t *path, const Emulator_Options *options);
+int32_t emulatorFrames(hemu_ctx *emu, const Emulator_Options *options, double *seconds);
+int32_t frameWrite(const uint8_t *path, const uint8_t *image);
+int32_t programLoad(const uint8_t *path, uint16_t *rom, size_t *words, Source_Map *map);
+int32_t programMap(const uint8_t *path, const Emulator_Options *options, Source_Map *map);
+int32_t profileReport(hemu_ctx *emu, const Source_Map *map, const uint8_t *path, const Emulator_Options *options);
+void profileTop(const uint64_t *values, uint32_t count, uint32_t *top, uint32_t *topCount);
+void profileLabel(const Hemu_Profile *prof, const Source_Map *map, uint32_t address, uint8_t *text, size_t size);
+void profileSymbol(const Source_Map *map, uint32_t symbol, uint8_t *text, size_t size);
+int32_t profileFolded(const hemu_ctx *emu, const Source_Map *map, const uint8_t *path);
+int32_t profileHeatmap(const hemu_ctx *emu, const uint8_t *path);
+int32_t runOption(Emulator_Options *options, int32_t count, char **tokens, int32_t *arg, uint8_t *matched);
+int32_t runCheck(hemu_ctx *emu, const uint8_t *path, const Emulator_Options *options, Report_Text *report);
+int32_t ramSnapshotRead(const uint8_t *path, uint16_t *words);
+int32_t ramSnapshotWrite(const uint8_t *path, const uint16_t *ram);
+int32_t screenSnapshotRead(const uint8_t *path, uint8_t *image);
+void reportAdd(Report_Text *report, const char *format, ...);
+int32_t batchAdd(Batch_List *list, const uint8_t *path, const Emulator_Options *options);
+int32_t batchManifest(Batch_List *list, const uint8_t *path, const Emulator_Options *options);
+void batchFree(Batch_List *list);
+int32_t batchRun(Batch_List *list, uint32_t workers, uint8_t jit);
+void batchJob(hemu_ctx *emu, uint16_t *rom, Batch_Job *job);
+void *batchWorker(void *arg);
+int32_t threadCount(const uint8_t *str, uint32_t *count);
+int32_t hackParse(const uint8_t *text, size_t len, uint16_t *rom, size_t *words);
+int32_t fileRead(const uint8_t *path, uint8_t **text, size_t *len);
+int32_t probeAdd(Probe_List *list, const uint8_t *str, uint8_t separator);
+int32_t parseWord(const uint8_t *str, uint8_t **end, uint32_t *value);
+int32_t parseNumber(const uint8_t *str, uint32_t *value);
+void usage(const uint8_t *program);
+
+int main(int argc, char **argv)
+{
+  int32_t status = SYSTEM_SUCCESS;
+  Emulator_Options options;
+  Batch_List list = { NULL, 0U, 0U, NULL };
+  const uint8_t *manifestPath = NULL;
+  uint32_t workers = 1U;
+
+  memset(&options, 0, sizeof(options));
+  options.cycles = EMU_DEFAULT_CYCLES;
+  options.frameCycles = EMU_FRAME_CYCLES;
+
+  /* Options */
+  for(int32_t arg = 1; (arg < argc) && (status == SYSTEM_SUCCESS); arg++)
+  {
+    uint8_t matched = 0U;
+
+    status = runOption(&options, argc, argv, &arg, &matched);
+    if(matched)
+    {
+      /* -c, --set, --expect, --key and the snapshots, also taken by manifest lines */
+    }
+    else if( !strncmp(argv[arg], "--frame-cycles=", 15U) )
+    {
+      /* Cycles between two looks at the screen */
+      const uint8_t *str = &argv[arg][15];
+      uint8_t *end = NULL;
+
+      options.frameCycles = strtoull(str, (char **)&end, 10);
+      status = ( (end != str) && (*end == '\0') && (str[0] != '-') && (options.frameCycles != 0U) ) ?
+               SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    }
+    else if( !strcmp(argv[arg], "--frames") && ((arg + 1) < argc) )
+    {
+      /* PPM of every slice that changed the screen */
+      options.framePrefix = argv[++arg];
+    }
+    else if( !strcmp(argv[arg], "--screen") && ((arg + 1) < argc) )
+    {
+      /* PPM of the screen after the run */
+      options.screenPath = argv[++arg];
+    }
+    else if( !strcmp(argv[arg], "--save-ram") && ((arg + 1) < argc) )
+    {
+      /* RAM snapshot after the run, for --expect-ram */
+      options.saveRamPath = argv[++arg];
+    }
+    else if( !strcmp(argv[arg], "--dump") && ((arg + 1) < argc) )
+    {
+      /* RAM range printed after the run */
+      status = probeAdd(&options.dumps, argv[++arg], '-');
+    }
+    else if( !strcmp(argv[arg], "--profile") || !strncmp(argv[arg], "--profile=", 10U) )
+    {
+      /* Hot spot report after the run, on stderr or to a file */
+      options.profile = 1U;
+      options.profilePath = (argv[arg][9] == '=') ? &argv[arg][10] : NULL;
+    }
+    else if( !strcmp(argv[arg], "--folded") && ((arg + 1) < argc) )
+    {
+      /* Folded stacks for flamegraph.pl */
+      options.profile = 1U;
+      options.foldedPath = argv[++arg];
+    }
+    else if( !strcmp(argv[arg], "--heatmap") && ((arg + 1) < argc) )
+    {
+      /* Reads and writes of every RAM word */
+      options.profile = 1U;
+      options.heatmapPath = argv[++arg];
+    }
+    else if( !strcmp(argv[arg], "--map") && ((arg + 1) < argc) )
+    {
+      /* Symbol map of a .hack file */
+      options.mapPath = argv[++arg];
+    }
+    else if(!strcmp(argv[arg], "--jit"))
+    {
+      /* Compile the basic blocks to native code */
+      options.jit = 1U;
+    }
+    else if( !strcmp(argv[arg], "--manifest") && ((arg + 1) < argc) )
+    {
+      /* Programs of a batch, one per line with the options of its run */
+      manifestPath = argv[++arg];
+    }
+    else if( (!strcmp(argv[arg], "-j") && ((arg + 1) < argc)) || !strncmp(argv[arg], "--jobs=", 7U) )
+    {
+      /* Emulators running a batch side by side */
+      status = threadCount((argv[arg][1] == 'j') ? argv[++arg] : &argv[arg][7], &workers);
+    }
+    else if( !strcmp(argv[arg], "-h") || !strcmp(argv[arg], "--help") )
+    {
+      usage(argv[0]);
+      batchFree(&list);
+      return EXIT_SUCCESS;
+    }
+    else if(argv[arg][0] != '-')
+    {
+      /* Program, its options are only complete after the loop */
+      status = batchAdd(&list, argv[arg], &options);
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[arg]);
+      status = SYSTEM_FAILURE;
+    }
+
+    if( (status != SYSTEM_SUCCESS) && (argv[arg][0] != '-') )
+    {
+      fprintf(stderr, "Invalid value %s\n", argv[arg]);
+    }
+  }
+
+  if( (status != SYSTEM_SUCCESS) || ((list.count == 0U) && (manifestPath == NULL)) )
+  {
+    usage(argv[0]);
+    batchFree(&list);
+    return EXIT_FAILURE;
+  }
+
+  if( (list.count == 1U) && (manifestPath == NULL) )
+  {
+    status = emulatorRun(list.jobs[0].path, &options);
+    batchFree(&list);
+    return (status == SYSTEM_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  /* A batch: every program once, in an emulator of the pool */
+  if( (options.framePrefix != NULL) || (options.screenPath != NULL) || (options.saveRamPath != NULL) ||
+      (options.dumps.count != 0U) || options.profile || (options.mapPath != NULL) )
+  {
+    fprintf(stderr, "--frames, --screen, --save-ram, --dump, --map and the profiles take a single program\n");
+    batchFree(&list);
+    return EXIT_FAILURE;
+  }
+
+  /* The command line options hold for its programs wherever they came */
+  for(uint32_t job = 0U; job < list.count; job++)
+  {
+    list.jobs[job].options = options;
+  }
+  if( (status == SYSTEM_SUCCESS) && (manifestPath != NULL) )
+  {
+    status = batchManifest(&list, manifestPath, &options);
+  }
+
+  status = (status == SYSTEM_SUCCESS) ? batchRun(&list, workers, options.jit) : status;
+  batchFree(&list);
+
+  return (status == SYSTEM_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Whole string as an unsigned decimal */
+int32_t parseNumber(const uint8_t *str, uint32_t *value)
+{
+  uint8_t *end = NULL;
+  uint32_t number = 0U;
+
+  if( (parseWord(str, &end, &number) != SYSTEM_SUCCESS) || (*end != '\0') || (str[0] == '-') )
+  {
+    return SYSTEM_FAILURE;
+  }
+  *value = number;
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * The options of one run at tokens[*arg], from the command line or a
+ * manifest line; *arg is left on the last token used. *matched stays 0
+ * for any other token.
+ */
+int32_t runOption(Emulator_Options *options, int32_t count, char **tokens, int32_t *arg, uint8_t *matched)
+{
+  const uint8_t *token = tokens[*arg];
+  uint8_t hasValue = ((*arg + 1) < count);
+  int32_t status = SYSTEM_SUCCESS;
+
+  *matched = 1U;
+  if( (!strcmp(token, "-c") && hasValue) || !strncmp(token, "--cycles=", 9U) )
+  {
+    /* Cycle budget of the run */
+    const uint8_t *str = (token[1] == 'c') ? (const uint8_t *)tokens[++(*arg)] : &token[9];
+    uint8_t *end = NULL;
+
+    options->cycles = strtoull(str, (char **)&end, 10);
+    status = ( (end != str) && (*end == '\0') && (str[0] != '-') ) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+  }
+  else if( !strcmp(token, "--set") && hasValue )
+  {
+    /* RAM word before the run */
+    status = probeAdd(&options->sets, tokens[++(*arg)], '=');
+  }
+  else if( !strcmp(token, "--expect") && hasValue )
+  {
+    /* RAM word checked after the run */
+    status = probeAdd(&options->expects, tokens[++(*arg)], '=');
+  }
+  else if( !strcmp(token, "--expect-ram") && hasValue )
+  {
+    /* RAM below KBD checked after the run */
+    options->expectRamPath = tokens[++(*arg)];
+  }
+  else if( !strcmp(token, "--expect-screen") && hasValue )
+  {
+    /* Screen checked after the run */
+    options->expectScreenPath = tokens[++(*arg)];
+  }
+  else if( !strcmp(token, "--key") && hasValue )
+  {
+    /* Key held down for the whole run */
+    uint32_t key = 0U;
+
+    status = parseNumber(tokens[++(*arg)], &key);
+    status = (key <= 0xFFFFU) ? status : SYSTEM_FAILURE;
+    options->key = (uint16_t)key;
+  }
+  else
+  {
+    *matched = 0U;
+  }
+
+  return status;
+}
+
+/* Parses a -j thread count, 0 is one per online CPU */
+int32_t threadCount(const uint8_t *str, uint32_t *count)
+{
+  if(parseNumber(str, count) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Invalid thread count %s\n", str);
+    return SYSTEM_FAILURE;
+  }
+#if N2T_HAVE_THREADS
+  if(*count == 0U)
+  {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    *count = (online > 0) ? (uint32_t)online : 1U;
+  }
+#else
+  *count = 1U;
+#endif
+  *count = (*count > MAX_WORKERS) ? MAX_WORKERS : *count;
+
+  return SYSTEM_SUCCESS;
+}
+
+void usage(const uint8_t *program)
+{
+  fprintf(stderr,
+          "Usage: %s [options] file.hack|file.asm ...\n"
+          "  -c N, --cycles=N   run at most N instructions (default %llu)\n"
+          "  --set ADDR=VALUE   store VALUE at RAM[ADDR] before the run\n"
+          "  --expect ADDR=VALUE  fail unless RAM[ADDR] is VALUE after the run\n"
+          "  --expect-ram FILE  fail unless the RAM matches a --save-ram snapshot after the run\n"
+          "  --expect-screen FILE  fail unless the screen matches a --screen image after the run\n"
+          "  --save-ram FILE    write the RAM below KBD after the run (\"ADDR VALUE\" per non-zero word)\n"
+          "  --dump FROM[-TO]   print RAM[FROM..TO] after the run\n"
+          "  --key CODE         hold the key with scan code CODE down (read at KBD)\n"
+          "  --jit              compile the basic blocks to native code (x86-64)\n"
+          "  --frames PREFIX    write PREFIXnnnnnn.ppm whenever the screen changed\n"
+          "  --frame-cycles=N   cycles between two frames (default %llu)\n"
+          "  --screen FILE      write the screen after the run to FILE (PPM)\n"
+          "  --profile[=FILE]   count what the program does, report the hot spots on stderr or to FILE\n"
+          "  --folded FILE      write the cycles per call stack of labels, for flamegraph.pl\n"
+          "  --heatmap FILE     write the reads and writes of every RAM word accessed\n"
+          "  --map FILE         labels and source lines of a .hack file (default FILE.hack" MAP_EXTENSION ")\n"
+          "  --manifest FILE    run a batch: \"program [options]\" per line, with -c, --set, --expect,\n"
+          "                     --key, --expect-ram and --expect-screen on top of the command line's\n"
+          "  -j N, --jobs=N     run the programs of a batch on N threads (0: one per CPU)\n"
+          "Values are decimal, -32768 to 65535. The run ends early when the program halts\n"
+          "in a jump to itself; cycles and MIPS are reported on stderr. With several programs\n"
+          "or a manifest only the mismatches and the total throughput are.\n",
+          program, (unsigned long long)EMU_DEFAULT_CYCLES, (unsigned long long)EMU_FRAME_CYCLES);
+}
+
+/* Loads, runs and checks one program */
+int32_t emulatorRun(const uint8_t *path, const Emulator_Options *options)
+{
+  hemu_ctx *emu = hemu_create();
+  uint16_t *rom = malloc(HEMU_ROM_SIZE * sizeof(uint16_t));
+  size_t words = HEMU_ROM_SIZE;
+  uint16_t *ram = NULL;
+  uint16_t a = 0U;
+  uint16_t d = 0U;
+  uint16_t pc = 0U;
+  int32_t result = HEMU_LIMIT;
+  int32_t status = SYSTEM_SUCCESS;
+  double start = 0.0;
+  double seconds = 0.0;
+  uint8_t jit = 0U;
+  Source_Map map;
+  Report_Text report = { NULL, 0U, 0U };
+
+  memset(&map, 0, sizeof(map));
+  if( (emu == NULL) || (rom == NULL) )
+  {
+    fprintf(stderr, "Out of memory\n");
+    status = SYSTEM_FAILURE;
+  }
+  else if(programLoad(path, rom, &words, options->profile ? &map : NULL) != SYSTEM_SUCCESS)
+  {
+    status = SYSTEM_FAILURE;
+  }
+  else if(options->profile && (programMap(path, options, &map) != SYSTEM_SUCCESS))
+  {
+    status = SYSTEM_FAILURE;
+  }
+
+  if(status == SYSTEM_SUCCESS)
+  {
+    hemu_load(emu, rom, words);
+    ram = hemu_ram(emu);
+    for(uint32_t i = 0U; i < options->sets.count; i++)
+    {
+      ram[options->sets.probes[i].address] = (uint16_t)options->sets.probes[i].value;
+    }
+    hemu_set_key(emu, options->key);
+    if( options->jit && (hemu_set_jit(emu, 1) != HEMU_SUCCESS) )
+    {
+      fprintf(stderr, "No JIT on this host (or no executable memory), interpreting\n");
+    }
+    jit = (uint8_t)hemu_jit_active(emu);
+    if(options->profile)
+    {
+      if(options->jit)
+      {
+        fprintf(stderr, "Profiling interprets, --jit is ignored\n");
+      }
+      status = hemuProfileStart(emu, (map.symbols != NULL) ? &map : NULL) == HEMU_SUCCESS ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    }
+  }
+
+  if(status == SYSTEM_SUCCESS)
+  {
+    if( (options->framePrefix != NULL) || (options->screenPath != NULL) )
+    {
+      result = emulatorFrames(emu, options, &seconds);
+      status = (result == HEMU_FAILURE) ? SYSTEM_FAILURE : SYSTEM_SUCCESS;
+    }
+    else
+    {
+      start = wallSeconds();
+      result = hemu_run(emu, options->cycles);
+      seconds = wallSeconds() - start;
+    }
+
+    if(jit && !hemu_jit_active(emu))
+    {
+      fprintf(stderr, "JIT code could not be made executable again, the rest was interpreted\n");
+    }
+
+    hemu_registers(emu, &a, &d, &pc);
+    fprintf(stderr, "%s: %s after %llu cycles, %.1f MIPS (A=%u D=%d PC=%u)\n",
+            path, (result == HEMU_HALTED) ? "halted" : "stopped",
+            (unsigned long long)hemu_cycles(emu),
+            ((double)hemu_cycles(emu) / ((seconds > 0.0) ? seconds : 1e-9)) / 1e6,
+            a, (int32_t)(int16_t)d, pc);
+
+    for(uint32_t i = 0U; i < options->dumps.count; i++)
+    {
+      for(uint32_t address = options->dumps.probes[i].address; address <= options->dumps.probes[i].value; address++)
+      {
+        printf("RAM[%u] = %d\n", address, (int32_t)(int16_t)ram[address]);
+      }
+    }
+
+    if(runCheck(emu, path, options, &report) != SYSTEM_SUCCESS)
+    {
+      status = SYSTEM_FAILURE;
+    }
+    if(report.length != 0U)
+    {
+      fputs(report.text, stderr);
+    }
+    if( (options->saveRamPath != NULL) && (ramSnapshotWrite(options->saveRamPath, ram) != SYSTEM_SUCCESS) )
+    {
+      status = SYSTEM_FAILURE;
+    }
+
+    if( options->profile && (profileReport(emu, (map.symbols != NULL) ? &map : NULL, path, options) != SYSTEM_SUCCESS) )
+    {
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  free(rom);
+  free(report.text);
+  hemu_destroy(emu);
+  mapFree(&map);
+
+  return status;
+}
+
+/*
+ * Checks the state after a run against the --expect words and the RAM and
+ * screen snapshots. Every mismatch becomes a line of report; SYSTEM_FAILURE
+ * on any, or on a snapshot that can't be read.
+ */
+int32_t runCheck(hemu_ctx *emu, const uint8_t *path, const Emulator_Options *options, Report_Text *report)
+{
+  const uint16_t *ram = hemu_ram(emu);
+  int32_t status = SYSTEM_SUCCESS;
+
+  for(uint32_t i = 0U; i < options->expects.count; i++)
+  {
+    const Emulator_Probe *probe = &options->expects.probes[i];
+
+    if(ram[probe->address] != (uint16_t)probe->value)
+    {
+      reportAdd(report, "%s: RAM[%u] = %d, expected %d\n", path, probe->address,
+                (int32_t)(int16_t)ram[probe->address], (int32_t)(int16_t)probe->value);
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  if(options->expectRamPath != NULL)
+  {
+    uint16_t *expected = malloc(EMU_SNAPSHOT_WORDS * sizeof(uint16_t));
+    uint32_t differ = 0U;
+
+    if( (expected == NULL) || (ramSnapshotRead(options->expectRamPath, expected) != SYSTEM_SUCCESS) )
+    {
+      reportAdd(report, "%s: couldn't read the RAM snapshot %s\n", path, options->expectRamPath);
+      status = SYSTEM_FAILURE;
+    }
+    else
+    {
+      for(uint32_t address = 0U; address < EMU_SNAPSHOT_WORDS; address++)
+      {
+        if( (ram[address] != expected[address]) && (differ++ < EMU_DIFF_LINES) )
+        {
+          reportAdd(report, "%s: RAM[%u] = %d, expected %d\n", path, address,
+                    (int32_t)(int16_t)ram[address], (int32_t)(int16_t)expected[address]);
+        }
+      }
+      if(differ > EMU_DIFF_LINES)
+      {
+        reportAdd(report, "%s: %u more words differ from %s\n", path, differ - EMU_DIFF_LINES, options->expectRamPath);
+      }
+      status = (differ == 0U) ? status : SYSTEM_FAILURE;
+    }
+    free(expected);
+  }
+
+  if(options->expectScreenPath != NULL)
+  {
+    uint8_t *image = malloc(2U * EMU_FRAME_BYTES);
+    uint64_t dirty[HEMU_SCREEN_DIRTY];
+    uint32_t differ = 0U;
+    uint32_t firstRow = 0U;
+    uint32_t firstColumn = 0U;
+
+    if( (image == NULL) || (screenSnapshotRead(options->expectScreenPath, &image[EMU_FRAME_BYTES]) != SYSTEM_SUCCESS) )
+    {
+      reportAdd(report, "%s: couldn't read the screen image %s\n", path, options->expectScreenPath);
+      status = SYSTEM_FAILURE;
+    }
+    else
+    {
+      /* The whole screen as --screen writes it, then row by row */
+      memset(dirty, 0xFF, sizeof(dirty));
+      hemu_screen_render(emu, dirty, image, HEMU_SCREEN_WIDTH * 3U, HEMU_PIXELS_RGB24);
+      for(uint32_t row = HEMU_SCREEN_HEIGHT; row > 0U; row--)
+      {
+        const uint8_t *got = &image[(row - 1U) * HEMU_SCREEN_WIDTH * 3U];
+        const uint8_t *want = &image[EMU_FRAME_BYTES + ((row - 1U) * HEMU_SCREEN_WIDTH * 3U)];
+
+        if(memcmp(got, want, HEMU_SCREEN_WIDTH * 3U) != 0)
+        {
+          for(firstColumn = 0U; !memcmp(&got[firstColumn * 3U], &want[firstColumn * 3U], 3U); firstColumn++)
+          {
+          }
+          firstRow = row - 1U;
+          differ++;
+        }
+      }
+      if(differ != 0U)
+      {
+        reportAdd(report, "%s: screen differs from %s in %u rows, first at x=%u y=%u\n", path,
+                  options->expectScreenPath, differ, firstColumn, firstRow);
+        status = SYSTEM_FAILURE;
+      }
+    }
+    free(image);
+  }
+
+  return status;
+}
+
+/* RAM snapshot: "ADDR VALUE" lines, signed like --dump; words left out are 0 */
+int32_t ramSnapshotRead(const uint8_t *path, uint16_t *words)
+{
+  uint8_t *text = NULL;
+  size_t len = 0U;
+  size_t pos = 0U;
+  int32_t status = SYSTEM_SUCCESS;
+
+  if(fileRead(path, &text, &len) != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+  text[len] = '\0';
+  memset(words, 0, EMU_SNAPSHOT_WORDS * sizeof(uint16_t));
+
+  while( (pos < len) && (status == SYSTEM_SUCCESS) )
+  {
+    uint8_t *line = &text[pos];
+    uint8_t *end = NULL;
+    uint32_t address = 0U;
+    uint32_t value = 0U;
+
+    while( (pos < len) && (text[pos] != '\n') )
+    {
+      pos++;
+    }
+    text[pos++] = '\0';
+
+    while( (*line == ' ') || (*line == '\t') )
+    {
+      line++;
+    }
+    if( (*line == '\0') || (*line == '\r') || (*line == '#') )
+    {
+      continue;
+    }
+
+    status = ( (parseWord(line, &end, &address) == SYSTEM_SUCCESS) && (line[0] != '-') &&
+               (address < EMU_SNAPSHOT_WORDS) && ((*end == ' ') || (*end == '\t')) &&
+               (parseWord(end, &end, &value) == SYSTEM_SUCCESS) &&
+               ((*end == '\0') || (*end == '\r')) ) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    if(status == SYSTEM_SUCCESS)
+    {
+      words[address] = (uint16_t)value;
+    }
+  }
+  free(text);
+
+  return status;
+}
+
+int32_t ramSnapshotWrite(const uint8_t *path, const uint16_t *ram)
+{
+  FILE *file = fopen(path, "w");
+  int32_t status = SYSTEM_FAILURE;
+
+  if(file != NULL)
+  {
+    fprintf(file, "# address value\n");
+    for(uint32_t address = 0U; address < EMU_SNAPSHOT_WORDS; address++)
+    {
+      if(ram[address] != 0U)
+      {
+        fprintf(file, "%u %d\n", address, (int32_t)(int16_t)ram[address]);
+      }
+    }
+    status = (ferror(file) == 0) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    status = (fclose(file) == 0) ? status : SYSTEM_FAILURE;
+  }
+  if(status != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Couldn't write %s\n", path);
+  }
+
+  return status;
+}
+
+/* The RGB24 pixels of a 512x256 binary PPM, as --screen writes it */
+int32_t screenSnapshotRead(const uint8_t *path, uint8_t *image)
+{
+  uint8_t *text = NULL;
+  size_t len = 0U;
+  uint32_t width = 0U;
+  uint32_t height = 0U;
+  uint32_t depth = 0U;
+  int32_t header = 0;
+  int32_t status = SYSTEM_FAILURE;
+
+  if(fileRead(path, &text, &len) != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+  text[len] = '\0';
+
+  /* One whitespace byte ends the header */
+  if( (sscanf((const char *)text, "P6 %u %u %u%n", &width, &height, &depth, &header) == 3) &&
+      (width == HEMU_SCREEN_WIDTH) && (height == HEMU_SCREEN_HEIGHT) && (depth == 255U) &&
+      ((len - (size_t)header - 1U) == EMU_FRAME_BYTES) )
+  {
+    memcpy(image, &text[header + 1], EMU_FRAME_BYTES);
+    status = SYSTEM_SUCCESS;
+  }
+  free(text);
+
+  return status;
+}
+
+/* Appends a printf line to report; a line that can't be stored is dropped */
+void reportAdd(Report_Text *report, const char *format, ...)
+{
+  va_list args;
+  int32_t needed = 0;
+
+  va_start(args, format);
+  needed = vsnprintf(NULL, 0U, format, args);
+  va_end(args);
+
+  if( (needed <= 0) ||
+      (growArray((void **)&report->text, &report->size, 1U, report->length + (uint32_t)needed + 1U) != SYSTEM_SUCCESS) )
+  {
+    return;
+  }
+
+  va_start(args, format);
+  vsnprintf((char *)&report->text[report->length], report->size - report->length, format, args);
+  va_end(args);
+  report->length += (uint32_t)needed;
+}
+
+/* Adds a program run with options (copied) to a batch */
+int32_t batchAdd(Batch_List *list, const uint8_t *path, const Emulator_Options *options)
+{
+  Batch_Job *job = NULL;
+
+  if(growArray((void **)&list->jobs, &list->size, sizeof(Batch_Job), list->count + 1U) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return SYSTEM_FAILURE;
+  }
+
+  job = &list->jobs[list->count++];
+  memset(job, 0, sizeof(*job));
+  job->path = path;
+  job->options = *options;
+  job->status = SYSTEM_FAILURE;
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * Manifest: "program [options]" per line, blank lines and '#' comments
+ * ignored. A line's options add to (or, for -c and --key, replace) those of
+ * the command line. The tokens are cut out of the text in place, which the
+ * list keeps for the paths.
+ */
+int32_t batchManifest(Batch_List *list, const uint8_t *path, const Emulator_Options *options)
+{
+  uint8_t *text = NULL;
+  size_t len = 0U;
+  size_t pos = 0U;
+  uint32_t lineNumber = 0U;
+  int32_t status = SYSTEM_SUCCESS;
+
+  if(fileRead(path, &text, &len) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Error reading manifest %s\n", path);
+    return SYSTEM_FAILURE;
+  }
+  text[len] = '\0';
+  list->manifest = text;
+
+  while( (pos < len) && (status == SYSTEM_SUCCESS) )
+  {
+    char *tokens[EMU_LINE_TOKENS];
+    int32_t count = 0;
+    Emulator_Options lineOptions = *options;
+
+    lineNumber++;
+    while( (pos < len) && (text[pos] != '\n') )
+    {
+      /* Cut the line into tokens at its spaces */
+      while( (pos < len) && ((text[pos] == ' ') || (text[pos] == '\t') || (text[pos] == '\r')) )
+      {
+        text[pos++] = '\0';
+      }
+      if( (pos < len) && (text[pos] != '\n') )
+      {
+        if(count == (int32_t)EMU_LINE_TOKENS)
+        {
+          fprintf(stderr, "%s:%u: too many options\n", path, lineNumber);
+          return SYSTEM_FAILURE;
+        }
+        tokens[count++] = (char *)&text[pos];
+      }
+      while( (pos < len) && (text[pos] != '\n') && (text[pos] != ' ') && (text[pos] != '\t') && (text[pos] != '\r') )
+      {
+        pos++;
+      }
+    }
+    text[pos++] = '\0';
+
+    if( (count == 0) || (tokens[0][0] == '#') )
+    {
+      continue;
+    }
+
+    for(int32_t arg = 1; (arg < count) && (status == SYSTEM_SUCCESS); arg++)
+    {
+      uint8_t matched = 0U;
+
+      status = runOption(&lineOptions, count, tokens, &arg, &matched);
+      if( !matched || (status != SYSTEM_SUCCESS) )
+      {
+        fprintf(stderr, "%s:%u: %s %s\n", path, lineNumber, matched ? "invalid value" : "unknown option", tokens[arg]);
+        status = SYSTEM_FAILURE;
+      }
+    }
+
+    status = (status == SYSTEM_SUCCESS) ? batchAdd(list, (const uint8_t *)tokens[0], &lineOptions) : status;
+  }
+
+  return status;
+}
+
+void batchFree(Batch_List *list)
+{
+  for(uint32_t job = 0U; job < list->count; job++)
+  {
+    free(list->jobs[job].report.text);
+  }
+  free(list->jobs);
+  free(list->manifest);
+  memset(list, 0, sizeof(*list));
+}
+
+/*
+ * Runs every program of a batch on a pool of workers, then prints the
+ * mismatches in the order of the list and one line of throughput: the
+ * instructions per second of all workers together and of one core, the
+ * cycles over the time spent emulating.
+ */
+int32_t batchRun(Batch_List *list, uint32_t workers, uint8_t jit)
+{
+  Batch_Pool pool;
+  uint32_t failed = 0U;
+  uint64_t cycles = 0U;
+  double busy = 0.0;
+  double start = wallSeconds();
+  double seconds = 0.0;
+#if N2T_HAVE_THREADS
+  pthread_t threads[MAX_WORKERS];
+  uint32_t started = 0U;
+#endif
+
+  workers = (workers < list->count) ? workers : list->count;
+  workers = (workers == 0U) ? 1U : workers;
+  pool.list = list;
+  pool.jit = jit;
+  pool.next = 0U;
+
+#if N2T_HAVE_THREADS
+  pthread_mutex_init(&pool.lock, NULL);
+  for(uint32_t w = 0U; (w < workers) && (workers > 1U); w++)
+  {
+    if(pthread_create(&threads[w], NULL, batchWorker, &pool) != 0)
+    {
+      break;
+    }
+    started++;
+  }
+  if(started == 0U)
+  {
+    /* One worker, or no threads at all: run the batch here */
+    batchWorker(&pool);
+  }
+  for(uint32_t w = 0U; w < started; w++)
+  {
+    pthread_join(threads[w], NULL);
+  }
+  pthread_mutex_destroy(&pool.lock);
+  workers = (started == 0U) ? 1U : started;
+#else
+  batchWorker(&pool);
+  workers = 1U;
+#endif
+  seconds = wallSeconds() - start;
+
+  for(uint32_t i = 0U; i < list->count; i++)
+  {
+    const Batch_Job *job = &list->jobs[i];
+
+    if(!job->ran)
+    {
+      fprintf(stderr, "%s: not run, out of memory\n", job->path);
+    }
+    if(job->report.length != 0U)
+    {
+      fputs(job->report.text, stderr);
+    }
+    failed += (job->status == SYSTEM_SUCCESS) ? 0U : 1U;
+    cycles += job->cycles;
+    busy += job->seconds;
+  }
+
+  fprintf(stderr, "%u programs, %u failed: %llu instructions in %.2f s on %u thread%s, %.1f MIPS, %.1f MIPS per core\n",
+          list->count, failed, (unsigned long long)cycles, seconds, workers, (workers == 1U) ? "" : "s",
+          ((double)cycles / ((seconds > 0.0) ? seconds : 1e-9)) / 1e6,
+          ((double)cycles / ((busy > 0.0) ? busy : 1e-9)) / 1e6);
+
+  return (failed == 0U) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+}
+
+/* Loads, runs and checks one program of a batch in a worker's emulator */
+void batchJob(hemu_ctx *emu, uint16_t *rom, Batch_Job *job)
+{
+  const Emulator_Options *options = &job->options;
+  size_t words = HEMU_ROM_SIZE;
+  uint16_t *ram = NULL;
+  double start = 0.0;
+
+  job->ran = 1U;
+  if(programLoad(job->path, rom, &words, NULL) != SYSTEM_SUCCESS)
+  {
+    job->status = SYSTEM_FAILURE;
+    return;
+  }
+
+  /* Loading clears the RAM of the last program */
+  hemu_load(emu, rom, words);
+  ram = hemu_ram(emu);
+  for(uint32_t i = 0U; i < options->sets.count; i++)
+  {
+    ram[options->sets.probes[i].address] = (uint16_t)options->sets.probes[i].value;
+  }
+  hemu_set_key(emu, options->key);
+
+  start = wallSeconds();
+  hemu_run(emu, options->cycles);
+  job->seconds = wallSeconds() - start;
+  job->cycles = hemu_cycles(emu);
+
+  job->status = runCheck(emu, job->path, options, &job->report);
+}
+
+/*
+ * One emulator per worker, its RAM and decoded ROM the arena every program
+ * it takes runs in; nothing is shared but the index of the next program.
+ */
+void *batchWorker(void *arg)
+{
+  Batch_Pool *pool = arg;
+  hemu_ctx *emu = hemu_create();
+  uint16_t *rom = malloc(HEMU_ROM_SIZE * sizeof(uint16_t));
+  uint32_t job = 0U;
+
+  if( (emu == NULL) || (rom == NULL) )
+  {
+    /* Leave the programs to the other workers */
+    free(rom);
+    hemu_destroy(emu);
+    return NULL;
+  }
+  if( pool->jit && (hemu_set_jit(emu, 1) != HEMU_SUCCESS) )
+  {
+    hemu_set_jit(emu, 0);
+  }
+
+  for(;;)
+  {
+#if N2T_HAVE_THREADS
+    pthread_mutex_lock(&pool->lock);
+#endif
+    job = pool->next;
+    pool->next += (job < pool->list->count) ? 1U : 0U;
+#if N2T_HAVE_THREADS
+    pthread_mutex_unlock(&pool->lock);
+#endif
+    if(job >= pool->list->count)
+    {
+      break;
+    }
+    batchJob(emu, rom, &pool->list->jobs[job]);
+  }
+
+  free(rom);
+  hemu_destroy(emu);
+
+  return NULL;
+}
+
+/*
+ * Runs in slices of frameCycles and brings a copy of the screen up to date
+ * after each one, converting only the rows the slice wrote. Returns the
+ * result of the last slice, HEMU_FAILURE when an image cannot be written;
+ * seconds covers the emulation alone.
+ */
+int32_t emulatorFrames(hemu_ctx *emu, const Emulator_Options *options, double *seconds)
+{
+  uint8_t *image = malloc(EMU_FRAME_BYTES);
+  uint8_t path[EMU_MAX_PATH];
+  uint64_t left = options->cycles;
+  uint32_t frames = 0U;
+  uint64_t rows = 0U;
+  int32_t result = HEMU_LIMIT;
+
+  *seconds = 0.0;
+  if(image == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return HEMU_FAILURE;
+  }
+
+  /* The first slice renders everything: loading marks all rows */
+  while( (left != 0U) && (result == HEMU_LIMIT) )
+  {
+    uint64_t slice = (left < options->frameCycles) ? left : options->frameCycles;
+    uint64_t dirty[HEMU_SCREEN_DIRTY];
+    uint32_t converted = 0U;
+    double start = wallSeconds();
+
+    result = hemu_run(emu, slice);
+    *seconds += wallSeconds() - start;
+    left -= slice;
+
+    hemu_screen_dirty(emu, dirty);
+    converted = hemu_screen_render(emu, dirty, image, HEMU_SCREEN_WIDTH * 3U, HEMU_PIXELS_RGB24);
+    rows += converted;
+    if( (options->framePrefix != NULL) && (converted != 0U) )
+    {
+      snprintf(path, sizeof(path), "%s%06u.ppm", options->framePrefix, frames);
+      if(frameWrite(path, image) != SYSTEM_SUCCESS)
+      {
+        result = HEMU_FAILURE;
+      }
+      frames++;
+    }
+  }
+
+  if( (result != HEMU_FAILURE) && (options->screenPath != NULL) && (frameWrite(options->screenPath, image) != SYSTEM_SUCCESS) )
+  {
+    result = HEMU_FAILURE;
+  }
+  if(options->framePrefix != NULL)
+  {
+    fprintf(stderr, "%u frames, %llu rows converted\n", frames, (unsigned long long)rows);
+  }
+  free(image);
+
+  return result;
+}
+
+/* Binary PPM of a 512x256 RGB24 image */
+int32_t frameWrite(const uint8_t *path, const uint8_t *image)
+{
+  FILE *file = fopen(path, "wb");
+  int32_t status = SYSTEM_FAILURE;
+
+  if(file != NULL)
+  {
+    fprintf(file, "P6\n%u %u\n255\n", HEMU_SCREEN_WIDTH, HEMU_SCREEN_HEIGHT);
+    status = (fwrite(image, 1U, EMU_FRAME_BYTES, file) == EMU_FRAME_BYTES) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    status = (fclose(file) == 0) ? status : SYSTEM_FAILURE;
+  }
+  if(status != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Couldn't write %s\n", path);
+  }
+
+  return status;
+}
+
+/*
+ * A .hack text file as it is, anything else through the assembler library;
+ * map (optional) then gets the labels and source lines of that assembly
+ */
+int32_t programLoad(const uint8_t *path, uint16_t *rom, size_t *words, Source_Map *map)
+{
+  uint8_t *text = NULL;
+  size_t len = 0U;
+  size_t pathLen = strlen(path);
+  int32_t status = SYSTEM_SUCCESS;
+  uint8_t invalid = 0U;
+
+  if(fileRead(path, &text, &len) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "Couldn't read %s\n", path);
+    return SYSTEM_FAILURE;
+  }
+
+  if( (pathLen >= 5U) && !strcmp(&path[pathLen - 5U], ".hack") )
+  {
+    status = hackParse(text, len, rom, words);
+  }
+  else
+  {
+    hasm_ctx *ctx = hasm_ctx_create();
+    Source_Buffer source = { text, len, 0U };
+
+    if( (ctx != NULL) && (map != NULL) )
+    {
+      mapStart(ctx, &source);
+    }
+    int32_t result = (ctx != NULL) ? hasm_assemble_buffer(ctx, (const char *)text, len, rom, words) : HASM_FAILURE;
+
+    status = (result == HASM_SUCCESS) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    if(result == HASM_SYNTAX)
+    {
+      fprintf(stderr, "%s:%u: invalid instruction\n", path, hasm_error_line(ctx));
+      invalid = 1U;
+    }
+    if( (status == SYSTEM_SUCCESS) && (map != NULL) && (mapFromContext(ctx, map) != SYSTEM_SUCCESS) )
+    {
+      fprintf(stderr, "No map of %s, out of memory\n", path);
+    }
+    hasm_ctx_destroy(ctx);
+  }
+
+  if( (status != SYSTEM_SUCCESS) && !invalid )
+  {
+    fprintf(stderr, "%s is not a Hack program of at most %u words\n", path, HEMU_ROM_SIZE);
+  }
+  free(text);
+
+  return status;
+}
+
+/* The --map of a .hack file, or FILE.hack.map if n2tasm --map left one; none keeps the addresses */
+int32_t programMap(const uint8_t *path, const Emulator_Options *options, Source_Map *map)
+{
+  uint8_t mapPath[EMU_MAX_PATH];
+
+  if(map->symbols != NULL)
+  {
+    return SYSTEM_SUCCESS;
+  }
+
+  if(options->mapPath != NULL)
+  {
+    if(mapLoad(options->mapPath, map) != SYSTEM_SUCCESS)
+    {
+      fprintf(stderr, "Couldn't read %s as a map of n2tasm --map\n", options->mapPath);
+      return SYSTEM_FAILURE;
+    }
+    return SYSTEM_SUCCESS;
+  }
+
+  snprintf(mapPath, sizeof(mapPath), "%s%s", path, MAP_EXTENSION);
+  if(mapLoad(mapPath, map) != SYSTEM_SUCCESS)
+  {
+    fprintf(stderr, "No map of %s (n2tasm --map), profiling by address\n", path);
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/*
+ * --profile, --folded and --heatmap of a profiled run. Labels are ranked
+ * by the cycles of the words from their address to the next label.
+ */
+int32_t profileReport(hemu_ctx *emu, const Source_Map *map, const uint8_t *path, const Emulator_Options *options)
+{
+  const Hemu_Profile *prof = emu->profile;
+  uint32_t labels = (map != NULL) ? map->header.labelCount : 0U;
+  uint64_t *counts = malloc(HEMU_ROM_SIZE * sizeof(uint64_t));
+  uint64_t *labelCycles = calloc((size_t)labels + 1U, sizeof(uint64_t));
+  uint64_t jumpTaken[JUMP_FIELD_COUNT];
+  uint64_t jumpNotTaken[JUMP_FIELD_COUNT];
+  uint32_t top[EMU_PROFILE_TOP];
+  uint32_t topCount = 0U;
+  uint64_t total = 0U;
+  uint8_t text[256];
+  FILE *file = stderr;
+  int32_t status = SYSTEM_SUCCESS;
+
+  if( (counts == NULL) || (labelCycles == NULL) )
+  {
+    fprintf(stderr, "Out of memory\n");
+    free(counts);
+    free(labelCycles);
+    return SYSTEM_FAILURE;
+  }
+
+  /* Only the folded totals of the RAM counters are reported */
+  hemuProfileFold(emu->profile);
+
+  hemuProfileCounts(prof, counts);
+  memset(jumpTaken, 0, sizeof(jumpTaken));
+  memset(jumpNotTaken, 0, sizeof(jumpNotTaken));
+  for(uint32_t i = 0U; i < HEMU_ROM_SIZE; i++)
+  {
+    uint16_t word = emu->ops[i].value;
+
+    total += counts[i];
+    if( (word & HEMU_C_INST) && ((word & HEMU_JUMP_MASK) != 0U) )
+    {
+      jumpTaken[word & HEMU_JUMP_MASK] += prof->taken[i];
+      jumpNotTaken[word & HEMU_JUMP_MASK] += counts[i] - prof->taken[i];
+    }
+    /* The words ahead of the first label share the last slot */
+    labelCycles[((prof->symbolAt[i] & HEMU_PROFILE_ADDRESS) == 0U) ? prof->symbolAt[i] : labels] += counts[i];
+  }
+
+  if( (options->profilePath != NULL) && ((file = fopen(options->profilePath, "w")) == NULL) )
+  {
+    fprintf(stderr, "Couldn't write %s\n", options->profilePath);
+    status = SYSTEM_FAILURE;
+  }
+
+  if(status == SYSTEM_SUCCESS)
+  {
+    fprintf(file, "Profile of %s: %llu cycles\n", path, (unsigned long long)total);
+
+    profileTop(labelCycles, labels, top, &topCount);
+    if(topCount != 0U)
+    {
+      fprintf(file, "  %-32s %14s %7s  %s\n", "label", "cycles", "share", "line");
+    }
+    for(uint32_t i = 0U; i < topCount; i++)
+    {
+      uint32_t address = map->symbols[top[i]].value;
+
+      profileSymbol(map, top[i], text, sizeof(text));
+      fprintf(file, "  %-32s %14llu %6.2f%%  %u\n", text, (unsigned long long)labelCycles[top[i]],
+              (100.0 * (double)labelCycles[top[i]]) / (double)((total != 0U) ? total : 1U),
+              (address < map->header.words) ? map->lines[address].line : 0U);
+    }
+    if( (topCount != 0U) && (labelCycles[labels] != 0U) )
+    {
+      fprintf(file, "  %-32s %14llu %6.2f%%\n", "(before the first label)", (unsigned long long)labelCycles[labels],
+              (100.0 * (double)labelCycles[labels]) / (double)((total != 0U) ? total : 1U));
+    }
+
+    profileTop(counts, HEMU_ROM_SIZE, top, &topCount);
+    fprintf(file, "  %-7s %-32s %14s %7s  %s\n", "address", "word", "cycles", "share", "line:column");
+    for(uint32_t i = 0U; i < topCount; i++)
+    {
+      profileLabel(prof, map, top[i], text, sizeof(text));
+      fprintf(file, "  %-7u %-32s %14llu %6.2f%%", top[i], text, (unsigned long long)counts[top[i]],
+              (100.0 * (double)counts[top[i]]) / (double)((total != 0U) ? total : 1U));
+      if( (map != NULL) && (top[i] < map->header.words) )
+      {
+        fprintf(file, "  %u:%u", map->lines[top[i]].line, map->lines[top[i]].column);
+      }
+      fputc('\n', file);
+    }
+
+    fprintf(file, "  %-7s %14s %14s\n", "jump", "taken", "not taken");
+    for(uint32_t jump = 1U; jump < JUMP_FIELD_COUNT; jump++)
+    {
+      fprintf(file, "  %-7s %14llu %14llu\n", jumpFieldLT[jump].mnemonic,
+              (unsigned long long)jumpTaken[jump], (unsigned long long)jumpNotTaken[jump]);
+    }
+
+    fprintf(file, "  %-7s %14s %14s %7s  %s\n", "RAM", "reads", "writes", "words", "hottest");
+    for(uint32_t region = 0U; region < EMU_REGION_COUNT; region++)
+    {
+      const Memory_Region *r = &memoryRegions[region];
+      uint64_t reads = 0U;
+      uint64_t writes = 0U;
+      uint32_t touched = 0U;
+      uint32_t hottest = r->first;
+
+      for(uint32_t address = r->first; address <= r->last; address++)
+      {
+        uint64_t accesses = prof->readTotals[address] + prof->writeTotals[address];
+
+        reads += prof->readTotals[address];
+        writes += prof->writeTotals[address];
+        touched += (accesses != 0U) ? 1U : 0U;
+        hottest = (accesses > (prof->readTotals[hottest] + prof->writeTotals[hottest])) ? address : hottest;
+      }
+      fprintf(file, "  %-7s %14llu %14llu %7u", r->name, (unsigned long long)reads, (unsigned long long)writes, touched);
+      if(touched != 0U)
+      {
+        fprintf(file, "  %u", hottest);
+      }
+      fputc('\n', file);
+    }
+
+    if(prof->failed)
+    {
+      fprintf(file, "  Out of memory growing the call tree, some cycles count in their caller\n");
+    }
+    if( (file != stderr) && (fclose(file) != 0) )
+    {
+      fprintf(stderr, "Couldn't write %s\n", options->profilePath);
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  if( (status == SYSTEM_SUCCESS) && (options->foldedPath != NULL) )
+  {
+    status = profileFolded(emu, map, options->foldedPath);
+  }
+  if( (status == SYSTEM_SUCCESS) && (options->heatmapPath != NULL) )
+  {
+    status = profileHeatmap(emu, options->heatmapPath);
+  }
+
+  free(counts);
+  free(labelCycles);
+
+  return status;
+}
+
+/* Indices of the EMU_PROFILE_TOP largest non-zero values, largest first */
+void profileTop(const uint64_t *values, uint32_t count, uint32_t *top, uint32_t *topCount)
+{
+  *topCount = 0U;
+  for(uint32_t i = 0U; i < count; i++)
+  {
+    uint32_t at = *topCount;
+
+    if( (values[i] == 0U) || ((at == EMU_PROFILE_TOP) && (values[i] <= values[top[at - 1U]])) )
+    {
+      continue;
+    }
+
+    /* Insertion into the sorted list, the smallest falls off the end */
+    at = (at == EMU_PROFILE_TOP) ? (at - 1U) : at;
+    while( (at > 0U) && (values[top[at - 1U]] < values[i]) )
+    {
+      top[at] = top[at - 1U];
+      at--;
+    }
+    top[at] = i;
+    *topCount += (*topCount < EMU_PROFILE_TOP) ? 1U : 0U;
+  }
+}
+
+/* "label+offset" of a ROM address, the bare address without a label before it */
+void profileLabel(const Hemu_Profile *prof, const Source_Map *map, uint32_t address, uint8_t *text, size_t size)
+{
+  uint32_t symbol = prof->symbolAt[address];
+
+  profileSymbol(map, symbol, text, size);
+  if( ((symbol & HEMU_PROFILE_ADDRESS) == 0U) && (address != map->symbols[symbol].value) )
+  {
+    size_t len = strlen(text);
+
+    snprintf(&text[len], size - len, "+%u", address - map->symbols[symbol].value);
+  }
+}
+
+/* Name of a call tree symbol: a label of the map, or 0xNNNN for an address */
+void profileSymbol(const Source_Map *map, uint32_t symbol, uint8_t *text, size_t size)
+{
+  if( (symbol & HEMU_PROFILE_ADDRESS) || (map == NULL) )
+  {
+    snprintf(text, size, "0x%04x", symbol & HEMU_ADDR_MASK);
+  }
+  else
+  {
+    uint32_t len = map->symbols[symbol].length;
+
+    len = (len < (size - 1U)) ? len : (uint32_t)(size - 1U);
+    memcpy(text, &map->names[map->symbols[symbol].offset], len);
+    text[len] = '\0';
+  }
+}
+
+/* One "frame;frame;leaf cycles" line per call tree node that ran, the format of flamegraph.pl */
+int32_t profileFolded(const hemu_ctx *emu, const Source_Map *map, const uint8_t *path)
+{
+  const Hemu_Profile *prof = emu->profile;
+  FILE *file = fopen(path, "w");
+  uint32_t stack[HEMU_PROFILE_DEPTH + 3U];
+  uint8_t text[256];
+  int32_t status = SYSTEM_SUCCESS;
+
+  if(file == NULL)
+  {
+    fprintf(stderr, "Couldn't write %s\n", path);
+    return SYSTEM_FAILURE;
+  }
+
+  for(uint32_t node = 1U; node < prof->nodeCount; node++)
+  {
+    uint32_t depth = 0U;
+
+    if(prof->nodes[node].cycles == 0U)
+    {
+      continue;
+    }
+    for(uint32_t at = node; (at != 0U) && (depth < (HEMU_PROFILE_DEPTH + 3U)); at = prof->nodes[at].parent)
+    {
+      stack[depth++] = at;
+    }
+    while(depth > 0U)
+    {
+      profileSymbol(map, prof->nodes[stack[--depth]].symbol, text, sizeof(text));
+      fprintf(file, "%s%c", text, (depth > 0U) ? ';' : ' ');
+    }
+    fprintf(file, "%llu\n", (unsigned long long)prof->nodes[node].cycles);
+  }
+
+  if( ferror(file) || (fclose(file) != 0) )
+  {
+    fprintf(stderr, "Couldn't write %s\n", path);
+    status = SYSTEM_FAILURE;
+  }
+
+  return status;
+}
+
+/* "address reads writes" of every RAM word the program accessed through M */
+int32_t profileHeatmap(const hemu_ctx *emu, const uint8_t *path)
+{
+  const Hemu_Profile *prof = emu->profile;
+  FILE *file = fopen(path, "w");
+  int32_t status = SYSTEM_SUCCESS;
+
+  if(file == NULL)
+  {
+    fprintf(stderr, "Couldn't write %s\n", path);
+    return SYSTEM_FAILURE;
+  }
+
+  fprintf(file, "# address reads writes\n");
+  for(uint32_t address = 0U; address < HEMU_RAM_SIZE; address++)
+  {
+    if( (prof->readTotals[address] | prof->writeTotals[address]) != 0U )
+    {
+      fprintf(file, "%u %llu %llu\n", address, (unsigned long long)prof->readTotals[address],
+              (unsigned long long)prof->writeTotals[address]);
+    }
+  }
+
+  if( ferror(file) || (fclose(file) != 0) )
+  {
+    fprintf(stderr, "Couldn't write %s\n", path);
+    status = SYSTEM_FAILURE;
+  }
+
+  return status;
+}
+
+/* One word of 16 '0'/'1' per line, blank lines and CR ignored */
+int32_t hackParse(const uint8_t *text, size_t len, uint16_t *rom, size_t *words)
+{
+  size_t count = 0U;
+  size_t pos = 0U;
+
+  while(pos < len)
+  {
+    uint32_t word = 0U;
+    uint32_t bits = 0U;
+
+    for( ; (pos < len) && (text[pos] != '\n'); pos++)
+    {
+      if( (text[pos] == '0') || (text[pos] == '1') )
+      {
+        word = (word << 1) | (uint32_t)(text[pos] - '0');
+        bits++;
+      }
+      else if( (text[pos] != '\r') && (text[pos] != ' ') && (text[pos] != '\t') )
+      {
+        return SYSTEM_FAILURE;
+      }
+    }
+    pos++;
+
+    if(bits == 0U)
+    {
+      continue;
+    }
+    if( (bits != BITFIELD_MAX) || (count == *words) )
+    {
+      return SYSTEM_FAILURE;
+    }
+    rom[count++] = (uint16_t)word;
+  }
+  *words = count;
+
+  return SYSTEM_SUCCESS;
+}
+
+int32_t fileRead(const uint8_t *path, uint8_t **text, size_t *len)
+{
+  FILE *file = fopen(path, "rb");
+  long size = 0;
+
+  *text = NULL;
+  if(file == NULL)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  if( (fseek(file, 0, SEEK_END) == 0) && ((size = ftell(file)) >= 0) && (fseek(file, 0, SEEK_SET) == 0) )
+  {
+    *text = malloc((size_t)size + 1U);
+  }
+
+  if( (*text == NULL) || (fread(*text, 1U, (size_t)size, file) != (size_t)size) )
+  {
+    free(*text);
+    *text = NULL;
+    fclose(file);
+    return SYSTEM_FAILURE;
+  }
+  *len = (size_t)size;
+  fclose(file);
+
+  return SYSTEM_SUCCESS;
+}
+
+/* "ADDR=VALUE" (separator '=') or "FROM[-TO]" (separator '-') */
+int32_t probeAdd(Probe_List *list, const uint8_t *str, uint8_t separator)
+{
+  Emulator_Probe probe;
+  uint8_t *end = NULL;
+
+  if( (list->count == EMU_MAX_PROBES) || (parseWord(str, &end, &probe.address) != SYSTEM_SUCCESS) ||
+      (str[0] == '-') || (probe.address >= HEMU_RAM_SIZE) )
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  if( (separator == '-') && (*end == '\0') )
+  {
+    probe.value = probe.address;
+  }
+  else if( (*end != separator) || (parseWord(end + 1, &end, &probe.value) != SYSTEM_SUCCESS) || (*end != '\0') )
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  if( (separator == '-') && ((probe.value < probe.address) || (probe.value >= HEMU_RAM_SIZE)) )
+  {
+    return SYSTEM_FAILURE;
+  }
+  list->probes[list->count++] = probe;
+
+  return SYSTEM_SUCCESS;
+}
+
+/* Decimal from -32768 to 65535, negatives as their 16-bit two's complement */
+int32_t parseWord(const uint8_t *str, uint8_t **end, uint32_t *value)
+{
+  long number = strtol(str, (char **)end, 10);
+
+  if( (*end == str) || (number < -32768L) || (number > 65535L) )
+  {
+    return SYSTEM_FAILURE;
+  }
+  *value = (uint32_t)((uint16_t)number);
+
+  return SYSTEM_SUCCESS;
+}
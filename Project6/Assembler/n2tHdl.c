@@ -0,0 +1,649 @@
+/**
+ * @file n2tHdl.c
+ * @brief Command line front end of the HDL netlist library (hdl.c): builds
+ *        the netlist of a chip, writes it as bit-sliced C and checks it
+ *        against the chip's specification, 64 vectors per evaluation.
+ *
+ *   ./n2thdl -I ../../Project1 --check ../../Project2/ALU.hdl
+ *   ./n2thdl -I ../../Project1 -I ../../Project2 --emit alu.c ../../Project2/ALU.hdl
+ *
+ * --check runs every input combination when there are at most --vectors of
+ * them (Inc16, the 1-bit gates, Or8Way ...), random vectors otherwise, with
+ * the corner words 0, 1, -1, 0x7FFF and 0x8000 mixed in. Clocked chips run
+ * 64 independent sequences of random inputs, one per lane, for --vectors / 64
+ * cycles, with their outputs compared before every clock edge.
+ *
+ * RAM8 ... RAM16K are arrays when they are parts and gates when they are
+ * the chip checked: RAM64 is checked over eight RAM8 arrays, which the
+ * check of RAM8 stands for, and so on up to Memory. --structural flattens
+ * the parts too.
+ */
+
+#include "hasm_internal.h"
+#include "hdl.h"
+
+/* Macro Definitions */
+#define CHECK_MAX_PINS     (10U)
+#define CHECK_VECTORS      (1048576ULL) /* Default of --vectors */
+#define CHECK_REPORT_MAX   (8U)         /* Mismatches printed in full */
+#define CHECK_KBD          (0x6000U)    /* Address of the keyboard word in Memory */
+
+/* Variable Definitions */
+/* The behavior a chip of the course specifies, pins by name */
+typedef struct
+{
+  const char *chip;
+  const char *inputs[CHECK_MAX_PINS];
+  const char *outputs[CHECK_MAX_PINS];
+  uint32_t stateWords;  /* Per vector, 0 for combinational chips */
+  uint32_t limits[CHECK_MAX_PINS]; /* Largest valid value of an input, 0 for all of its width */
+} Chip_Model;
+
+enum
+{
+  MODEL_NOT, MODEL_AND, MODEL_OR, MODEL_XOR, MODEL_MUX, MODEL_DMUX,
+  MODEL_NOT16, MODEL_AND16, MODEL_OR16, MODEL_MUX16, MODEL_OR8WAY,
+  MODEL_MUX4WAY16, MODEL_MUX8WAY16, MODEL_DMUX4WAY, MODEL_DMUX8WAY,
+  MODEL_HALFADDER, MODEL_FULLADDER, MODEL_ADD16, MODEL_INC16, MODEL_ALU,
+  MODEL_BIT, MODEL_REGISTER, MODEL_PC, MODEL_RAM8, MODEL_RAM64,
+  MODEL_RAM512, MODEL_RAM4K, MODEL_RAM16K, MODEL_MEMORY, MODEL_CPU, MODEL_COUNT
+};
+
+const Chip_Model chipModels[MODEL_COUNT] =
+{
+  { "Not",       { "in" },                                        { "out" },                  0U },
+  { "And",       { "a", "b" },                                   { "out" },                  0U },
+  { "Or",        { "a", "b" },                                   { "out" },                  0U },
+  { "Xor",       { "a", "b" },                                   { "out" },                  0U },
+  { "Mux",       { "a", "b", "sel" },                            { "out" },                  0U },
+  { "DMux",      { "in", "sel" },                                { "a", "b" },               0U },
+  { "Not16",     { "in" },                                        { "out" },                  0U },
+  { "And16",     { "a", "b" },                                   { "out" },                  0U },
+  { "Or16",      { "a", "b" },                                   { "out" },                  0U },
+  { "Mux16",     { "a", "b", "sel" },                            { "out" },                  0U },
+  { "Or8Way",    { "in" },                                        { "out" },                  0U },
+  { "Mux4Way16", { "a", "b", "c", "d", "sel" },                  { "out" },                  0U },
+  { "Mux8Way16", { "a", "b", "c", "d", "e", "f", "g", "h", "sel" }, { "out" },               0U },
+  { "DMux4Way",  { "in", "sel" },                                { "a", "b", "c", "d" },     0U },
+  { "DMux8Way",  { "in", "sel" },                                { "a", "b", "c", "d", "e", "f", "g", "h" }, 0U },
+  { "HalfAdder", { "a", "b" },                                   { "sum", "carry" },         0U },
+  { "FullAdder", { "a", "b", "c" },                              { "sum", "carry" },         0U },
+  { "Add16",     { "a", "b" },                                   { "out" },                  0U },
+  { "Inc16",     { "in" },                                        { "out" },                  0U },
+  { "ALU",       { "x", "y", "zx", "nx", "zy", "ny", "f", "no" }, { "out", "zr", "ng" },     0U },
+  { "Bit",       { "in", "load" },                               { "out" },                  1U },
+  { "Register",  { "in", "load" },                               { "out" },                  1U },
+  { "PC",        { "in", "load", "inc", "reset" },               { "out" },                  1U },
+  { "RAM8",      { "in", "load", "address" },                    { "out" },                  8U },
+  { "RAM64",     { "in", "load", "address" },                    { "out" },                  64U },
+  { "RAM512",    { "in", "load", "address" },                    { "out" },                  512U },
+  { "RAM4K",     { "in", "load", "address" },                    { "out" },                  4096U },
+  { "RAM16K",    { "in", "load", "address" },                    { "out" },                  16384U },
+  /* RAM16K, Screen, then the keyboard in state[KBD]; above KBD is no memory */
+  { "Memory",    { "in", "load", "address" },                    { "out" },                  CHECK_KBD + 1U, { 0U, 0U, CHECK_KBD } },
+  { "CPU",       { "inM", "instruction", "reset" },              { "outM", "writeM", "addressM", "pc" }, 3U },
+};
+
+/* The pins of the netlist for the ones of a model */
+typedef struct
+{
+  hdl_pin inputs[CHECK_MAX_PINS];
+  hdl_pin outputs[CHECK_MAX_PINS];
+  uint32_t inputCount;
+  uint32_t outputCount;
+  uint32_t inputBits;
+} Check_Pins;
+
+/* Function Declarations */
+int32_t checkRun(const hdl_ctx *ctx, const uint8_t *chip, uint64_t vectors, uint64_t seed);
+int32_t checkPins(const hdl_ctx *ctx, const Chip_Model *model, Check_Pins *pins);
+void checkReport(const Chip_Model *model, const Check_Pins *pins, const uint32_t *in, const uint32_t *got,
+                 const uint32_t *expected, uint64_t vector, int32_t lane);
+void modelEval(uint32_t model, const uint32_t *in, uint32_t *out, uint32_t *care, const uint32_t *state);
+void modelTick(uint32_t model, const uint32_t *in, uint32_t *state);
+uint32_t modelAlu(uint32_t x, uint32_t y, uint32_t control);
+uint64_t randomNext(uint64_t *seed);
+void usage(const uint8_t *program);
+
+int main(int argc, char **argv)
+{
+  hdl_ctx *ctx = hdl_create();
+  const uint8_t *inPath = NULL;
+  const uint8_t *emitPath = NULL;
+  const uint8_t *prefix = NULL;
+  uint8_t check = 0U;
+  uint64_t vectors = CHECK_VECTORS;
+  uint64_t seed = 1U;
+  int32_t status = SYSTEM_SUCCESS;
+  hdl_stats stats;
+  double start = 0.0;
+  const uint8_t *base = NULL;
+  uint8_t name[64];
+  size_t len = 0U;
+
+  if(ctx == NULL)
+  {
+    fprintf(stderr, "Out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  /* Options */
+  for(int32_t arg = 1; (arg < argc) && (status == SYSTEM_SUCCESS); arg++)
+  {
+    if( !strcmp(argv[arg], "-I") && ((arg + 1) < argc) )
+    {
+      /* Directory of parts */
+      status = (hdl_add_path(ctx, argv[++arg]) == HDL_SUCCESS) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    }
+    else if( !strcmp(argv[arg], "--emit") && ((arg + 1) < argc) )
+    {
+      /* Bit-sliced C of the netlist */
+      emitPath = argv[++arg];
+    }
+    else if( !strcmp(argv[arg], "--prefix") && ((arg + 1) < argc) )
+    {
+      /* Names of the emitted functions */
+      prefix = argv[++arg];
+    }
+    else if(!strcmp(argv[arg], "--structural"))
+    {
+      /* RAM8 ... RAM16K parts as gates too */
+      hdl_set_structural(ctx, 1);
+    }
+    else if(!strcmp(argv[arg], "--check"))
+    {
+      /* Compare with the specification */
+      check = 1U;
+    }
+    else if( (!strcmp(argv[arg], "--vectors") || !strcmp(argv[arg], "--seed")) && ((arg + 1) < argc) )
+    {
+      uint64_t *value = (argv[arg][2] == 'v') ? &vectors : &seed;
+      const uint8_t *str = argv[++arg];
+      uint8_t *end = NULL;
+
+      *value = strtoull(str, (char **)&end, 10);
+      status = ( (end != str) && (*end == '\0') && (str[0] != '-') && (vectors != 0U) ) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+    }
+    else if( !strcmp(argv[arg], "-h") || !strcmp(argv[arg], "--help") )
+    {
+      usage(argv[0]);
+      hdl_destroy(ctx);
+      return EXIT_SUCCESS;
+    }
+    else if( (argv[arg][0] != '-') && (inPath == NULL) )
+    {
+      /* Chip */
+      inPath = argv[arg];
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[arg]);
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  if( (status != SYSTEM_SUCCESS) || (inPath == NULL) )
+  {
+    usage(argv[0]);
+    hdl_destroy(ctx);
+    return EXIT_FAILURE;
+  }
+
+  start = wallSeconds();
+  if(hdl_build(ctx, inPath) != HDL_SUCCESS)
+  {
+    hdl_destroy(ctx);
+    return EXIT_FAILURE;
+  }
+  hdl_get_stats(ctx, &stats);
+  fprintf(stderr, "%s: %u IN bits, %u OUT bits, %u DFFs, %u memories, %u Nand gates in %u levels (built in %.1f ms)\n",
+          inPath, stats.inputs, stats.outputs, stats.dffs, stats.memories, stats.gates, stats.levels,
+          (wallSeconds() - start) * 1e3);
+
+  /* The chip is the file name without its directory and extension */
+  base = strrchr(inPath, '/');
+  base = (base != NULL) ? (base + 1) : inPath;
+  len = strcspn(base, ".");
+  len = (len < sizeof(name)) ? len : (sizeof(name) - 1U);
+  memcpy(name, base, len);
+  name[len] = '\0';
+
+  if(emitPath != NULL)
+  {
+    if(hdl_emit_c(ctx, emitPath, (prefix != NULL) ? prefix : name) != HDL_SUCCESS)
+    {
+      fprintf(stderr, "Couldn't write %s\n", emitPath);
+      status = SYSTEM_FAILURE;
+    }
+  }
+
+  if( check && (status == SYSTEM_SUCCESS) )
+  {
+    status = checkRun(ctx, name, vectors, seed);
+  }
+  hdl_destroy(ctx);
+
+  return (status == SYSTEM_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void usage(const uint8_t *program)
+{
+  fprintf(stderr,
+          "Usage: %s [options] Chip.hdl\n"
+          "  -I DIR         search DIR for the parts, after the chip's own directory\n"
+          "  --emit FILE    write the netlist as bit-sliced C (64 vectors per uint64_t)\n"
+          "  --prefix NAME  name of the emitted functions (default: the chip)\n"
+          "  --check        compare the chip with its specification\n"
+          "  --vectors N    vectors of --check (default %llu), every combination when there are fewer\n"
+          "  --seed N       seed of the random vectors\n"
+          "  --structural   flatten RAM8 ... RAM16K parts to gates instead of arrays\n"
+          "Nand and DFF are the primitives, Screen, Keyboard and ROM32K arrays; the netlist is reported on stderr.\n",
+          program, (unsigned long long)CHECK_VECTORS);
+}
+
+/*
+ * Runs the vectors through the netlist and the model side by side. The
+ * vectors of a group of 64 are spread over the lanes of the IN bits, and
+ * the OUT bits gathered back, around one hdl_eval() per group.
+ */
+int32_t checkRun(const hdl_ctx *ctx, const uint8_t *chip, uint64_t vectors, uint64_t seed)
+{
+  static const uint32_t corners[5] = { 0x0000U, 0x0001U, 0xFFFFU, 0x7FFFU, 0x8000U };
+  uint32_t model = 0U;
+  Check_Pins pins;
+  hdl_stats stats;
+  uint64_t *signals = NULL;
+  uint32_t *state = NULL;
+  uint32_t in[HDL_LANES][CHECK_MAX_PINS];
+  uint64_t total = 0U;
+  uint64_t groups = 0U;
+  uint64_t mismatches = 0U;
+  uint8_t exhaustive = 0U;
+  uint8_t clocked = 0U;
+  uint8_t pressing = 0U;
+  hdl_memory keyboard;
+  double seconds = 0.0;
+
+  for( ; (model < MODEL_COUNT) && strcmp(chipModels[model].chip, chip); model++)
+  {
+  }
+  if(model == MODEL_COUNT)
+  {
+    fprintf(stderr, "%s: no specification to check against\n", chip);
+    return SYSTEM_FAILURE;
+  }
+  if(checkPins(ctx, &chipModels[model], &pins) != SYSTEM_SUCCESS)
+  {
+    return SYSTEM_FAILURE;
+  }
+
+  hdl_get_stats(ctx, &stats);
+  clocked = (chipModels[model].stateWords != 0U);
+  exhaustive = !clocked && (pins.inputBits < 64U) && ((1ULL << pins.inputBits) <= vectors);
+  total = exhaustive ? (1ULL << pins.inputBits) : vectors;
+  groups = (total + HDL_LANES - 1U) / HDL_LANES;
+  signals = malloc((size_t)stats.signals * sizeof(uint64_t));
+  state = calloc((size_t)HDL_LANES * (chipModels[model].stateWords + 1U), sizeof(uint32_t));
+  if( (signals == NULL) || (state == NULL) )
+  {
+    fprintf(stderr, "Out of memory\n");
+    free(signals);
+    free(state);
+    return SYSTEM_FAILURE;
+  }
+  hdl_reset(ctx, signals);
+  memset(in, 0, sizeof(in));
+
+  /* Keys pressed and released at random on the Keyboard of Memory */
+  for(uint32_t i = 0U; (model == MODEL_MEMORY) && (i < hdl_memory_count(ctx)) && !pressing; i++)
+  {
+    pressing = (hdl_memory_get(ctx, i, &keyboard) == HDL_SUCCESS) && !strcmp(keyboard.chip, "Keyboard");
+  }
+
+  for(uint64_t group = 0U; group < groups; group++)
+  {
+    uint32_t lanes = (uint32_t)(((total - (group * HDL_LANES)) < HDL_LANES) ? (total - (group * HDL_LANES)) : HDL_LANES);
+    double start = 0.0;
+
+    for(uint32_t lane = 0U; lane < HDL_LANES; lane++)
+    {
+      uint64_t vector = (group * HDL_LANES) + ((lane < lanes) ? lane : 0U);
+
+      for(uint32_t p = 0U, shift = 0U; p < pins.inputCount; p++)
+      {
+        uint32_t mask = (pins.inputs[p].width >= 32U) ? 0xFFFFFFFFU : ((1U << pins.inputs[p].width) - 1U);
+        uint32_t limit = chipModels[model].limits[p];
+        uint64_t random = randomNext(&seed);
+
+        if(exhaustive)
+        {
+          in[lane][p] = (uint32_t)(vector >> shift) & mask;
+          shift += pins.inputs[p].width;
+        }
+        /* A quarter of the words repeat, so clocked chips read back what they stored */
+        else if( ((random & 3U) != 0U) || (group == 0U) )
+        {
+          in[lane][p] = ((((random >> 2) & 7U) == 0U) ? corners[(random >> 5) % 5U] : (uint32_t)(random >> 32)) & mask;
+          in[lane][p] = (limit != 0U) ? (in[lane][p] % (limit + 1U)) : in[lane][p];
+        }
+      }
+    }
+
+    for(uint32_t lane = 0U; pressing && (lane < HDL_LANES); lane++)
+    {
+      uint64_t random = randomNext(&seed);
+
+      if((random & 7U) == 0U)
+      {
+        uint32_t key = ((random >> 3) & 1U) ? (uint32_t)((random >> 8) & 0xFFU) : 0U;
+
+        HDL_MEMORY_WORD(signals, &keyboard, lane, 0U) = (uint16_t)key;
+        state[(lane * chipModels[model].stateWords) + CHECK_KBD] = key;
+      }
+    }
+
+    /* Lane j of bit b of a pin is bit b of vector j */
+    for(uint32_t p = 0U; p < pins.inputCount; p++)
+    {
+      for(uint32_t bit = 0U; bit < pins.inputs[p].width; bit++)
+      {
+        uint64_t word = 0U;
+
+        for(uint32_t lane = 0U; lane < HDL_LANES; lane++)
+        {
+          word |= (uint64_t)((in[lane][p] >> bit) & 1U) << lane;
+        }
+        signals[pins.inputs[p].offset + bit] = word;
+      }
+    }
+    start = wallSeconds();
+    hdl_eval(ctx, signals);
+    seconds += wallSeconds() - start;
+
+    for(uint32_t lane = 0U; lane < lanes; lane++)
+    {
+      uint32_t *laneState = &state[lane * chipModels[model].stateWords];
+      uint32_t expected[CHECK_MAX_PINS];
+      uint32_t care[CHECK_MAX_PINS];
+      uint32_t got[CHECK_MAX_PINS];
+      uint8_t wrong = 0U;
+
+      for(uint32_t p = 0U; p < pins.outputCount; p++)
+      {
+        uint32_t mask = (pins.outputs[p].width >= 32U) ? 0xFFFFFFFFU : ((1U << pins.outputs[p].width) - 1U);
+
+        got[p] = 0U;
+        care[p] = mask;
+        for(uint32_t bit = 0U; bit < pins.outputs[p].width; bit++)
+        {
+          got[p] |= (uint32_t)((signals[pins.outputs[p].offset + bit] >> lane) & 1U) << bit;
+        }
+      }
+      modelEval(model, in[lane], expected, care, laneState);
+      for(uint32_t p = 0U; p < pins.outputCount; p++)
+      {
+        wrong |= (((got[p] ^ expected[p]) & care[p]) != 0U);
+      }
+      if(wrong)
+      {
+        if(mismatches < CHECK_REPORT_MAX)
+        {
+          checkReport(&chipModels[model], &pins, in[lane], got, expected, clocked ? group : ((group * HDL_LANES) + lane),
+                      clocked ? (int32_t)lane : -1);
+        }
+        mismatches++;
+      }
+      if(clocked)
+      {
+        modelTick(model, in[lane], laneState);
+      }
+    }
+
+    if(clocked)
+    {
+      start = wallSeconds();
+      hdl_tick(ctx, signals);
+      seconds += wallSeconds() - start;
+    }
+  }
+
+  if(clocked)
+  {
+    fprintf(stderr, "%s: %u lanes x %llu cycles of random inputs, %llu mismatches", chip, HDL_LANES,
+            (unsigned long long)groups, (unsigned long long)mismatches);
+  }
+  else
+  {
+    fprintf(stderr, "%s: %s %llu vectors, %llu mismatches", chip, exhaustive ? "all" : "random",
+            (unsigned long long)total, (unsigned long long)mismatches);
+  }
+  fprintf(stderr, ", netlist %.2f ms (%.1f M vectors/s)\n", seconds * 1e3,
+          ((double)groups * HDL_LANES / ((seconds > 0.0) ? seconds : 1e-9)) / 1e6);
+  free(signals);
+  free(state);
+
+  return (mismatches == 0U) ? SYSTEM_SUCCESS : SYSTEM_FAILURE;
+}
+
+/* Every pin of the model must be on the chip, with the same direction */
+int32_t checkPins(const hdl_ctx *ctx, const Chip_Model *model, Check_Pins *pins)
+{
+  memset(pins, 0, sizeof(*pins));
+  for(uint32_t output = 0U; output < 2U; output++)
+  {
+    const char *const *names = output ? model->outputs : model->inputs;
+
+    for(uint32_t i = 0U; (i < CHECK_MAX_PINS) && (names[i] != NULL); i++)
+    {
+      hdl_pin *pin = output ? &pins->outputs[i] : &pins->inputs[i];
+
+      if( (hdl_pin_find(ctx, names[i], pin) != HDL_SUCCESS) || (pin->output != (int32_t)output) || (pin->width > 16U) )
+      {
+        fprintf(stderr, "%s: no %s pin %s as in the specification\n", model->chip, output ? "OUT" : "IN", names[i]);
+        return SYSTEM_FAILURE;
+      }
+      if(output)
+      {
+        pins->outputCount++;
+      }
+      else
+      {
+        pins->inputCount++;
+        pins->inputBits += pin->width;
+      }
+    }
+  }
+
+  return SYSTEM_SUCCESS;
+}
+
+/* One mismatch; clocked chips give the cycle and the lane, lane -1 the others the vector */
+void checkReport(const Chip_Model *model, const Check_Pins *pins, const uint32_t *in, const uint32_t *got,
+                 const uint32_t *expected, uint64_t vector, int32_t lane)
+{
+  if(lane < 0)
+  {
+    fprintf(stderr, "%s: vector %llu:", model->chip, (unsigned long long)vector);
+  }
+  else
+  {
+    fprintf(stderr, "%s: cycle %llu of lane %d:", model->chip, (unsigned long long)vector, lane);
+  }
+  for(uint32_t p = 0U; p < pins->inputCount; p++)
+  {
+    fprintf(stderr, (pins->inputs[p].width == 1U) ? " %s=%u" : " %s=0x%04X", pins->inputs[p].name, in[p]);
+  }
+  fprintf(stderr, " ->");
+  for(uint32_t p = 0U; p < pins->outputCount; p++)
+  {
+    fprintf(stderr, (pins->outputs[p].width == 1U) ? " %s=%u" : " %s=0x%04X", pins->outputs[p].name, got[p]);
+    if(got[p] != expected[p])
+    {
+      fprintf(stderr, (pins->outputs[p].width == 1U) ? " (expected %u)" : " (expected 0x%04X)", expected[p]);
+    }
+  }
+  fprintf(stderr, "\n");
+}
+
+/*
+ * The outputs the specification gives for the inputs and the state before
+ * the clock edge. care[] starts as the pin masks; a model clears the bits
+ * the specification leaves open (outM of the CPU when writeM is 0).
+ */
+void modelEval(uint32_t model, const uint32_t *in, uint32_t *out, uint32_t *care, const uint32_t *state)
+{
+  uint32_t sel = in[1];
+
+  switch(model)
+  {
+    case MODEL_NOT:
+    case MODEL_NOT16:
+      out[0] = ~in[0];
+      break;
+    case MODEL_AND:
+    case MODEL_AND16:
+      out[0] = in[0] & in[1];
+      break;
+    case MODEL_OR:
+    case MODEL_OR16:
+      out[0] = in[0] | in[1];
+      break;
+    case MODEL_XOR:
+      out[0] = in[0] ^ in[1];
+      break;
+    case MODEL_MUX:
+    case MODEL_MUX16:
+      out[0] = in[2] ? in[1] : in[0];
+      break;
+    case MODEL_MUX4WAY16:
+      out[0] = in[in[4]];
+      break;
+    case MODEL_MUX8WAY16:
+      out[0] = in[in[8]];
+      break;
+    case MODEL_DMUX:
+    case MODEL_DMUX4WAY:
+    case MODEL_DMUX8WAY:
+      for(uint32_t i = 0U; i < ((model == MODEL_DMUX) ? 2U : ((model == MODEL_DMUX4WAY) ? 4U : 8U)); i++)
+      {
+        out[i] = (i == sel) ? in[0] : 0U;
+      }
+      break;
+    case MODEL_OR8WAY:
+      out[0] = (in[0] != 0U);
+      break;
+    case MODEL_HALFADDER:
+      out[0] = in[0] ^ in[1];
+      out[1] = in[0] & in[1];
+      break;
+    case MODEL_FULLADDER:
+      out[0] = in[0] ^ in[1] ^ in[2];
+      out[1] = (in[0] + in[1] + in[2]) >> 1;
+      break;
+    case MODEL_ADD16:
+      out[0] = in[0] + in[1];
+      break;
+    case MODEL_INC16:
+      out[0] = in[0] + 1U;
+      break;
+    case MODEL_ALU:
+      out[0] = modelAlu(in[0], in[1], (in[2] << 5) | (in[3] << 4) | (in[4] << 3) | (in[5] << 2) | (in[6] << 1) | in[7]);
+      out[1] = (out[0] == 0U);
+      out[2] = out[0] >> 15;
+      break;
+    case MODEL_BIT:
+    case MODEL_REGISTER:
+    case MODEL_PC:
+      out[0] = state[0];
+      break;
+    case MODEL_RAM8:
+    case MODEL_RAM64:
+    case MODEL_RAM512:
+    case MODEL_RAM4K:
+    case MODEL_RAM16K:
+    case MODEL_MEMORY:
+      out[0] = state[in[2]];
+      break;
+    case MODEL_CPU:
+    {
+      /* state: A, D, PC */
+      uint32_t instruction = in[1];
+      uint32_t cInstruction = instruction >> 15;
+
+      out[0] = modelAlu(state[1], (instruction & 0x1000U) ? in[0] : state[0], (instruction >> 6) & 0x3FU);
+      out[1] = cInstruction & (instruction >> 3);
+      out[2] = state[0];
+      out[3] = state[2];
+      care[0] = out[1] ? care[0] : 0U;
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+/* The state after the clock edge */
+void modelTick(uint32_t model, const uint32_t *in, uint32_t *state)
+{
+  switch(model)
+  {
+    case MODEL_BIT:
+    case MODEL_REGISTER:
+      state[0] = in[1] ? in[0] : state[0];
+      break;
+    case MODEL_PC:
+      state[0] = in[3] ? 0U : (in[1] ? in[0] : (in[2] ? ((state[0] + 1U) & 0xFFFFU) : state[0]));
+      break;
+    case MODEL_RAM8:
+    case MODEL_RAM64:
+    case MODEL_RAM512:
+    case MODEL_RAM4K:
+    case MODEL_RAM16K:
+      state[in[2]] = in[1] ? in[0] : state[in[2]];
+      break;
+    case MODEL_MEMORY:
+      /* The keyboard is read only */
+      state[in[2]] = (in[1] && (in[2] < CHECK_KBD)) ? in[0] : state[in[2]];
+      break;
+    case MODEL_CPU:
+    {
+      uint32_t instruction = in[1];
+      uint32_t cInstruction = instruction >> 15;
+      uint32_t out = modelAlu(state[1], (instruction & 0x1000U) ? in[0] : state[0], (instruction >> 6) & 0x3FU);
+      uint32_t flags = (out == 0U) ? 2U : ((out & 0x8000U) ? 4U : 1U);
+      uint32_t a = state[0];
+
+      state[0] = !cInstruction ? instruction : ((instruction & 0x20U) ? out : a);
+      state[1] = (cInstruction && (instruction & 0x10U)) ? out : state[1];
+      state[2] = in[2] ? 0U : ((cInstruction && (instruction & flags)) ? a : ((state[2] + 1U) & 0xFFFFU));
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+/* The Hack ALU, control = zx nx zy ny f no from bit 5 down */
+uint32_t modelAlu(uint32_t x, uint32_t y, uint32_t control)
+{
+  uint32_t out = 0U;
+
+  x = (control & 0x20U) ? 0U : x;
+  x = (control & 0x10U) ? ~x : x;
+  y = (control & 0x08U) ? 0U : y;
+  y = (control & 0x04U) ? ~y : y;
+  out = (control & 0x02U) ? (x + y) : (x & y);
+  out = (control & 0x01U) ? ~out : out;
+
+  return out & 0xFFFFU;
+}
+
+/* xorshift64* */
+uint64_t randomNext(uint64_t *seed)
+{
+  *seed ^= *seed >> 12;
+  *seed ^= *seed << 25;
+  *seed ^= *seed >> 27;
+
+  return *seed * 0x2545F4914F6CDD1DULL;
+}